@@ -28,6 +28,7 @@
 // Platform, Peripherals, Devices, Services
 #include "simple_ble.h"
 #include "eddystone.h"
+#include "multi_adv.h"
 
 
 void eddystone_adv(const char* url_str, const ble_advdata_t* scan_response_data) {
@@ -65,7 +66,7 @@ void eddystone_adv(const char* url_str, const ble_advdata_t* scan_response_data)
     advdata.uuids_complete          = PHYSWEB_SERVICE_LIST;
 
     // Actually set advertisement data
-    err_code = ble_advdata_set(&advdata, scan_response_data);
+    err_code = multi_adv_advdata_set(&advdata, scan_response_data);
     APP_ERROR_CHECK(err_code);
 
     // Start the advertisement
@@ -18,6 +18,7 @@
 // Platform, Peripherals, Devices, Services
 #include "simple_ble.h"
 #include "iot_gateway.h"
+#include "multi_adv.h"
 
 uint32_t iot_gateway_adv (char* post_url_str,
                           uint8_t incentive_program_level,
@@ -61,7 +62,7 @@ uint32_t iot_gateway_adv (char* post_url_str,
     advdata.service_data_count      = 1;
 
     // Actually set advertisement data
-    err_code = ble_advdata_set(&advdata, scan_response_data);
+    err_code = multi_adv_advdata_set(&advdata, scan_response_data);
     APP_ERROR_CHECK(err_code);
 
     // Start the advertisement
@@ -3,13 +3,34 @@
 #include "nrf_error.h"
 #include "nordic_common.h"
 #include "app_timer.h"
+#include "app_error.h"
+#include "ble_gap.h"
+#include "ble_advdata.h"
 
+#include "simple_ble.h"
 #include "multi_adv.h"
 
+// A function that sets up an advertisement, and the bytes it encoded to the
+// last time it ran
+typedef struct {
+	multi_adv_configure_f configure;
+	uint8_t cached;  // adv and sr are what configure would set
+	uint8_t has_adv; // else leave the SoftDevice's as they were, as
+	uint8_t has_sr;  //  ble_advdata_set does when given NULL
+	uint8_t adv_len;
+	uint8_t sr_len;
+	uint8_t adv[BLE_GAP_ADV_MAX_SIZE];
+	uint8_t sr[BLE_GAP_ADV_MAX_SIZE];
+} multi_adv_slot_t;
+
 // Keep track of the function calls that setup the various advertisements
-static multi_adv_configure_f adv_config_functions[MULTI_ADV_MAX_CONFIG_FUNCTIONS] = {NULL};
+static multi_adv_slot_t adv_slots[MULTI_ADV_MAX_CONFIG_FUNCTIONS];
 static uint8_t adv_config_len = 0;
 
+// Where multi_adv_encode puts the bytes, while a configure function runs
+static multi_adv_slot_t* adv_capture = NULL;
+static uint8_t adv_captured = 0;
+
 // Current index of advertisement to advertise.
 static uint8_t adv_config_index = 0;
 
@@ -19,14 +40,89 @@ static uint32_t multi_adv_interval_ms = 1000;
 // Timer state
 APP_TIMER_DEF(multi_adv_timer);
 
+// Run the configure function with its advertisement going to the slot.
+// Returns 0 if it didn't go through multi_adv_advdata_set, and set the
+// SoftDevice some other way.
+static uint8_t multi_adv_capture (multi_adv_slot_t* p_slot) {
+	// Cached from here on, unless configure invalidates itself
+	p_slot->cached = 1;
+	adv_captured = 0;
+	adv_capture = p_slot;
+	p_slot->configure();
+	adv_capture = NULL;
+
+	if (!adv_captured) {
+		p_slot->cached = 0;
+	}
+	return adv_captured;
+}
+
 // Timer callback for when it's time to switch advertisements.
 static void multi_adv_timer_handler (void* p_context) {
+	multi_adv_slot_t* p_slot;
+	uint32_t err;
+
 	// Increment the index
 	adv_config_index = (adv_config_index + 1) % adv_config_len;
+	p_slot = &adv_slots[adv_config_index];
 
-	// Call that function to update the advertisement in the softdevice
-	adv_config_functions[adv_config_index]();
+	// Only call the configure function the first time round, or after it
+	// was invalidated
+	if (!p_slot->cached && !multi_adv_capture(p_slot)) {
+		return;
+	}
+
+	// Update the advertisement in the softdevice
+	err = sd_ble_gap_adv_data_set(p_slot->has_adv ? p_slot->adv : NULL, p_slot->adv_len,
+	                              p_slot->has_sr ? p_slot->sr : NULL, p_slot->sr_len);
+	APP_ERROR_CHECK(err);
+	advertising_start();
+}
+
+// Keep what the configure function running would have set
+#ifdef SDK_VERSION_9
+// adv_data_encode is static before SDK 10, so nothing is kept and the
+// configure functions run every time round, as if they set the SoftDevice
+// themselves
+uint32_t multi_adv_encode (const ble_advdata_t* p_advdata,
+                           const ble_advdata_t* p_srdata) {
+	return ble_advdata_set(p_advdata, p_srdata);
 }
+#else
+uint32_t multi_adv_encode (const ble_advdata_t* p_advdata,
+                           const ble_advdata_t* p_srdata) {
+	uint16_t len;
+	uint32_t err;
+
+	if (adv_capture == NULL) {
+		return ble_advdata_set(p_advdata, p_srdata);
+	}
+
+	adv_capture->has_adv = (p_advdata != NULL);
+	adv_capture->has_sr = (p_srdata != NULL);
+	adv_capture->adv_len = 0;
+	adv_capture->sr_len = 0;
+	if (p_advdata != NULL) {
+		len = BLE_GAP_ADV_MAX_SIZE;
+		err = adv_data_encode(p_advdata, adv_capture->adv, &len);
+		if (err != NRF_SUCCESS) {
+			return err;
+		}
+		adv_capture->adv_len = len;
+	}
+	if (p_srdata != NULL) {
+		len = BLE_GAP_ADV_MAX_SIZE;
+		err = adv_data_encode(p_srdata, adv_capture->sr, &len);
+		if (err != NRF_SUCCESS) {
+			return err;
+		}
+		adv_capture->sr_len = len;
+	}
+
+	adv_captured = 1;
+	return NRF_SUCCESS;
+}
+#endif
 
 
 // Initialize the multi_adv_module. Basically setup a timer.
@@ -52,7 +148,8 @@ uint32_t multi_adv_register_config (multi_adv_configure_f config_function) {
 	}
 
 	// Add this as a advertisement configure function
-	adv_config_functions[adv_config_len] = config_function;
+	adv_slots[adv_config_len].configure = config_function;
+	adv_slots[adv_config_len].cached = 0;
 	adv_config_len++;
 
 	return NRF_SUCCESS;
@@ -72,3 +169,17 @@ uint32_t multi_adv_start () {
 uint32_t multi_adv_stop () {
 	return app_timer_stop(multi_adv_timer);
 }
+
+// Encode an advertisement again when it next comes round
+uint32_t multi_adv_invalidate (multi_adv_configure_f config_function) {
+	uint32_t err = (config_function == NULL) ? NRF_SUCCESS : NRF_ERROR_NOT_FOUND;
+	uint8_t i;
+
+	for (i = 0; i < adv_config_len; i++) {
+		if (config_function == NULL || adv_slots[i].configure == config_function) {
+			adv_slots[i].cached = 0;
+			err = NRF_SUCCESS;
+		}
+	}
+	return err;
+}
@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 
+#include "ble_advdata.h"
+
 // Max number of advertisements to iterate through
 #ifndef MULTI_ADV_MAX_CONFIG_FUNCTIONS
 #define MULTI_ADV_MAX_CONFIG_FUNCTIONS 3
@@ -14,3 +16,24 @@ uint32_t multi_adv_init (uint32_t switch_interval_ms);
 uint32_t multi_adv_register_config (multi_adv_configure_f config_function);
 uint32_t multi_adv_start ();
 uint32_t multi_adv_stop ();
+
+// The next time the advertisement of this configure function comes round,
+// call the function and encode it again. NULL does it for all of them. A
+// configure function can call this on itself to be called every time.
+uint32_t multi_adv_invalidate (multi_adv_configure_f config_function);
+
+// Keeps the encoded bytes while multi_adv runs a configure function, and is
+// ble_advdata_set the rest of the time. Weak, so it is NULL in apps that
+// don't link multi_adv.c.
+uint32_t multi_adv_encode (const ble_advdata_t* p_advdata,
+                           const ble_advdata_t* p_srdata) __attribute__((weak));
+
+// ble_advdata_set for the advertisement libraries, so multi_adv only has to
+// run their configure functions once
+static inline uint32_t multi_adv_advdata_set (const ble_advdata_t* p_advdata,
+                                              const ble_advdata_t* p_srdata) {
+	if (multi_adv_encode) {
+		return multi_adv_encode(p_advdata, p_srdata);
+	}
+	return ble_advdata_set(p_advdata, p_srdata);
+}
@@ -24,6 +24,7 @@
 // Platform, Peripherals, Devices, Services
 #include "simple_ble.h"
 #include "simple_adv.h"
+#include "multi_adv.h"
 
 static void full_adv (bool name, // if true, name goes in original packet
                       ble_uuid_t* service_uuid,
@@ -58,7 +59,7 @@ static void full_adv (bool name, // if true, name goes in original packet
         advdata.p_manuf_specific_data   = manuf_specific_data;
     }
 
-    err_code = ble_advdata_set(&advdata, &srdata);
+    err_code = multi_adv_advdata_set(&advdata, &srdata);
     APP_ERROR_CHECK(err_code);
 
     // Start the advertisement
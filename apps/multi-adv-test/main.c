@@ -40,6 +40,13 @@ static simple_ble_config_t ble_config = {
     .max_conn_interval = MSEC_TO_UNITS(1000, UNIT_1_25_MS)
 };
 
+// 128bit uuid, registered with the softdevice once in main
+static const ble_uuid128_t uuid128 = {{
+    0x99, 0xf9, 0xac, 0xe5, 0x57, 0xb9, 0x43, 0xec,
+    0x88, 0xf8, 0x88, 0xb9, 0x4d, 0xa1, 0x80, 0x50
+}};
+static ble_uuid_t service_uuid;
+
 static void adv_config_eddystone () {
     eddystone_adv(PHYSWEB_URL, NULL);
 }
@@ -49,17 +56,6 @@ static void adv_config_name () {
 }
 
 static void adv_128bit_service () {
-    ble_uuid_t service_uuid;
-
-    // create 128bit uuid and register with the softdevice
-    const ble_uuid128_t uuid128 = {{
-        0x99, 0xf9, 0xac, 0xe5, 0x57, 0xb9, 0x43, 0xec,
-        0x88, 0xf8, 0x88, 0xb9, 0x4d, 0xa1, 0x80, 0x50
-    }};
-    uint16_t uuid16 = (uuid128.uuid128[13] << 8) | uuid128.uuid128[12];
-    service_uuid.uuid = uuid16;
-    sd_ble_uuid_vs_add(&uuid128, &service_uuid.type);
-
     simple_adv_service(&service_uuid);
 }
 
@@ -74,6 +70,10 @@ static void adv_config_data () {
     mandata.data.size   = 2;
 
     simple_adv_manuf_data(&mandata);
+
+    // multi_adv keeps the encoded advertisement, so ask for this one to be
+    // built again next time round
+    multi_adv_invalidate(adv_config_data);
 }
 
 // main is essentially two library calls to setup all of the Nordic SDK
@@ -83,6 +83,10 @@ int main(void) {
     // Setup BLE
     simple_ble_init(&ble_config);
 
+    // Register the 128bit uuid with the softdevice
+    service_uuid.uuid = (uuid128.uuid128[13] << 8) | uuid128.uuid128[12];
+    sd_ble_uuid_vs_add(&uuid128, &service_uuid.type);
+
     // Need to init multi adv
     multi_adv_init(ADV_SWITCH_MS);
 
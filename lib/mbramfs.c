@@ -11,35 +11,335 @@ typedef struct {
 	uint8_t flags;
 	uint32_t handle;
 	uint32_t index;
+	uint16_t block;     // cached block that holds block_pos
+	uint32_t block_pos; // file offset of the start of that block
 } FILE;
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
+#include "mbramfs.h"
+
 #define MBRAMFS_MAX_FILENAME_LEN  128
-#define MBRAMFS_FILESIZE_IN_BYTES 5000
 #define MBRAMFS_NUM_FILE_POINTERS 10
-#define MBRAMFS_NUM_FILES         2
+
+#ifndef MBRAMFS_NUM_FILES
+#define MBRAMFS_NUM_FILES         8
+#endif
+
+// Files are stored as chains of fixed-size blocks that all come out of one
+// shared arena. A file only holds as many blocks as it needs for its length.
+// MBRAMFS_BLOCK_SIZE is in mbramfs.h.
+#ifndef MBRAMFS_NUM_BLOCKS
+#define MBRAMFS_NUM_BLOCKS        64
+#endif
+
+// File names are packed back to back in one pool instead of each file
+// reserving MBRAMFS_MAX_FILENAME_LEN bytes.
+#ifndef MBRAMFS_NAME_POOL_SIZE
+#define MBRAMFS_NAME_POOL_SIZE    256
+#endif
+
+// Slots in the hashed directory. Must be a power of two and larger than
+// MBRAMFS_NUM_FILES so that probe chains stay short.
+#ifndef MBRAMFS_DIR_SIZE
+#define MBRAMFS_DIR_SIZE          16
+#endif
+
+#if (MBRAMFS_DIR_SIZE & (MBRAMFS_DIR_SIZE-1)) || MBRAMFS_DIR_SIZE <= MBRAMFS_NUM_FILES
+#error "MBRAMFS_DIR_SIZE must be a power of two larger than MBRAMFS_NUM_FILES"
+#endif
+
+// Capacity of files opened with the 'c' (circular) flag. Writes to a full
+// ring file overwrite its oldest bytes.
+#ifndef MBRAMFS_RING_SIZE_IN_BYTES
+#define MBRAMFS_RING_SIZE_IN_BYTES 512
+#endif
+
+#ifdef MBRAMFS_PERSIST
+// Each file's blocks are stored as flash records keyed by file slot and
+// block number, which must both fit in a byte
+#if MBRAMFS_NUM_FILES > MBRAMFS_FLASH_MAX_FILES || MBRAMFS_NUM_BLOCKS >= MBRAMFS_FLASH_KEY_META
+#error "Too many files or blocks to persist mbramfs to flash"
+#endif
+
+// Flash is written in whole words
+#if MBRAMFS_BLOCK_SIZE % 4
+#error "MBRAMFS_BLOCK_SIZE must be a multiple of 4 to persist mbramfs to flash"
+#endif
+
+#define MBRAMFS_FLASH_META_STORED 0x01 // a metadata record exists for this slot
+#define MBRAMFS_FLASH_META_DIRTY  0x02 // length, name or ring state changed
+#endif
+
+// Block ids are 1-based so that zeroed memory means "no block"
+#define MBRAMFS_BLOCK_NONE        0
+
+// Directory entries hold file index + 1 so that zero means "empty"
+#define MBRAMFS_DIR_EMPTY         0
+
+typedef uint16_t block_id_t;
+
+#if MBRAMFS_NUM_FILES < 255
+typedef uint8_t dir_entry_t;
+#else
+typedef uint16_t dir_entry_t;
+#endif
 
 typedef struct {
-	char name[MBRAMFS_MAX_FILENAME_LEN];
-	uint8_t buf[MBRAMFS_FILESIZE_IN_BYTES];
+	uint16_t hash;
+	uint16_t name_off;
+	uint8_t name_len; // 0 if this file slot is free
+	block_id_t first_block;
 	uint32_t len;
+	uint32_t ring_size;  // 0 for normal files, otherwise the ring capacity
+	uint32_t ring_start; // where logical offset 0 of a ring is stored
+#ifdef MBRAMFS_PERSIST
+	uint8_t flash_state;  // MBRAMFS_FLASH_META_* flags
+	uint8_t flash_blocks; // number of block records stored in flash
+#endif
 } file_buf_t;
 
 
 // Allocate all files and FILE objects here.
-FILE              file_ptrs[MBRAMFS_NUM_FILE_POINTERS] = {{0, 0, 0}};
-static file_buf_t files[MBRAMFS_NUM_FILES] = {{{0}, {0}, 0}};
+FILE              file_ptrs[MBRAMFS_NUM_FILE_POINTERS] = {{0, 0, 0, 0, 0, 0}};
+static file_buf_t files[MBRAMFS_NUM_FILES] = {{0}};
+
+// Open addressed hash table from name hash to file
+static dir_entry_t dir[MBRAMFS_DIR_SIZE] = {0};
+
+static char     names[MBRAMFS_NAME_POOL_SIZE];
+static uint32_t names_used = 0;
+
+// The block arena. block_next links blocks into file chains and the free list.
+static uint8_t    blocks[MBRAMFS_NUM_BLOCKS][MBRAMFS_BLOCK_SIZE] __attribute__ ((aligned (4)));
+static block_id_t block_next[MBRAMFS_NUM_BLOCKS] = {0};
+
+#ifdef MBRAMFS_PERSIST
+// Blocks changed since they were last written to flash
+static uint8_t block_dirty[(MBRAMFS_NUM_BLOCKS+7)/8] = {0};
+
+#define BLOCK_IS_DIRTY(id)     (block_dirty[((id)-1)/8] & (1 << (((id)-1)%8)))
+#define BLOCK_SET_DIRTY(id)    (block_dirty[((id)-1)/8] |= (1 << (((id)-1)%8)))
+#define BLOCK_CLEAR_DIRTY(id)  (block_dirty[((id)-1)/8] &= ~(1 << (((id)-1)%8)))
+#define FILE_SET_DIRTY(file)   ((file)->flash_state |= MBRAMFS_FLASH_META_DIRTY)
+#else
+#define BLOCK_SET_DIRTY(id)
+#define FILE_SET_DIRTY(file)
+#endif
+
+// Freed blocks go on a free list. Blocks that have never been handed out are
+// taken in order from blocks_unused, which means the arena needs no init.
+static block_id_t free_head = MBRAMFS_BLOCK_NONE;
+static uint32_t   blocks_unused = 0;
+static uint32_t   blocks_free = MBRAMFS_NUM_BLOCKS;
 
 static unsigned short handle_cnt = 1;
 
 
+#define BLOCK_DATA(id) (blocks[(id)-1])
+#define BLOCK_NEXT(id) (block_next[(id)-1])
+
+static block_id_t block_alloc (void) {
+	block_id_t id;
+
+	if (free_head != MBRAMFS_BLOCK_NONE) {
+		id = free_head;
+		free_head = BLOCK_NEXT(id);
+	} else if (blocks_unused < MBRAMFS_NUM_BLOCKS) {
+		blocks_unused++;
+		id = blocks_unused;
+	} else {
+		return MBRAMFS_BLOCK_NONE;
+	}
+
+	BLOCK_NEXT(id) = MBRAMFS_BLOCK_NONE;
+	BLOCK_SET_DIRTY(id);
+	blocks_free--;
+	return id;
+}
+
+// Return an entire chain of blocks to the free list
+static void block_free_chain (block_id_t id) {
+	while (id != MBRAMFS_BLOCK_NONE) {
+		block_id_t next = BLOCK_NEXT(id);
+		BLOCK_NEXT(id) = free_head;
+		free_head = id;
+		blocks_free++;
+		id = next;
+	}
+}
+
+// Number of blocks backing a file of the given length
+static uint32_t blocks_for_len (uint32_t len) {
+	return (len + MBRAMFS_BLOCK_SIZE - 1) / MBRAMFS_BLOCK_SIZE;
+}
+
+// Find the block that contains offset `pos` of the file. Starts from the
+// stream's cached block when it is at or before `pos` so that sequential
+// reads and writes do not walk the chain from the start every time.
+static block_id_t block_seek (FILE* stream, file_buf_t* file, uint32_t pos) {
+	block_id_t id = file->first_block;
+	uint32_t block_pos = 0;
+
+	if (stream->block != MBRAMFS_BLOCK_NONE && stream->block_pos <= pos) {
+		id = stream->block;
+		block_pos = stream->block_pos;
+	}
+
+	while (id != MBRAMFS_BLOCK_NONE && pos - block_pos >= MBRAMFS_BLOCK_SIZE) {
+		id = BLOCK_NEXT(id);
+		block_pos += MBRAMFS_BLOCK_SIZE;
+	}
+
+	stream->block = id;
+	stream->block_pos = block_pos;
+	return id;
+}
+
+// Append blocks to a file's chain until it is `need_blocks` long. The caller
+// must have checked that enough blocks are free.
+static void chain_grow (FILE* stream, file_buf_t* file,
+                        uint32_t have_blocks, uint32_t need_blocks) {
+	block_id_t tail = MBRAMFS_BLOCK_NONE;
+
+	if (need_blocks <= have_blocks) return;
+
+	if (have_blocks > 0) {
+		tail = block_seek(stream, file, (have_blocks-1) * MBRAMFS_BLOCK_SIZE);
+	}
+	for (; have_blocks < need_blocks; have_blocks++) {
+		block_id_t id = block_alloc();
+		if (tail == MBRAMFS_BLOCK_NONE) file->first_block = id;
+		else                           BLOCK_NEXT(tail) = id;
+		tail = id;
+	}
+}
+
+// Number of blocks a file currently holds
+static uint32_t file_blocks (file_buf_t* file) {
+	if (file->ring_size) return blocks_for_len(file->ring_size);
+	return blocks_for_len(file->len);
+}
+
+// Map a file offset to where it lives in the file's block chain. Only ring
+// files differ, their contents start at ring_start and wrap around.
+static uint32_t file_phys (file_buf_t* file, uint32_t pos) {
+	if (file->ring_size == 0) return pos;
+	pos += file->ring_start;
+	if (pos >= file->ring_size) pos -= file->ring_size;
+	return pos;
+}
+
+// How many bytes can be accessed contiguously starting at a stored offset
+static uint32_t file_contig (file_buf_t* file, uint32_t phys, uint32_t block_pos) {
+	uint32_t chunk = MBRAMFS_BLOCK_SIZE - (phys - block_pos);
+	if (file->ring_size && chunk > file->ring_size - phys) {
+		chunk = file->ring_size - phys;
+	}
+	return chunk;
+}
+
+static void file_truncate (file_buf_t* file) {
+	int i;
+
+	// Other streams on this file would otherwise keep following blocks
+	// that are about to be handed to someone else
+	for (i=0; i<MBRAMFS_NUM_FILE_POINTERS; i++) {
+		if (file_ptrs[i].handle != 0 && file_ptrs[i].index == (uint32_t) (file - files)) {
+			file_ptrs[i].block = MBRAMFS_BLOCK_NONE;
+			file_ptrs[i].block_pos = 0;
+		}
+	}
+
+	block_free_chain(file->first_block);
+	file->first_block = MBRAMFS_BLOCK_NONE;
+	file->len = 0;
+	file->ring_size = 0;
+	file->ring_start = 0;
+	FILE_SET_DIRTY(file);
+}
+
+// FNV-1a over the name, folded to 16 bits. Also returns the name length.
+static uint16_t name_hash (const char* fname, uint32_t* len) {
+	uint32_t h = 2166136261u;
+	uint32_t i = 0;
+	while (i < MBRAMFS_MAX_FILENAME_LEN && fname[i]) {
+		h ^= (uint8_t) fname[i];
+		h *= 16777619u;
+		i++;
+	}
+	*len = i;
+	return (uint16_t) (h ^ (h >> 16));
+}
+
+// Find the directory slot for a name. Returns the slot holding the file if
+// it exists, or the empty slot that ends its probe chain if it does not.
+static uint32_t dir_find (const char* fname, uint16_t hash, uint32_t len) {
+	uint32_t slot = hash & (MBRAMFS_DIR_SIZE-1);
+
+	while (dir[slot] != MBRAMFS_DIR_EMPTY) {
+		file_buf_t* file = &files[dir[slot]-1];
+		if (file->hash == hash &&
+		    file->name_len == len &&
+		    memcmp(names+file->name_off, fname, len) == 0) {
+			break;
+		}
+		slot = (slot + 1) & (MBRAMFS_DIR_SIZE-1);
+	}
+	return slot;
+}
+
+// Remove a directory entry, shifting later members of the probe chain back
+// so that lookups never need tombstones.
+static void dir_delete (uint32_t slot) {
+	uint32_t next = slot;
+
+	dir[slot] = MBRAMFS_DIR_EMPTY;
+	while (1) {
+		uint32_t home;
+
+		next = (next + 1) & (MBRAMFS_DIR_SIZE-1);
+		if (dir[next] == MBRAMFS_DIR_EMPTY) break;
+
+		// Entries whose home slot lies cyclically in (slot, next] are
+		// already reachable and must stay put
+		home = files[dir[next]-1].hash & (MBRAMFS_DIR_SIZE-1);
+		if (slot <= next ? (slot < home && home <= next)
+		                 : (slot < home || home <= next)) {
+			continue;
+		}
+
+		dir[slot] = dir[next];
+		dir[next] = MBRAMFS_DIR_EMPTY;
+		slot = next;
+	}
+}
+
+// Free a file's name, compacting the name pool behind it
+static void name_release (file_buf_t* file) {
+	uint32_t off = file->name_off;
+	uint32_t len = file->name_len;
+	int i;
+
+	memmove(names+off, names+off+len, names_used-off-len);
+	names_used -= len;
+	for (i=0; i<MBRAMFS_NUM_FILES; i++) {
+		if (files[i].name_len && files[i].name_off > off) {
+			files[i].name_off -= len;
+		}
+	}
+	file->name_len = 0;
+}
+
+
 FILE* fopen (const char* fname, const char* flags) {
 	uint8_t read = 0;
 	uint8_t write = 0;
 	uint8_t append = 0;
+	uint8_t ring = 0;
 
 	int file_ptr_index;
 	int i;
@@ -65,6 +365,7 @@ FILE* fopen (const char* fname, const char* flags) {
 		if      (flags[i] == 'w') write = 1;
 		else if (flags[i] == 'r') read = 1;
 		else if (flags[i] == 'a') append = 1;
+		else if (flags[i] == 'c') ring = 1;
 
 		i++;
 	}
@@ -75,12 +376,17 @@ FILE* fopen (const char* fname, const char* flags) {
 	}
 
 	// Determine if this file exists
+	uint32_t name_len;
+	uint16_t hash = name_hash(fname, &name_len);
+	uint32_t slot = dir_find(fname, hash, name_len);
 	int file_index = -1;
-	for (i=0; i<MBRAMFS_NUM_FILES; i++) {
-		if (strncmp(fname, files[i].name, MBRAMFS_MAX_FILENAME_LEN) == 0) {
-			file_index = i;
-			break;
-		}
+
+	if (name_len == 0) {
+		return NULL;
+	}
+
+	if (dir[slot] != MBRAMFS_DIR_EMPTY) {
+		file_index = dir[slot]-1;
 	}
 
 	// Cannot read from a file that does not exist
@@ -88,14 +394,36 @@ FILE* fopen (const char* fname, const char* flags) {
 		return NULL;
 	}
 
+	// A ring file takes all of its blocks when it is created or truncated,
+	// so make sure they are there before changing anything
+	if (ring && (write || file_index == -1)) {
+		uint32_t available = blocks_free;
+		if (file_index != -1) available += file_blocks(&files[file_index]);
+		if (blocks_for_len(MBRAMFS_RING_SIZE_IN_BYTES) > available) {
+			return NULL;
+		}
+	} else {
+		ring = 0;
+	}
+
 	// May need to create new file
 	if (file_index == -1) {
+		if (names_used + name_len > MBRAMFS_NAME_POOL_SIZE) {
+			return NULL;
+		}
+
 		// Find space for it
 		for (i=0; i<MBRAMFS_NUM_FILES; i++) {
-			if (files[i].name[0] == '\0') {
+			if (files[i].name_len == 0) {
 				// This is free
 				file_index = i;
-				strncpy(files[i].name, fname, MBRAMFS_MAX_FILENAME_LEN);
+				files[i].hash = hash;
+				files[i].name_off = names_used;
+				files[i].name_len = name_len;
+				memcpy(names+names_used, fname, name_len);
+				names_used += name_len;
+				dir[slot] = file_index+1;
+				FILE_SET_DIRTY(&files[i]);
 				break;
 			}
 		}
@@ -111,13 +439,23 @@ FILE* fopen (const char* fname, const char* flags) {
 
 	// Save which file this points to
 	file_ptr->index = file_index;
+	file_ptr->block = MBRAMFS_BLOCK_NONE;
+	file_ptr->block_pos = 0;
+
+	// Set up a new ring with all of its storage
+	if (ring) {
+		file_truncate(file);
+		file->ring_size = MBRAMFS_RING_SIZE_IN_BYTES;
+		chain_grow(file_ptr, file, 0, blocks_for_len(file->ring_size));
+	}
 
 	// Writing a file makes it exist
 	if (read) {
 		file_ptr->fpos = 0;
 		file_ptr->flags = _F_READ;
 	} else if (write) {
-		file->len = 0;
+		// Give the old contents back to the pool
+		if (!ring) file_truncate(file);
 		file_ptr->fpos = 0;
 		file_ptr->flags = _F_WRIT;
 	} else if (append) {
@@ -134,16 +472,32 @@ size_t fread (void* ptr, size_t size, size_t count, FILE* stream) {
 	uint32_t copy_len = size*count;
 	uint32_t fptr = (uint32_t) stream->fpos;
 	file_buf_t* file = &files[stream->index];
+	uint8_t* out = (uint8_t*) ptr;
+	uint32_t remaining;
 
 	if (!(stream->flags & _F_READ)) return 0;
 
-	// Make sure we don't read past the end of the file
-	if (fptr + copy_len > file->len) {
+	// Make sure we don't read past the end of the file, which another stream
+	// may have truncated to before this one's position
+	if (fptr >= file->len) {
+		copy_len = 0;
+	} else if (fptr + copy_len > file->len) {
 		copy_len = ((file->len - fptr) / size) * size;
 	}
 
-	// memcpy the "file" to the user buffer and return how much we copied
-	memcpy(ptr, file->buf+fptr, copy_len);
+	// Copy the "file" to the user buffer one block at a time
+	remaining = copy_len;
+	while (remaining > 0) {
+		uint32_t phys = file_phys(file, fptr);
+		block_id_t id = block_seek(stream, file, phys);
+		uint32_t chunk = file_contig(file, phys, stream->block_pos);
+		if (chunk > remaining) chunk = remaining;
+
+		memcpy(out, BLOCK_DATA(id)+(phys - stream->block_pos), chunk);
+		out += chunk;
+		fptr += chunk;
+		remaining -= chunk;
+	}
 
 	stream->fpos += copy_len;
 	return copy_len / size;
@@ -153,17 +507,62 @@ size_t fwrite (const void* ptr, size_t size, size_t count, FILE* stream) {
 	uint32_t write_len = size*count;
 	uint32_t fptr = (uint32_t) stream->fpos;
 	file_buf_t* file = &files[stream->index];
+	const uint8_t* in = (const uint8_t*) ptr;
+	uint32_t remaining;
 
 	if (!(stream->flags & _F_WRIT)) return 0;
 
-	// Make sure we don't read off the end of the array
-	if (fptr + write_len > MBRAMFS_FILESIZE_IN_BYTES) {
-		write_len = ((MBRAMFS_FILESIZE_IN_BYTES - fptr) / size) * size;
+	if (file->ring_size) {
+		// A ring never runs out of space, it drops its oldest bytes instead
+		// by moving ring_start forward. Nothing in storage moves.
+		remaining = write_len;
+		if (remaining > file->ring_size) {
+			// Only the newest ring_size bytes of this write survive
+			in += remaining - file->ring_size;
+			remaining = file->ring_size;
+			fptr = 0;
+			file->len = 0;
+		}
+		if (fptr + remaining > file->ring_size) {
+			uint32_t drop = fptr + remaining - file->ring_size;
+			file->ring_start = file_phys(file, drop);
+			file->len -= drop;
+			FILE_SET_DIRTY(file);
+			fptr -= drop;
+		}
+	} else {
+		uint32_t have_blocks = blocks_for_len(file->len);
+
+		// Make sure there are enough blocks left in the pool, otherwise only
+		// write as many whole items as will fit
+		if (blocks_for_len(fptr + write_len) > have_blocks + blocks_free) {
+			uint32_t capacity = (have_blocks + blocks_free) * MBRAMFS_BLOCK_SIZE;
+			write_len = ((capacity - fptr) / size) * size;
+		}
+
+		// Grow the chain up front so the copy below never runs off its end
+		chain_grow(stream, file, have_blocks, blocks_for_len(fptr + write_len));
+		remaining = write_len;
+	}
+
+	while (remaining > 0) {
+		uint32_t phys = file_phys(file, fptr);
+		block_id_t id = block_seek(stream, file, phys);
+		uint32_t chunk = file_contig(file, phys, stream->block_pos);
+		if (chunk > remaining) chunk = remaining;
+
+		memcpy(BLOCK_DATA(id)+(phys - stream->block_pos), in, chunk);
+		BLOCK_SET_DIRTY(id);
+		in += chunk;
+		fptr += chunk;
+		remaining -= chunk;
 	}
 
-	memcpy(file->buf+fptr, ptr, write_len);
-	stream->fpos += write_len;
-	file->len += write_len;
+	stream->fpos = fptr;
+	if (stream->fpos > file->len) {
+		file->len = stream->fpos;
+		FILE_SET_DIRTY(file);
+	}
 	return write_len / size;
 }
 
@@ -177,6 +576,9 @@ int fseek (FILE* f, long int offset, int origin) {
 	} else if (origin == SEEK_CUR) {
 		// From current position
 		new_position = offset + fptr;
+	} else if (origin == SEEK_END) {
+		// From the end of the file
+		new_position = offset + file->len;
 	}
 
 	if (new_position > file->len) {
@@ -189,6 +591,10 @@ int fseek (FILE* f, long int offset, int origin) {
 	return 0;
 }
 
+long int ftell (FILE* f) {
+	return f->fpos;
+}
+
 void rewind (FILE* f) {
 	// Just need to reset our array index into the file buffer
 	f->fpos = 0;
@@ -199,15 +605,261 @@ int fclose (FILE* stream) {
 	return 0;
 }
 
-// "delete" file by adding it to the allocatable pool
+// "delete" file by returning its name and blocks to the allocatable pool
 int remove (const char* filename) {
+	uint32_t name_len;
+	uint16_t hash = name_hash(filename, &name_len);
+	uint32_t slot = dir_find(filename, hash, name_len);
+
+	if (dir[slot] != MBRAMFS_DIR_EMPTY) {
+		file_buf_t* file = &files[dir[slot]-1];
+		dir_delete(slot);
+		name_release(file);
+		file_truncate(file);
+	}
+	return 0;
+}
+
+
+/*******************************************************************************
+ * Zero-copy access
+ *
+ * These hand out pointers directly into the block that holds the stream's
+ * current position. A borrowed or reserved region never crosses a block
+ * boundary, so callers that want more data just call again after
+ * releasing/committing.
+ ******************************************************************************/
+
+size_t mbramfs_read_borrow (FILE* stream, const uint8_t** data, size_t max_len) {
+	uint32_t fptr = (uint32_t) stream->fpos;
+	file_buf_t* file = &files[stream->index];
+	block_id_t id;
+	uint32_t phys;
+	uint32_t len;
+
+	*data = NULL;
+	if (!(stream->flags & _F_READ)) return 0;
+	if (fptr >= file->len) return 0;
+
+	phys = file_phys(file, fptr);
+	id = block_seek(stream, file, phys);
+
+	len = file_contig(file, phys, stream->block_pos);
+	if (len > file->len - fptr) len = file->len - fptr;
+	if (len > max_len)          len = max_len;
+
+	*data = BLOCK_DATA(id) + (phys - stream->block_pos);
+	return len;
+}
+
+void mbramfs_read_release (FILE* stream, size_t len) {
+	stream->fpos += len;
+}
+
+size_t mbramfs_write_reserve (FILE* stream, uint8_t** data, size_t max_len) {
+	uint32_t fptr = (uint32_t) stream->fpos;
+	file_buf_t* file = &files[stream->index];
+	uint32_t have_blocks = blocks_for_len(file->len);
+	block_id_t id;
+	uint32_t offset;
+	uint32_t len;
+
+	*data = NULL;
+	if (!(stream->flags & _F_WRIT)) return 0;
+
+	// Rings can drop data from under a reservation, use fwrite for them
+	if (file->ring_size) return 0;
+
+	// At the end of the last block, so the file needs another one
+	if (fptr == have_blocks * MBRAMFS_BLOCK_SIZE) {
+		if (blocks_free == 0) return 0;
+		chain_grow(stream, file, have_blocks, have_blocks+1);
+	}
+
+	id = block_seek(stream, file, fptr);
+	offset = fptr - stream->block_pos;
+
+	len = MBRAMFS_BLOCK_SIZE - offset;
+	if (len > max_len) len = max_len;
+
+	*data = BLOCK_DATA(id) + offset;
+	return len;
+}
+
+void mbramfs_write_commit (FILE* stream, size_t len) {
+	file_buf_t* file = &files[stream->index];
+
+	if (len > 0) {
+		BLOCK_SET_DIRTY(stream->block);
+	}
+
+	stream->fpos += len;
+	if (stream->fpos > file->len) {
+		file->len = stream->fpos;
+		FILE_SET_DIRTY(file);
+	}
+
+	// If the reserve had to add a block to the end of the file and nothing
+	// was written into it, give it back. Otherwise tail is just BLOCK_NONE.
+	if (len == 0 && file->ring_size == 0 && stream->fpos == file->len &&
+	    stream->fpos % MBRAMFS_BLOCK_SIZE == 0) {
+		block_id_t tail;
+		if (stream->fpos == 0) {
+			tail = file->first_block;
+			file->first_block = MBRAMFS_BLOCK_NONE;
+		} else {
+			block_id_t prev = block_seek(stream, file, stream->fpos - MBRAMFS_BLOCK_SIZE);
+			tail = BLOCK_NEXT(prev);
+			BLOCK_NEXT(prev) = MBRAMFS_BLOCK_NONE;
+		}
+		block_free_chain(tail);
+	}
+}
+
+
+#ifdef MBRAMFS_PERSIST
+/*******************************************************************************
+ * Flash persistence
+ *
+ * Every file slot has one metadata record (length, ring state, name) and one
+ * record per block in its chain. mbramfs_sync only writes the blocks and
+ * metadata that changed since the last sync, and deletes the records of
+ * blocks a file no longer has.
+ ******************************************************************************/
+
+typedef struct {
+	uint32_t len;
+	uint32_t ring_size;
+	uint32_t ring_start;
+	uint8_t name_len;
+	char name[MBRAMFS_MAX_FILENAME_LEN];
+} __attribute__ ((aligned (4))) file_meta_t;
+
+#define META_HEADER_LEN offsetof(file_meta_t, name)
+
+static file_meta_t meta;
+
+static void fs_clear (void) {
+	memset(file_ptrs, 0, sizeof(file_ptrs));
+	memset(files, 0, sizeof(files));
+	memset(dir, 0, sizeof(dir));
+	memset(block_next, 0, sizeof(block_next));
+	memset(block_dirty, 0, sizeof(block_dirty));
+	names_used = 0;
+	free_head = MBRAMFS_BLOCK_NONE;
+	blocks_unused = 0;
+	blocks_free = MBRAMFS_NUM_BLOCKS;
+}
+
+int mbramfs_sync (void) {
+	int i;
+
+	for (i=0; i<MBRAMFS_NUM_FILES; i++) {
+		file_buf_t* file = &files[i];
+		uint32_t nblocks = 0;
+		block_id_t id;
+
+		// Write blocks that changed
+		if (file->name_len) {
+			id = file->first_block;
+			while (id != MBRAMFS_BLOCK_NONE) {
+				if (BLOCK_IS_DIRTY(id)) {
+					if (mbramfs_flash_write(MBRAMFS_FLASH_KEY(i, nblocks),
+					                        BLOCK_DATA(id), MBRAMFS_BLOCK_SIZE)) {
+						return -1;
+					}
+					BLOCK_CLEAR_DIRTY(id);
+				}
+				id = BLOCK_NEXT(id);
+				nblocks++;
+			}
+		}
+
+		// Drop blocks the file no longer has
+		while (file->flash_blocks > nblocks) {
+			if (mbramfs_flash_delete(MBRAMFS_FLASH_KEY(i, file->flash_blocks-1))) {
+				return -1;
+			}
+			file->flash_blocks--;
+		}
+		file->flash_blocks = nblocks;
+
+		// Then the metadata, so flash never describes blocks it doesn't have
+		if (file->name_len && (file->flash_state & MBRAMFS_FLASH_META_DIRTY)) {
+			meta.len = file->len;
+			meta.ring_size = file->ring_size;
+			meta.ring_start = file->ring_start;
+			meta.name_len = file->name_len;
+			memcpy(meta.name, names+file->name_off, file->name_len);
+			if (mbramfs_flash_write(MBRAMFS_FLASH_KEY(i, MBRAMFS_FLASH_KEY_META),
+			                        &meta, META_HEADER_LEN + file->name_len)) {
+				return -1;
+			}
+			file->flash_state = MBRAMFS_FLASH_META_STORED;
+		} else if (!file->name_len && (file->flash_state & MBRAMFS_FLASH_META_STORED)) {
+			if (mbramfs_flash_delete(MBRAMFS_FLASH_KEY(i, MBRAMFS_FLASH_KEY_META))) {
+				return -1;
+			}
+			file->flash_state = 0;
+		}
+	}
+
+	return 0;
+}
+
+int mbramfs_restore (void) {
 	int i;
+
+	fs_clear();
+
 	for (i=0; i<MBRAMFS_NUM_FILES; i++) {
-		if (strncmp(files[i].name, filename, MBRAMFS_MAX_FILENAME_LEN) == 0) {
-			memset(files[i].name, 0, MBRAMFS_MAX_FILENAME_LEN);
-			files[i].len = 0;
-			break;
+		file_buf_t* file = &files[i];
+		uint32_t name_len;
+		uint32_t nblocks, n;
+		block_id_t id, tail;
+		int len;
+
+		len = mbramfs_flash_read(MBRAMFS_FLASH_KEY(i, MBRAMFS_FLASH_KEY_META),
+		                         &meta, sizeof(meta));
+		if (len < (int) META_HEADER_LEN + 1) continue;
+
+		// Recreate the directory entry
+		name_len = meta.name_len;
+		if (name_len < MBRAMFS_MAX_FILENAME_LEN) meta.name[name_len] = '\0';
+		if (names_used + name_len > MBRAMFS_NAME_POOL_SIZE) return -1;
+		file->hash = name_hash(meta.name, &name_len);
+		file->name_off = names_used;
+		file->name_len = name_len;
+		memcpy(names+names_used, meta.name, name_len);
+		names_used += name_len;
+		dir[dir_find(meta.name, file->hash, name_len)] = i+1;
+
+		file->len = meta.len;
+		file->ring_size = meta.ring_size;
+		file->ring_start = meta.ring_start;
+		file->flash_state = MBRAMFS_FLASH_META_STORED;
+
+		// Read each block record straight into the arena
+		nblocks = file_blocks(file);
+		if (nblocks > blocks_free) return -1;
+		tail = MBRAMFS_BLOCK_NONE;
+		for (n=0; n<nblocks; n++) {
+			id = block_alloc();
+			if (tail == MBRAMFS_BLOCK_NONE) file->first_block = id;
+			else                           BLOCK_NEXT(tail) = id;
+			tail = id;
+
+			if (mbramfs_flash_read(MBRAMFS_FLASH_KEY(i, n), BLOCK_DATA(id),
+			                       MBRAMFS_BLOCK_SIZE) == MBRAMFS_BLOCK_SIZE) {
+				BLOCK_CLEAR_DIRTY(id);
+			} else {
+				// Lost this block, keep the slot consistent and rewrite it
+				memset(BLOCK_DATA(id), 0, MBRAMFS_BLOCK_SIZE);
+			}
 		}
+		file->flash_blocks = nblocks;
 	}
+
 	return 0;
 }
+#endif
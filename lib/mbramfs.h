@@ -0,0 +1,105 @@
+#ifndef __MBRAMFS_H
+#define __MBRAMFS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*******************************************************************************
+ * USAGE
+ *
+ * mbramfs provides fopen/fread/fwrite/fseek/ftell/fclose/remove on top of RAM.
+ * Those need no header beyond stdio.h. The functions here are extras that
+ * let a caller work directly in the file's storage instead of copying
+ * through its own buffer.
+ *
+ * Adding 'c' to the fopen flags ("wc", or "ac" for a new file) creates a
+ * circular file of MBRAMFS_RING_SIZE_IN_BYTES. Once it is full, writes
+ * overwrite the oldest data and reads/seeks are relative to the oldest byte
+ * still stored. Useful for keeping the latest window of sensor samples.
+ *
+ *   FILE* log = fopen("samples", "wc");
+ *   fwrite(&sample, sizeof(sample), 1, log); // never runs out of space
+ *
+ *   // Send a file over BLE without staging it first
+ *   const uint8_t* data;
+ *   size_t len;
+ *   while ((len = mbramfs_read_borrow(f, &data, 20)) > 0) {
+ *     send(data, len);
+ *     mbramfs_read_release(f, len);
+ *   }
+ *
+ *   // Fill a file in place
+ *   uint8_t* dst;
+ *   len = mbramfs_write_reserve(f, &dst, sizeof(sample_t));
+ *   ... write up to len bytes into dst ...
+ *   mbramfs_write_commit(f, len);
+ *
+ * A borrowed/reserved region is only valid until the next call on the file
+ * and never spans more than one storage block, so it may be shorter than
+ * requested even when more data or space is available. Do not mix other
+ * calls on the stream between a reserve and its commit.
+ */
+
+// Size of the storage blocks files are made of, so callers can size their
+// writes to fill whole blocks
+#ifndef MBRAMFS_BLOCK_SIZE
+#define MBRAMFS_BLOCK_SIZE        64
+#endif
+
+// Get a pointer to up to max_len bytes at the current position of a stream
+// opened for reading. Returns the number of bytes available, 0 at EOF.
+size_t mbramfs_read_borrow (FILE* stream, const uint8_t** data, size_t max_len);
+
+// Consume len bytes of a borrowed region, advancing the stream position
+void mbramfs_read_release (FILE* stream, size_t len);
+
+// Get a pointer to up to max_len bytes of writable storage at the current
+// position of a stream opened for writing. Returns 0 if the filesystem is
+// full or the file is circular.
+size_t mbramfs_write_reserve (FILE* stream, uint8_t** data, size_t max_len);
+
+// Mark len bytes of a reserved region as written, advancing the stream
+void mbramfs_write_commit (FILE* stream, size_t len);
+
+
+/*******************************************************************************
+ * PERSISTENCE
+ *
+ * Build with MBRAMFS_PERSIST defined to be able to save files to flash and
+ * get them back after a reset:
+ *
+ *   mbramfs_fds_init();     // or any other flash backend
+ *   mbramfs_restore();      // at boot, before opening files
+ *   ...
+ *   mbramfs_sync();         // whenever the data should survive a reset
+ *
+ * mbramfs_sync only writes blocks that changed since the last sync, so
+ * calling it often while appending to a log costs about one block write per
+ * MBRAMFS_BLOCK_SIZE bytes logged. Open streams are closed by
+ * mbramfs_restore.
+ */
+
+// Write every changed block and file to flash. Returns 0 on success.
+int mbramfs_sync (void);
+
+// Replace the filesystem contents with what is stored in flash. Returns 0
+// on success.
+int mbramfs_restore (void);
+
+// Flash backend used by the two functions above. mbramfs_fds.c implements
+// this with the SDK's Flash Data Storage (SDK 11+), host tests use a RAM
+// fake.
+// Records are identified by a 16-bit key. Write creates or replaces,
+// deleting a record that does not exist succeeds.
+#define MBRAMFS_FLASH_MAX_FILES    0xBE
+#define MBRAMFS_FLASH_KEY_META     0xFF
+#define MBRAMFS_FLASH_KEY(slot, n) ((uint16_t) ((((slot)+1) << 8) | (n)))
+
+int mbramfs_flash_write (uint16_t key, const void* data, uint16_t len);
+int mbramfs_flash_read (uint16_t key, void* data, uint16_t len); // returns bytes read
+int mbramfs_flash_delete (uint16_t key);
+
+// Set up the FDS backend. Returns an FDS error code.
+uint32_t mbramfs_fds_init (void);
+
+#endif
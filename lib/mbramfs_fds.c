@@ -0,0 +1,125 @@
+// Flash Data Storage backend for mbramfs persistence, SDK 11+
+//
+// Add this file and fds.c/fstorage.c to APPLICATION_SRCS, build with
+// MBRAMFS_PERSIST, and forward SoC events to fs_sys_event_handler (with
+// simple_ble, implement sys_evt_user_handler to do so).
+//
+// FDS works asynchronously and does not copy the data it writes. Each call
+// here waits for its operation to finish so that mbramfs can keep changing
+// its blocks as soon as mbramfs_sync returns. This relies on SoftDevice
+// events being handled in interrupt context, not through the app_scheduler.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(SDK_VERSION_9) || defined(SDK_VERSION_10)
+#error "mbramfs_fds.c uses the FDS API of SDK 11 and later"
+#endif
+
+#include "fds.h"
+
+#include "mbramfs.h"
+
+// FDS file that all mbramfs records are stored in
+#ifndef MBRAMFS_FDS_FILE_ID
+#define MBRAMFS_FDS_FILE_ID 0x4D42
+#endif
+
+static volatile bool       fds_pending = false;
+static volatile ret_code_t fds_result = FDS_SUCCESS;
+
+static void fds_evt_handler (fds_evt_t const * const p_evt) {
+	fds_result = p_evt->result;
+	fds_pending = false;
+}
+
+// Start an FDS operation with the given result and wait for it to finish
+static ret_code_t fds_wait (ret_code_t err_code) {
+	if (err_code != FDS_SUCCESS) {
+		fds_pending = false;
+		return err_code;
+	}
+	while (fds_pending);
+	return fds_result;
+}
+
+uint32_t mbramfs_fds_init (void) {
+	ret_code_t err_code;
+
+	err_code = fds_register(fds_evt_handler);
+	if (err_code != FDS_SUCCESS) return err_code;
+
+	fds_pending = true;
+	return fds_wait(fds_init());
+}
+
+int mbramfs_flash_write (uint16_t key, const void* data, uint16_t len) {
+	fds_record_desc_t  desc = {0};
+	fds_find_token_t   token = {0};
+	fds_record_chunk_t chunk;
+	fds_record_t       record;
+	ret_code_t         err_code;
+	int                tries;
+
+	chunk.p_data       = data;
+	chunk.length_words = (len + 3) / 4;
+
+	record.file_id         = MBRAMFS_FDS_FILE_ID;
+	record.key             = key;
+	record.data.p_chunks   = &chunk;
+	record.data.num_chunks = 1;
+
+	// Try again once after garbage collection if flash is full
+	for (tries=0; tries<2; tries++) {
+		fds_pending = true;
+		if (fds_record_find(MBRAMFS_FDS_FILE_ID, key, &desc, &token) == FDS_SUCCESS) {
+			err_code = fds_wait(fds_record_update(&desc, &record));
+		} else {
+			err_code = fds_wait(fds_record_write(&desc, &record));
+		}
+
+		if (err_code != FDS_ERR_NO_SPACE_IN_FLASH) break;
+
+		fds_pending = true;
+		fds_wait(fds_gc());
+		memset(&token, 0, sizeof(token));
+	}
+
+	return err_code == FDS_SUCCESS ? 0 : -1;
+}
+
+int mbramfs_flash_read (uint16_t key, void* data, uint16_t len) {
+	fds_record_desc_t  desc = {0};
+	fds_find_token_t   token = {0};
+	fds_flash_record_t flash_record;
+	uint16_t           stored;
+
+	if (fds_record_find(MBRAMFS_FDS_FILE_ID, key, &desc, &token) != FDS_SUCCESS) {
+		return 0;
+	}
+	if (fds_record_open(&desc, &flash_record) != FDS_SUCCESS) {
+		return 0;
+	}
+
+	// Records are memory mapped, so this is the only copy
+	stored = flash_record.p_header->tl.length_words * 4;
+	if (len > stored) len = stored;
+	memcpy(data, flash_record.p_data, len);
+
+	fds_record_close(&desc);
+	return len;
+}
+
+int mbramfs_flash_delete (uint16_t key) {
+	fds_record_desc_t desc = {0};
+	fds_find_token_t  token = {0};
+
+	// Already gone is fine
+	if (fds_record_find(MBRAMFS_FDS_FILE_ID, key, &desc, &token) != FDS_SUCCESS) {
+		return 0;
+	}
+
+	fds_pending = true;
+	return fds_wait(fds_record_delete(&desc)) == FDS_SUCCESS ? 0 : -1;
+}
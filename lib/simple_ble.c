@@ -20,8 +20,12 @@
 #include "ble_bas_c.h"
 #include "app_util.h"
 #include "app_timer.h"
+#include "app_util_platform.h"
 #include "softdevice_handler.h"
 #include "nrf_sdm.h"
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+#include "nrf_ble_gatt.h"
+#endif
 
 // device firmware update code
 #ifdef ENABLE_DFU
@@ -51,10 +55,11 @@ static const simple_ble_config_t* ble_config;
 
 simple_ble_app_t app;
 ble_gap_adv_params_t m_adv_params;
+static bool adv_running = false;    // advertising_start got advertising going
 ble_gap_sec_params_t m_sec_params = {
     SEC_PARAM_BOND,
     SEC_PARAM_MITM,
-#ifdef SOFTDEVICE_s130
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
     SEC_PARAM_LESC,
     SEC_PARAM_KEYPRESS,
 #endif
@@ -62,7 +67,7 @@ ble_gap_sec_params_t m_sec_params = {
     SEC_PARAM_OOB,
     SEC_PARAM_MIN_KEY_SIZE,
     SEC_PARAM_MAX_KEY_SIZE,
-#ifdef SOFTDEVICE_s130
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
     {0, 0, 0, 0},
     {0, 0, 0, 0}
 #endif
@@ -73,6 +78,13 @@ __attribute__((weak)) const int SLAVE_LATENCY = 0;
 __attribute__((weak)) const int CONN_SUP_TIMEOUT = MSEC_TO_UNITS(4000, UNIT_10_MS);
 __attribute__((weak)) const int FIRST_CONN_PARAMS_UPDATE_DELAY = APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER);
 
+// parameters the connection policy switches between, see SIMPLE_BLE_CONN_POLICY
+__attribute__((weak)) const int BULK_MIN_CONN_INTERVAL = MSEC_TO_UNITS(8, UNIT_1_25_MS);
+__attribute__((weak)) const int BULK_MAX_CONN_INTERVAL = MSEC_TO_UNITS(30, UNIT_1_25_MS);
+__attribute__((weak)) const int IDLE_MIN_CONN_INTERVAL = MSEC_TO_UNITS(250, UNIT_1_25_MS);
+__attribute__((weak)) const int IDLE_MAX_CONN_INTERVAL = MSEC_TO_UNITS(500, UNIT_1_25_MS);
+__attribute__((weak)) const int IDLE_SLAVE_LATENCY = 2;
+
 #ifdef ENABLE_DFU
 static simple_ble_service_t dfu_service = {
     .uuid128 =  {{0x23, 0xD1, 0xBC, 0xEA, 0x5F, 0x78, 0x23, 0x15,
@@ -84,6 +96,135 @@ static simple_ble_char_t    dfu_ctrlpt_char = {.uuid16 = BLE_DFU_CTRL_PT_UUID};
 static bool pending_dfu = 0;
 #endif
 
+// Notifications the SoftDevice had no TX buffer for, by value handle. They
+// go out with the value as it is when they are sent, a handle is only in a
+// queue once.
+// Every link has its own queue, at the same index as in app.links.
+#if SIMPLE_BLE_NOTIFY_QUEUE_LEN > 0
+typedef struct {
+    uint16_t handles[SIMPLE_BLE_NOTIFY_QUEUE_LEN];
+    uint8_t head;
+    uint8_t count;
+} notify_queue_t;
+
+static notify_queue_t notify_queues[SIMPLE_BLE_MAX_LINKS];
+#endif
+static simple_ble_notify_stats_t notify_stats = {0};
+
+// Peripheral links the SoftDevice takes, advertising stays connectable while
+// there is room for another
+#ifdef PERIPHERAL_LINK_COUNT
+#define PERIPHERAL_LINKS PERIPHERAL_LINK_COUNT
+#else
+#define PERIPHERAL_LINKS 1
+#endif
+
+// Characteristics with a handler, and for every attribute handle the index
+// of its characteristic plus one, zero if it has none
+#if SIMPLE_BLE_CHAR_HANDLERS > 0
+static simple_ble_char_t* char_handlers[SIMPLE_BLE_CHAR_HANDLERS];
+static uint8_t char_handler_count = 0;
+static uint8_t char_handler_index[SIMPLE_BLE_MAX_ATTR_HANDLE + 1];
+#endif
+
+// The link ble_conn_params is negotiating for
+static uint16_t conn_params_handle = BLE_CONN_HANDLE_INVALID;
+
+// S132 3.x leaves the ATT MTU exchange to the application. nrf_ble_gatt asks
+// every new link for SIMPLE_BLE_ATT_MTU and answers the peer's requests.
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+static nrf_ble_gatt_t gatt;
+#endif
+
+// Once ble_conn_params has settled the configured parameters, the policy
+// asks the central for the ones of the phase the traffic is in
+#if SIMPLE_BLE_CONN_POLICY
+enum {
+    CONN_PHASE_NORMAL,  // min_conn_interval and max_conn_interval of the config
+    CONN_PHASE_BULK,
+    CONN_PHASE_IDLE,
+};
+
+APP_TIMER_DEF(conn_policy_timer);
+
+static struct {
+    bool     active;        // ble_conn_params is done, the policy has the link
+    uint8_t  phase;         // parameters last asked for
+    uint8_t  prev_phase;    // to go back to if the central turns them down
+    bool     bulk;          // simple_ble_conn_policy_bulk or a notification backlog
+    bool     deferred;      // a change is waiting for gap_ticks
+    uint8_t  answer_ticks;  // left to wait for the central, 0 if not waiting
+    uint16_t gap_ticks;     // before the next request may go out
+    uint16_t quiet_ticks;
+    uint32_t traffic;       // notifications and writes since the last tick
+} conn_policy;
+
+static simple_ble_conn_policy_stats_t conn_policy_stats = {0};
+#endif
+
+// What the SoftDevice holds for stack characteristics (their value) and for
+// variable length ones in the user's buffer (their length), so calls that
+// would change nothing don't have to go to it. Stack values sit one after
+// the other in shadow_pool.
+#if SIMPLE_BLE_SHADOW_CHARS > 0
+#define SHADOW_STACK 0x01   // the value is in shadow_pool
+#define SHADOW_VLEN  0x02
+#define SHADOW_STALE 0x04   // the peer wrote it, read it back before using it
+
+typedef struct {
+    uint16_t handle;        // value handle
+    uint16_t cccd_handle;
+    uint16_t len;
+    uint16_t max_len;
+    uint16_t offset;        // of the value in shadow_pool
+    uint8_t  flags;
+    uint32_t notified;      // links, by index in app.links, sent this value
+} shadow_t;
+
+static shadow_t shadows[SIMPLE_BLE_SHADOW_CHARS];
+static uint8_t shadow_count = 0;
+static uint8_t shadow_pool[SIMPLE_BLE_SHADOW_BYTES];
+static uint16_t shadow_pool_used = 0;
+static simple_ble_shadow_stats_t shadow_stats = {0};
+#endif
+
+// Keys of the peers that bonded on the peripheral link, the ones used last
+// in RAM and all of them wherever simple_ble_bond_store puts them, so that
+// a peer coming back resumes encryption instead of pairing again
+#if SIMPLE_BLE_BOND_CACHE > 0
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+#define BOND_KEYS_OWN   keys_own
+#define BOND_KEYS_PEER  keys_peer
+#define BOND_KDIST_OWN  kdist_own
+#define BOND_KDIST_PEER kdist_peer
+#else
+#define BOND_KEYS_OWN   keys_periph
+#define BOND_KEYS_PEER  keys_central
+#define BOND_KDIST_OWN  kdist_periph
+#define BOND_KDIST_PEER kdist_central
+#endif
+
+typedef struct {
+    simple_ble_bond_t bond;
+    uint32_t last_used;     // bond_clock when last used, 0 for a free entry
+} bond_entry_t;
+
+APP_TIMER_DEF(bond_timer);
+
+static bond_entry_t bond_cache[SIMPLE_BLE_BOND_CACHE];
+static uint32_t bond_clock = 0;
+
+static struct {
+    simple_ble_bond_t keys;         // filled in by the SoftDevice while pairing
+    ble_gap_sec_keyset_t keyset;
+    uint32_t connected_ticks;       // RTC when the link came up
+    bool     timing;                // bond_timer runs until the link is encrypted
+    bool     resuming;              // the SoftDevice got stored keys for the peer
+} bond_link;
+
+static simple_ble_bond_stats_t bond_stats = {0};
+#endif
+
 /*******************************************************************************
  *   FUNCTION PROTOTYPES
  ******************************************************************************/
@@ -92,6 +233,15 @@ static void ble_evt_dispatch(ble_evt_t * p_ble_evt);
 static void sys_evt_dispatch(uint32_t sys_evt);
 static void on_conn_params_evt(ble_conn_params_evt_t * p_evt);
 static void on_ble_evt(ble_evt_t * p_ble_evt);
+static void notify_queue_drain(uint8_t index);
+static void notify_queue_clear(uint8_t index);
+static void shadow_link_reset(uint8_t index);
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+static void scan_adapt_init(void);
+static void scan_adapt_stop(void);
+static void scan_dedup_init(void);
+static bool scan_dedup_check(const ble_evt_t * p_ble_evt);
+#endif
 #ifdef ENABLE_DFU
 static void dfu_reset();
 #endif
@@ -118,10 +268,11 @@ void __attribute__((weak)) ble_evt_write(ble_evt_t* p_ble_evt);
 void __attribute__((weak)) ble_evt_rw_auth(ble_evt_t* p_ble_evt);
 void __attribute__((weak)) ble_evt_user_handler(ble_evt_t* p_ble_evt);
 void __attribute__((weak)) ble_evt_adv_report(ble_evt_t* p_ble_evt);
+void __attribute__((weak)) sys_evt_user_handler(uint32_t sys_evt);
 void __attribute__((weak)) ble_error(uint32_t error_code);
 
 
-#ifndef SOFTDEVICE_s130 // This function is called app_error_fault_handler in the SDK 11
+#if !defined(SOFTDEVICE_s130) && !defined(SOFTDEVICE_s132) // This function is called app_error_fault_handler in the SDK 11
 void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name) {
 #else
 void __attribute__((weak)) app_error_fault_handler(uint32_t error_code, __attribute__ ((unused)) uint32_t line_num, __attribute__ ((unused)) uint32_t info) {
@@ -155,25 +306,825 @@ static void conn_params_error_handler(uint32_t nrf_error) {
     APP_ERROR_HANDLER(nrf_error);
 }
 
+// Every event about a connection starts with its handle, whichever part of
+// the union it is in
+static uint16_t evt_conn_handle (ble_evt_t* p_ble_evt) {
+    return p_ble_evt->evt.gap_evt.conn_handle;
+}
+
+// Index of the link in app.links. Free entries have an invalid handle, so
+// looking that up finds a free one. SIMPLE_BLE_MAX_LINKS if there is none.
+static uint8_t link_index (uint16_t conn_handle) {
+    uint8_t i;
+
+    for (i = 0; i < SIMPLE_BLE_MAX_LINKS; i++) {
+        if (app.links[i].conn_handle == conn_handle) {
+            return i;
+        }
+    }
+    return SIMPLE_BLE_MAX_LINKS;
+}
+
+#if SIMPLE_BLE_CHAR_HANDLERS > 0
+static void char_handler_add (simple_ble_char_t* char_handle) {
+    uint16_t handle = char_handle->char_handle.value_handle;
+
+    if (char_handle->handler == NULL) {
+        return;
+    }
+    if (char_handler_count == SIMPLE_BLE_CHAR_HANDLERS || handle > SIMPLE_BLE_MAX_ATTR_HANDLE) {
+        // raise SIMPLE_BLE_CHAR_HANDLERS or SIMPLE_BLE_MAX_ATTR_HANDLE
+        APP_ERROR_CHECK(NRF_ERROR_NO_MEM);
+        return;
+    }
+
+    char_handlers[char_handler_count++] = char_handle;
+    char_handler_index[handle] = char_handler_count;
+}
+
+// Hand the event to the handler of the characteristic at this attribute
+// handle. Returns false if there is none.
+static bool char_handler_dispatch (ble_evt_t* p_ble_evt, uint16_t handle) {
+    simple_ble_char_t* char_handle;
+
+    if (handle > SIMPLE_BLE_MAX_ATTR_HANDLE || char_handler_index[handle] == 0) {
+        return false;
+    }
+    char_handle = char_handlers[char_handler_index[handle] - 1];
+    char_handle->handler(p_ble_evt, char_handle);
+    return true;
+}
+#else
+static void char_handler_add (simple_ble_char_t* char_handle) {
+    if (char_handle->handler != NULL) {
+        APP_ERROR_CHECK(NRF_ERROR_NOT_SUPPORTED);
+    }
+}
+
+static bool char_handler_dispatch (ble_evt_t* p_ble_evt, uint16_t handle) {
+    return false;
+}
+#endif
+
+static uint8_t evt_role (ble_evt_t* p_ble_evt) {
+    uint8_t index;
+
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED) {
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+        return p_ble_evt->evt.gap_evt.params.connected.role;
+#else
+        return BLE_GAP_ROLE_PERIPH;
+#endif
+    }
+
+    index = link_index(evt_conn_handle(p_ble_evt));
+    if (evt_conn_handle(p_ble_evt) == BLE_CONN_HANDLE_INVALID || index == SIMPLE_BLE_MAX_LINKS) {
+        return BLE_GAP_ROLE_INVALID;
+    }
+    return app.links[index].role;
+}
+
+static void link_add (ble_evt_t* p_ble_evt) {
+    uint16_t conn_handle = evt_conn_handle(p_ble_evt);
+    uint8_t index = link_index(BLE_CONN_HANDLE_INVALID);
+
+    if (index == SIMPLE_BLE_MAX_LINKS) {
+        // more links than the SoftDevice was set up for, nothing to track
+        //  them in
+        return;
+    }
+
+    app.links[index].conn_handle = conn_handle;
+    app.links[index].role = evt_role(p_ble_evt);
+    app.links[index].peer_addr = p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+    app.links[index].att_mtu = GATT_MTU_SIZE_DEFAULT;
+    shadow_link_reset(index);
+    app.link_count++;
+    app.conn_handle = conn_handle;
+}
+
+static void link_remove (uint16_t conn_handle) {
+    uint8_t index = link_index(conn_handle);
+    uint8_t i;
+
+    if (conn_handle == BLE_CONN_HANDLE_INVALID || index == SIMPLE_BLE_MAX_LINKS) {
+        return;
+    }
+
+    notify_queue_clear(index);
+    app.links[index].conn_handle = BLE_CONN_HANDLE_INVALID;
+    app.link_count--;
+
+    if (app.conn_handle == conn_handle) {
+        // fall back to another link that is still up
+        app.conn_handle = BLE_CONN_HANDLE_INVALID;
+        for (i = 0; i < SIMPLE_BLE_MAX_LINKS; i++) {
+            if (app.links[i].conn_handle != BLE_CONN_HANDLE_INVALID) {
+                app.conn_handle = app.links[i].conn_handle;
+            }
+        }
+    }
+}
+
+// Connectable advertising while another peripheral link would fit
+static uint8_t adv_type (void) {
+    uint8_t periph_links = 0;
+    uint8_t i;
+
+    for (i = 0; i < SIMPLE_BLE_MAX_LINKS; i++) {
+        if (app.links[i].conn_handle != BLE_CONN_HANDLE_INVALID &&
+                app.links[i].role == BLE_GAP_ROLE_PERIPH) {
+            periph_links++;
+        }
+    }
+    return periph_links < PERIPHERAL_LINKS ? BLE_GAP_ADV_TYPE_ADV_IND : BLE_GAP_ADV_TYPE_ADV_SCAN_IND;
+}
+
+#if SIMPLE_BLE_CONN_POLICY
+static void conn_policy_params (uint8_t phase, ble_gap_conn_params_t* p_params) {
+    p_params->conn_sup_timeout = CONN_SUP_TIMEOUT;
+    if (phase == CONN_PHASE_BULK) {
+        p_params->min_conn_interval = BULK_MIN_CONN_INTERVAL;
+        p_params->max_conn_interval = BULK_MAX_CONN_INTERVAL;
+        p_params->slave_latency     = 0;
+    } else if (phase == CONN_PHASE_IDLE) {
+        p_params->min_conn_interval = IDLE_MIN_CONN_INTERVAL;
+        p_params->max_conn_interval = IDLE_MAX_CONN_INTERVAL;
+        p_params->slave_latency     = IDLE_SLAVE_LATENCY;
+    } else {
+        p_params->min_conn_interval = ble_config->min_conn_interval;
+        p_params->max_conn_interval = ble_config->max_conn_interval;
+        p_params->slave_latency     = SLAVE_LATENCY;
+    }
+}
+
+static void conn_policy_rejected (void) {
+    conn_policy_stats.rejected++;
+    conn_policy.phase = conn_policy.prev_phase;
+    conn_policy.answer_ticks = 0;
+    conn_policy.gap_ticks = SIMPLE_BLE_CONN_POLICY_BACKOFF_TICKS;
+}
+
+// Ask the central for the parameters of a phase, unless the last request
+//  was too recent or is still unanswered
+static void conn_policy_request (uint8_t phase) {
+    ble_gap_conn_params_t params;
+
+    if (!conn_policy.active || conn_policy.answer_ticks > 0 || phase == conn_policy.phase) {
+        return;
+    }
+    if (conn_policy.gap_ticks > 0) {
+        if (!conn_policy.deferred) {
+            conn_policy.deferred = true;
+            conn_policy_stats.deferred++;
+        }
+        return;
+    }
+
+    conn_policy_params(phase, &params);
+    if (sd_ble_gap_conn_param_update(conn_params_handle, &params) != NRF_SUCCESS) {
+        // another procedure is running, try again on the next tick
+        return;
+    }
+    conn_policy.prev_phase = conn_policy.phase;
+    conn_policy.phase = phase;
+    conn_policy.deferred = false;
+    conn_policy.answer_ticks = SIMPLE_BLE_CONN_POLICY_ANSWER_TICKS;
+    conn_policy.gap_ticks = SIMPLE_BLE_CONN_POLICY_GAP_TICKS;
+    if (phase == CONN_PHASE_BULK) {
+        conn_policy_stats.to_bulk++;
+    } else if (phase == CONN_PHASE_IDLE) {
+        conn_policy_stats.to_idle++;
+    }
+}
+
+static void conn_policy_tick (void* p_context) {
+    uint8_t wanted = conn_policy.phase;
+
+    if (conn_policy.phase == CONN_PHASE_BULK) {
+        conn_policy_stats.bulk_ticks++;
+    } else if (conn_policy.phase == CONN_PHASE_IDLE) {
+        conn_policy_stats.idle_ticks++;
+    } else {
+        conn_policy_stats.normal_ticks++;
+    }
+
+    if (conn_policy.gap_ticks > 0) {
+        conn_policy.gap_ticks--;
+    }
+    if (conn_policy.answer_ticks > 0 && --conn_policy.answer_ticks == 0) {
+        // no answer, as good as turned down
+        conn_policy_rejected();
+    }
+
+    if (conn_policy.traffic > 0) {
+        conn_policy.quiet_ticks = 0;
+    } else {
+        if (conn_policy.quiet_ticks < UINT16_MAX) {
+            conn_policy.quiet_ticks++;
+        }
+        if (conn_policy.phase == CONN_PHASE_BULK) {
+            // the transfer it was for is over
+            conn_policy.bulk = false;
+        }
+    }
+    conn_policy.traffic = 0;
+
+    if (conn_policy.bulk) {
+        wanted = CONN_PHASE_BULK;
+    } else if (conn_policy.quiet_ticks >= SIMPLE_BLE_CONN_POLICY_IDLE_TICKS) {
+        wanted = CONN_PHASE_IDLE;
+    }
+    conn_policy_request(wanted);
+}
+
+static void conn_policy_init (void) {
+    uint32_t err_code;
+
+    err_code = app_timer_create(&conn_policy_timer, APP_TIMER_MODE_REPEATED, conn_policy_tick);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void conn_policy_connected (ble_evt_t* p_ble_evt) {
+    uint32_t err_code;
+
+    memset(&conn_policy, 0, sizeof(conn_policy));
+    conn_policy.phase = CONN_PHASE_NORMAL;
+    conn_policy_stats.conn_interval = p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
+    conn_policy_stats.slave_latency = p_ble_evt->evt.gap_evt.params.connected.conn_params.slave_latency;
+
+    err_code = app_timer_start(conn_policy_timer,
+            APP_TIMER_TICKS(SIMPLE_BLE_CONN_POLICY_TICK_MS, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void conn_policy_disconnected (void) {
+    conn_policy.active = false;
+    app_timer_stop(conn_policy_timer);
+}
+
+// ble_conn_params got the configured parameters, from now on the policy
+//  decides
+static void conn_policy_start (void) {
+    conn_policy.active = true;
+    conn_policy.gap_ticks = SIMPLE_BLE_CONN_POLICY_GAP_TICKS;
+}
+
+static void conn_policy_updated (ble_evt_t* p_ble_evt) {
+    ble_gap_conn_params_t* p_new = &(p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params);
+    ble_gap_conn_params_t asked;
+
+    conn_policy_stats.conn_interval = p_new->max_conn_interval;
+    conn_policy_stats.slave_latency = p_new->slave_latency;
+
+    if (conn_policy.answer_ticks > 0) {
+        conn_policy_params(conn_policy.phase, &asked);
+        if (p_new->max_conn_interval >= asked.min_conn_interval &&
+                p_new->max_conn_interval <= asked.max_conn_interval &&
+                p_new->slave_latency <= asked.slave_latency) {
+            conn_policy.answer_ticks = 0;
+        } else {
+            conn_policy_rejected();
+        }
+    }
+}
+
+// Parameter updates on the link are the policy's once it has it, don't let
+//  ble_conn_params negotiate them back to the configured ones
+static bool conn_policy_owns (ble_evt_t* p_ble_evt) {
+    return conn_policy.active &&
+           p_ble_evt->header.evt_id == BLE_GAP_EVT_CONN_PARAM_UPDATE &&
+           evt_conn_handle(p_ble_evt) == conn_params_handle;
+}
+
+static void conn_policy_traffic (uint16_t conn_handle) {
+    if (conn_handle == conn_params_handle) {
+        conn_policy.traffic++;
+    }
+}
+
+// Notifications are waiting for buffers, go fast straight away
+static void conn_policy_backlog (uint16_t conn_handle) {
+    if (conn_handle == conn_params_handle) {
+        conn_policy.bulk = true;
+        conn_policy_request(CONN_PHASE_BULK);
+    }
+}
+#else
+static void conn_policy_init (void) {
+}
+
+static void conn_policy_connected (ble_evt_t* p_ble_evt) {
+}
+
+static void conn_policy_disconnected (void) {
+}
+
+static void conn_policy_start (void) {
+}
+
+static void conn_policy_updated (ble_evt_t* p_ble_evt) {
+}
+
+static bool conn_policy_owns (ble_evt_t* p_ble_evt) {
+    return false;
+}
+
+static void conn_policy_traffic (uint16_t conn_handle) {
+}
+
+static void conn_policy_backlog (uint16_t conn_handle) {
+}
+#endif
+
+#if SIMPLE_BLE_SHADOW_CHARS > 0
+static shadow_t* shadow_find (uint16_t handle) {
+    uint8_t i;
+
+    for (i = 0; i < shadow_count; i++) {
+        if (shadows[i].handle == handle) {
+            return &shadows[i];
+        }
+    }
+    return NULL;
+}
+
+// The SoftDevice starts a new attribute table
+static void shadow_reset (void) {
+    shadow_count = 0;
+    shadow_pool_used = 0;
+}
+
+// Start keeping a characteristic that was just added. buf has the initial
+// value of a stack characteristic, stack is false for a value in the user's
+// buffer, of which only the length is kept.
+static void shadow_add (simple_ble_char_t* char_handle, uint8_t vlen, uint16_t len,
+                        const uint8_t* buf, bool stack) {
+    shadow_t* shadow;
+
+    if (shadow_count == SIMPLE_BLE_SHADOW_CHARS ||
+            (stack && len > SIMPLE_BLE_SHADOW_BYTES - shadow_pool_used)) {
+        // no room, it keeps going to the SoftDevice every time
+        shadow_stats.uncached++;
+        return;
+    }
+
+    shadow = &shadows[shadow_count++];
+    shadow->handle = char_handle->char_handle.value_handle;
+    shadow->cccd_handle = char_handle->char_handle.cccd_handle;
+    shadow->len = len;
+    shadow->max_len = len;
+    shadow->flags = vlen ? SHADOW_VLEN : 0;
+    shadow->notified = 0;
+    if (stack) {
+        shadow->flags |= SHADOW_STACK;
+        shadow->offset = shadow_pool_used;
+        shadow_pool_used += len;
+        if (buf) {
+            memcpy(&shadow_pool[shadow->offset], buf, len);
+        } else {
+            memset(&shadow_pool[shadow->offset], 0, len);
+        }
+    }
+}
+
+// A new link hasn't been sent anything
+static void shadow_link_reset (uint8_t index) {
+    uint8_t i;
+
+    for (i = 0; i < shadow_count; i++) {
+        shadows[i].notified &= ~(1UL << index);
+    }
+}
+
+// The peer wrote a value or a CCCD, or asked to
+static void shadow_write (ble_evt_t* p_ble_evt) {
+    uint8_t index = link_index(p_ble_evt->evt.gatts_evt.conn_handle);
+    uint16_t handle;
+    uint8_t op;
+    uint8_t i;
+
+    if (p_ble_evt->header.evt_id == BLE_GATTS_EVT_WRITE) {
+        handle = p_ble_evt->evt.gatts_evt.params.write.handle;
+        op = p_ble_evt->evt.gatts_evt.params.write.op;
+    } else {
+        handle = p_ble_evt->evt.gatts_evt.params.authorize_request.request.write.handle;
+        op = p_ble_evt->evt.gatts_evt.params.authorize_request.request.write.op;
+    }
+
+    for (i = 0; i < shadow_count; i++) {
+        if (shadows[i].handle == handle || op == BLE_GATTS_OP_EXEC_WRITE_REQ_NOW) {
+            // the SoftDevice has the peer's value now
+            shadows[i].flags |= SHADOW_STALE;
+            shadows[i].notified = 0;
+        } else if (shadows[i].cccd_handle == handle && index < SIMPLE_BLE_MAX_LINKS) {
+            // notifications turned on again should start with the value
+            shadows[i].notified &= ~(1UL << index);
+        }
+    }
+}
+
+// True if setting the value would change nothing
+static bool shadow_set_unchanged (uint16_t handle, uint16_t len, const uint8_t* buf) {
+    shadow_t* shadow = shadow_find(handle);
+
+    if (shadow == NULL || (shadow->flags & (SHADOW_STACK | SHADOW_STALE)) != SHADOW_STACK ||
+            len > shadow->len || ((shadow->flags & SHADOW_VLEN) && len != shadow->len) ||
+            memcmp(&shadow_pool[shadow->offset], buf, len) != 0) {
+        return false;
+    }
+    shadow_stats.sets_skipped++;
+    shadow_stats.avoided++;
+    return true;
+}
+
+// The SoftDevice took a new value
+static void shadow_set_done (uint16_t handle, uint16_t len, const uint8_t* buf) {
+    shadow_t* shadow = shadow_find(handle);
+
+    if (shadow == NULL || !(shadow->flags & SHADOW_STACK)) {
+        return;
+    }
+    shadow_stats.svc_calls++;
+    memcpy(&shadow_pool[shadow->offset], buf, len);
+    if (shadow->flags & SHADOW_VLEN) {
+        shadow->len = len;
+    }
+    if (len == shadow->len) {
+        // all of it is known again
+        shadow->flags &= ~SHADOW_STALE;
+    }
+    shadow->notified = 0;
+}
+
+// Copy up to *p_len bytes of the value to buf, reading it back from the
+// SoftDevice first if the peer wrote it. False if it isn't kept.
+static bool shadow_get (uint16_t conn_handle, uint16_t handle, uint16_t* p_len, uint8_t* buf) {
+    shadow_t* shadow = shadow_find(handle);
+
+    if (shadow == NULL || !(shadow->flags & SHADOW_STACK)) {
+        return false;
+    }
+
+    if (shadow->flags & SHADOW_STALE) {
+        ble_gatts_value_t value = {
+            .len = shadow->max_len,
+            .offset = 0,
+            .p_value = &shadow_pool[shadow->offset],
+        };
+
+        shadow_stats.svc_calls++;
+        if (sd_ble_gatts_value_get(conn_handle, handle, &value) != NRF_SUCCESS) {
+            return false;
+        }
+        shadow_stats.refreshes++;
+        shadow->len = MIN(value.len, shadow->max_len);
+        shadow->flags &= ~SHADOW_STALE;
+    } else {
+        shadow_stats.gets_local++;
+        shadow_stats.avoided++;
+    }
+
+    *p_len = MIN(*p_len, shadow->len);
+    memcpy(buf, &shadow_pool[shadow->offset], *p_len);
+    return true;
+}
+
+// True if the length is already set
+static bool shadow_len_unchanged (uint16_t handle, uint16_t len) {
+    shadow_t* shadow = shadow_find(handle);
+
+    if (shadow == NULL || (shadow->flags & SHADOW_STALE) || len != shadow->len) {
+        return false;
+    }
+    shadow_stats.lens_skipped++;
+    shadow_stats.avoided++;
+    return true;
+}
+
+static void shadow_len_done (uint16_t handle, uint16_t len) {
+    shadow_t* shadow = shadow_find(handle);
+
+    if (shadow == NULL) {
+        return;
+    }
+    shadow_stats.svc_calls++;
+    shadow->len = len;
+    if (!(shadow->flags & SHADOW_STACK)) {
+        // the value itself is in the user's buffer
+        shadow->flags &= ~SHADOW_STALE;
+    }
+    shadow->notified = 0;
+}
+
+// True if the link was already sent the value of this stack characteristic
+static bool shadow_notify_unchanged (uint8_t index, uint16_t handle) {
+    shadow_t* shadow = shadow_find(handle);
+
+    if (shadow == NULL || (shadow->flags & (SHADOW_STACK | SHADOW_STALE)) != SHADOW_STACK ||
+            !(shadow->notified & (1UL << index))) {
+        return false;
+    }
+    shadow_stats.notifies_skipped++;
+    shadow_stats.avoided++;
+    return true;
+}
+
+static void shadow_notified (uint8_t index, uint16_t handle) {
+    shadow_t* shadow = shadow_find(handle);
+
+    if (shadow != NULL) {
+        shadow->notified |= (1UL << index);
+    }
+}
+#else
+static void shadow_reset (void) {
+}
+
+static void shadow_add (simple_ble_char_t* char_handle, uint8_t vlen, uint16_t len,
+                        const uint8_t* buf, bool stack) {
+}
+
+static void shadow_link_reset (uint8_t index) {
+}
+
+static void shadow_write (ble_evt_t* p_ble_evt) {
+}
+
+static bool shadow_set_unchanged (uint16_t handle, uint16_t len, const uint8_t* buf) {
+    return false;
+}
+
+static void shadow_set_done (uint16_t handle, uint16_t len, const uint8_t* buf) {
+}
+
+static bool shadow_get (uint16_t conn_handle, uint16_t handle, uint16_t* p_len, uint8_t* buf) {
+    return false;
+}
+
+static bool shadow_len_unchanged (uint16_t handle, uint16_t len) {
+    return false;
+}
+
+static void shadow_len_done (uint16_t handle, uint16_t len) {
+}
+
+static bool shadow_notify_unchanged (uint8_t index, uint16_t handle) {
+    return false;
+}
+
+static void shadow_notified (uint8_t index, uint16_t handle) {
+}
+#endif
+
+#if SIMPLE_BLE_BOND_CACHE > 0
+static bool bond_same_peer (const simple_ble_bond_t* p_a, const simple_ble_bond_t* p_b) {
+    static const uint8_t none[BLE_GAP_ADDR_LEN] = {0};
+
+    // a peer that didn't hand out its identity can't be recognised
+    return memcmp(p_a->peer_id.id_addr_info.addr, none, BLE_GAP_ADDR_LEN) != 0 &&
+           memcmp(&p_a->peer_id.id_addr_info, &p_b->peer_id.id_addr_info,
+                  sizeof(p_a->peer_id.id_addr_info)) == 0;
+}
+
+static bond_entry_t* bond_find (const ble_gap_master_id_t* p_master_id) {
+    uint8_t i;
+
+    for (i = 0; i < SIMPLE_BLE_BOND_CACHE; i++) {
+        if (bond_cache[i].last_used != 0 &&
+                bond_cache[i].bond.enc_key.master_id.ediv == p_master_id->ediv &&
+                memcmp(bond_cache[i].bond.enc_key.master_id.rand, p_master_id->rand,
+                       BLE_GAP_SEC_RAND_LEN) == 0) {
+            return &bond_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Put a bond in the cache, over an older bond of the same peer, a free
+//  entry or the one used longest ago
+static bond_entry_t* bond_cache_add (const simple_ble_bond_t* p_bond) {
+    bond_entry_t* entry = &bond_cache[0];
+    uint8_t i;
+
+    for (i = 0; i < SIMPLE_BLE_BOND_CACHE; i++) {
+        if (bond_cache[i].last_used != 0 && bond_same_peer(&bond_cache[i].bond, p_bond)) {
+            entry = &bond_cache[i];
+            break;
+        }
+        if (bond_cache[i].last_used < entry->last_used) {
+            entry = &bond_cache[i];
+        }
+    }
+    entry->bond = *p_bond;
+    entry->last_used = ++bond_clock;
+    return entry;
+}
+
+// The RTC under app_timer. SDK 12 returns it from app_timer_cnt_get, and
+//  its app_timer.h no longer has APP_TIMER_USER_SIZE.
+static uint32_t bond_rtc (void) {
+#ifdef APP_TIMER_USER_SIZE
+    uint32_t ticks;
+
+    app_timer_cnt_get(&ticks);
+    return ticks;
+#else
+    return app_timer_cnt_get();
+#endif
+}
+
+static void bond_timeout (void* p_context) {
+    bond_link.timing = false;
+    bond_stats.unencrypted++;
+}
+
+static void bond_init (void) {
+    uint32_t err_code;
+
+    memset(bond_cache, 0, sizeof(bond_cache));
+    bond_clock = 0;
+
+    // hand out a key the peer can come back with, and ask for its identity
+    //  to know it again when it pairs anew
+    m_sec_params.BOND_KDIST_OWN.enc = 1;
+    m_sec_params.BOND_KDIST_PEER.id = 1;
+
+    err_code = app_timer_create(&bond_timer, APP_TIMER_MODE_SINGLE_SHOT, bond_timeout);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void bond_connected (void) {
+    uint32_t err_code;
+
+    memset(&bond_link, 0, sizeof(bond_link));
+    err_code = app_timer_start(bond_timer,
+            APP_TIMER_TICKS(SIMPLE_BLE_BOND_TIMEOUT_MS, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+    // the RTC only counts while a timer runs, so read it after the start
+    bond_link.connected_ticks = bond_rtc();
+    bond_link.timing = true;
+}
+
+static void bond_disconnected (void) {
+    if (bond_link.timing) {
+        bond_link.timing = false;
+        app_timer_stop(bond_timer);
+    }
+}
+
+// Where the SoftDevice puts the keys of a pairing on the peripheral link
+static ble_gap_sec_keyset_t* bond_keyset (uint16_t conn_handle) {
+    if (conn_handle != conn_params_handle) {
+        return NULL;
+    }
+    memset(&bond_link.keys, 0, sizeof(bond_link.keys));
+    memset(&bond_link.keyset, 0, sizeof(bond_link.keyset));
+    bond_link.keyset.BOND_KEYS_OWN.p_enc_key = &bond_link.keys.enc_key;
+    bond_link.keyset.BOND_KEYS_PEER.p_id_key = &bond_link.keys.peer_id;
+    return &bond_link.keyset;
+}
+
+// The key the peer wants to encrypt with, from the cache or the store
+static const ble_gap_enc_info_t* bond_enc_info (ble_evt_t* p_ble_evt) {
+    const ble_gap_master_id_t* p_master_id =
+            &(p_ble_evt->evt.gap_evt.params.sec_info_request.master_id);
+    bond_entry_t* entry = bond_find(p_master_id);
+    simple_ble_bond_t bond;
+
+    if (entry != NULL) {
+        bond_stats.cache_hits++;
+        entry->last_used = ++bond_clock;
+    } else if (simple_ble_bond_load(p_master_id, &bond) == NRF_SUCCESS) {
+        bond_stats.flash_hits++;
+        entry = bond_cache_add(&bond);
+    } else {
+        bond_stats.unknown++;
+        return NULL;
+    }
+
+    if (p_ble_evt->evt.gap_evt.conn_handle == conn_params_handle) {
+        bond_link.resuming = true;
+    }
+    return &entry->bond.enc_key.enc_info;
+}
+
+static void bond_auth_status (ble_evt_t* p_ble_evt) {
+    ble_gap_evt_auth_status_t* p_auth = &(p_ble_evt->evt.gap_evt.params.auth_status);
+    bond_entry_t* entry;
+
+    if (p_ble_evt->evt.gap_evt.conn_handle != conn_params_handle ||
+            p_auth->auth_status != BLE_GAP_SEC_STATUS_SUCCESS ||
+            !p_auth->bonded || !p_auth->BOND_KDIST_OWN.enc) {
+        return;
+    }
+
+    bond_stats.bonded++;
+    entry = bond_cache_add(&bond_link.keys);
+    if (simple_ble_bond_store(&entry->bond) != NRF_SUCCESS) {
+        // only good until it drops out of the cache
+        bond_stats.store_failed++;
+    }
+}
+
+static void bond_sec_update (ble_evt_t* p_ble_evt) {
+    ble_gap_conn_sec_t* p_sec = &(p_ble_evt->evt.gap_evt.params.conn_sec_update.conn_sec);
+    uint32_t ticks;
+    uint32_t ms;
+
+    if (p_ble_evt->evt.gap_evt.conn_handle != conn_params_handle ||
+            !bond_link.timing || p_sec->sec_mode.lv < 2) {
+        return;
+    }
+
+    app_timer_cnt_diff_compute(bond_rtc(), bond_link.connected_ticks, &ticks);
+    ms = (uint32_t) ROUNDED_DIV((uint64_t) ticks * 1000 * (APP_TIMER_PRESCALER + 1), APP_TIMER_CLOCK_FREQ);
+    bond_link.timing = false;
+    app_timer_stop(bond_timer);
+
+    if (bond_link.resuming) {
+        bond_stats.resumed++;
+        bond_stats.resume_ms += ms;
+        if (ms > bond_stats.resume_ms_max) {
+            bond_stats.resume_ms_max = ms;
+        }
+    } else {
+        bond_stats.paired++;
+        bond_stats.pair_ms += ms;
+    }
+}
+#else
+static void bond_init (void) {
+}
+
+static void bond_connected (void) {
+}
+
+static void bond_disconnected (void) {
+}
+
+static ble_gap_sec_keyset_t* bond_keyset (uint16_t conn_handle) {
+    return NULL;
+}
+
+static const ble_gap_enc_info_t* bond_enc_info (ble_evt_t* p_ble_evt) {
+    // no keys for anyone
+    return NULL;
+}
+
+static void bond_auth_status (ble_evt_t* p_ble_evt) {
+}
+
+static void bond_sec_update (ble_evt_t* p_ble_evt) {
+}
+#endif
+
 static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
 {
+    // ble_conn_params negotiates for one link in the peripheral role, keep
+    //  the links we are central on away from it. The role has to be found
+    //  before on_ble_evt forgets a link that went down.
+    bool central = (evt_role(p_ble_evt) == BLE_GAP_ROLE_CENTRAL);
+
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+    nrf_ble_gatt_on_ble_evt(&gatt, p_ble_evt);
+#endif
     on_ble_evt(p_ble_evt);
-    ble_conn_params_on_ble_evt(p_ble_evt);
+    if (!central && !conn_policy_owns(p_ble_evt)) {
+        ble_conn_params_on_ble_evt(p_ble_evt);
+    }
 }
 
-static void sys_evt_dispatch(__attribute__ ((unused)) uint32_t sys_evt) {
+static void sys_evt_dispatch(uint32_t sys_evt) {
+    // SoC events (flash operations, etc.) are only of interest to users of
+    //  modules like fstorage. Weak reference, check validity before calling
+    if (sys_evt_user_handler) {
+        sys_evt_user_handler(sys_evt);
+    }
 }
 
 static void on_conn_params_evt(ble_conn_params_evt_t * p_evt) {
     uint32_t err_code;
 
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED) {
-        err_code = sd_ble_gap_disconnect(app.conn_handle,
+        err_code = sd_ble_gap_disconnect(conn_params_handle,
                 BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
         APP_ERROR_CHECK(err_code);
+    } else if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_SUCCEEDED) {
+        conn_policy_start();
     }
 }
 
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+static void on_gatt_evt(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t * p_evt) {
+    uint8_t index = link_index(p_evt->conn_handle);
+
+    if (p_evt->conn_handle != BLE_CONN_HANDLE_INVALID && index != SIMPLE_BLE_MAX_LINKS) {
+        app.links[index].att_mtu = p_evt->att_mtu_effective;
+    }
+}
+#endif
+
 #ifdef ENABLE_DFU
 static void interrupts_disable(void) {
     uint32_t interrupt_setting_mask;
@@ -195,15 +1146,30 @@ static void interrupts_disable(void) {
 
 static void on_ble_evt(ble_evt_t * p_ble_evt) {
     uint32_t err_code;
+    uint16_t conn_handle = evt_conn_handle(p_ble_evt);
 
     switch (p_ble_evt->header.evt_id) {
         case BLE_GAP_EVT_CONNECTED:
-            app.conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-            // continue advertising, but nonconnectably
-            m_adv_params.type = BLE_GAP_ADV_TYPE_ADV_SCAN_IND;
+            link_add(p_ble_evt);
+            if (evt_role(p_ble_evt) == BLE_GAP_ROLE_PERIPH) {
+                // the SoftDevice stopped advertising to take the connection
+                adv_running = false;
+                conn_params_handle = conn_handle;
+                conn_policy_connected(p_ble_evt);
+                bond_connected();
+            }
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+            if (evt_role(p_ble_evt) == BLE_GAP_ROLE_CENTRAL) {
+                // the SoftDevice stopped scanning to make the connection
+                scan_adapt_stop();
+            }
+#endif
+            // continue advertising, but nonconnectably once the peripheral
+            //  links are all taken
+            m_adv_params.type = adv_type();
             advertising_start();
             // connected to device. Set initial CCCD attributes to NULL
-            err_code = sd_ble_gatts_sys_attr_set(app.conn_handle, NULL, 0, 0);
+            err_code = sd_ble_gatts_sys_attr_set(conn_handle, NULL, 0, 0);
             APP_ERROR_CHECK(err_code);
 
             // callback for user. Weak reference, so check validity first
@@ -213,7 +1179,12 @@ static void on_ble_evt(ble_evt_t * p_ble_evt) {
             break;
 
         case BLE_GAP_EVT_DISCONNECTED:
-            app.conn_handle = BLE_CONN_HANDLE_INVALID;
+            link_remove(conn_handle);
+            if (conn_params_handle == conn_handle) {
+                conn_params_handle = BLE_CONN_HANDLE_INVALID;
+                conn_policy_disconnected();
+                bond_disconnected();
+            }
             advertising_stop();
 #ifdef ENABLE_DFU
             // if pending dfu, clear and disable irq and then reset to bootloader
@@ -222,8 +1193,9 @@ static void on_ble_evt(ble_evt_t * p_ble_evt) {
                 dfu_reset();
             }
 #endif
-            // go back to advertising connectably
-            m_adv_params.type = BLE_GAP_ADV_TYPE_ADV_IND;
+            // go back to advertising connectably, if a peripheral link is
+            //  free now
+            m_adv_params.type = adv_type();
             advertising_start();
 
             // callback for user. Weak reference, so check validity first
@@ -233,59 +1205,104 @@ static void on_ble_evt(ble_evt_t * p_ble_evt) {
             break;
 
         case BLE_GATTS_EVT_WRITE:
+            conn_policy_traffic(conn_handle);
+            shadow_write(p_ble_evt);
 #ifdef ENABLE_DFU
             // if written to dfu ctrl pt
             if (simple_ble_is_char_event(p_ble_evt, &dfu_ctrlpt_char)) {
                 pending_dfu = 1;
                 // disconnect, wait for event.
-                err_code = sd_ble_gap_disconnect(app.conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+                err_code = sd_ble_gap_disconnect(conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
                 APP_ERROR_CHECK(err_code);
                 break;
             }
 #endif
+            if (char_handler_dispatch(p_ble_evt, p_ble_evt->evt.gatts_evt.params.write.handle)) {
+                break;
+            }
             // callback for user. Weak reference, so check validity first
             if (ble_evt_write) {
                 ble_evt_write(p_ble_evt);
             }
             break;
 
+        case BLE_EVT_TX_COMPLETE:
+            conn_policy_traffic(conn_handle);
+            // buffers are free again, fill them from the queue so that
+            //  every connection event carries as much as it can
+            if (link_index(conn_handle) < SIMPLE_BLE_MAX_LINKS) {
+                notify_queue_drain(link_index(conn_handle));
+            }
+            break;
+
         case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            conn_policy_traffic(conn_handle);
+            {
+                ble_gatts_evt_rw_authorize_request_t* p_auth_req =
+                        &(p_ble_evt->evt.gatts_evt.params.authorize_request);
+                uint16_t handle = (p_auth_req->type == BLE_GATTS_AUTHORIZE_TYPE_READ) ?
+                        p_auth_req->request.read.handle : p_auth_req->request.write.handle;
+
+                if (p_auth_req->type == BLE_GATTS_AUTHORIZE_TYPE_WRITE) {
+                    shadow_write(p_ble_evt);
+                }
+                if (char_handler_dispatch(p_ble_evt, handle)) {
+                    break;
+                }
+            }
             // callback for user. Weak reference, so check validity first
             if (ble_evt_rw_auth) {
                 ble_evt_rw_auth(p_ble_evt);
             }
             break;
 
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            if (conn_handle == conn_params_handle) {
+                conn_policy_updated(p_ble_evt);
+            }
+            break;
+
         case BLE_GAP_EVT_SEC_PARAMS_REQUEST:
-            err_code = sd_ble_gap_sec_params_reply(app.conn_handle,
-                    BLE_GAP_SEC_STATUS_SUCCESS, &m_sec_params, NULL);
+            err_code = sd_ble_gap_sec_params_reply(conn_handle,
+                    BLE_GAP_SEC_STATUS_SUCCESS, &m_sec_params, bond_keyset(conn_handle));
             APP_ERROR_CHECK(err_code);
             break;
 
         case BLE_GATTS_EVT_SYS_ATTR_MISSING:
-            err_code = sd_ble_gatts_sys_attr_set(app.conn_handle, NULL, 0, 0);
+            err_code = sd_ble_gatts_sys_attr_set(conn_handle, NULL, 0, 0);
             APP_ERROR_CHECK(err_code);
             break;
 
         case BLE_GAP_EVT_AUTH_STATUS:
+            bond_auth_status(p_ble_evt);
             break;
 
         case BLE_GAP_EVT_SEC_INFO_REQUEST:
-            // No keys found for this device.
-            err_code = sd_ble_gap_sec_info_reply(app.conn_handle, NULL, NULL, NULL);
+            // Stored keys if the peer bonded before, none otherwise
+            err_code = sd_ble_gap_sec_info_reply(conn_handle, bond_enc_info(p_ble_evt), NULL, NULL);
             APP_ERROR_CHECK(err_code);
             break;
 
+        case BLE_GAP_EVT_CONN_SEC_UPDATE:
+            bond_sec_update(p_ble_evt);
+            break;
+
         case BLE_GAP_EVT_TIMEOUT:
             if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_ADVERTISING) {
+                adv_running = false;
                 err_code = sd_power_system_off();
                 APP_ERROR_CHECK(err_code);
             }
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+            if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_SCAN) {
+                scan_adapt_stop();
+            }
+#endif
             break;
 
         case BLE_GATTS_EVT_TIMEOUT:
             if (p_ble_evt->evt.gatts_evt.params.timeout.src == BLE_GATT_TIMEOUT_SRC_PROTOCOL) {
-                err_code = sd_ble_gap_disconnect(app.conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+                err_code = sd_ble_gap_disconnect(conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
                 APP_ERROR_CHECK(err_code);
             }
             break;
@@ -293,13 +1310,18 @@ static void on_ble_evt(ble_evt_t * p_ble_evt) {
         case BLE_GAP_EVT_ADV_REPORT:
             {
 #ifdef ENABLE_DFU
-#ifdef SOFTDEVICE_s130
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
               // check if DFU advertisement
-              uint8_t data[31];
-              int len = parse_adata(p_ble_evt, 0xFF, data);
+              simple_ble_adv_index_t index;
+              const uint8_t* data;
+              uint8_t len;
+
+              simple_ble_adv_index(p_ble_evt->evt.gap_evt.params.adv_report.data,
+                                   p_ble_evt->evt.gap_evt.params.adv_report.dlen, &index);
+              data = simple_ble_adv_find(&index, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, &len);
 
-              if (len > 4 && len <= 31 &&
-                  *((short *) data) == 0x02E0 &&
+              if (len >= 10 &&
+                  data[0] == 0xE0 && data[1] == 0x02 &&
                   data[2] == DFU_ADV_DATA_TYPE &&
                   data[3] == DFU_ADV_DATA_VERS)
               {
@@ -313,6 +1335,11 @@ static void on_ble_evt(ble_evt_t * p_ble_evt) {
 #endif
 #endif
 
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+              if (!scan_dedup_check(p_ble_evt)) {
+                  break;
+              }
+#endif
               if (ble_evt_adv_report) {
                   ble_evt_adv_report(p_ble_evt);
               }
@@ -366,7 +1393,11 @@ void __attribute__((weak)) ble_address_set (void) {
             // Set the new BLE address with the Michigan OUI, Platform ID, and
             //  bottom two octets from the original gap address
             // Get the current original address
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+            sd_ble_gap_addr_get(&gap_addr);
+#else
             sd_ble_gap_address_get(&gap_addr);
+#endif
             memcpy(gap_addr.addr+2, new_mac_addr+2, sizeof(gap_addr.addr)-2);
         }
     } else {
@@ -381,7 +1412,11 @@ void __attribute__((weak)) ble_address_set (void) {
     memcpy((uint8_t*)BOOTLOADER_BLE_ADDR_START, gap_addr.addr, 6);
 #endif
     gap_addr.addr_type = BLE_GAP_ADDR_TYPE_PUBLIC;
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+    err_code = sd_ble_gap_addr_set(&gap_addr);
+#else
     err_code = sd_ble_gap_address_set(BLE_GAP_ADDR_CYCLE_MODE_NONE, &gap_addr);
+#endif
     APP_ERROR_CHECK(err_code);
 }
 
@@ -389,7 +1424,7 @@ void __attribute__((weak)) ble_address_set (void) {
 void __attribute__((weak)) ble_stack_init (void) {
     uint32_t err_code;
 
-#ifdef SOFTDEVICE_s130
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
     // Softdevice 130 2.0.0 changes how the softdevice init procedure works.
     nrf_clock_lf_cfg_t clock_lf_cfg = {
         .source        = NRF_CLOCK_LF_SRC_RC,
@@ -408,6 +1443,9 @@ void __attribute__((weak)) ble_stack_init (void) {
                                                     PERIPHERAL_LINK_COUNT, // peripheral link count
                                                     &ble_enable_params);
     ble_enable_params.common_enable_params.vs_uuid_count = BLE_UUID_VS_COUNT_DEFAULT;
+#if SIMPLE_BLE_ATT_MTU > GATT_MTU_SIZE_DEFAULT
+    ble_enable_params.gatt_enable_params.att_mtu = SIMPLE_BLE_ATT_MTU;
+#endif
     APP_ERROR_CHECK(err_code);
 
     //Check the ram settings against the used number of links
@@ -417,6 +1455,17 @@ void __attribute__((weak)) ble_stack_init (void) {
     err_code = softdevice_enable(&ble_enable_params);
     APP_ERROR_CHECK(err_code);
 
+#if SIMPLE_BLE_ATT_MTU > GATT_MTU_SIZE_DEFAULT
+    // Let the link layer carry a whole ATT packet and its 4 byte L2CAP
+    //  header in one PDU, rather than in 27 byte pieces. The SoftDevice
+    //  updates the data length after the MTU exchange.
+    ble_opt_t opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.gap_opt.ext_len.rxtx_max_pdu_payload_size = MIN(SIMPLE_BLE_ATT_MTU + 4, 251);
+    err_code = sd_ble_opt_set(BLE_GAP_OPT_EXT_LEN, &opt);
+    APP_ERROR_CHECK(err_code);
+#endif
+
 #else // softdevice s110 and possibly others
 
     // Initialize the SoftDevice handler module.
@@ -503,6 +1552,17 @@ void __attribute__((weak)) conn_params_init(void) {
 void __attribute__((weak)) services_init (void) {
 }
 
+// Without a store, bonds only last as long as they stay in the RAM cache.
+//  simple_ble_bonds_fds.c keeps them in flash.
+uint32_t __attribute__((weak)) simple_ble_bond_store (const simple_ble_bond_t* p_bond) {
+    return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t __attribute__((weak)) simple_ble_bond_load (const ble_gap_master_id_t* p_master_id,
+                                                     simple_ble_bond_t* p_bond) {
+    return NRF_ERROR_NOT_FOUND;
+}
+
 #ifdef ENABLE_DFU
 void __attribute__((weak)) dfu_init (void) {
 
@@ -554,7 +1614,10 @@ void __attribute__((weak)) initialize_app_timer (void) {
  ******************************************************************************/
 void __attribute__((weak)) advertising_start(void) {
     uint32_t err_code = sd_ble_gap_adv_start(&m_adv_params);
-#ifdef SOFTDEVICE_s130
+    if (err_code == NRF_SUCCESS) {
+        adv_running = true;
+    }
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
     if (err_code == NRF_ERROR_CONN_COUNT) {
         // ignore Connection Count problems. Connectable advertising seems to work just fine
         return;
@@ -568,6 +1631,7 @@ void __attribute__((weak)) advertising_start(void) {
 
 void __attribute__((weak)) advertising_stop(void) {
     uint32_t err_code = sd_ble_gap_adv_stop();
+    adv_running = false;
     if (err_code != NRF_ERROR_INVALID_STATE) {
         // ignore Invalid State responses. Occurs when stop is called although
         //  advertising is not running
@@ -587,8 +1651,19 @@ void __attribute__((weak)) power_manage(void) {
 simple_ble_app_t* simple_ble_init(const simple_ble_config_t* conf) {
     ble_config = conf;
 
+#if SIMPLE_BLE_CHAR_HANDLERS > 0
+    // the SoftDevice starts a new attribute table
+    char_handler_count = 0;
+    memset(char_handler_index, 0, sizeof(char_handler_index));
+#endif
+    shadow_reset();
+
     // Setup BLE and services
     ble_stack_init();
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+    uint32_t err_code = nrf_ble_gatt_init(&gatt, on_gatt_evt);
+    APP_ERROR_CHECK(err_code);
+#endif
     gap_params_init();
     advertising_init();
     services_init();
@@ -606,9 +1681,19 @@ simple_ble_app_t* simple_ble_init(const simple_ble_config_t* conf) {
     // APP_TIMER_INIT must be called before conn_params_init since it uses timers
     initialize_app_timer();
     conn_params_init();
+    conn_policy_init();
+    bond_init();
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+    scan_adapt_init();
+    scan_dedup_init();
+#endif
 
     // initialize our connection state to "not in a connection"
     app.conn_handle = BLE_CONN_HANDLE_INVALID;
+    app.link_count = 0;
+    for (uint8_t i = 0; i < SIMPLE_BLE_MAX_LINKS; i++) {
+        app.links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
 
     // Return a reference to the application state so that the user of this
     // module has a pointer to the connection handle.
@@ -683,6 +1768,11 @@ void simple_ble_add_characteristic (uint8_t read,
     err_code = sd_ble_gatts_characteristic_add((service_handle->service_handle),
             &char_md, &attr_char_value, &(char_handle->char_handle));
     APP_ERROR_CHECK(err_code);
+
+    char_handler_add(char_handle);
+    if (vlen) {
+        shadow_add(char_handle, vlen, len, NULL, false);
+    }
 }
 
 uint32_t simple_ble_update_char_len (simple_ble_char_t* char_handle, uint16_t len) {
@@ -693,19 +1783,111 @@ uint32_t simple_ble_update_char_len (simple_ble_char_t* char_handle, uint16_t le
     value_config.offset = 0;
     value_config.p_value = NULL;
 
+    if (shadow_len_unchanged(char_handle->char_handle.value_handle, len)) {
+        return NRF_SUCCESS;
+    }
+
     // Update length for vlen variable stored in user-space (VLOC_USER)
     err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, char_handle->char_handle.value_handle, &value_config);
+    if (err_code == NRF_SUCCESS) {
+        shadow_len_done(char_handle->char_handle.value_handle, len);
+    }
     // since this isn't a configuration-time call, actually return the error
     //  code to the user for handling rather than checking it ourselves and
     //  possibly crashing the app
     return err_code;
 }
 
-uint32_t simple_ble_notify_char (simple_ble_char_t* char_handle) {
+// Count what the SoftDevice did with a notification
+static uint32_t notify_result (uint32_t err_code) {
+    if (err_code == NRF_SUCCESS) {
+        notify_stats.sent++;
+    } else if (err_code == NRF_ERROR_INVALID_STATE) {
+        // error means notify is not enabled by the client. IGNORE
+        err_code = NRF_SUCCESS;
+    } else if (err_code != BLE_ERROR_NO_TX_BUFFERS) {
+        notify_stats.failed++;
+    }
+    return err_code;
+}
+
+#if SIMPLE_BLE_NOTIFY_QUEUE_LEN > 0
+// Hand a link's queued notifications to the SoftDevice until it runs out of
+// buffers for that link
+static void notify_queue_drain (uint8_t index) {
+    notify_queue_t* queue = &notify_queues[index];
+
+    CRITICAL_REGION_ENTER();
+    while (queue->count > 0) {
+        ble_gatts_hvx_params_t hvx_params;
+        hvx_params.handle = queue->handles[queue->head];
+        hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+        hvx_params.offset = 0;
+        hvx_params.p_len = NULL;
+        // the current value, p_data would overwrite it for every link
+        hvx_params.p_data = NULL;
+
+        if (notify_result(sd_ble_gatts_hvx(app.links[index].conn_handle, &hvx_params)) ==
+                BLE_ERROR_NO_TX_BUFFERS) {
+            // try again on the next BLE_EVT_TX_COMPLETE
+            break;
+        }
+        queue->head = (queue->head + 1) % SIMPLE_BLE_NOTIFY_QUEUE_LEN;
+        queue->count--;
+        notify_stats.queued--;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+static void notify_queue_clear (uint8_t index) {
+    notify_queue_t* queue = &notify_queues[index];
+
+    CRITICAL_REGION_ENTER();
+    notify_stats.failed += queue->count;
+    notify_stats.queued -= queue->count;
+    queue->count = 0;
+    CRITICAL_REGION_EXIT();
+}
+
+// Put the characteristic at the back of the link's queue, unless it is
+// waiting already and will send the new value anyway
+static uint32_t notify_queue_add (uint8_t index, uint16_t handle) {
+    notify_queue_t* queue = &notify_queues[index];
+    uint8_t i;
+
+    for (i = 0; i < queue->count; i++) {
+        if (queue->handles[(queue->head + i) % SIMPLE_BLE_NOTIFY_QUEUE_LEN] == handle) {
+            notify_stats.coalesced++;
+            return NRF_SUCCESS;
+        }
+    }
+    if (queue->count == SIMPLE_BLE_NOTIFY_QUEUE_LEN) {
+        notify_stats.dropped++;
+        return NRF_ERROR_NO_MEM;
+    }
+
+    queue->handles[(queue->head + queue->count) % SIMPLE_BLE_NOTIFY_QUEUE_LEN] = handle;
+    queue->count++;
+    notify_stats.queued++;
+    if (notify_stats.queued > notify_stats.high_water) {
+        notify_stats.high_water = notify_stats.queued;
+    }
+    return NRF_SUCCESS;
+}
+#else
+static void notify_queue_drain (uint8_t index) {
+}
+
+static void notify_queue_clear (uint8_t index) {
+}
+#endif
+
+uint32_t simple_ble_notify_char_link (uint16_t conn_handle, simple_ble_char_t* char_handle) {
     volatile uint32_t err_code;
+    uint8_t index = link_index(conn_handle);
 
-    // can't notify if we aren't in a connection
-    if (app.conn_handle == BLE_CONN_HANDLE_INVALID) {
+    // can't notify if we aren't in that connection
+    if (conn_handle == BLE_CONN_HANDLE_INVALID || index == SIMPLE_BLE_MAX_LINKS) {
         // not an error though
         return NRF_SUCCESS;
     }
@@ -717,18 +1899,127 @@ uint32_t simple_ble_notify_char (simple_ble_char_t* char_handle) {
     hvx_params.p_len = NULL; // notify full length. No response wanted
     hvx_params.p_data = NULL; // use existing value
 
-    err_code = sd_ble_gatts_hvx(app.conn_handle, &hvx_params);
-    if (err_code == NRF_ERROR_INVALID_STATE) {
-        // error means notify is not enabled by the client. IGNORE
+    if (shadow_notify_unchanged(index, hvx_params.handle)) {
+        // the peer has this value already
         return NRF_SUCCESS;
     }
 
+#if SIMPLE_BLE_NOTIFY_QUEUE_LEN > 0
+    CRITICAL_REGION_ENTER();
+    if (notify_queues[index].count > 0) {
+        // keep the order, this goes out after the ones already waiting
+        err_code = notify_queue_add(index, hvx_params.handle);
+    } else {
+        err_code = notify_result(sd_ble_gatts_hvx(conn_handle, &hvx_params));
+        if (err_code == BLE_ERROR_NO_TX_BUFFERS) {
+            // the SoftDevice is full, wait for BLE_EVT_TX_COMPLETE
+            err_code = notify_queue_add(index, hvx_params.handle);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+    if (notify_queues[index].count > 0) {
+        conn_policy_backlog(conn_handle);
+    }
+#else
+    err_code = notify_result(sd_ble_gatts_hvx(conn_handle, &hvx_params));
+#endif
+    if (err_code == NRF_SUCCESS) {
+        conn_policy_traffic(conn_handle);
+        shadow_notified(index, hvx_params.handle);
+    }
+
     // since this isn't a configuration-time call, actually return the error
     //  code to the user for handling rather than checking it ourselves and
     //  possibly crashing the app
     return err_code;
 }
 
+uint32_t simple_ble_notify_char_all (simple_ble_char_t* char_handle) {
+    uint32_t err_code = NRF_SUCCESS;
+    uint32_t link_err;
+    uint8_t i;
+
+    // every link gets its try, the first error is the one reported
+    for (i = 0; i < SIMPLE_BLE_MAX_LINKS; i++) {
+        if (app.links[i].conn_handle == BLE_CONN_HANDLE_INVALID) {
+            continue;
+        }
+        link_err = simple_ble_notify_char_link(app.links[i].conn_handle, char_handle);
+        if (err_code == NRF_SUCCESS) {
+            err_code = link_err;
+        }
+    }
+    return err_code;
+}
+
+uint32_t simple_ble_notify_char (simple_ble_char_t* char_handle) {
+    return simple_ble_notify_char_all(char_handle);
+}
+
+simple_ble_link_t* simple_ble_get_link (uint16_t conn_handle) {
+    uint8_t index = link_index(conn_handle);
+
+    if (conn_handle == BLE_CONN_HANDLE_INVALID || index == SIMPLE_BLE_MAX_LINKS) {
+        return NULL;
+    }
+    return &app.links[index];
+}
+
+uint16_t simple_ble_get_max_payload (uint16_t conn_handle) {
+    simple_ble_link_t* link = simple_ble_get_link(conn_handle);
+
+    if (link == NULL) {
+        return 0;
+    }
+    return link->att_mtu - 3;
+}
+
+void simple_ble_get_notify_stats (simple_ble_notify_stats_t* p_stats) {
+    CRITICAL_REGION_ENTER();
+    *p_stats = notify_stats;
+    CRITICAL_REGION_EXIT();
+}
+
+void simple_ble_conn_policy_bulk (void) {
+#if SIMPLE_BLE_CONN_POLICY
+    CRITICAL_REGION_ENTER();
+    conn_policy.bulk = true;
+    conn_policy.quiet_ticks = 0;
+    conn_policy_request(CONN_PHASE_BULK);
+    CRITICAL_REGION_EXIT();
+#endif
+}
+
+void simple_ble_get_conn_policy_stats (simple_ble_conn_policy_stats_t* p_stats) {
+#if SIMPLE_BLE_CONN_POLICY
+    CRITICAL_REGION_ENTER();
+    *p_stats = conn_policy_stats;
+    CRITICAL_REGION_EXIT();
+#else
+    memset(p_stats, 0, sizeof(*p_stats));
+#endif
+}
+
+void simple_ble_get_bond_stats (simple_ble_bond_stats_t* p_stats) {
+#if SIMPLE_BLE_BOND_CACHE > 0
+    CRITICAL_REGION_ENTER();
+    *p_stats = bond_stats;
+    CRITICAL_REGION_EXIT();
+#else
+    memset(p_stats, 0, sizeof(*p_stats));
+#endif
+}
+
+void simple_ble_get_shadow_stats (simple_ble_shadow_stats_t* p_stats) {
+#if SIMPLE_BLE_SHADOW_CHARS > 0
+    CRITICAL_REGION_ENTER();
+    *p_stats = shadow_stats;
+    CRITICAL_REGION_EXIT();
+#else
+    memset(p_stats, 0, sizeof(*p_stats));
+#endif
+}
+
 bool simple_ble_is_char_event (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
     ble_gatts_evt_write_t* p_evt_write = &(p_ble_evt->evt.gatts_evt.params.write);
 
@@ -787,6 +2078,11 @@ void simple_ble_add_auth_characteristic (uint8_t read,
     err_code = sd_ble_gatts_characteristic_add((service_handle->service_handle),
             &char_md, &attr_char_value, &(char_handle->char_handle));
     APP_ERROR_CHECK(err_code);
+
+    char_handler_add(char_handle);
+    if (vlen) {
+        shadow_add(char_handle, vlen, len, NULL, false);
+    }
 }
 
 bool simple_ble_is_read_auth_event (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
@@ -843,7 +2139,7 @@ uint32_t simple_ble_grant_auth (ble_evt_t* p_ble_evt) {
 
     // since this isn't configuration, return any possible errors to the user
     //  rather than app error checking
-    return sd_ble_gatts_rw_authorize_reply(app.conn_handle, &auth_resp);
+    return sd_ble_gatts_rw_authorize_reply(p_ble_evt->evt.gatts_evt.conn_handle, &auth_resp);
 }
 
 void simple_ble_add_stack_characteristic (uint8_t read,
@@ -896,6 +2192,9 @@ void simple_ble_add_stack_characteristic (uint8_t read,
     err_code = sd_ble_gatts_characteristic_add((service_handle->service_handle),
             &char_md, &attr_char_value, &(char_handle->char_handle));
     APP_ERROR_CHECK(err_code);
+
+    char_handler_add(char_handle);
+    shadow_add(char_handle, vlen, len, buf, true);
 }
 
 // assuming that the buffer sent in there will be long enough
@@ -905,8 +2204,16 @@ uint32_t simple_ble_stack_char_get (simple_ble_char_t* char_handle, uint16_t* le
         .offset = 0,
         .p_value = buf,
     };
+    uint32_t err_code;
 
-    return sd_ble_gatts_value_get(app.conn_handle, char_handle->char_handle.value_handle, &value);
+    CRITICAL_REGION_ENTER();
+    if (shadow_get(app.conn_handle, char_handle->char_handle.value_handle, &value.len, buf)) {
+        err_code = NRF_SUCCESS;
+    } else {
+        err_code = sd_ble_gatts_value_get(app.conn_handle, char_handle->char_handle.value_handle, &value);
+    }
+    CRITICAL_REGION_EXIT();
+    return err_code;
 }
 
 uint32_t simple_ble_stack_char_set (simple_ble_char_t* char_handle, uint16_t len, uint8_t* buf) {
@@ -915,44 +2222,497 @@ uint32_t simple_ble_stack_char_set (simple_ble_char_t* char_handle, uint16_t len
         .offset = 0,
         .p_value = buf,
     };
-    return sd_ble_gatts_value_set(app.conn_handle, char_handle->char_handle.value_handle, &value);
+    uint32_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    if (!shadow_set_unchanged(char_handle->char_handle.value_handle, len, buf)) {
+        err_code = sd_ble_gatts_value_set(app.conn_handle, char_handle->char_handle.value_handle, &value);
+        if (err_code == NRF_SUCCESS) {
+            shadow_set_done(char_handle->char_handle.value_handle, len, buf);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+    return err_code;
 }
 
-#ifdef SOFTDEVICE_s130
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
 static const ble_gap_scan_params_t m_scan_param = {
     .active = 0,                   // Active scanning not set.
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3)
+    .use_whitelist = 0,            // No whitelist.
+#else
     .selective = 0,                // Selective scanning not set.
     .p_whitelist = NULL,           // No whitelist provided.
+#endif
     .interval = 0x00A0,
     .window = 0x0050,
     .timeout = 0x0000              // No timeout.
 };
 
+// Scan duty cycle that follows how much there is to discover. An address
+//  new to the scan report cache starts a burst of
+//  SIMPLE_BLE_SCAN_ADAPT_BURST_TICKS with the window as long as the
+//  interval, or SIMPLE_BLE_SCAN_ADAPT_ADV_DUTY of it while simple_ble
+//  advertises, so its own advertising events still get the radio. The scan
+//  then goes back to m_scan_param. Every SIMPLE_BLE_SCAN_ADAPT_QUIET_TICKS
+//  with no new address it backs off: to one window of
+//  SIMPLE_BLE_SCAN_ADAPT_QUIET_WINDOW_MS, which hears every advertiser at
+//  most that slow, every other window, then every fourth and so on up to
+//  SIMPLE_BLE_SCAN_ADAPT_MAX_INTERVAL_MS. Short windows spread thin would
+//  lock onto the phase of advertisers whose interval is a multiple of the
+//  scan's, and miss them for minutes.
+#if SIMPLE_BLE_SCAN_ADAPT
+#if SIMPLE_BLE_SCAN_DEDUP == 0
+#error "SIMPLE_BLE_SCAN_ADAPT finds new addresses with the SIMPLE_BLE_SCAN_DEDUP cache"
+#endif
+
+#define SCAN_ADAPT_BURST        0
+#define SCAN_ADAPT_NORMAL       1
+#define SCAN_ADAPT_MAX_INTERVAL MIN(MSEC_TO_UNITS(SIMPLE_BLE_SCAN_ADAPT_MAX_INTERVAL_MS, UNIT_0_625_MS), BLE_GAP_SCAN_INTERVAL_MAX)
+#define SCAN_ADAPT_QUIET_WINDOW MIN(MSEC_TO_UNITS(SIMPLE_BLE_SCAN_ADAPT_QUIET_WINDOW_MS, UNIT_0_625_MS), SCAN_ADAPT_MAX_INTERVAL)
+
+APP_TIMER_DEF(scan_adapt_timer);
+
+static ble_gap_scan_params_t scan_adapt_param;
+static struct {
+    bool     scanning;      // simple_ble_scan_start was called
+    uint8_t  level;         // SCAN_ADAPT_BURST, or backed off level - SCAN_ADAPT_NORMAL times
+    uint8_t  ticks;         // left in a burst, or quiet so far
+} scan_adapt;
+static simple_ble_scan_adapt_stats_t scan_adapt_stats = {0};
+
+static void scan_adapt_set (uint8_t level) {
+    uint32_t interval = m_scan_param.interval;
+    uint32_t err_code;
+
+    scan_adapt.level = level;
+    scan_adapt.ticks = 0;
+    scan_adapt_param = m_scan_param;
+    if (level == SCAN_ADAPT_BURST) {
+        scan_adapt.ticks = SIMPLE_BLE_SCAN_ADAPT_BURST_TICKS;
+        scan_adapt_param.window = adv_running ?
+            interval * SIMPLE_BLE_SCAN_ADAPT_ADV_DUTY / 100 : interval;
+    } else if (level > SCAN_ADAPT_NORMAL) {
+        interval = (uint32_t) SCAN_ADAPT_QUIET_WINDOW << (level - SCAN_ADAPT_NORMAL);
+        scan_adapt_param.window = SCAN_ADAPT_QUIET_WINDOW;
+        scan_adapt_param.interval = MIN(interval, SCAN_ADAPT_MAX_INTERVAL);
+    }
+    scan_adapt_stats.interval = scan_adapt_param.interval;
+    scan_adapt_stats.window = scan_adapt_param.window;
+    scan_adapt_stats.changes++;
+
+    if (scan_adapt.scanning) {
+        sd_ble_gap_scan_stop();
+        err_code = sd_ble_gap_scan_start(&scan_adapt_param);
+        if (err_code != NRF_ERROR_INVALID_STATE) {
+            APP_ERROR_CHECK(err_code);
+        }
+    }
+}
+
+static void scan_adapt_tick (void* p_context) {
+    scan_adapt_stats.scan_ms += SIMPLE_BLE_SCAN_ADAPT_TICK_MS * scan_adapt_param.window / scan_adapt_param.interval;
+
+    if (scan_adapt.level == SCAN_ADAPT_BURST) {
+        if (--scan_adapt.ticks == 0) {
+            scan_adapt_set(SCAN_ADAPT_NORMAL);
+        }
+    } else if (++scan_adapt.ticks >= SIMPLE_BLE_SCAN_ADAPT_QUIET_TICKS) {
+        scan_adapt.ticks = SIMPLE_BLE_SCAN_ADAPT_QUIET_TICKS;
+        if (scan_adapt_param.interval < SCAN_ADAPT_MAX_INTERVAL) {
+            scan_adapt_stats.backoffs++;
+            scan_adapt_set(scan_adapt.level + 1);
+        }
+    }
+}
+
+static void scan_adapt_init (void) {
+    uint32_t err_code;
+
+    memset(&scan_adapt, 0, sizeof(scan_adapt));
+    scan_adapt_param = m_scan_param;
+    err_code = app_timer_create(&scan_adapt_timer, APP_TIMER_MODE_REPEATED, scan_adapt_tick);
+    APP_ERROR_CHECK(err_code);
+}
+
+// A scan starts with a burst, to find what is around
+static void scan_adapt_start (void) {
+    uint32_t err_code;
+
+    scan_adapt_stop();
+    scan_adapt_stats.bursts++;
+    scan_adapt_set(SCAN_ADAPT_BURST);
+    scan_adapt.scanning = true;
+    err_code = app_timer_start(scan_adapt_timer,
+            APP_TIMER_TICKS(SIMPLE_BLE_SCAN_ADAPT_TICK_MS, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+// The SoftDevice or the app stopped the scan, so nothing is left to adapt
+static void scan_adapt_stop (void) {
+    uint32_t err_code;
+
+    scan_adapt.scanning = false;
+    err_code = app_timer_stop(scan_adapt_timer);
+    APP_ERROR_CHECK(err_code);
+}
+
+static const ble_gap_scan_params_t* scan_adapt_params (void) {
+    return &scan_adapt_param;
+}
+
+// The scan report cache heard an address it didn't have
+static void scan_adapt_discovered (void) {
+    if (!scan_adapt.scanning) {
+        return;
+    }
+    if (scan_adapt.level == SCAN_ADAPT_BURST) {
+        scan_adapt.ticks = SIMPLE_BLE_SCAN_ADAPT_BURST_TICKS;
+    } else {
+        scan_adapt_stats.bursts++;
+        scan_adapt_set(SCAN_ADAPT_BURST);
+    }
+}
+
+void simple_ble_get_scan_adapt_stats (simple_ble_scan_adapt_stats_t* p_stats) {
+    CRITICAL_REGION_ENTER();
+    *p_stats = scan_adapt_stats;
+    CRITICAL_REGION_EXIT();
+}
+#else
+static void scan_adapt_init (void) {
+}
+
+static void scan_adapt_start (void) {
+}
+
+static void scan_adapt_stop (void) {
+}
+
+static const ble_gap_scan_params_t* scan_adapt_params (void) {
+    return &m_scan_param;
+}
+
+#if SIMPLE_BLE_SCAN_DEDUP > 0
+static void scan_adapt_discovered (void) {
+}
+#endif
+
+void simple_ble_get_scan_adapt_stats (simple_ble_scan_adapt_stats_t* p_stats) {
+    memset(p_stats, 0, sizeof(*p_stats));
+}
+#endif
+
 void simple_ble_scan_start () {
     ret_code_t err_code;
 
     err_code = sd_ble_gap_scan_stop();
 
-    err_code = sd_ble_gap_scan_start(&m_scan_param);
+    scan_adapt_start();
+    err_code = sd_ble_gap_scan_start(scan_adapt_params());
     // It is okay to ignore this error since we are stopping the scan anyway.
     if (err_code != NRF_ERROR_INVALID_STATE) {
         APP_ERROR_CHECK(err_code);
     }
 }
 
+void simple_ble_scan_stop () {
+    ret_code_t err_code;
+
+    scan_adapt_stop();
+    err_code = sd_ble_gap_scan_stop();
+    // The scan may have already stopped on its own
+    if (err_code != NRF_ERROR_INVALID_STATE) {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+uint8_t simple_ble_adv_index (const uint8_t* p_data, uint8_t dlen, simple_ble_adv_index_t* p_index) {
+    simple_ble_adv_field_t* p_field = p_index->fields;
+    uint8_t count = 0;
+    bool malformed = false;
+    uint8_t i = 0;
+    uint8_t len;
+
+    // kept in locals, the stores to the index could alias the report
+    while (dlen - i >= 2) {
+        len = p_data[i];
+        if (len == 0) {
+            // early end of the significant part, the rest is padding
+            break;
+        }
+        if (len > dlen - i - 1) {
+            // runs past the end of the report
+            malformed = true;
+            break;
+        }
+        if (count < SIMPLE_BLE_ADV_INDEX_FIELDS) {
+            p_field->type = p_data[i + 1];
+            p_field->offset = i + 2;
+            p_field->len = len - 1;
+            p_field++;
+            count++;
+        }
+        i += len + 1;
+    }
+    if (dlen - i == 1 && p_data[i] != 0) {
+        // a length with no type after it
+        malformed = true;
+    }
+
+    p_index->p_data = p_data;
+    p_index->count = count;
+    p_index->malformed = malformed;
+    return count;
+}
+
+const uint8_t* simple_ble_adv_find (const simple_ble_adv_index_t* p_index, uint8_t type, uint8_t* p_len) {
+    uint8_t i;
+
+    for (i = 0; i < p_index->count; i++) {
+        if (p_index->fields[i].type == type) {
+            *p_len = p_index->fields[i].len;
+            return p_index->p_data + p_index->fields[i].offset;
+        }
+    }
+    *p_len = 0;
+    return NULL;
+}
+
+// Advertisements heard lately. An address hashes to a set of
+//  SIMPLE_BLE_SCAN_DEDUP_WAYS entries next to each other, which hold its
+//  payloads (advertising and scan response, or the frames of a beacon that
+//  rotates) and other addresses that hash there. A report with a payload
+//  the set has for its address is dropped, unless the entry is due to be
+//  passed on again. Otherwise it takes a free entry, or the one heard
+//  longest ago, which is where an old payload ends up.
+// Time is counted in steps of a quarter of SIMPLE_BLE_SCAN_DEDUP_AGE_MS by
+//  a timer, since the RTC under app_timer stops when no timer runs. The
+//  timer starts with the first report and stops after a step without any,
+//  so it doesn't wake the chip while nothing is scanning. How long it was
+//  stopped isn't known, so when it starts again everything heard before is
+//  counted as due to be passed on again.
+#if SIMPLE_BLE_SCAN_DEDUP > 0
+#if (SIMPLE_BLE_SCAN_DEDUP & (SIMPLE_BLE_SCAN_DEDUP - 1)) != 0 || SIMPLE_BLE_SCAN_DEDUP < SIMPLE_BLE_SCAN_DEDUP_WAYS
+#error "SIMPLE_BLE_SCAN_DEDUP has to be a power of two, at least SIMPLE_BLE_SCAN_DEDUP_WAYS"
+#endif
+
+#define SCAN_DEDUP_SETS (SIMPLE_BLE_SCAN_DEDUP / SIMPLE_BLE_SCAN_DEDUP_WAYS)
+#define SCAN_DEDUP_AGE_STEPS 4
+
+typedef struct {
+    uint32_t hash;          // of the payload and whether it is a scan response
+    uint8_t  addr[BLE_GAP_ADDR_LEN];
+    uint8_t  addr_type;
+    int8_t   rssi_max;
+    int16_t  rssi;          // smoothed, in 1/16 dBm
+    uint16_t reports;       // 0 for a free entry
+    uint16_t passed;        // scan_dedup_step it last went to the app at
+    uint16_t heard;         // and it was last reported at
+} scan_dedup_entry_t;
+
+APP_TIMER_DEF(scan_dedup_timer);
+
+static scan_dedup_entry_t scan_dedup[SIMPLE_BLE_SCAN_DEDUP];
+static uint16_t scan_dedup_step = 0;
+static bool scan_dedup_running = false;
+static bool scan_dedup_reported = false;    // in this step
+static simple_ble_scan_dedup_stats_t scan_dedup_stats = {0};
+
+static void scan_dedup_tick (void* p_context) {
+    scan_dedup_step++;
+    if (!scan_dedup_reported) {
+        app_timer_stop(scan_dedup_timer);
+        scan_dedup_running = false;
+    }
+    scan_dedup_reported = false;
+}
+
+static void scan_dedup_init (void) {
+    uint32_t err_code;
+
+    err_code = app_timer_create(&scan_dedup_timer, APP_TIMER_MODE_REPEATED, scan_dedup_tick);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void scan_dedup_start (void) {
+    uint32_t err_code;
+
+    scan_dedup_reported = true;
+    if (scan_dedup_running) {
+        return;
+    }
+    err_code = app_timer_start(scan_dedup_timer,
+            APP_TIMER_TICKS(SIMPLE_BLE_SCAN_DEDUP_AGE_MS / SCAN_DEDUP_AGE_STEPS, APP_TIMER_PRESCALER), NULL);
+    if (err_code == NRF_SUCCESS) {
+        scan_dedup_running = true;
+        scan_dedup_step += SCAN_DEDUP_AGE_STEPS;
+    }
+}
+
+// FNV-1a
+static uint32_t scan_dedup_hash (uint32_t hash, const uint8_t* p_data, uint8_t len) {
+    uint8_t i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ p_data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static scan_dedup_entry_t* scan_dedup_set (const ble_gap_addr_t* p_addr) {
+    uint32_t hash = scan_dedup_hash(2166136261u, p_addr->addr, BLE_GAP_ADDR_LEN);
+
+    hash = (hash ^ p_addr->addr_type) * 16777619u;
+    return &scan_dedup[((hash ^ (hash >> 16)) & (SCAN_DEDUP_SETS - 1)) * SIMPLE_BLE_SCAN_DEDUP_WAYS];
+}
+
+static uint32_t scan_dedup_payload (const ble_gap_evt_adv_report_t* p_report) {
+    return scan_dedup_hash(2166136261u ^ p_report->scan_rsp, p_report->data, p_report->dlen);
+}
+
+static scan_dedup_entry_t* scan_dedup_find (scan_dedup_entry_t* p_set,
+        const ble_gap_addr_t* p_addr, uint32_t hash) {
+    uint8_t i;
+
+    for (i = 0; i < SIMPLE_BLE_SCAN_DEDUP_WAYS; i++) {
+        if (p_set[i].reports != 0 && p_set[i].hash == hash &&
+                p_set[i].addr_type == p_addr->addr_type &&
+                memcmp(p_set[i].addr, p_addr->addr, BLE_GAP_ADDR_LEN) == 0) {
+            return &p_set[i];
+        }
+    }
+    return NULL;
+}
+
+// True if the report should go on to the app
+static bool scan_dedup_check (const ble_evt_t * p_ble_evt) {
+    const ble_gap_evt_adv_report_t* p_report = &p_ble_evt->evt.gap_evt.params.adv_report;
+    scan_dedup_entry_t* p_set = scan_dedup_set(&p_report->peer_addr);
+    uint32_t hash = scan_dedup_payload(p_report);
+    scan_dedup_entry_t* entry;
+    uint16_t age, oldest = 0;
+    bool known;
+    uint8_t i;
+
+    scan_dedup_start();
+    scan_dedup_stats.reports++;
+    entry = scan_dedup_find(p_set, &p_report->peer_addr, hash);
+    if (entry != NULL) {
+        if (entry->reports < UINT16_MAX) {
+            entry->reports++;
+        }
+        entry->heard = scan_dedup_step;
+        entry->rssi += (p_report->rssi * 16 - entry->rssi) / 8;
+        if (p_report->rssi > entry->rssi_max) {
+            entry->rssi_max = p_report->rssi;
+        }
+        if ((uint16_t) (scan_dedup_step - entry->passed) < SCAN_DEDUP_AGE_STEPS) {
+            scan_dedup_stats.hits++;
+            return false;
+        }
+        entry->passed = scan_dedup_step;
+        scan_dedup_stats.aged++;
+        return true;
+    }
+
+    entry = &p_set[0];
+    known = false;
+    for (i = 0; i < SIMPLE_BLE_SCAN_DEDUP_WAYS; i++) {
+        if (p_set[i].reports != 0 && p_set[i].addr_type == p_report->peer_addr.addr_type &&
+                memcmp(p_set[i].addr, p_report->peer_addr.addr, BLE_GAP_ADDR_LEN) == 0) {
+            known = true;
+        }
+    }
+    if (!known) {
+        scan_adapt_discovered();
+    }
+    for (i = 0; i < SIMPLE_BLE_SCAN_DEDUP_WAYS; i++) {
+        if (p_set[i].reports == 0) {
+            entry = &p_set[i];
+            break;
+        }
+        age = scan_dedup_step - p_set[i].heard;
+        if (age >= oldest) {
+            entry = &p_set[i];
+            oldest = age;
+        }
+    }
+    if (entry->reports != 0 && oldest <= 1) {
+        scan_dedup_stats.evictions++;
+    }
+    entry->hash = hash;
+    entry->passed = scan_dedup_step;
+    entry->heard = scan_dedup_step;
+    memcpy(entry->addr, p_report->peer_addr.addr, BLE_GAP_ADDR_LEN);
+    entry->addr_type = p_report->peer_addr.addr_type;
+    entry->rssi_max = p_report->rssi;
+    entry->rssi = p_report->rssi * 16;
+    entry->reports = 1;
+    scan_dedup_stats.misses++;
+    return true;
+}
+
+bool simple_ble_scan_dedup_rssi (const ble_evt_t* p_ble_evt, simple_ble_scan_rssi_t* p_rssi) {
+    const ble_gap_evt_adv_report_t* p_report = &p_ble_evt->evt.gap_evt.params.adv_report;
+    scan_dedup_entry_t* entry;
+    bool found = false;
+
+    CRITICAL_REGION_ENTER();
+    entry = scan_dedup_find(scan_dedup_set(&p_report->peer_addr),
+                            &p_report->peer_addr, scan_dedup_payload(p_report));
+    if (entry != NULL) {
+        p_rssi->reports = entry->reports;
+        p_rssi->rssi = (entry->rssi - 8) / 16;
+        p_rssi->rssi_max = entry->rssi_max;
+        found = true;
+    }
+    CRITICAL_REGION_EXIT();
+    return found;
+}
+
+void simple_ble_scan_dedup_clear (void) {
+    CRITICAL_REGION_ENTER();
+    memset(scan_dedup, 0, sizeof(scan_dedup));
+    CRITICAL_REGION_EXIT();
+}
+
+void simple_ble_get_scan_dedup_stats (simple_ble_scan_dedup_stats_t* p_stats) {
+    CRITICAL_REGION_ENTER();
+    *p_stats = scan_dedup_stats;
+    CRITICAL_REGION_EXIT();
+}
+#else
+static void scan_dedup_init (void) {
+}
+
+static bool scan_dedup_check (const ble_evt_t * p_ble_evt) {
+    return true;
+}
+
+bool simple_ble_scan_dedup_rssi (const ble_evt_t* p_ble_evt, simple_ble_scan_rssi_t* p_rssi) {
+    return false;
+}
+
+void simple_ble_scan_dedup_clear (void) {
+}
+
+void simple_ble_get_scan_dedup_stats (simple_ble_scan_dedup_stats_t* p_stats) {
+    memset(p_stats, 0, sizeof(*p_stats));
+}
+#endif
+
 int parse_adata(ble_evt_t * p_ble_evt, uint8_t type, uint8_t * data) {
-  unsigned int i = 0;
-  uint8_t * payload = p_ble_evt->evt.gap_evt.params.adv_report.data;
-  while (i < p_ble_evt->evt.gap_evt.params.adv_report.dlen) {
-    unsigned int dlen = payload[i];
-    if (payload[i+1] != type) {
-      i += dlen+1;
-      continue;
-    }
-    memcpy(data, payload+i+2, dlen-1);
-    return dlen-1;
-  }
-
-  return 0;
+    simple_ble_adv_index_t index;
+    const uint8_t* p_field;
+    uint8_t len;
+
+    simple_ble_adv_index(p_ble_evt->evt.gap_evt.params.adv_report.data,
+                         p_ble_evt->evt.gap_evt.params.adv_report.dlen, &index);
+    p_field = simple_ble_adv_find(&index, type, &len);
+    if (p_field != NULL) {
+        memcpy(data, p_field, len);
+    }
+    return len;
 }
 #endif
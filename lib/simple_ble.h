@@ -6,11 +6,44 @@
 
 #include "ble.h"
 
+// Characteristics that can have a handler, and the highest attribute handle
+// one can be found at. The lookup table takes a byte per handle.
+#ifndef SIMPLE_BLE_CHAR_HANDLERS
+#define SIMPLE_BLE_CHAR_HANDLERS 16
+#endif
+#ifndef SIMPLE_BLE_MAX_ATTR_HANDLE
+#define SIMPLE_BLE_MAX_ATTR_HANDLE 96
+#endif
+
+// Connections that can be up at once, as the SoftDevice is configured
+#ifndef SIMPLE_BLE_MAX_LINKS
+#if (PERIPHERAL_LINK_COUNT + CENTRAL_LINK_COUNT) > 1
+#define SIMPLE_BLE_MAX_LINKS (PERIPHERAL_LINK_COUNT + CENTRAL_LINK_COUNT)
+#else
+#define SIMPLE_BLE_MAX_LINKS 1
+#endif
+#endif
+
+// Fields of an advertising report simple_ble_adv_index keeps. A legacy
+// report is 31 bytes, so no more than 15 can be in it.
+#ifndef SIMPLE_BLE_ADV_INDEX_FIELDS
+#define SIMPLE_BLE_ADV_INDEX_FIELDS 8
+#endif
+
 /*******************************************************************************
  *   TYPE DEFINITIONS
  ******************************************************************************/
+typedef struct simple_ble_link_s {
+    uint16_t        conn_handle;    // BLE_CONN_HANDLE_INVALID if this entry is free
+    uint8_t         role;           // BLE_GAP_ROLE_PERIPH if the peer connected to us, BLE_GAP_ROLE_CENTRAL if we connected to it
+    ble_gap_addr_t  peer_addr;
+    uint16_t        att_mtu;        // GATT_MTU_SIZE_DEFAULT until an MTU exchange raises it
+} simple_ble_link_t;
+
 typedef struct simple_ble_app_s {
-    uint16_t    conn_handle; // Handle of the current connection. This will be BLE_CONN_HANDLE_INVALID when not in a connection.
+    uint16_t    conn_handle; // Handle of the most recent connection still up. This will be BLE_CONN_HANDLE_INVALID when not in a connection.
+    uint8_t     link_count;  // Connections up, they are the entries of links with a valid conn_handle
+    simple_ble_link_t links[SIMPLE_BLE_MAX_LINKS];
 } simple_ble_app_t;
 
 typedef struct simple_ble_config_s {
@@ -28,11 +61,103 @@ typedef struct simple_ble_service_s {
     uint16_t service_handle;
 } simple_ble_service_t;
 
+struct simple_ble_char_s;
+typedef void (*simple_ble_char_handler_t)(ble_evt_t* p_ble_evt, struct simple_ble_char_s* char_handle);
+
 typedef struct simple_ble_char_s {
     uint16_t uuid16;
     ble_gatts_char_handles_t char_handle;
+    simple_ble_char_handler_t handler; // optional, gets the writes and authorization requests for this characteristic
 } simple_ble_char_t;
 
+typedef struct simple_ble_notify_stats_s {
+    uint32_t queued;        // waiting for a TX buffer
+    uint32_t high_water;    // most ever waiting at once
+    uint32_t sent;          // handed to the SoftDevice
+    uint32_t dropped;       // the queue was full
+    uint32_t coalesced;     // already waiting, goes out with the newer value
+    uint32_t failed;        // refused by the SoftDevice, or queued when the link dropped
+} simple_ble_notify_stats_t;
+
+typedef struct simple_ble_conn_policy_stats_s {
+    uint32_t to_bulk;       // requests for the bulk parameters
+    uint32_t to_idle;       // requests for the idle parameters
+    uint32_t deferred;      // changes that had to wait for the rate limit
+    uint32_t rejected;      // requests the central turned down or never answered
+    uint32_t normal_ticks;  // policy ticks spent in each phase
+    uint32_t bulk_ticks;
+    uint32_t idle_ticks;
+    uint16_t conn_interval; // current interval, in 1.25 ms units
+    uint16_t slave_latency; // current slave latency
+} simple_ble_conn_policy_stats_t;
+
+typedef struct simple_ble_shadow_stats_s {
+    uint32_t svc_calls;     // value calls that still went to the SoftDevice
+    uint32_t avoided;       // ones that didn't have to, the next four together
+    uint32_t sets_skipped;  // simple_ble_stack_char_set with the value it had
+    uint32_t gets_local;    // simple_ble_stack_char_get answered from RAM
+    uint32_t lens_skipped;  // simple_ble_update_char_len with the length it had
+    uint32_t notifies_skipped; // notifications of a value the link was already sent
+    uint32_t refreshes;     // values read back after the peer wrote them
+    uint32_t uncached;      // characteristics that didn't fit
+} simple_ble_shadow_stats_t;
+
+typedef struct simple_ble_bond_s {
+    ble_gap_enc_key_t enc_key;  // LTK handed to the peer, which brings back its EDIV and Rand
+    ble_gap_id_key_t  peer_id;  // IRK and identity address the peer handed out
+} simple_ble_bond_t;
+
+typedef struct simple_ble_bond_stats_s {
+    uint32_t cache_hits;    // returning peers whose keys were in RAM
+    uint32_t flash_hits;    // ones whose keys came from simple_ble_bond_load
+    uint32_t unknown;       // peers asking for keys there are none of
+    uint32_t bonded;        // new bonds
+    uint32_t store_failed;  // new bonds simple_ble_bond_store turned down
+    uint32_t resumed;       // links encrypted with stored keys
+    uint32_t resume_ms;     // connection to encryption, over all resumed links
+    uint32_t resume_ms_max;
+    uint32_t paired;        // links encrypted by pairing
+    uint32_t pair_ms;       // connection to encryption, over all paired links
+    uint32_t unencrypted;   // links not encrypted within SIMPLE_BLE_BOND_TIMEOUT_MS
+} simple_ble_bond_stats_t;
+
+typedef struct simple_ble_adv_field_s {
+    uint8_t type;
+    uint8_t offset;         // of the data, past the length and type
+    uint8_t len;            // of the data
+} simple_ble_adv_field_t;
+
+typedef struct simple_ble_adv_index_s {
+    const uint8_t* p_data;  // the report the fields point into
+    uint8_t count;
+    bool    malformed;      // an element ran past the end, it and the rest are left out
+    simple_ble_adv_field_t fields[SIMPLE_BLE_ADV_INDEX_FIELDS];
+} simple_ble_adv_index_t;
+
+typedef struct simple_ble_scan_dedup_stats_s {
+    uint32_t reports;       // advertising reports from the SoftDevice
+    uint32_t hits;          // ones already in the cache, not passed on
+    uint32_t misses;        // new addresses or payloads, passed on
+    uint32_t aged;          // ones passed on again after SIMPLE_BLE_SCAN_DEDUP_AGE_MS
+    uint32_t evictions;     // entries heard lately dropped for a new one: old payloads,
+                            //  or if it keeps going up a cache too small
+} simple_ble_scan_dedup_stats_t;
+
+typedef struct simple_ble_scan_adapt_stats_s {
+    uint32_t bursts;        // scans raised to the highest duty by a new address
+    uint32_t backoffs;      // quiet spells that doubled the scan interval
+    uint32_t changes;       // times the scan parameters changed
+    uint32_t scan_ms;       // time the radio was scanning, counted each tick
+    uint16_t interval;      // the scan's now, in 0.625 ms units
+    uint16_t window;
+} simple_ble_scan_adapt_stats_t;
+
+typedef struct simple_ble_scan_rssi_s {
+    uint16_t reports;       // heard with this payload, duplicates included
+    int8_t   rssi;          // smoothed over those reports
+    int8_t   rssi_max;
+} simple_ble_scan_rssi_t;
+
 /*******************************************************************************
  *   FUNCTION PROTOTYPES
  ******************************************************************************/
@@ -43,6 +168,7 @@ extern void ble_evt_write(ble_evt_t* p_ble_evt);
 extern void ble_evt_rw_auth(ble_evt_t* p_ble_evt);
 extern void ble_evt_user_handler(ble_evt_t* p_ble_evt);
 extern void ble_evt_adv_report(ble_evt_t* p_ble_evt);
+extern void sys_evt_user_handler(uint32_t sys_evt);
 extern void ble_error(uint32_t error_code);
 
 // overwrite to change functionality
@@ -52,6 +178,12 @@ void gap_params_init(void);
 void advertising_init(void);
 void conn_params_init(void);
 void services_init(void);
+// bonds across resets, simple_ble_bonds_fds.c keeps them with the SDK's
+// Flash Data Storage. Load finds a bond by the EDIV and Rand of its key.
+uint32_t simple_ble_bond_store (const simple_ble_bond_t* p_bond);
+uint32_t simple_ble_bond_load (const ble_gap_master_id_t* p_master_id, simple_ble_bond_t* p_bond);
+// Set up the FDS bond store, after simple_ble_init. Returns an FDS error code.
+uint32_t simple_ble_bonds_fds_init (void);
 #ifdef ENABLE_DFU
 void dfu_init (void);
 void dfu_reset_prepare (void);
@@ -74,6 +206,22 @@ void simple_ble_add_characteristic (uint8_t read, uint8_t write, uint8_t notify,
 
 uint32_t simple_ble_update_char_len (simple_ble_char_t* char_handle, uint16_t len);
 uint32_t simple_ble_notify_char (simple_ble_char_t* char_handle);
+uint32_t simple_ble_notify_char_link (uint16_t conn_handle, simple_ble_char_t* char_handle);
+uint32_t simple_ble_notify_char_all (simple_ble_char_t* char_handle);
+simple_ble_link_t* simple_ble_get_link (uint16_t conn_handle);
+uint16_t simple_ble_get_max_payload (uint16_t conn_handle);
+void simple_ble_get_notify_stats (simple_ble_notify_stats_t* p_stats);
+
+// connection parameter policy, see SIMPLE_BLE_CONN_POLICY
+void simple_ble_conn_policy_bulk (void);
+void simple_ble_get_conn_policy_stats (simple_ble_conn_policy_stats_t* p_stats);
+
+// characteristic value shadow, see SIMPLE_BLE_SHADOW_CHARS
+void simple_ble_get_shadow_stats (simple_ble_shadow_stats_t* p_stats);
+
+// bonds, see SIMPLE_BLE_BOND_CACHE
+void simple_ble_get_bond_stats (simple_ble_bond_stats_t* p_stats);
+
 bool simple_ble_is_char_event (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle);
 
 // enable read/write authorization on a characteristic
@@ -96,10 +244,39 @@ void simple_ble_add_stack_characteristic (uint8_t read, uint8_t write, uint8_t n
 uint32_t simple_ble_stack_char_get(simple_ble_char_t* char_handle, uint16_t* len, uint8_t* buf);
 uint32_t simple_ble_stack_char_set(simple_ble_char_t* char_handle, uint16_t len, uint8_t* buf);
 
-#ifdef SOFTDEVICE_s130
-// For S130 with central role support
+#if defined(SOFTDEVICE_s130) || defined(SOFTDEVICE_s132)
+// For S130 with central role support. With SIMPLE_BLE_SCAN_ADAPT the scan
+// starts at its highest duty, and backs off while no new addresses are
+// heard, down to a window every SIMPLE_BLE_SCAN_ADAPT_MAX_INTERVAL_MS.
 void simple_ble_scan_start ();
+
+// Stop the scan, and with it SIMPLE_BLE_SCAN_ADAPT's timer. A scan timeout
+// or a connection made as central stops them as well.
+void simple_ble_scan_stop ();
+
+// Index an advertising report in one pass: where the data of each AD type
+// is, without copying it. Stops at a zero length (the rest is padding) and
+// at an element running past dlen, which sets malformed. Returns the number
+// of fields indexed, at most SIMPLE_BLE_ADV_INDEX_FIELDS.
+uint8_t simple_ble_adv_index (const uint8_t* p_data, uint8_t dlen, simple_ble_adv_index_t* p_index);
+
+// The data of the first field of this type, in the indexed report, or NULL
+const uint8_t* simple_ble_adv_find (const simple_ble_adv_index_t* p_index, uint8_t type, uint8_t* p_len);
+
+// Copy the data of the first field of this type, returns its length
 int parse_adata(ble_evt_t * p_ble_evt, uint8_t type, uint8_t * data);
+
+// The RSSI of the reports with this report's address and payload, for
+// ble_evt_adv_report. Returns false if SIMPLE_BLE_SCAN_DEDUP is 0 or the
+// report is no longer in the cache.
+bool simple_ble_scan_dedup_rssi (const ble_evt_t* p_ble_evt, simple_ble_scan_rssi_t* p_rssi);
+
+// Forget every advertisement heard, so each reaches the app again
+void simple_ble_scan_dedup_clear (void);
+
+void simple_ble_get_scan_dedup_stats (simple_ble_scan_dedup_stats_t* p_stats);
+
+void simple_ble_get_scan_adapt_stats (simple_ble_scan_adapt_stats_t* p_stats);
 #endif
 
 
@@ -109,6 +286,11 @@ int parse_adata(ble_evt_t * p_ble_evt, uint8_t type, uint8_t * data);
 extern const int SLAVE_LATENCY;
 extern const int CONN_SUP_TIMEOUT;
 extern const int FIRST_CONN_PARAMS_UPDATE_DELAY;
+extern const int BULK_MIN_CONN_INTERVAL;
+extern const int BULK_MAX_CONN_INTERVAL;
+extern const int IDLE_MIN_CONN_INTERVAL;
+extern const int IDLE_MAX_CONN_INTERVAL;
+extern const int IDLE_SLAVE_LATENCY;
 
 /*******************************************************************************
  *   DEFINES
@@ -174,6 +356,147 @@ extern const int FIRST_CONN_PARAMS_UPDATE_DELAY;
 
 #define MAX_PKT_LEN                     20
 
+//ATT MTU offered to peers. Only S132 3.x (SDK 12) can go past the default
+// of 23, up to 247, and it takes NRF_BLE_GATT_MAX_MTU_SIZE from the build so
+// that the SoftDevice handler sizes its event buffer to match.
+#if defined(NRF_SD_BLE_API_VERSION) && (NRF_SD_BLE_API_VERSION >= 3) && defined(NRF_BLE_GATT_MAX_MTU_SIZE)
+#define SIMPLE_BLE_ATT_MTU              NRF_BLE_GATT_MAX_MTU_SIZE
+#else
+#define SIMPLE_BLE_ATT_MTU              GATT_MTU_SIZE_DEFAULT
+#endif
+
+//longest notification payload any link can negotiate, MAX_PKT_LEN with the
+// default MTU
+#define SIMPLE_BLE_MAX_PAYLOAD          (SIMPLE_BLE_ATT_MTU - 3)
+
+//S130 2.0 renamed the error for a full TX queue
+#ifndef BLE_ERROR_NO_TX_BUFFERS
+#define BLE_ERROR_NO_TX_BUFFERS         BLE_ERROR_NO_TX_PACKETS
+#endif
+
+//notifications that can wait for a TX buffer, 0 to hand
+// BLE_ERROR_NO_TX_BUFFERS back to the caller instead
+#ifndef SIMPLE_BLE_NOTIFY_QUEUE_LEN
+#define SIMPLE_BLE_NOTIFY_QUEUE_LEN     8
+#endif
+
+//switch the peripheral link between a short interval while notifications
+// back up or after simple_ble_conn_policy_bulk, and a long interval with
+// slave latency once traffic stops. 0 keeps the configured parameters for
+// the whole connection.
+#ifndef SIMPLE_BLE_CONN_POLICY
+#define SIMPLE_BLE_CONN_POLICY          0
+#endif
+
+//how often the policy looks at the traffic
+#ifndef SIMPLE_BLE_CONN_POLICY_TICK_MS
+#define SIMPLE_BLE_CONN_POLICY_TICK_MS  1000
+#endif
+
+//quiet ticks before going idle
+#ifndef SIMPLE_BLE_CONN_POLICY_IDLE_TICKS
+#define SIMPLE_BLE_CONN_POLICY_IDLE_TICKS 5
+#endif
+
+//ticks between requests, and after a request was turned down
+#ifndef SIMPLE_BLE_CONN_POLICY_GAP_TICKS
+#define SIMPLE_BLE_CONN_POLICY_GAP_TICKS 5
+#endif
+#ifndef SIMPLE_BLE_CONN_POLICY_BACKOFF_TICKS
+#define SIMPLE_BLE_CONN_POLICY_BACKOFF_TICKS 30
+#endif
+
+//ticks to wait for the central to answer a request
+#ifndef SIMPLE_BLE_CONN_POLICY_ANSWER_TICKS
+#define SIMPLE_BLE_CONN_POLICY_ANSWER_TICKS 10
+#endif
+
+//stack characteristics whose values are kept in RAM as well, so setting a
+// value they already have, reading them and notifying a link of a value it
+// was sent already skip the SoftDevice. The lengths of variable length
+// characteristics in the user's buffer take an entry too. 0 sends every
+// call to the SoftDevice.
+#ifndef SIMPLE_BLE_SHADOW_CHARS
+#define SIMPLE_BLE_SHADOW_CHARS         0
+#endif
+
+//RAM for the kept values, all stack characteristics together
+#ifndef SIMPLE_BLE_SHADOW_BYTES
+#define SIMPLE_BLE_SHADOW_BYTES         256
+#endif
+
+//peers whose keys are kept in RAM, so one that bonded before resumes
+// encryption on the peripheral link without pairing again. Bonds go to
+// simple_ble_bond_store as well, and keys not in RAM are looked for with
+// simple_ble_bond_load. 0 answers every peer without keys.
+#ifndef SIMPLE_BLE_BOND_CACHE
+#define SIMPLE_BLE_BOND_CACHE           4
+#endif
+
+//a peripheral link not encrypted this long after connecting counts as
+// unencrypted in the bond stats
+#ifndef SIMPLE_BLE_BOND_TIMEOUT_MS
+#define SIMPLE_BLE_BOND_TIMEOUT_MS      30000
+#endif
+
+//advertisements remembered by address and payload, so only new or changed
+// ones reach ble_evt_adv_report. A power of two, at least
+// SIMPLE_BLE_SCAN_DEDUP_WAYS. 0 passes every report on.
+#ifndef SIMPLE_BLE_SCAN_DEDUP
+#define SIMPLE_BLE_SCAN_DEDUP           0
+#endif
+
+//entries an address can be in, the ones looked through for each report
+#ifndef SIMPLE_BLE_SCAN_DEDUP_WAYS
+#define SIMPLE_BLE_SCAN_DEDUP_WAYS      4
+#endif
+
+//an advertisement still being heard is passed on again about this often
+// (between 3/4 of it and all of it), so the app knows it is still there
+#ifndef SIMPLE_BLE_SCAN_DEDUP_AGE_MS
+#define SIMPLE_BLE_SCAN_DEDUP_AGE_MS    10000
+#endif
+
+//scan harder while new addresses turn up and less while none do. Needs SIMPLE_BLE_SCAN_DEDUP to tell new addresses
+// apart. 0 always scans with the same parameters.
+#ifndef SIMPLE_BLE_SCAN_ADAPT
+#define SIMPLE_BLE_SCAN_ADAPT           0
+#endif
+
+//how often the scan parameters are looked at
+#ifndef SIMPLE_BLE_SCAN_ADAPT_TICK_MS
+#define SIMPLE_BLE_SCAN_ADAPT_TICK_MS   1000
+#endif
+
+//ticks a new address keeps the scan at its highest duty for
+#ifndef SIMPLE_BLE_SCAN_ADAPT_BURST_TICKS
+#define SIMPLE_BLE_SCAN_ADAPT_BURST_TICKS 3
+#endif
+
+//ticks with no new address before the scan interval doubles
+#ifndef SIMPLE_BLE_SCAN_ADAPT_QUIET_TICKS
+#define SIMPLE_BLE_SCAN_ADAPT_QUIET_TICKS 10
+#endif
+
+//scan window once it is quiet: advertisers at most this slow, less the
+// 10 ms advertising delay, are heard in any one window
+#ifndef SIMPLE_BLE_SCAN_ADAPT_QUIET_WINDOW_MS
+#define SIMPLE_BLE_SCAN_ADAPT_QUIET_WINDOW_MS 1050
+#endif
+
+//longest scan interval, the latency target: an advertiser that turns up
+// while it is quiet is heard within about this long. With the quiet window
+// it sets the lowest duty, the power target. At most 10240.
+#ifndef SIMPLE_BLE_SCAN_ADAPT_MAX_INTERVAL_MS
+#define SIMPLE_BLE_SCAN_ADAPT_MAX_INTERVAL_MS 10240
+#endif
+
+//percent of the interval a burst scans for while simple_ble advertises,
+// the rest is left to its advertising events
+#ifndef SIMPLE_BLE_SCAN_ADAPT_ADV_DUTY
+#define SIMPLE_BLE_SCAN_ADAPT_ADV_DUTY  75
+#endif
+
 
 #endif
 
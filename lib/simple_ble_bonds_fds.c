@@ -0,0 +1,179 @@
+// Flash Data Storage store for simple_ble's bonds, SDK 11+
+//
+// Add this file and fds.c/fstorage.c to APPLICATION_SRCS, call
+// simple_ble_bonds_fds_init after simple_ble_init, and forward SoC events to
+// fs_sys_event_handler (implement sys_evt_user_handler to do so).
+//
+// simple_ble stores a bond from the SoftDevice's event handler, where
+// waiting for FDS would wait forever for the SoC event that ends the write.
+// The bond is copied and written in the background instead, one at a time,
+// and a bond that comes while one is being written is only kept in RAM.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(SDK_VERSION_9) || defined(SDK_VERSION_10)
+#error "simple_ble_bonds_fds.c uses the FDS API of SDK 11 and later"
+#endif
+
+#include "fds.h"
+
+#include "simple_ble.h"
+
+// FDS file and record key of the bonds
+#ifndef SIMPLE_BLE_BONDS_FDS_FILE_ID
+#define SIMPLE_BLE_BONDS_FDS_FILE_ID 0x424E
+#endif
+#ifndef SIMPLE_BLE_BONDS_FDS_KEY
+#define SIMPLE_BLE_BONDS_FDS_KEY     0x0001
+#endif
+
+// Bonds kept in flash, a new peer replaces the one written longest ago once
+// there are this many
+#ifndef SIMPLE_BLE_BONDS_FDS_MAX
+#define SIMPLE_BLE_BONDS_FDS_MAX     8
+#endif
+
+#define BOND_WORDS ((sizeof(simple_ble_bond_t) + 3) / 4)
+
+static volatile bool       init_pending = false;
+static volatile ret_code_t init_result = FDS_SUCCESS;
+static volatile bool       write_pending = false;
+
+// FDS doesn't copy what it writes
+static uint32_t write_buf[BOND_WORDS];
+
+static void fds_evt_handler (fds_evt_t const * const p_evt) {
+    switch (p_evt->id) {
+        case FDS_EVT_INIT:
+            init_result = p_evt->result;
+            init_pending = false;
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            if (p_evt->write.file_id == SIMPLE_BLE_BONDS_FDS_FILE_ID) {
+                write_pending = false;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static bool same_peer (const simple_ble_bond_t* p_a, const simple_ble_bond_t* p_b) {
+    static const uint8_t none[BLE_GAP_ADDR_LEN] = {0};
+
+    return memcmp(p_a->peer_id.id_addr_info.addr, none, BLE_GAP_ADDR_LEN) != 0 &&
+           memcmp(&p_a->peer_id.id_addr_info, &p_b->peer_id.id_addr_info,
+                  sizeof(p_a->peer_id.id_addr_info)) == 0;
+}
+
+// Records are memory mapped, this points into flash until the record is
+//  closed
+static const simple_ble_bond_t* bond_open (fds_record_desc_t* p_desc) {
+    fds_flash_record_t flash_record;
+
+    if (fds_record_open(p_desc, &flash_record) != FDS_SUCCESS) {
+        return NULL;
+    }
+    if (flash_record.p_header->tl.length_words < BOND_WORDS) {
+        fds_record_close(p_desc);
+        return NULL;
+    }
+    return (const simple_ble_bond_t*) flash_record.p_data;
+}
+
+uint32_t simple_ble_bonds_fds_init (void) {
+    ret_code_t err_code;
+
+    err_code = fds_register(fds_evt_handler);
+    if (err_code != FDS_SUCCESS) return err_code;
+
+    init_pending = true;
+    err_code = fds_init();
+    if (err_code != FDS_SUCCESS) {
+        init_pending = false;
+        return err_code;
+    }
+    while (init_pending);
+    return init_result;
+}
+
+uint32_t simple_ble_bond_store (const simple_ble_bond_t* p_bond) {
+    fds_record_desc_t        desc = {0};
+    fds_record_desc_t        replace = {0};
+    fds_find_token_t         token = {0};
+    fds_record_chunk_t       chunk;
+    fds_record_t             record;
+    const simple_ble_bond_t* stored;
+    uint8_t                  count = 0;
+    bool                     found = false;
+    ret_code_t               err_code;
+
+    if (write_pending) {
+        return NRF_ERROR_BUSY;
+    }
+
+    // the peer's old bond, or the oldest one if there are too many
+    while (!found && fds_record_find_in_file(SIMPLE_BLE_BONDS_FDS_FILE_ID, &desc, &token) == FDS_SUCCESS) {
+        stored = bond_open(&desc);
+        if (stored == NULL) continue;
+        found = same_peer(stored, p_bond);
+        fds_record_close(&desc);
+
+        if (found || count == 0 || desc.record_id < replace.record_id) {
+            replace = desc;
+        }
+        count++;
+    }
+
+    memcpy(write_buf, p_bond, sizeof(*p_bond));
+    chunk.p_data       = write_buf;
+    chunk.length_words = BOND_WORDS;
+
+    record.file_id         = SIMPLE_BLE_BONDS_FDS_FILE_ID;
+    record.key             = SIMPLE_BLE_BONDS_FDS_KEY;
+    record.data.p_chunks   = &chunk;
+    record.data.num_chunks = 1;
+
+    write_pending = true;
+    if (found || count >= SIMPLE_BLE_BONDS_FDS_MAX) {
+        err_code = fds_record_update(&replace, &record);
+    } else {
+        err_code = fds_record_write(&desc, &record);
+    }
+    if (err_code != FDS_SUCCESS) {
+        write_pending = false;
+        if (err_code == FDS_ERR_NO_SPACE_IN_FLASH) {
+            // make room for the next one
+            fds_gc();
+        }
+    }
+    return err_code;
+}
+
+uint32_t simple_ble_bond_load (const ble_gap_master_id_t* p_master_id, simple_ble_bond_t* p_bond) {
+    fds_record_desc_t        desc = {0};
+    fds_find_token_t         token = {0};
+    const simple_ble_bond_t* stored;
+    bool                     found;
+
+    while (fds_record_find_in_file(SIMPLE_BLE_BONDS_FDS_FILE_ID, &desc, &token) == FDS_SUCCESS) {
+        stored = bond_open(&desc);
+        if (stored == NULL) continue;
+
+        found = stored->enc_key.master_id.ediv == p_master_id->ediv &&
+                memcmp(stored->enc_key.master_id.rand, p_master_id->rand, BLE_GAP_SEC_RAND_LEN) == 0;
+        if (found) {
+            memcpy(p_bond, stored, sizeof(*p_bond));
+        }
+        fds_record_close(&desc);
+        if (found) {
+            return NRF_SUCCESS;
+        }
+    }
+    return NRF_ERROR_NOT_FOUND;
+}
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Turn a binary simple_logger file back into text.
+
+Usage: decode_log.py [-t] LOG.BIN [OUT.TXT]
+
+  -t  start each line from a log record with its time in ms, as "ms,"
+
+The file format is described in simple_logger_bin.h.
+"""
+
+import re
+import struct
+import sys
+
+TAG_TEXT = 0xFD
+TAG_FORMAT = 0xFE
+TAG_TIME = 0xFF
+FLAG_TIME = 0x01
+
+# one printf conversion, split into the parts python's % operator understands
+CONVERSION = re.compile(r'%([-+ #0]*\d*(?:\.\d*)?)(hh|h|l|z|t)?([diucxXopfFeEgGaAs%])')
+
+
+def varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def narrow(v, length, signed):
+    """What printf makes of an h or hh argument. Newer loggers store it
+    narrowed already, older ones stored the whole int."""
+    bits = {'h': 16, 'hh': 8}.get(length)
+    if bits is None:
+        return v
+    v &= (1 << bits) - 1
+    if signed and v >> (bits - 1):
+        v -= 1 << bits
+    return v
+
+
+class Format:
+    def __init__(self, text):
+        self.text = text
+        self.parts = []  # literal text and (spec, length, conversion)
+        last = 0
+        for m in CONVERSION.finditer(text):
+            self.parts.append(text[last:m.start()])
+            self.parts.append((m.group(1), m.group(2), m.group(3)))
+            last = m.end()
+        self.parts.append(text[last:])
+
+    def render(self, payload, pos, version):
+        out = []
+        for part in self.parts:
+            if isinstance(part, str):
+                out.append(part)
+                continue
+            spec, length, conv = part
+            if conv == '%':
+                out.append('%')
+                continue
+            if conv in 'dic':
+                v, pos = varint(payload, pos)
+                v = (v >> 1) ^ -(v & 1)
+                v = narrow(v, length, True)
+                out.append(('%' + spec + conv) % v)
+            elif conv in 'uxXop':
+                v, pos = varint(payload, pos)
+                v = narrow(v, length, False)
+                if conv == 'p':
+                    out.append('0x%x' % v)
+                else:
+                    out.append(('%' + spec + conv.replace('u', 'd')) % v)
+            elif conv in 'fFeEgGaA':
+                # version 1 files kept floats, later ones doubles
+                fmt = '<f' if version == 1 else '<d'
+                v = struct.unpack_from(fmt, payload, pos)[0]
+                pos += struct.calcsize(fmt)
+                if conv in 'aA':
+                    out.append(float.hex(v))
+                else:
+                    out.append(('%' + spec + conv) % v)
+            else:
+                n, pos = varint(payload, pos)
+                s = payload[pos:pos + n].decode('latin-1')
+                pos += n
+                out.append(('%' + spec + 's') % s)
+        return ''.join(out)
+
+
+def decode(data, timestamps=False):
+    if data[:3] != b'SLB':
+        raise ValueError('not a binary simple_logger file')
+    version = data[3]
+    flags = data[4]
+    pos = 5
+
+    formats = {}
+    now = 0
+    out = []
+    while pos < len(data):
+        tag = data[pos]
+        try:
+            length, start = varint(data, pos + 1)
+        except IndexError:
+            break  # cut off by a reset
+        pos = start + length
+        payload = data[start:pos]
+        if len(payload) < length:
+            break
+
+        if tag == TAG_TEXT:
+            out.append(payload.decode('latin-1'))
+        elif tag == TAG_FORMAT:
+            formats[payload[0]] = Format(payload[1:].decode('latin-1'))
+        elif tag == TAG_TIME:
+            now = struct.unpack('<I', payload)[0]
+        elif tag in formats:
+            p = 0
+            if flags & FLAG_TIME:
+                delta, p = varint(payload, 0)
+                now += delta
+            if timestamps:
+                out.append('%d,' % now)
+            out.append(formats[tag].render(payload, p, version))
+        # records whose format was lost are skipped, their length is known
+
+    return ''.join(out)
+
+
+def main(argv):
+    timestamps = '-t' in argv
+    args = [a for a in argv if a != '-t']
+    if not args:
+        sys.stderr.write(__doc__)
+        return 1
+
+    with open(args[0], 'rb') as f:
+        text = decode(f.read(), timestamps)
+
+    if len(args) > 1:
+        with open(args[1], 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -2,10 +2,20 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "simple_logger.h"
+#include "simple_logger_sink.h"
 #include "simple_timer.h"
-#include "chanfs/ff.h"
-#include "chanfs/diskio.h"
 #include "stdarg.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SIMPLE_LOGGER_BINARY
+#include "simple_logger_bin.h"
+#endif
+
+#ifdef SIMPLE_LOGGER_QUEUE_LEN
+#include "app_util_platform.h"
+#include "app_scheduler.h"
+#endif
 
 static uint8_t simple_logger_inited = 0;
 static uint8_t simple_logger_file_exists = 0;
@@ -25,111 +35,544 @@ const char *file = NULL;
 	static uint32_t buffer_size = 256;
 #endif
 
+static const simple_logger_sink_t *sink;
+static uint8_t simple_logger_append;
+
+// milliseconds since init, counted by the heartbeat
+static volatile uint32_t ms_ticks = 0;
+
+#ifdef SIMPLE_LOGGER_BATCH_SIZE
+	#ifndef SIMPLE_LOGGER_BATCH_MAX_AGE_MS
+	#define SIMPLE_LOGGER_BATCH_MAX_AGE_MS 1000
+	#endif
+
+	//most records that can wait at once
+	#ifndef SIMPLE_LOGGER_BATCH_RECORDS
+	#define SIMPLE_LOGGER_BATCH_RECORDS (SIMPLE_LOGGER_BATCH_SIZE/16)
+	#endif
+
+	// Formatted records waiting to be written to the sink
+	static char batch[SIMPLE_LOGGER_BATCH_SIZE];
+	static uint32_t batch_head = 0;       // next byte to write to the sink
+	static uint32_t batch_len = 0;        // bytes waiting
+	static uint32_t batch_oldest_ms = 0;  // when the oldest waiting record was logged
+
+	// Lengths of the waiting records, so we know which ones a write completed
+	static uint16_t batch_record_len[SIMPLE_LOGGER_BATCH_RECORDS];
+	static uint32_t batch_record_head = 0;
+	static uint32_t batch_records = 0;    // records waiting
+	static uint32_t batch_record_done = 0;// bytes of the oldest one already written
+	static simple_logger_batch_stats_t batch_stats = {0};
+#endif
 
-static FIL 	simple_logger_fpointer;
-static FATFS 	simple_logger_fs;
-static uint8_t simple_logger_opts;
+#ifdef SIMPLE_LOGGER_BINARY
+	#ifndef SIMPLE_LOGGER_BIN_FORMATS
+	#define SIMPLE_LOGGER_BIN_FORMATS 16
+	#endif
+	#if SIMPLE_LOGGER_BIN_FORMATS > SIMPLE_LOGGER_BIN_MAX_ID + 1
+	#error "SIMPLE_LOGGER_BIN_FORMATS is more than the record tags can hold"
+	#endif
+
+	#ifdef SIMPLE_LOGGER_BIN_NO_TIMESTAMPS
+	#define BIN_FLAGS 0
+	#else
+	#define BIN_FLAGS SIMPLE_LOGGER_BIN_FLAG_TIME
+	#endif
+
+	// Text is formatted this far into its buffer, leaving room to put the
+	// text record's tag and length in front of it
+	#define TEXT_ROOM 3
+
+	static const char *bin_formats[SIMPLE_LOGGER_BIN_FORMATS];
+	static uint32_t bin_types[SIMPLE_LOGGER_BIN_FORMATS];
+	static uint8_t bin_nargs[SIMPLE_LOGGER_BIN_FORMATS];
+	static uint8_t bin_defined[SIMPLE_LOGGER_BIN_FORMATS]; // definition is in the open file
+	static uint8_t bin_time_synced = 0;                    // time base is in the open file
+	static uint32_t bin_last_ms = 0;
+#else
+	#define TEXT_ROOM 0
+#endif
 
-extern void disk_timerproc(void);
-extern void disk_restart(void);
+#ifdef SIMPLE_LOGGER_QUEUE_LEN
+	#ifndef SIMPLE_LOGGER_QUEUE_RECORD_SIZE
+	#define SIMPLE_LOGGER_QUEUE_RECORD_SIZE 64
+	#endif
+
+	// Records logged from interrupts, waiting for the main loop to write them.
+	// Producers only mask interrupts long enough to claim a slot, then format
+	// into it and mark it ready; the main loop drains ready slots in order.
+	static char queue[SIMPLE_LOGGER_QUEUE_LEN][SIMPLE_LOGGER_QUEUE_RECORD_SIZE];
+	static volatile uint8_t queue_ready[SIMPLE_LOGGER_QUEUE_LEN];
+	static volatile uint32_t queue_head = 0;     // next slot to drain, only moved by the main loop
+	static volatile uint32_t queue_tail = 0;     // next slot to claim
+	static volatile uint8_t queue_drain_scheduled = 0;
+	static simple_logger_queue_stats_t queue_stats = {0};
+#endif
 
 static void error(void) {
 	error_count++;
 
 	if(error_count > 20) {
-		disk_restart();
+		if(sink->reset) {
+			sink->reset(sink->context);
+		}
 		error_count = 0;
 	}
 }
 
 static void heartbeat (void* p_context) {
-	disk_timerproc();
+	if(sink->tick) {
+		sink->tick(sink->context);
+	}
+	ms_ticks++;
+}
+
+static uint8_t write_header(void) {
+	uint32_t written;
+#ifdef SIMPLE_LOGGER_BINARY
+	uint8_t prefix[TEXT_ROOM];
+	sink->write(sink->context, prefix,
+			simple_logger_bin_text_prefix(prefix, strlen(header_buffer)), &written);
+#endif
+	sink->write(sink->context, header_buffer, strlen(header_buffer), &written);
+	return sink->sync(sink->context);
 }
 
 
-//an sd card was inserted after being gone for a bit
+//the sink went away for a bit (e.g. an sd card was removed and reinserted)
 //let's reopen the file, and try to rewrite the header if it's necessary
 static uint8_t logger_init() {
 
-	volatile FRESULT res;
-	res |= f_mount(&simple_logger_fs, "", 1);
+	uint8_t res = sink->open(sink->context, file, simple_logger_append,
+			&simple_logger_file_exists);
 
-	//see if the file exists already
-	FIL temp;
-	res |= f_open(&temp,file, FA_READ | FA_OPEN_EXISTING);
-	if(res == FR_NO_FILE) {
-		//the file doesn't exist
-		simple_logger_file_exists = 0;
-	} else if(res == FR_OK) {
-		simple_logger_file_exists = 1;
-		res |= f_close(&temp);
+#ifdef SIMPLE_LOGGER_BINARY
+	if(res == SIMPLE_LOGGER_SUCCESS && sink->tell(sink->context) == 0) {
+		uint8_t file_header[SIMPLE_LOGGER_BIN_FILE_HDR_LEN];
+		uint32_t written;
+		res |= sink->write(sink->context, file_header,
+				simple_logger_bin_file_header(file_header, BIN_FLAGS), &written);
 	}
 
-	res |= f_open(&simple_logger_fpointer,file, simple_logger_opts);
-
-	if(simple_logger_opts && FA_OPEN_ALWAYS) {
-		//we are in append mode and should move to the end
-		res |= f_lseek(&simple_logger_fpointer, f_size(&simple_logger_fpointer));
-	}
+	//the time base and formats are restated before their next use, in case
+	// this is a new file
+	memset(bin_defined, 0, sizeof(bin_defined));
+	bin_time_synced = 0;
+#endif
 
 	if(header_written && !simple_logger_file_exists) {
-		f_puts(header_buffer, &simple_logger_fpointer);
-		res |= f_sync(&simple_logger_fpointer);
+		res |= write_header();
 	}
 
 	simple_logger_inited = 1;
 	return res;
 }
 
-uint8_t simple_logger_init(const char *filename, const char *permissions) {
+uint8_t simple_logger_init_sink(const simple_logger_sink_t *log_sink,
+		const char *filename, const char *permissions) {
 
 	if(simple_logger_inited) {
 		return SIMPLE_LOGGER_ALREADY_INITIALIZED; //can only initialize once 
 	}
 
+	sink = log_sink;
+
 	//initialize a simple timer
 	simple_timer_init();
 	simple_timer_start (1, heartbeat);
 	
 	file = filename;
 
-	//we must have not timed out and a card is available
 	if((permissions[0] != 'w' && permissions[0] != 'a') || permissions[1] != '\0') {
 		//the person didn't use the right permissions
 		return SIMPLE_LOGGER_BAD_PERMISSIONS;
-	} else if(permissions[0] == 'w') {
-		simple_logger_opts = (FA_WRITE | FA_CREATE_ALWAYS);
-	} else {
-		simple_logger_opts = (FA_WRITE | FA_OPEN_ALWAYS);
 	}
+	simple_logger_append = (permissions[0] == 'a');
 
 	uint8_t err_code = logger_init();
 	return  err_code;
 }
 
+static uint8_t batch_flush(void);
+
+#ifdef SIMPLE_LOGGER_BATCH_SIZE
+//write the first len waiting bytes to the sink, without syncing
+static uint8_t batch_write(uint32_t len) {
+	uint8_t res = SIMPLE_LOGGER_SUCCESS;
+	uint32_t written;
+
+	while(len > 0 && res == SIMPLE_LOGGER_SUCCESS) {
+		//the batch buffer is a ring, so the data may wrap around
+		uint32_t chunk = SIMPLE_LOGGER_BATCH_SIZE - batch_head;
+		if(chunk > len) {
+			chunk = len;
+		}
+
+		written = 0;
+		res = sink->write(sink->context, batch+batch_head, chunk, &written);
+
+		batch_head = (batch_head + written) % SIMPLE_LOGGER_BATCH_SIZE;
+		batch_len -= written;
+		len -= written;
+		if(written < chunk && res == SIMPLE_LOGGER_SUCCESS) {
+			res = SIMPLE_LOGGER_FILE_ERROR; //sink full
+		}
+	}
+
+	return res;
+}
+
+//drop records that are now entirely in the sink
+static uint32_t batch_retire(uint32_t len) {
+	uint32_t retired = 0;
+
+	len += batch_record_done;
+	while(batch_records > 0 && batch_record_len[batch_record_head] <= len) {
+		len -= batch_record_len[batch_record_head];
+		batch_record_head = (batch_record_head + 1) % SIMPLE_LOGGER_BATCH_RECORDS;
+		batch_records--;
+		retired++;
+	}
+	batch_record_done = len;
+
+	return retired;
+}
+
+//write len bytes and commit them with a single sync
+static uint8_t batch_commit(uint32_t len) {
+	uint32_t start_len = batch_len;
+	uint32_t keep_len = batch_len - len;
+	uint8_t res = batch_write(len);
+	if(res == SIMPLE_LOGGER_SUCCESS) {
+		res = sink->sync(sink->context);
+	}
+
+	if(res != SIMPLE_LOGGER_SUCCESS && res != SIMPLE_LOGGER_BUSY) {
+		//reopen the sink and write whatever did not make it
+		res = logger_init();
+		if(res == SIMPLE_LOGGER_SUCCESS) {
+			res = batch_write(batch_len - keep_len);
+			if(res == SIMPLE_LOGGER_SUCCESS) {
+				res = sink->sync(sink->context);
+			}
+		}
+	}
+
+	//records that are only partially written stay counted as waiting
+	batch_stats.records_last_flush = batch_retire(start_len - batch_len);
+	batch_oldest_ms = ms_ticks;
+	if(res == SIMPLE_LOGGER_BUSY) {
+		//the sink is fine, the rest waits for the next commit
+		return res;
+	}
+	if(res != SIMPLE_LOGGER_SUCCESS) {
+		error();
+		return res;
+	}
+
+	batch_stats.flushes++;
+	return res;
+}
+
+//add a formatted record to the batch, flushing whole sink blocks as they fill
+static uint8_t batch_add(const char *record, uint32_t len) {
+	uint32_t tail;
+	uint8_t res = SIMPLE_LOGGER_SUCCESS;
+
+	//make room by committing everything that is waiting
+	if(batch_len + len > SIMPLE_LOGGER_BATCH_SIZE ||
+	   batch_records == SIMPLE_LOGGER_BATCH_RECORDS) {
+		res = batch_flush();
+		if(batch_len + len > SIMPLE_LOGGER_BATCH_SIZE ||
+		   batch_records == SIMPLE_LOGGER_BATCH_RECORDS) {
+			//still no room, the sink is not taking data
+			batch_stats.records_dropped++;
+			return res != SIMPLE_LOGGER_SUCCESS ? res : SIMPLE_LOGGER_BUSY;
+		}
+	}
+
+	if(batch_len == 0) {
+		batch_oldest_ms = ms_ticks;
+	}
+
+	tail = (batch_head + batch_len) % SIMPLE_LOGGER_BATCH_SIZE;
+	if(tail + len > SIMPLE_LOGGER_BATCH_SIZE) {
+		uint32_t first = SIMPLE_LOGGER_BATCH_SIZE - tail;
+		memcpy(batch+tail, record, first);
+		memcpy(batch, record+first, len-first);
+	} else {
+		memcpy(batch+tail, record, len);
+	}
+	batch_len += len;
+	batch_record_len[(batch_record_head + batch_records) % SIMPLE_LOGGER_BATCH_RECORDS] = len;
+	batch_records++;
+
+	//once at least a block (a sector for a card) is waiting, write as much as
+	// ends on a block boundary so that the sink only sees whole block writes
+	if(batch_len >= sink->align) {
+		uint32_t to_boundary = sink->align - (sink->tell(sink->context) % sink->align);
+		res = batch_commit(to_boundary + ((batch_len - to_boundary) / sink->align) * sink->align);
+		if(res == SIMPLE_LOGGER_BUSY) {
+			//this record is in the batch, it just has to wait
+			res = SIMPLE_LOGGER_SUCCESS;
+		}
+	}
+
+	return res;
+}
+
+static uint8_t batch_flush(void) {
+	if(batch_len == 0) {
+		return SIMPLE_LOGGER_SUCCESS;
+	}
+	return batch_commit(batch_len);
+}
+
+void simple_logger_update() {
+	//flush records that have waited too long
+	if(batch_len > 0 && ms_ticks - batch_oldest_ms >= SIMPLE_LOGGER_BATCH_MAX_AGE_MS) {
+		batch_flush();
+	}
+}
+
+void simple_logger_get_batch_stats(simple_logger_batch_stats_t* stats) {
+	*stats = batch_stats;
+	stats->records_pending = batch_records;
+	stats->bytes_pending = batch_len;
+}
+#else
+static uint8_t batch_flush(void) {
+	//every record is synced as it is logged
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+void simple_logger_update() {
+}
+#endif
+
+#ifdef SIMPLE_LOGGER_ROTATE_SIZE
+//start a new file if len more bytes would take this one past the rotate size
+static void rotate_check(uint32_t len) {
+#ifdef SIMPLE_LOGGER_BATCH_SIZE
+	uint32_t size = sink->tell(sink->context) + batch_len;
+#else
+	uint32_t size = sink->tell(sink->context);
+#endif
+
+	//a record bigger than a whole file still goes in one
+	if(sink->rotate == NULL || size == 0 || size + len <= SIMPLE_LOGGER_ROTATE_SIZE) {
+		return;
+	}
+
+	batch_flush();
+	if(sink->rotate(sink->context, file) != SIMPLE_LOGGER_SUCCESS ||
+	   logger_init() != SIMPLE_LOGGER_SUCCESS) {
+		error();
+	}
+}
+#else
+#define rotate_check(len)
+#endif
+
+//write one record to the sink (or the batch)
+static uint8_t log_record(const char *record, uint32_t len) {
+	rotate_check(len);
+
+#ifdef SIMPLE_LOGGER_BATCH_SIZE
+	return batch_add(record, len);
+#else
+	uint32_t written;
+
+	sink->write(sink->context, record, len, &written);
+	uint8_t res = sink->sync(sink->context);
+
+	if(res != SIMPLE_LOGGER_SUCCESS) {
+		res = logger_init();
+		if(res == SIMPLE_LOGGER_SUCCESS) {
+			sink->write(sink->context, record, len, &written);
+			res = sink->sync(sink->context);
+		} else {
+			error();
+		}
+	}
+
+	return res;
+#endif
+}
+
+//log text that was formatted TEXT_ROOM bytes into buf
+static uint8_t log_text(char *buf) {
+	uint32_t len = strlen(buf + TEXT_ROOM);
+
+#ifdef SIMPLE_LOGGER_BINARY
+	uint8_t prefix[TEXT_ROOM];
+	uint32_t n = simple_logger_bin_text_prefix(prefix, len);
+	memcpy(buf + TEXT_ROOM - n, prefix, n);
+	return log_record(buf + TEXT_ROOM - n, len + n);
+#else
+	return log_record(buf, len);
+#endif
+}
+
+#ifdef SIMPLE_LOGGER_QUEUE_LEN
+//write out queued records, runs in the main loop via app_scheduler
+static void queue_drain(void* p_event_data, uint16_t event_size) {
+	//clear first, so records queued while we drain schedule another pass
+	queue_drain_scheduled = 0;
+
+	while(queue_head != queue_tail) {
+		uint32_t slot = queue_head % SIMPLE_LOGGER_QUEUE_LEN;
+		if(!queue_ready[slot]) {
+			//claimed but still being formatted, its producer reschedules us
+			break;
+		}
+
+		if(log_text(queue[slot]) != SIMPLE_LOGGER_SUCCESS) {
+			queue_stats.write_errors++;
+		} else {
+			queue_stats.records_written++;
+		}
+
+		queue_ready[slot] = 0;
+		queue_head++;
+	}
+}
+
+//safe to call from interrupt handlers, never touches the sink
+uint8_t simple_logger_log_async(const char *format, ...) {
+	uint32_t slot = 0;
+	uint8_t full = 0;
+	uint8_t schedule = 0;
+	int len;
+
+	CRITICAL_REGION_ENTER();
+	if(queue_tail - queue_head >= SIMPLE_LOGGER_QUEUE_LEN) {
+		full = 1;
+		queue_stats.records_dropped++;
+	} else {
+		slot = queue_tail % SIMPLE_LOGGER_QUEUE_LEN;
+		queue_tail++;
+		if(queue_tail - queue_head > queue_stats.high_water) {
+			queue_stats.high_water = queue_tail - queue_head;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+
+	if(full) {
+		return SIMPLE_LOGGER_BUSY;
+	}
+
+	va_list argptr;
+	va_start(argptr, format);
+	len = vsnprintf(queue[slot] + TEXT_ROOM, SIMPLE_LOGGER_QUEUE_RECORD_SIZE - TEXT_ROOM,
+			format, argptr);
+	va_end(argptr);
+
+	queue_ready[slot] = 1;
+
+	CRITICAL_REGION_ENTER();
+	if(len >= SIMPLE_LOGGER_QUEUE_RECORD_SIZE - TEXT_ROOM) {
+		queue_stats.records_truncated++;
+	}
+	if(!queue_drain_scheduled) {
+		queue_drain_scheduled = 1;
+		schedule = 1;
+	}
+	CRITICAL_REGION_EXIT();
+
+	if(schedule && app_sched_event_put(NULL, 0, queue_drain) != NRF_SUCCESS) {
+		//scheduler queue is full, the next record will try again
+		queue_drain_scheduled = 0;
+	}
+
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+void simple_logger_get_queue_stats(simple_logger_queue_stats_t* stats) {
+	CRITICAL_REGION_ENTER();
+	*stats = queue_stats;
+	stats->records_queued = queue_tail - queue_head;
+	CRITICAL_REGION_EXIT();
+}
+#endif
+
+uint8_t simple_logger_flush(void) {
+#ifdef SIMPLE_LOGGER_QUEUE_LEN
+	queue_drain(NULL, 0);
+#endif
+	return batch_flush();
+}
+
 //the function meant to log data
 uint8_t simple_logger_log(const char *format, ...) {
 
 	va_list argptr;
 	va_start(argptr, format);
-	vsnprintf(buffer, buffer_size, format, argptr);
+	vsnprintf(buffer + TEXT_ROOM, buffer_size - TEXT_ROOM, format, argptr);
 	va_end(argptr);
-	
-	f_puts(buffer, &simple_logger_fpointer);
-	FRESULT res = f_sync(&simple_logger_fpointer);
 
-	if(res != FR_OK) {
-		res = logger_init();
-		if(res == FR_OK) {
-			f_puts(buffer, &simple_logger_fpointer);
-			res = f_sync(&simple_logger_fpointer);
-		} else {
-			error();
-		}
+	return log_text(buffer);
+}
+
+#ifdef SIMPLE_LOGGER_BINARY
+uint8_t simple_logger_bin_register(uint8_t id, const char *format) {
+	uint32_t types;
+	int8_t nargs = simple_logger_bin_parse(format, &types);
+
+	//the definition and a record have to fit in the buffer together
+	if(id >= SIMPLE_LOGGER_BIN_FORMATS || nargs < 0 ||
+	   6 + 4 + strlen(format) + SIMPLE_LOGGER_BIN_RECORD_MIN > buffer_size) {
+		return SIMPLE_LOGGER_BAD_FORMAT;
+	}
+
+	bin_formats[id] = format;
+	bin_types[id] = types;
+	bin_nargs[id] = nargs;
+	bin_defined[id] = 0;
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+//store the arguments as they are, the host formats them when decoding
+uint8_t simple_logger_log_bin(uint8_t id, ...) {
+	uint8_t *out = (uint8_t *)buffer;
+	uint32_t len = 0;
+	uint32_t now = ms_ticks;
+	uint8_t res;
+
+	if(id >= SIMPLE_LOGGER_BIN_FORMATS || bin_formats[id] == NULL) {
+		return SIMPLE_LOGGER_BAD_FORMAT;
 	}
 
+	//rotate before the time base and definition are added, so that the new
+	// file gets them. The record is at most a buffer long.
+	rotate_check(buffer_size);
+
+	if(!bin_time_synced) {
+		len += simple_logger_bin_time(out, buffer_size, now);
+		bin_last_ms = now;
+		bin_time_synced = 1;
+	}
+	if(!bin_defined[id]) {
+		len += simple_logger_bin_format(out+len, buffer_size-len, id, bin_formats[id]);
+		bin_defined[id] = 1;
+	}
+
+	va_list argptr;
+	va_start(argptr, id);
+	len += simple_logger_bin_record(out+len, buffer_size-len, id, bin_nargs[id],
+			bin_types[id], BIN_FLAGS, now - bin_last_ms, argptr);
+	va_end(argptr);
+	bin_last_ms = now;
+
+	res = log_record(buffer, len);
+	if(res != SIMPLE_LOGGER_SUCCESS) {
+		//the time base and definition may not have made it either
+		memset(bin_defined, 0, sizeof(bin_defined));
+		bin_time_synced = 0;
+	}
 	return res;
 }
+#endif
 
 uint8_t simple_logger_log_header(const char *format, ...) {
 
@@ -141,12 +584,14 @@ uint8_t simple_logger_log_header(const char *format, ...) {
 	va_end(argptr);
 
 	if(!simple_logger_file_exists) {
-		f_puts(header_buffer, &simple_logger_fpointer);
-		FRESULT res = f_sync(&simple_logger_fpointer);
+		//anything already logged goes before the header
+		simple_logger_flush();
+
+		uint8_t res = write_header();
 
-		if(res != FR_OK) {
+		if(res != SIMPLE_LOGGER_SUCCESS) {
 			res = logger_init();
-			if(res != FR_OK) {
+			if(res != SIMPLE_LOGGER_SUCCESS) {
 				error();
 			}
 			return res;	
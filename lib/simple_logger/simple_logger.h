@@ -1,8 +1,12 @@
 #ifndef SIMPLE_LOGGER_H
 #define SIMPLE_LOGGER_H
 
+#include "simple_logger_sink.h"
+
 //////////////USAGE GUIDE////////////
-//	//REQUIRES: simple_ble, simple_timer
+//	//REQUIRES: simple_ble, simple_timer, simple_timer_wheel
+//	//and for simple_logger_init, which is in simple_logger_sink_fatfs.c:
+//	//simple_logger_sink_fatfs.c, ff.c, mmc_nrf.c
 //	//USES: one simple timer
 //
 //	//In initialization
@@ -10,6 +14,12 @@
 //	//"w" - write
 //	//"a" - append (just like c files)
 //	simple_logger_init(filename, permissions);
+//
+//	//simple_logger_init logs to the sd card (simple_logger_sink_fatfs.c).
+//	//To log somewhere else pick a sink, see simple_logger_sink.h
+//	simple_logger_init_sink(simple_logger_sink_mbramfs(), filename, permissions);
+//	simple_logger_init_sink(simple_logger_sink_rtt(0), NULL, "w");
+//	simple_logger_init_sink(simple_logger_sink_fram(&fram), NULL, "a");
 //	
 //	//In main loop
 //	simple_logger_update()
@@ -24,9 +34,60 @@
 //	//of max length 256 chars
 //	//To have longer strings
 //	#define SIMPLE_LOGGER_BUFFER_SIZE N
+//
+//	//By default every record is synced to the sink as it is logged.
+//	//To instead collect records in RAM and write them in whole
+//	//blocks of the sink (sectors for a card), give the size of the RAM
+//	//buffer (a multiple of 512 for a card)
+//	#define SIMPLE_LOGGER_BATCH_SIZE 1024
+//	//records are also written once the oldest has waited this long,
+//	//as long as simple_logger_update() is called from the main loop
+//	#define SIMPLE_LOGGER_BATCH_MAX_AGE_MS 1000
+//	//to force everything out, e.g. before sleeping or removing the card
+//	simple_logger_flush();
+//
+//	//simple_logger_log blocks on the sink, so to log from interrupt
+//	//handlers give the number of records that can wait in a queue.
+//	//REQUIRES: app_scheduler (APP_SCHED_INIT and app_sched_execute in main)
+//	#define SIMPLE_LOGGER_QUEUE_LEN 16
+//	//longest queued record, longer ones are truncated
+//	#define SIMPLE_LOGGER_QUEUE_RECORD_SIZE 64
+//	//returns immediately, the main loop writes the record later, so
+//	//records from simple_logger_log can land before queued ones
+//	simple_logger_log_async("%d,%d", ...vars);
+//
+//	//For numeric logs, formatting on the host is much cheaper than
+//	//vsnprintf here and the records are around half the size.
+//	//With this defined the file is binary and has to be decoded with
+//	//simple_logger/decode_log.py (see simple_logger_bin.h for the format)
+//	#define SIMPLE_LOGGER_BINARY
+//	//REQUIRES: simple_logger_bin.c in APPLICATION_SRCS
+//	//give each format an id below SIMPLE_LOGGER_BIN_FORMATS (default 16),
+//	//the string must stay valid, e.g. a literal
+//	simple_logger_bin_register(0, "%lu,%d,%d,%d\n");
+//	//log just the arguments
+//	simple_logger_log_bin(0, ...vars);
+//	//each record carries the ms since the previous one, to drop that
+//	#define SIMPLE_LOGGER_BIN_NO_TIMESTAMPS
+//	//text from simple_logger_log and headers is still stored as text
+//
+//	//To keep the log from filling the card, start a new file once
+//	//this one would go past a size. The full file is renamed with a
+//	//digit before the extension (LOG.TXT to LOG1.TXT, LOG1.TXT to
+//	//LOG2.TXT...) and the oldest is deleted. Leave room in an 8.3
+//	//name for the digit. Only the sd card sink rotates.
+//	#define SIMPLE_LOGGER_ROTATE_SIZE 1048576
+//	//files kept besides the open one, 1 to 9 (default 4)
+//	#define SIMPLE_LOGGER_ROTATE_COUNT 4
+//	//On the card each new file gets its clusters when it is created
+//	//(in one run if there is one), so appends don't have to update
+//	//the FAT. This defaults to the rotate size and can be used on its
+//	//own. Until the file is rotated chkdsk reports the unused part as
+//	//lost clusters.
+//	#define SIMPLE_LOGGER_PREALLOC_SIZE 1048576
 ////////////////////////////////////
 
-enum {
+typedef enum {
 	SIMPLE_LOGGER_SUCCESS = 0,
 	SIMPLE_LOGGER_BUSY,
 	SIMPLE_LOGGER_BAD_FPOINTER,
@@ -36,12 +97,48 @@ enum {
 	SIMPLE_LOGGER_FILE_EXISTS,
 	SIMPLE_LOGGER_FILE_ERROR,
 	SIMPLE_LOGGER_ALREADY_INITIALIZED,
-	SIMPLE_LOGGER_BAD_PERMISSIONS
+	SIMPLE_LOGGER_BAD_PERMISSIONS,
+	SIMPLE_LOGGER_BAD_FORMAT
 } SIMPLE_LOGGER_ERROR; 
 
+#ifdef SIMPLE_LOGGER_BATCH_SIZE
+typedef struct {
+	uint32_t records_pending;    //logged but not in the sink yet, lost on a reset
+	uint32_t bytes_pending;
+	uint32_t records_last_flush; //records committed by the most recent flush
+	uint32_t flushes;
+	uint32_t records_dropped;    //the batch was full and the sink not writable
+} simple_logger_batch_stats_t;
+
+void simple_logger_get_batch_stats(simple_logger_batch_stats_t* stats);
+#endif
+
+#ifdef SIMPLE_LOGGER_QUEUE_LEN
+typedef struct {
+	uint32_t records_queued;    //waiting for the main loop
+	uint32_t high_water;        //most records ever waiting at once
+	uint32_t records_written;
+	uint32_t records_dropped;   //the queue was full
+	uint32_t records_truncated; //longer than SIMPLE_LOGGER_QUEUE_RECORD_SIZE
+	uint32_t write_errors;
+} simple_logger_queue_stats_t;
+
+uint8_t simple_logger_log_async(const char *format, ...)
+		__attribute__ ((format (printf, 1, 2)));
+void simple_logger_get_queue_stats(simple_logger_queue_stats_t* stats);
+#endif
+
+#ifdef SIMPLE_LOGGER_BINARY
+uint8_t simple_logger_bin_register(uint8_t id, const char *format);
+uint8_t simple_logger_log_bin(uint8_t id, ...);
+#endif
+
 uint8_t simple_logger_init(const char *filename, const char *permissions);
+uint8_t simple_logger_init_sink(const simple_logger_sink_t *log_sink,
+		const char *filename, const char *permissions);
 uint8_t simple_logger_ready(void);
 void simple_logger_update();
+uint8_t simple_logger_flush(void);
 uint8_t simple_logger_log(const char *format, ...)
 		__attribute__ ((format (printf, 1, 2)));
 uint8_t simple_logger_log_header(const char *format, ...)
@@ -0,0 +1,227 @@
+// Encoder for simple_logger's binary records. Kept apart from the card
+// handling so that it can also be built on the host.
+
+#include <stdint.h>
+#include <string.h>
+#include "simple_logger_bin.h"
+
+// most payload a two byte length can describe
+#define MAX_PAYLOAD 0x3FFF
+
+static uint32_t put_varint(uint8_t *out, uint32_t v) {
+	uint32_t n = 0;
+	while(v >= 0x80) {
+		out[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	out[n++] = v;
+	return n;
+}
+
+static uint32_t varint_len(uint32_t v) {
+	uint32_t n = 1;
+	while(v >= 0x80) {
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+int8_t simple_logger_bin_parse(const char *format, uint32_t *types) {
+	int8_t nargs = 0;
+	uint8_t type;
+	uint8_t size;
+
+	*types = 0;
+	while(*format) {
+		if(*format++ != '%') {
+			continue;
+		}
+
+		//flags, width and precision don't change what is stored
+		while(*format && strchr("-+ #0123456789.", *format)) {
+			format++;
+		}
+		if(*format == '*') {
+			return -1;
+		}
+
+		//32 bit lengths only, though long, size_t and ptrdiff_t are
+		// wider on the host
+		size = 0;
+		if(*format == 'h') {
+			size = SIMPLE_LOGGER_BIN_ARG_SHORT;
+			if(*++format == 'h') {
+				size = SIMPLE_LOGGER_BIN_ARG_CHAR;
+				format++;
+			}
+		} else if(*format == 'l' || *format == 'z' || *format == 't') {
+			size = SIMPLE_LOGGER_BIN_ARG_LONG;
+			if(*format++ == 'l' && *format == 'l') {
+				return -1;
+			}
+		}
+
+		switch(*format) {
+			case '%':
+				format++;
+				continue;
+			case 'd': case 'i': case 'c':
+				type = SIMPLE_LOGGER_BIN_ARG_INT | size;
+				break;
+			case 'u': case 'x': case 'X': case 'o':
+				type = SIMPLE_LOGGER_BIN_ARG_UINT | size;
+				break;
+			case 'p':
+				//pointers are as wide as long on the host and the chip
+				type = SIMPLE_LOGGER_BIN_ARG_UINT | SIMPLE_LOGGER_BIN_ARG_LONG;
+				break;
+			case 'f': case 'F': case 'e': case 'E':
+			case 'g': case 'G': case 'a': case 'A':
+				type = SIMPLE_LOGGER_BIN_ARG_FLOAT;
+				break;
+			case 's':
+				type = SIMPLE_LOGGER_BIN_ARG_STRING;
+				break;
+			default:
+				return -1;
+		}
+		format++;
+
+		if(nargs == SIMPLE_LOGGER_BIN_MAX_ARGS) {
+			return -1;
+		}
+		*types |= (uint32_t)type << (nargs*SIMPLE_LOGGER_BIN_ARG_BITS);
+		nargs++;
+	}
+
+	return nargs;
+}
+
+uint32_t simple_logger_bin_file_header(uint8_t *out, uint8_t flags) {
+	out[0] = 'S';
+	out[1] = 'L';
+	out[2] = 'B';
+	out[3] = SIMPLE_LOGGER_BIN_VERSION;
+	out[4] = flags;
+	return SIMPLE_LOGGER_BIN_FILE_HDR_LEN;
+}
+
+uint32_t simple_logger_bin_time(uint8_t *out, uint32_t size, uint32_t ms) {
+	if(size < 6) {
+		return 0;
+	}
+	out[0] = SIMPLE_LOGGER_BIN_TAG_TIME;
+	out[1] = 4;
+	out[2] = ms;
+	out[3] = ms >> 8;
+	out[4] = ms >> 16;
+	out[5] = ms >> 24;
+	return 6;
+}
+
+uint32_t simple_logger_bin_format(uint8_t *out, uint32_t size,
+		uint8_t id, const char *format) {
+	uint32_t len = strlen(format) + 1;
+	uint32_t n;
+
+	if(len > MAX_PAYLOAD || 1 + varint_len(len) + len > size) {
+		return 0;
+	}
+	out[0] = SIMPLE_LOGGER_BIN_TAG_FORMAT;
+	n = 1 + put_varint(out+1, len);
+	out[n++] = id;
+	memcpy(out+n, format, len-1);
+	return n + len-1;
+}
+
+uint32_t simple_logger_bin_text_prefix(uint8_t *out, uint32_t len) {
+	out[0] = SIMPLE_LOGGER_BIN_TAG_TEXT;
+	return 1 + put_varint(out+1, len);
+}
+
+uint32_t simple_logger_bin_record(uint8_t *out, uint32_t size,
+		uint8_t id, uint8_t nargs, uint32_t types,
+		uint8_t timestamps, uint32_t delta_ms, va_list args) {
+	uint32_t n = 3; //payload starts after the tag and a two byte length
+	uint8_t i;
+
+	if(size < SIMPLE_LOGGER_BIN_RECORD_MIN) {
+		return 0;
+	}
+	if(size > 3 + MAX_PAYLOAD) {
+		size = 3 + MAX_PAYLOAD;
+	}
+
+	if(timestamps) {
+		n += put_varint(out+n, delta_ms);
+	}
+
+	for(i = 0; i < nargs; i++) {
+		switch((types >> (i*SIMPLE_LOGGER_BIN_ARG_BITS)) & 0xF) {
+			case SIMPLE_LOGGER_BIN_ARG_INT: {
+				int32_t v = va_arg(args, int);
+				n += put_varint(out+n, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+				break;
+			}
+			case SIMPLE_LOGGER_BIN_ARG_INT | SIMPLE_LOGGER_BIN_ARG_LONG: {
+				int32_t v = va_arg(args, long);
+				n += put_varint(out+n, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+				break;
+			}
+			case SIMPLE_LOGGER_BIN_ARG_INT | SIMPLE_LOGGER_BIN_ARG_SHORT: {
+				int32_t v = (int16_t) va_arg(args, int);
+				n += put_varint(out+n, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+				break;
+			}
+			case SIMPLE_LOGGER_BIN_ARG_INT | SIMPLE_LOGGER_BIN_ARG_CHAR: {
+				int32_t v = (int8_t) va_arg(args, int);
+				n += put_varint(out+n, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+				break;
+			}
+			case SIMPLE_LOGGER_BIN_ARG_UINT:
+				n += put_varint(out+n, va_arg(args, unsigned int));
+				break;
+			case SIMPLE_LOGGER_BIN_ARG_UINT | SIMPLE_LOGGER_BIN_ARG_SHORT:
+				n += put_varint(out+n, (uint16_t) va_arg(args, unsigned int));
+				break;
+			case SIMPLE_LOGGER_BIN_ARG_UINT | SIMPLE_LOGGER_BIN_ARG_CHAR:
+				n += put_varint(out+n, (uint8_t) va_arg(args, unsigned int));
+				break;
+			case SIMPLE_LOGGER_BIN_ARG_UINT | SIMPLE_LOGGER_BIN_ARG_LONG:
+				n += put_varint(out+n, va_arg(args, unsigned long));
+				break;
+			case SIMPLE_LOGGER_BIN_ARG_FLOAT: {
+				//all of it, printf would print the digits a float loses
+				double d = va_arg(args, double);
+				memcpy(out+n, &d, sizeof(d));
+				n += sizeof(d);
+				break;
+			}
+			case SIMPLE_LOGGER_BIN_ARG_STRING: {
+				const char *s = va_arg(args, const char *);
+				//leave room for the remaining args at their largest
+				uint32_t room = size - n - 8*(nargs-i);
+				uint32_t len = strlen(s);
+				if(len > room) {
+					len = room;
+				}
+				n += put_varint(out+n, len);
+				memcpy(out+n, s, len);
+				n += len;
+				break;
+			}
+		}
+	}
+
+	//short payloads only need one length byte
+	out[0] = id;
+	if(n - 3 < 0x80) {
+		out[1] = n - 3;
+		memmove(out+2, out+3, n - 3);
+		return n - 1;
+	}
+	out[1] = ((n - 3) & 0x7F) | 0x80;
+	out[2] = (n - 3) >> 7;
+	return n;
+}
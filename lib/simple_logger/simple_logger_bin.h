@@ -0,0 +1,79 @@
+#ifndef SIMPLE_LOGGER_BIN_H
+#define SIMPLE_LOGGER_BIN_H
+
+#include <stdint.h>
+#include <stdarg.h>
+
+//////////////FILE FORMAT////////////
+//	//Binary log files are turned back into text on the host with
+//	//	python simple_logger/decode_log.py LOG.BIN
+//
+//	//File: "SLB", version byte, flags byte, then records
+//	//Record: tag byte, varint payload length, payload
+//	//	tag 0x00-0xFC  log record using the format with that id
+//	//	               payload: [varint ms since previous record] args
+//	//	tag 0xFD       text, payload is the raw string
+//	//	tag 0xFE       format definition, payload: id, format string
+//	//	tag 0xFF       time base, payload: uint32 ms (little endian)
+//
+//	//Args are stored in the order of the format's conversions
+//	//	%d %i %c       zigzag varint
+//	//	%u %x %o %p    varint
+//	//	%f %e %g %a    double (little endian), float in version 1 files
+//	//	%s             varint length, bytes
+//	//h and hh values are narrowed to a short or a char first, as printf does
+//	//varints are LEB128, at most 5 bytes for 32 bits
+////////////////////////////////////
+
+#define SIMPLE_LOGGER_BIN_VERSION       2
+#define SIMPLE_LOGGER_BIN_FILE_HDR_LEN  5
+#define SIMPLE_LOGGER_BIN_FLAG_TIME     0x01
+
+#define SIMPLE_LOGGER_BIN_TAG_TEXT      0xFD
+#define SIMPLE_LOGGER_BIN_TAG_FORMAT    0xFE
+#define SIMPLE_LOGGER_BIN_TAG_TIME      0xFF
+#define SIMPLE_LOGGER_BIN_MAX_ID        0xFC
+
+//conversions per format, each type takes four bits of a uint32_t
+#define SIMPLE_LOGGER_BIN_MAX_ARGS      8
+#define SIMPLE_LOGGER_BIN_ARG_BITS      4
+
+enum {
+	SIMPLE_LOGGER_BIN_ARG_INT = 0,
+	SIMPLE_LOGGER_BIN_ARG_UINT,
+	SIMPLE_LOGGER_BIN_ARG_FLOAT,
+	SIMPLE_LOGGER_BIN_ARG_STRING
+};
+
+//or'ed into INT and UINT for arguments passed as long (l, z and t), which
+// are wider than 32 bits on the host. Only the low 32 bits are stored.
+#define SIMPLE_LOGGER_BIN_ARG_LONG      0x4
+
+//or'ed into INT and UINT for h and hh, which printf narrows to a short or
+// a char. They are stored narrowed.
+#define SIMPLE_LOGGER_BIN_ARG_SHORT     0x8
+#define SIMPLE_LOGGER_BIN_ARG_CHAR      0xC
+
+//returns the number of conversions and fills in their types,
+// or -1 if the format uses something that cannot be deferred
+// (64 bit values, '*' widths, %n, or too many conversions)
+int8_t simple_logger_bin_parse(const char *format, uint32_t *types);
+
+//each returns the bytes used in out, or 0 if out is too small
+uint32_t simple_logger_bin_file_header(uint8_t *out, uint8_t flags);
+uint32_t simple_logger_bin_time(uint8_t *out, uint32_t size, uint32_t ms);
+uint32_t simple_logger_bin_format(uint8_t *out, uint32_t size,
+		uint8_t id, const char *format);
+
+//only the tag and length of a text record, so the text itself can be
+// written straight from the caller's buffer
+uint32_t simple_logger_bin_text_prefix(uint8_t *out, uint32_t len);
+
+//strings are truncated to fit, everything else always fits when size is at
+// least SIMPLE_LOGGER_BIN_RECORD_MIN
+#define SIMPLE_LOGGER_BIN_RECORD_MIN (1 + 2 + 5 + SIMPLE_LOGGER_BIN_MAX_ARGS*8)
+uint32_t simple_logger_bin_record(uint8_t *out, uint32_t size,
+		uint8_t id, uint8_t nargs, uint32_t types,
+		uint8_t timestamps, uint32_t delta_ms, va_list args);
+
+#endif
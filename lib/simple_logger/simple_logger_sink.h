@@ -0,0 +1,43 @@
+#ifndef SIMPLE_LOGGER_SINK_H
+#define SIMPLE_LOGGER_SINK_H
+
+#include <stdint.h>
+
+// Where simple_logger puts its records. Every function returns 0 on success,
+// anything else is passed back to the caller of simple_logger as an error.
+typedef struct {
+	//open (or reopen, after an error) the log. existed is set when appending
+	// to a log that already has data, so the header is not written again
+	uint8_t  (*open)(void *context, const char *name, uint8_t append, uint8_t *existed);
+	//written is less than len if the sink is full. A sink that will take the
+	// rest later returns SIMPLE_LOGGER_BUSY, and is not reopened for it
+	uint8_t  (*write)(void *context, const void *data, uint32_t len, uint32_t *written);
+	//make everything written so far survive a reset
+	uint8_t  (*sync)(void *context);
+	//bytes in the log
+	uint32_t (*tell)(void *context);
+	//called every millisecond, may be NULL
+	void     (*tick)(void *context);
+	//called after repeated errors, may be NULL
+	void     (*reset)(void *context);
+	//move the full log aside so the next open starts an empty one, may be
+	// NULL if the sink does not rotate
+	uint8_t  (*rotate)(void *context, const char *name);
+	//batched writes are sized to end on a multiple of this
+	uint16_t align;
+	void     *context;
+} simple_logger_sink_t;
+
+//REQUIRES: simple_logger_sink_fatfs.c, ff.c, mmc_nrf.c
+const simple_logger_sink_t *simple_logger_sink_fatfs(void);
+
+//REQUIRES: simple_logger_sink_mbramfs.c, mbramfs.c
+const simple_logger_sink_t *simple_logger_sink_mbramfs(void);
+
+//REQUIRES: simple_logger_sink_rtt.c, SEGGER_RTT.c
+//the name is ignored, records go out on RTT up buffer channel
+const simple_logger_sink_t *simple_logger_sink_rtt(uint8_t channel);
+
+//the FRAM sink is in simple_logger_sink_fram.h
+
+#endif
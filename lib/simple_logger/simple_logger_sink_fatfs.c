@@ -0,0 +1,167 @@
+// simple_logger sink for a file on an SD card, through chanfs
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "simple_logger.h"
+#include "simple_logger_sink.h"
+#include "chanfs/ff.h"
+#include "chanfs/diskio.h"
+
+static FIL 	simple_logger_fpointer;
+static FATFS 	simple_logger_fs;
+
+#ifndef SIMPLE_LOGGER_ROTATE_COUNT
+#define SIMPLE_LOGGER_ROTATE_COUNT 4
+#endif
+#if SIMPLE_LOGGER_ROTATE_COUNT < 1 || SIMPLE_LOGGER_ROTATE_COUNT > 9
+#error "SIMPLE_LOGGER_ROTATE_COUNT must be 1 to 9"
+#endif
+
+//clusters to reserve for each new file
+#if !defined(SIMPLE_LOGGER_PREALLOC_SIZE) && defined(SIMPLE_LOGGER_ROTATE_SIZE)
+#define SIMPLE_LOGGER_PREALLOC_SIZE SIMPLE_LOGGER_ROTATE_SIZE
+#endif
+
+#define NAME_MAX_LEN 32
+
+extern void disk_timerproc(void);
+extern void disk_restart(void);
+
+#ifdef SIMPLE_LOGGER_PREALLOC_SIZE
+//Give a new file all of its clusters up front, preferably in one contiguous
+// run, but leave its size at zero so that the size on the card is still only
+// what has been synced. Appends then follow the existing chain instead of
+// extending the FAT, and a reset loses nothing. Until the file is rotated the
+// chain is longer than the file, which chkdsk reports as lost clusters.
+static FRESULT preallocate(FIL *fp) {
+	FRESULT res = f_expand(fp, SIMPLE_LOGGER_PREALLOC_SIZE, 1);
+	if(res == FR_DENIED) {
+		//no contiguous run is free, a fragmented chain still saves the FAT updates
+		res = f_lseek(fp, SIMPLE_LOGGER_PREALLOC_SIZE);
+	}
+	if(res == FR_OK) {
+		res = f_lseek(fp, 0);
+		fp->obj.objsize = 0;
+		res |= f_sync(fp);
+	}
+	return res;
+}
+#endif
+
+//free the clusters past the end of the data, f_truncate only does that when
+// the size is past the current position
+static FRESULT release_tail(FIL *fp) {
+	fp->obj.objsize = f_tell(fp) + 1;
+	return f_truncate(fp);
+}
+
+static uint8_t fatfs_open(void *context, const char *name, uint8_t append, uint8_t *existed) {
+	FRESULT res = f_mount(&simple_logger_fs, "", 1);
+	if(res != FR_OK) {
+		return res;
+	}
+
+	if(append) {
+		res = f_open(&simple_logger_fpointer, name, FA_WRITE | FA_OPEN_ALWAYS);
+		if(res == FR_OK) {
+			//move to the end
+			*existed = (f_size(&simple_logger_fpointer) > 0);
+			res = f_lseek(&simple_logger_fpointer, f_size(&simple_logger_fpointer));
+		}
+	} else {
+		*existed = 0;
+		res = f_open(&simple_logger_fpointer, name, FA_WRITE | FA_CREATE_ALWAYS);
+	}
+
+#ifdef SIMPLE_LOGGER_PREALLOC_SIZE
+	//a file left preallocated by a reset keeps its chain
+	if(res == FR_OK && simple_logger_fpointer.obj.sclust == 0) {
+		preallocate(&simple_logger_fpointer);
+	}
+#endif
+
+	return res;
+}
+
+static uint8_t fatfs_write(void *context, const void *data, uint32_t len, uint32_t *written) {
+	UINT bw = 0;
+	FRESULT res = f_write(&simple_logger_fpointer, data, len, &bw);
+	*written = bw;
+	return res;
+}
+
+static uint8_t fatfs_sync(void *context) {
+	return f_sync(&simple_logger_fpointer);
+}
+
+static uint32_t fatfs_tell(void *context) {
+	return f_tell(&simple_logger_fpointer);
+}
+
+static void fatfs_tick(void *context) {
+	disk_timerproc();
+}
+
+static void fatfs_reset(void *context) {
+	disk_restart();
+}
+
+//"LOG.TXT" becomes "LOG1.TXT", so leave room in the name for the digit
+static void rotated_name(char *out, const char *name, uint8_t index) {
+	const char *dot = strrchr(name, '.');
+	const char *slash = strrchr(name, '/');
+	uint32_t base = (dot != NULL && (slash == NULL || dot > slash)) ? dot - name : strlen(name);
+
+	memcpy(out, name, base);
+	out[base] = '0' + index;
+	strcpy(out+base+1, name+base);
+}
+
+//close the full file and shift the older ones along, dropping the oldest
+static uint8_t fatfs_rotate(void *context, const char *name) {
+	char from[NAME_MAX_LEN];
+	char to[NAME_MAX_LEN];
+	uint8_t i;
+
+	if(strlen(name) + 2 > NAME_MAX_LEN) {
+		return FR_INVALID_NAME;
+	}
+
+	FRESULT res = release_tail(&simple_logger_fpointer);
+	res |= f_close(&simple_logger_fpointer);
+	if(res != FR_OK) {
+		return res;
+	}
+
+	//older files may not exist yet, so only the last rename has to work
+	rotated_name(to, name, SIMPLE_LOGGER_ROTATE_COUNT);
+	f_unlink(to);
+	for(i = SIMPLE_LOGGER_ROTATE_COUNT-1; i >= 1; i--) {
+		rotated_name(from, name, i);
+		f_rename(from, to);
+		strcpy(to, from);
+	}
+	return f_rename(name, to);
+}
+
+static const simple_logger_sink_t fatfs_sink = {
+	.open    = fatfs_open,
+	.write   = fatfs_write,
+	.sync    = fatfs_sync,
+	.tell    = fatfs_tell,
+	.tick    = fatfs_tick,
+	.reset   = fatfs_reset,
+	.rotate  = fatfs_rotate,
+	.align   = 512,
+	.context = NULL,
+};
+
+const simple_logger_sink_t *simple_logger_sink_fatfs(void) {
+	return &fatfs_sink;
+}
+
+//logging to the sd card is the default
+uint8_t simple_logger_init(const char *filename, const char *permissions) {
+	return simple_logger_init_sink(&fatfs_sink, filename, permissions);
+}
@@ -0,0 +1,86 @@
+// simple_logger sink for the FM25L04B FRAM, for short logs that have to
+// survive a reset without an SD card
+
+#include <stdint.h>
+#include <stddef.h>
+#include "simple_logger.h"
+#include "simple_logger_sink_fram.h"
+
+#define LEN_BYTES 2
+#define CAPACITY  (SIMPLE_LOGGER_FRAM_SIZE - LEN_BYTES)
+
+//nrf_drv_spi takes a uint8_t length, so longer writes go in pieces
+#define MAX_TRANSFER 255
+
+static uint16_t fram_len = 0;
+
+static uint8_t fram_sync(void *context) {
+	uint8_t len[LEN_BYTES] = {fram_len & 0xFF, fram_len >> 8};
+	if(fm25l04b_write(context, 0, len, LEN_BYTES) != 0) {
+		return SIMPLE_LOGGER_FILE_ERROR;
+	}
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+static uint8_t fram_open(void *context, const char *name, uint8_t append, uint8_t *existed) {
+	uint8_t len[LEN_BYTES];
+
+	fram_len = 0;
+	if(append) {
+		if(fm25l04b_read(context, 0, len, LEN_BYTES) != 0) {
+			return SIMPLE_LOGGER_FILE_ERROR;
+		}
+		fram_len = len[0] | (len[1] << 8);
+		if(fram_len > CAPACITY) {
+			//never written, or by something else
+			fram_len = 0;
+		}
+	}
+
+	*existed = (fram_len > 0);
+	return fram_sync(context);
+}
+
+static uint8_t fram_write(void *context, const void *data, uint32_t len, uint32_t *written) {
+	if(len > CAPACITY - fram_len) {
+		len = CAPACITY - fram_len;
+	}
+	*written = 0;
+
+	while(*written < len) {
+		uint32_t chunk = len - *written;
+		if(chunk > MAX_TRANSFER) {
+			chunk = MAX_TRANSFER;
+		}
+		if(fm25l04b_write(context, LEN_BYTES + fram_len,
+				(uint8_t *) data + *written, chunk) != 0) {
+			return SIMPLE_LOGGER_FILE_ERROR;
+		}
+		fram_len += chunk;
+		*written += chunk;
+	}
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+static uint32_t fram_tell(void *context) {
+	return fram_len;
+}
+
+static simple_logger_sink_t fram_sink = {
+	.open    = fram_open,
+	.write   = fram_write,
+	.sync    = fram_sync,
+	.tell    = fram_tell,
+	.tick    = NULL,
+	.reset   = NULL,
+	.rotate  = NULL,
+	//each write costs a bus setup and the write enable, so collect a few
+	// records per write when batching
+	.align   = 64,
+	.context = NULL,
+};
+
+const simple_logger_sink_t *simple_logger_sink_fram(fm25l04b_t *dev) {
+	fram_sink.context = dev;
+	return &fram_sink;
+}
@@ -0,0 +1,18 @@
+#ifndef SIMPLE_LOGGER_SINK_FRAM_H
+#define SIMPLE_LOGGER_SINK_FRAM_H
+
+#include "nrf_drv_spi.h"
+#include "fm25l04b.h"
+#include "simple_logger_sink.h"
+
+//REQUIRES: simple_logger_sink_fram.c, fm25l04b.c, nrf_drv_spi.c
+//
+//The log takes the whole chip. The first two bytes hold its length, which is
+//only updated on a sync, and logging stops once the chip is full.
+#ifndef SIMPLE_LOGGER_FRAM_SIZE
+#define SIMPLE_LOGGER_FRAM_SIZE 512
+#endif
+
+const simple_logger_sink_t *simple_logger_sink_fram(fm25l04b_t *dev);
+
+#endif
@@ -0,0 +1,55 @@
+// simple_logger sink for a file in RAM, through mbramfs
+//
+// mbramfs has nothing to sync, so with MBRAMFS_PERSIST the application still
+// decides when to call mbramfs_sync().
+
+#include <stdint.h>
+#include <stdio.h>
+#include "mbramfs.h"
+#include "simple_logger.h"
+#include "simple_logger_sink.h"
+
+static FILE *log_file = NULL;
+
+static uint8_t mbramfs_sink_open(void *context, const char *name, uint8_t append, uint8_t *existed) {
+	if(log_file != NULL) {
+		fclose(log_file);
+	}
+
+	log_file = fopen(name, append ? "a" : "w");
+	if(log_file == NULL) {
+		return SIMPLE_LOGGER_FILE_ERROR;
+	}
+
+	*existed = (ftell(log_file) > 0);
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+static uint8_t mbramfs_sink_write(void *context, const void *data, uint32_t len, uint32_t *written) {
+	*written = fwrite(data, 1, len, log_file);
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+static uint8_t mbramfs_sink_sync(void *context) {
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+static uint32_t mbramfs_sink_tell(void *context) {
+	return ftell(log_file);
+}
+
+static const simple_logger_sink_t mbramfs_sink = {
+	.open    = mbramfs_sink_open,
+	.write   = mbramfs_sink_write,
+	.sync    = mbramfs_sink_sync,
+	.tell    = mbramfs_sink_tell,
+	.tick    = NULL,
+	.reset   = NULL,
+	.rotate  = NULL,
+	.align   = MBRAMFS_BLOCK_SIZE,
+	.context = NULL,
+};
+
+const simple_logger_sink_t *simple_logger_sink_mbramfs(void) {
+	return &mbramfs_sink;
+}
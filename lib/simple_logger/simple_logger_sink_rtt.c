@@ -0,0 +1,50 @@
+// simple_logger sink for a SEGGER RTT up buffer, for boards with nothing to
+// store a log on. Read it with JLinkRTTLogger or JLinkRTTClient.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "simple_logger.h"
+#include "simple_logger_sink.h"
+#include "SEGGER_RTT.h"
+
+static uint32_t rtt_written = 0;
+static uint8_t rtt_opened = 0;
+
+static uint8_t rtt_open(void *context, const char *name, uint8_t append, uint8_t *existed) {
+	//the stream carries on across reopens, so the header only goes out once
+	*existed = rtt_opened;
+	rtt_opened = 1;
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+static uint8_t rtt_write(void *context, const void *data, uint32_t len, uint32_t *written) {
+	*written = SEGGER_RTT_Write((unsigned)(uintptr_t) context, data, len);
+	rtt_written += *written;
+	//the debugger is not keeping up, or not attached
+	return *written == len ? SIMPLE_LOGGER_SUCCESS : SIMPLE_LOGGER_BUSY;
+}
+
+static uint8_t rtt_sync(void *context) {
+	return SIMPLE_LOGGER_SUCCESS;
+}
+
+static uint32_t rtt_tell(void *context) {
+	return rtt_written;
+}
+
+static simple_logger_sink_t rtt_sink = {
+	.open    = rtt_open,
+	.write   = rtt_write,
+	.sync    = rtt_sync,
+	.tell    = rtt_tell,
+	.tick    = NULL,
+	.reset   = NULL,
+	.rotate  = NULL,
+	.align   = 1,
+	.context = NULL,
+};
+
+const simple_logger_sink_t *simple_logger_sink_rtt(uint8_t channel) {
+	rtt_sink.context = (void *)(uintptr_t) channel;
+	return &rtt_sink;
+}
@@ -2,55 +2,251 @@
 #include <stdbool.h>
 #include "nordic_common.h"
 #include "app_timer.h"
+#include "app_util_platform.h"
+#include "simple_timer.h"
+#include "simple_timer_wheel.h"
 
 #define SIMPLE_TIMER_PRESCALER     0
 #define SIMPLE_TIMER_OP_QUEUE_SIZE 4
 
-// Define four timers that the app can use.
-// This is a bit of a hack, but makes for a really simple API.
-// If your application needs more, or better control, please use the
-// Nordic API directly.
-APP_TIMER_DEF(timer00);
-APP_TIMER_DEF(timer01);
-APP_TIMER_DEF(timer02);
-APP_TIMER_DEF(timer03);
+// Longest single app_timer wait, well inside the 24 bit RTC
+#define MAX_WAIT_TICKS (1UL << 22)
 
-static uint8_t _in_use = 0;
+// Every simple_timer runs on this one app_timer. It is only started for
+// the next time the wheel has something to do, so the RTC wakes the chip
+// once for all of the timers that are due together.
+APP_TIMER_DEF(wheel_timer);
+
+// app_timer stops and clears the RTC whenever none of its timers are
+// running, even for a moment while the wheel's is restarted, which would
+// throw now off. This one keeps running so the counter only ever wraps.
+APP_TIMER_DEF(keepalive_timer);
+
+static uint8_t _inited = 0;
+static uint32_t rtc_last;      // RTC counter when now was last updated
+static uint32_t now;           // RTC ticks since init, wraps after 36 hours
+static uint8_t scheduled = 0;
+static uint32_t scheduled_at;
+static simple_timer_stats_t stats = {0};
+
+static void update_now (void) {
+	uint32_t counter, elapsed;
+	app_timer_cnt_get(&counter);
+	app_timer_cnt_diff_compute(counter, rtc_last, &elapsed);
+	rtc_last = counter;
+	now += elapsed;
+}
+
+// Make sure the app_timer fires by the time the wheel next needs it
+static void schedule (void) {
+	uint32_t wait = simple_timer_wheel_next(now);
+
+	if (wait == SIMPLE_TIMER_WHEEL_IDLE) {
+		//a wakeup left over from a stopped timer is harmless
+		return;
+	}
+	if (scheduled && (int32_t) (scheduled_at - (now + wait)) <= 0) {
+		return;
+	}
+
+	if (wait < APP_TIMER_MIN_TIMEOUT_TICKS) wait = APP_TIMER_MIN_TIMEOUT_TICKS;
+	if (wait > MAX_WAIT_TICKS) wait = MAX_WAIT_TICKS;
+
+	if (scheduled) {
+		app_timer_stop(wheel_timer);
+	}
+	if (app_timer_start(wheel_timer, wait, NULL) == NRF_SUCCESS) {
+		scheduled = 1;
+		scheduled_at = now + wait;
+	}
+}
+
+static void keepalive_timeout (void* p_context) {
+	CRITICAL_REGION_ENTER();
+	update_now();
+	CRITICAL_REGION_EXIT();
+}
+
+static void wheel_timeout (void* p_context) {
+	simple_timer_wheel_handler_t handler;
+	void* context;
+	uint8_t due;
+
+	scheduled = 0;
+	stats.wakeups++;
+
+	do {
+		// Handlers may start and stop timers, so only hold the wheel while
+		// taking each timer off it
+		CRITICAL_REGION_ENTER();
+		update_now();
+		due = simple_timer_wheel_expire(now, &handler, &context);
+		CRITICAL_REGION_EXIT();
+
+		if (due) {
+			stats.fired++;
+			handler(context);
+		}
+	} while (due);
+
+	CRITICAL_REGION_ENTER();
+	update_now();
+	schedule();
+	CRITICAL_REGION_EXIT();
+}
 
 // This only needs to be called if you are NOT calling simple_ble_init If you
 //  are using simple_ble, calling this again will still work, but wastes ~500
 //  bytes of RAM
 void simple_timer_init () {
+	// The RTC is cleared, so count the ticks up to now first
+	if (_inited) {
+		CRITICAL_REGION_ENTER();
+		update_now();
+		CRITICAL_REGION_EXIT();
+	}
+
 	APP_TIMER_INIT(SIMPLE_TIMER_PRESCALER,
                    SIMPLE_TIMER_OP_QUEUE_SIZE,
                    NULL);
+
+	// app_timer forgets running timers when it is initialized, so start
+	// the wheel's again. The timers on the wheel are kept.
+	app_timer_stop(wheel_timer);
+	app_timer_stop(keepalive_timer);
+	app_timer_create(&wheel_timer, APP_TIMER_MODE_SINGLE_SHOT, wheel_timeout);
+	app_timer_create(&keepalive_timer, APP_TIMER_MODE_REPEATED, keepalive_timeout);
+	app_timer_cnt_get(&rtc_last);
+	app_timer_start(keepalive_timer, MAX_WAIT_TICKS, NULL);
+	scheduled = 0;
+
+	if (!_inited) {
+		now = 0;
+		simple_timer_wheel_init(now);
+		_inited = 1;
+	}
+	schedule();
+}
+
+static uint32_t create (simple_timer_id_t* timer_id,
+                        app_timer_timeout_handler_t callback,
+                        uint8_t flags) {
+	if (callback == NULL) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+
+	CRITICAL_REGION_ENTER();
+	*timer_id = simple_timer_wheel_alloc(callback, flags);
+	CRITICAL_REGION_EXIT();
+
+	if (*timer_id == SIMPLE_TIMER_WHEEL_NONE) {
+		return NRF_ERROR_NO_MEM;
+	}
+	return NRF_SUCCESS;
+}
+
+// Start (or restart) the timer, periods are kept in RTC ticks so repeating
+// timers don't drift
+static uint32_t start (simple_timer_id_t timer_id, uint32_t milliseconds, void* p_context) {
+	uint32_t ticks = APP_TIMER_TICKS(milliseconds, SIMPLE_TIMER_PRESCALER);
+
+	if (ticks >= SIMPLE_TIMER_WHEEL_MAX_TICKS) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	if (ticks < (1UL << SIMPLE_TIMER_WHEEL_SHIFT)) {
+		ticks = 1UL << SIMPLE_TIMER_WHEEL_SHIFT;
+	}
+
+	CRITICAL_REGION_ENTER();
+	update_now();
+	simple_timer_wheel_start(timer_id, now, ticks, p_context);
+	schedule();
+	CRITICAL_REGION_EXIT();
+
+	return NRF_SUCCESS;
+}
+
+uint32_t simple_timer_create (simple_timer_id_t* timer_id,
+                              app_timer_mode_t mode,
+                              app_timer_timeout_handler_t callback) {
+	return create(timer_id, callback,
+	              mode == APP_TIMER_MODE_REPEATED ? SIMPLE_TIMER_WHEEL_REPEATED : 0);
+}
+
+uint32_t simple_timer_start_timer (simple_timer_id_t timer_id,
+                                   uint32_t milliseconds,
+                                   void* p_context) {
+	if (timer_id >= SIMPLE_TIMER_POOL_SIZE) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	return start(timer_id, milliseconds, p_context);
+}
+
+uint32_t simple_timer_stop (simple_timer_id_t timer_id) {
+	if (timer_id >= SIMPLE_TIMER_POOL_SIZE) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+
+	CRITICAL_REGION_ENTER();
+	simple_timer_wheel_stop(timer_id);
+	CRITICAL_REGION_EXIT();
+	return NRF_SUCCESS;
+}
+
+uint32_t simple_timer_set_slack (simple_timer_id_t timer_id, uint32_t milliseconds) {
+	uint32_t ticks = APP_TIMER_TICKS(milliseconds, SIMPLE_TIMER_PRESCALER);
+
+	if (timer_id >= SIMPLE_TIMER_POOL_SIZE || ticks > SIMPLE_TIMER_WHEEL_MAX_TICKS) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+
+	CRITICAL_REGION_ENTER();
+	simple_timer_wheel_set_slack(timer_id, ticks);
+	CRITICAL_REGION_EXIT();
+	return NRF_SUCCESS;
+}
+
+uint32_t simple_timer_delete (simple_timer_id_t timer_id) {
+	if (timer_id >= SIMPLE_TIMER_POOL_SIZE) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+
+	CRITICAL_REGION_ENTER();
+	simple_timer_wheel_free(timer_id);
+	CRITICAL_REGION_EXIT();
+	return NRF_SUCCESS;
 }
 
 uint32_t simple_timer_start (uint32_t milliseconds,
                              app_timer_timeout_handler_t callback) {
-	const app_timer_id_t* timer;
+	simple_timer_id_t timer_id;
 	uint32_t err_code;
 
-	// Make sure we have a timer left
-	if (_in_use > 3) {
-		return NRF_ERROR_NO_MEM;
-	}
+	err_code = create(&timer_id, callback, SIMPLE_TIMER_WHEEL_REPEATED);
+	if (err_code != NRF_SUCCESS) return err_code;
 
-	if (_in_use == 0)      timer = &timer00;
-	else if (_in_use == 1) timer = &timer01;
-	else if (_in_use == 2) timer = &timer02;
-	else if (_in_use == 3) timer = &timer03;
+	return start(timer_id, milliseconds, NULL);
+}
 
-	// Mark a new timer in use
-	_in_use++;
+uint32_t simple_timer_start_once (uint32_t milliseconds,
+                                  app_timer_timeout_handler_t callback,
+                                  void* p_context) {
+	simple_timer_id_t timer_id;
+	uint32_t err_code;
 
-	// Create and init the timer
-	err_code = app_timer_create(timer, APP_TIMER_MODE_REPEATED, callback);
+	// Goes back to the pool once it fires
+	err_code = create(&timer_id, callback, SIMPLE_TIMER_WHEEL_RELEASE);
 	if (err_code != NRF_SUCCESS) return err_code;
 
-	// Actually start the timer
-	err_code = app_timer_start(*timer,
-	                           APP_TIMER_TICKS(milliseconds, SIMPLE_TIMER_PRESCALER),
-	                           NULL);
+	err_code = start(timer_id, milliseconds, p_context);
+	if (err_code != NRF_SUCCESS) {
+		simple_timer_delete(timer_id);
+	}
 	return err_code;
 }
+
+void simple_timer_get_stats (simple_timer_stats_t* p_stats) {
+	CRITICAL_REGION_ENTER();
+	*p_stats = stats;
+	CRITICAL_REGION_EXIT();
+}
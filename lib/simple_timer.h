@@ -16,8 +16,41 @@
  *     simple_timer_start(1000, timer_handler);
  *   }
  *
+ *   // REQUIRES: simple_timer_wheel.c in APPLICATION_SRCS
+ *   // All timers share one app_timer, there can be up to
+ *   // SIMPLE_TIMER_POOL_SIZE (default 16) of them at once.
+ *
+ *   // To stop and restart a timer, create it and keep its id
+ *   simple_timer_id_t timer;
+ *   simple_timer_create(&timer, APP_TIMER_MODE_SINGLE_SHOT, timer_handler);
+ *   simple_timer_start_timer(timer, 500, p_context);
+ *   simple_timer_stop(timer);
+ *   // starting a running timer restarts it
+ *   simple_timer_start_timer(timer, 500, p_context);
+ *   // give it back to the pool
+ *   simple_timer_delete(timer);
+ *
+ *   // A one-shot that goes back to the pool by itself once it fires
+ *   simple_timer_start_once(100, timer_handler, p_context);
+ *
+ *   // To save power, let a timer fire up to 50 ms late so that it can
+ *   // share a wakeup with other timers. Takes effect when it next starts.
+ *   simple_timer_set_slack(timer, 50);
+ *   // slack for timers that weren't given any, as a percentage of their
+ *   // timeout (default 0)
+ *   #define SIMPLE_TIMER_SLACK_PERCENT 10
+ *   // count the wakeups to see what that saves
+ *   simple_timer_stats_t stats;
+ *   simple_timer_get_stats(&stats);
+ *
  */
 
+typedef uint16_t simple_timer_id_t;
+
+typedef struct {
+	uint32_t wakeups;   // times the RTC woke the chip for the timers
+	uint32_t fired;     // timer handlers run
+} simple_timer_stats_t;
 
 // Call this once to init the timer subsystem
 // This only needs to be called if you are NOT calling simple_ble_init If you
@@ -29,4 +62,21 @@ void simple_timer_init ();
 uint32_t simple_timer_start (uint32_t milliseconds,
                              app_timer_timeout_handler_t callback);
 
+// Returns NRF_ERROR_NO_MEM if the pool is empty
+uint32_t simple_timer_create (simple_timer_id_t* timer_id,
+                              app_timer_mode_t mode,
+                              app_timer_timeout_handler_t callback);
+uint32_t simple_timer_start_timer (simple_timer_id_t timer_id,
+                                   uint32_t milliseconds,
+                                   void* p_context);
+uint32_t simple_timer_stop (simple_timer_id_t timer_id);
+uint32_t simple_timer_set_slack (simple_timer_id_t timer_id, uint32_t milliseconds);
+uint32_t simple_timer_delete (simple_timer_id_t timer_id);
+
+uint32_t simple_timer_start_once (uint32_t milliseconds,
+                                  app_timer_timeout_handler_t callback,
+                                  void* p_context);
+
+void simple_timer_get_stats (simple_timer_stats_t* p_stats);
+
 #endif
@@ -0,0 +1,393 @@
+#include <stdint.h>
+#include "simple_timer_wheel.h"
+
+#define SLOTS       (1 << SIMPLE_TIMER_WHEEL_BITS)
+#define SLOT_MASK   (SLOTS - 1)
+#define STEP_MASK   (0xFFFFFFFFUL >> SIMPLE_TIMER_WHEEL_SHIFT) // steps wrap here
+#define WHEEL_RANGE (1UL << (SIMPLE_TIMER_WHEEL_BITS * SIMPLE_TIMER_WHEEL_LEVELS))
+
+#if SLOTS > 32
+#error "each level's slots need to fit in a 32 bit map"
+#endif
+#if SIMPLE_TIMER_POOL_SIZE >= SIMPLE_TIMER_WHEEL_NONE
+#error "SIMPLE_TIMER_POOL_SIZE is too big for the timer ids"
+#endif
+
+// Every running timer is on two wheels. The first has it at the start of
+// its slack window and is what timers are expired from, the second has it
+// at the end of the window and only decides when to wake up. Waking at the
+// earliest end of a window and firing every timer whose window has started
+// needs the fewest wakeups.
+#define EARLIEST 0
+#define LATEST   1
+
+typedef struct {
+	uint16_t slots[SIMPLE_TIMER_WHEEL_LEVELS * SLOTS];
+	uint32_t occupied[SIMPLE_TIMER_WHEEL_LEVELS];   // a bit for each slot with timers
+	uint32_t now;                                   // the last step moved to
+} wheel_t;
+
+typedef struct {
+	uint16_t next;
+	uint16_t prev;
+	uint16_t slot;      // level*SLOTS + slot the timer is queued in, or NONE
+} wheel_link_t;
+
+typedef struct {
+	uint32_t expires;   // start of the window, in counter ticks
+	uint32_t period;    // 0 for one-shots
+	uint32_t slack;     // as set, or SIMPLE_TIMER_WHEEL_SLACK_DEFAULT
+	uint32_t window;    // ticks the timer can wait past expires
+	simple_timer_wheel_handler_t handler;
+	void* p_context;
+	wheel_link_t link[2];
+	uint8_t in_use;
+	uint8_t flags;
+} wheel_timer_t;
+
+static wheel_timer_t timers[SIMPLE_TIMER_POOL_SIZE];
+static wheel_t wheels[2];
+static uint16_t free_head;
+static uint32_t running = 0;
+
+// Step a tick falls in, rounded up so timers never fire early
+static uint32_t tick_step (uint32_t ticks) {
+	return ((ticks + (1UL << SIMPLE_TIMER_WHEEL_SHIFT) - 1) >> SIMPLE_TIMER_WHEEL_SHIFT) & STEP_MASK;
+}
+
+static void slot_add (uint8_t w, uint16_t id, uint16_t slot) {
+	wheel_t* wheel = &wheels[w];
+	wheel_link_t* l = &timers[id].link[w];
+
+	l->slot = slot;
+	l->prev = SIMPLE_TIMER_WHEEL_NONE;
+	l->next = wheel->slots[slot];
+	if (l->next != SIMPLE_TIMER_WHEEL_NONE) {
+		timers[l->next].link[w].prev = id;
+	}
+	wheel->slots[slot] = id;
+	wheel->occupied[slot / SLOTS] |= 1UL << (slot & SLOT_MASK);
+}
+
+static void slot_remove (uint8_t w, uint16_t id) {
+	wheel_t* wheel = &wheels[w];
+	wheel_link_t* l = &timers[id].link[w];
+
+	if (l->prev != SIMPLE_TIMER_WHEEL_NONE) {
+		timers[l->prev].link[w].next = l->next;
+	} else {
+		wheel->slots[l->slot] = l->next;
+		if (l->next == SIMPLE_TIMER_WHEEL_NONE) {
+			wheel->occupied[l->slot / SLOTS] &= ~(1UL << (l->slot & SLOT_MASK));
+		}
+	}
+	if (l->next != SIMPLE_TIMER_WHEEL_NONE) {
+		timers[l->next].link[w].prev = l->prev;
+	}
+	l->slot = SIMPLE_TIMER_WHEEL_NONE;
+}
+
+// Put a timer in the slot for its step, at the level that covers how far
+// away it is. Timers that are already due go in the current step.
+static void insert (uint8_t w, uint16_t id) {
+	wheel_t* wheel = &wheels[w];
+	uint32_t step = tick_step(timers[id].expires + (w == LATEST ? timers[id].window : 0));
+	uint32_t delta = (step - wheel->now) & STEP_MASK;
+	uint8_t level = 0;
+
+	if (delta == 0 || delta > STEP_MASK/2) {
+		slot_add(w, id, wheel->now & SLOT_MASK);
+		return;
+	}
+
+	if (delta >= WHEEL_RANGE) {
+		//out of range, park it where the top level will be moved down last
+		delta = WHEEL_RANGE - 1;
+		step = (wheel->now + delta) & STEP_MASK;
+	}
+	while (delta >> (SIMPLE_TIMER_WHEEL_BITS * (level+1))) {
+		level++;
+	}
+
+	slot_add(w, id, level*SLOTS + ((step >> (SIMPLE_TIMER_WHEEL_BITS*level)) & SLOT_MASK));
+}
+
+static void queue (uint16_t id) {
+	insert(EARLIEST, id);
+	insert(LATEST, id);
+	running++;
+}
+
+static void dequeue (uint16_t id) {
+	slot_remove(EARLIEST, id);
+	slot_remove(LATEST, id);
+	running--;
+}
+
+// Move the timers of every level whose slot starts at this step down the
+// wheel. Higher levels go first, since their timers can land in a lower
+// level's slot that starts now too.
+static void cascade (uint8_t w) {
+	wheel_t* wheel = &wheels[w];
+	uint8_t level;
+
+	for (level = SIMPLE_TIMER_WHEEL_LEVELS-1; level > 0; level--) {
+		uint32_t shift = SIMPLE_TIMER_WHEEL_BITS * level;
+		if (wheel->now & ((1UL << shift) - 1)) {
+			continue;
+		}
+
+		uint16_t slot = level*SLOTS + ((wheel->now >> shift) & SLOT_MASK);
+		while (wheel->slots[slot] != SIMPLE_TIMER_WHEEL_NONE) {
+			uint16_t id = wheel->slots[slot];
+			slot_remove(w, id);
+			insert(w, id);
+		}
+	}
+}
+
+static uint32_t rotate_right (uint32_t map, uint32_t by) {
+	by &= SLOT_MASK;
+	if (by == 0) {
+		return map;
+	}
+	return (map >> by) | (map << (SLOTS - by));
+}
+
+// Steps until the next one with timers to run or move down, 0 if the
+// current step still has timers. Moving timers down is done on the way to
+// a step that has timers due, it never needs a wakeup of its own.
+static uint32_t next_step (uint8_t w) {
+	wheel_t* wheel = &wheels[w];
+	uint32_t best = SIMPLE_TIMER_WHEEL_IDLE;
+	uint8_t level;
+
+	if (wheel->occupied[0] & (1UL << (wheel->now & SLOT_MASK))) {
+		return 0;
+	}
+
+	for (level = 0; level < SIMPLE_TIMER_WHEEL_LEVELS; level++) {
+		uint32_t shift = SIMPLE_TIMER_WHEEL_BITS * level;
+		uint32_t index = wheel->now >> shift;
+		uint32_t step;
+
+		if (wheel->occupied[level] == 0) {
+			continue;
+		}
+
+		//the first slot with timers after the current one, coming round to
+		// the current one last
+		index += __builtin_ctz(rotate_right(wheel->occupied[level], (index & SLOT_MASK) + 1)) + 1;
+		step = ((index << shift) - wheel->now) & STEP_MASK;
+		if (step < best) {
+			best = step;
+		}
+	}
+
+	return best;
+}
+
+// Steps until the first timer is due on a wheel. Timers on the lower
+// levels are in the slot for their step, but the first slot in use on a
+// higher level has to be searched. A level can be skipped when its first
+// slot starts after a timer that is already known.
+static uint32_t next_due (uint8_t w) {
+	wheel_t* wheel = &wheels[w];
+	uint32_t best = SIMPLE_TIMER_WHEEL_IDLE;
+	uint8_t level;
+
+	if (wheel->occupied[0] & (1UL << (wheel->now & SLOT_MASK))) {
+		return 0;
+	}
+
+	for (level = 0; level < SIMPLE_TIMER_WHEEL_LEVELS; level++) {
+		uint32_t shift = SIMPLE_TIMER_WHEEL_BITS * level;
+		uint32_t index = wheel->now >> shift;
+		uint32_t step;
+		uint16_t id;
+
+		if (wheel->occupied[level] == 0) {
+			continue;
+		}
+
+		index += __builtin_ctz(rotate_right(wheel->occupied[level], (index & SLOT_MASK) + 1)) + 1;
+		step = ((index << shift) - wheel->now) & STEP_MASK;
+		if (level == 0 || step >= best) {
+			if (step < best) {
+				best = step;
+			}
+			continue;
+		}
+
+		id = wheel->slots[level*SLOTS + (index & SLOT_MASK)];
+		while (id != SIMPLE_TIMER_WHEEL_NONE) {
+			wheel_timer_t* t = &timers[id];
+			step = (tick_step(t->expires + (w == LATEST ? t->window : 0)) - wheel->now) & STEP_MASK;
+			if (step < best) {
+				best = step;
+			}
+			id = t->link[w].next;
+		}
+	}
+
+	return best;
+}
+
+// Move a wheel on towards target, skipping straight to the steps that have
+// anything to do. Returns 1 if it stopped at a step with timers in it.
+static uint8_t advance (uint8_t w, uint32_t target) {
+	wheel_t* wheel = &wheels[w];
+
+	for (;;) {
+		uint32_t behind = (target - wheel->now) & STEP_MASK;
+		uint32_t step = next_step(w);
+
+		if (step == 0) {
+			return 1;
+		}
+		if (behind == 0 || behind > STEP_MASK/2) {
+			return 0;
+		}
+		if (step > behind) {
+			wheel->now = target;
+			return 0;
+		}
+		wheel->now = (wheel->now + step) & STEP_MASK;
+		cascade(w);
+	}
+}
+
+void simple_timer_wheel_init (uint32_t now) {
+	uint32_t i;
+	uint8_t w;
+
+	for (w = 0; w < 2; w++) {
+		for (i = 0; i < SIMPLE_TIMER_WHEEL_LEVELS * SLOTS; i++) {
+			wheels[w].slots[i] = SIMPLE_TIMER_WHEEL_NONE;
+		}
+		for (i = 0; i < SIMPLE_TIMER_WHEEL_LEVELS; i++) {
+			wheels[w].occupied[i] = 0;
+		}
+		wheels[w].now = (now >> SIMPLE_TIMER_WHEEL_SHIFT) & STEP_MASK;
+	}
+	for (i = 0; i < SIMPLE_TIMER_POOL_SIZE; i++) {
+		timers[i].in_use = 0;
+		timers[i].link[EARLIEST].slot = SIMPLE_TIMER_WHEEL_NONE;
+		timers[i].link[EARLIEST].next = (i+1 < SIMPLE_TIMER_POOL_SIZE) ? i+1 : SIMPLE_TIMER_WHEEL_NONE;
+	}
+	free_head = 0;
+	running = 0;
+}
+
+uint16_t simple_timer_wheel_alloc (simple_timer_wheel_handler_t handler, uint8_t flags) {
+	uint16_t id = free_head;
+
+	if (id == SIMPLE_TIMER_WHEEL_NONE) {
+		return id;
+	}
+	free_head = timers[id].link[EARLIEST].next;
+
+	timers[id].handler = handler;
+	timers[id].flags = flags;
+	timers[id].slack = SIMPLE_TIMER_WHEEL_SLACK_DEFAULT;
+	timers[id].in_use = 1;
+	timers[id].link[EARLIEST].slot = SIMPLE_TIMER_WHEEL_NONE;
+	timers[id].link[LATEST].slot = SIMPLE_TIMER_WHEEL_NONE;
+	return id;
+}
+
+void simple_timer_wheel_free (uint16_t id) {
+	if (id >= SIMPLE_TIMER_POOL_SIZE || !timers[id].in_use) {
+		return;
+	}
+	simple_timer_wheel_stop(id);
+	timers[id].in_use = 0;
+	timers[id].link[EARLIEST].next = free_head;
+	free_head = id;
+}
+
+void simple_timer_wheel_set_slack (uint16_t id, uint32_t slack) {
+	timers[id].slack = slack;
+}
+
+void simple_timer_wheel_start (uint16_t id, uint32_t now, uint32_t ticks,
+                               void* p_context) {
+	wheel_timer_t* t = &timers[id];
+
+	if (t->link[EARLIEST].slot != SIMPLE_TIMER_WHEEL_NONE) {
+		dequeue(id);
+	}
+	if (running == 0) {
+		//nothing has moved the wheels along while they were empty
+		wheels[EARLIEST].now = (now >> SIMPLE_TIMER_WHEEL_SHIFT) & STEP_MASK;
+		wheels[LATEST].now = wheels[EARLIEST].now;
+	}
+
+	t->expires = now + ticks;
+	t->period = (t->flags & SIMPLE_TIMER_WHEEL_REPEATED) ? ticks : 0;
+	t->window = (t->slack == SIMPLE_TIMER_WHEEL_SLACK_DEFAULT) ?
+	            ticks / 100 * SIMPLE_TIMER_SLACK_PERCENT : t->slack;
+	if (t->window > SIMPLE_TIMER_WHEEL_MAX_TICKS) {
+		t->window = SIMPLE_TIMER_WHEEL_MAX_TICKS;
+	}
+	t->p_context = p_context;
+	queue(id);
+}
+
+void simple_timer_wheel_stop (uint16_t id) {
+	if (timers[id].link[EARLIEST].slot != SIMPLE_TIMER_WHEEL_NONE) {
+		dequeue(id);
+	}
+}
+
+uint8_t simple_timer_wheel_running (uint16_t id) {
+	return timers[id].link[EARLIEST].slot != SIMPLE_TIMER_WHEEL_NONE;
+}
+
+uint8_t simple_timer_wheel_expire (uint32_t now,
+                                   simple_timer_wheel_handler_t* handler,
+                                   void** p_context) {
+	uint32_t target = (now >> SIMPLE_TIMER_WHEEL_SHIFT) & STEP_MASK;
+	wheel_t* wheel = &wheels[EARLIEST];
+
+	//every timer whose window has started goes, whether or not it had to
+	if (advance(EARLIEST, target)) {
+		uint16_t id = wheel->slots[wheel->now & SLOT_MASK];
+		wheel_timer_t* t = &timers[id];
+
+		dequeue(id);
+		*handler = t->handler;
+		*p_context = t->p_context;
+		if (t->period) {
+			//after a stall go on from now, instead of once for every
+			// period that was missed
+			if ((int32_t) (now - t->expires) > (int32_t) t->period) {
+				t->expires = now;
+			}
+			t->expires += t->period;
+			queue(id);
+		} else if (t->flags & SIMPLE_TIMER_WHEEL_RELEASE) {
+			simple_timer_wheel_free(id);
+		}
+		return 1;
+	}
+
+	//every timer whose window ends by now has gone with the ones above, so
+	// this only keeps the other wheel in step
+	advance(LATEST, target);
+	return 0;
+}
+
+uint32_t simple_timer_wheel_next (uint32_t now) {
+	wheel_t* wheel = &wheels[LATEST];
+	uint32_t step;
+	int32_t wait;
+
+	if (running == 0) {
+		return SIMPLE_TIMER_WHEEL_IDLE;
+	}
+
+	step = next_due(LATEST);
+	wait = (int32_t) (((wheel->now + step) << SIMPLE_TIMER_WHEEL_SHIFT) - now);
+	return wait > 0 ? (uint32_t) wait : 0;
+}
@@ -0,0 +1,85 @@
+#ifndef __SIMPLE_TIMER_WHEEL_H
+#define __SIMPLE_TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// Hierarchical timer wheel that simple_timer runs all of its timers on, so
+// that they share one app_timer. Kept apart from app_timer so that it can
+// also be built on the host.
+//
+// Times are in ticks of a free running 32 bit counter (RTC ticks on the
+// chip). The wheel itself moves in steps of 2^SIMPLE_TIMER_WHEEL_SHIFT
+// ticks, and timers fire on the first step at or after their time.
+// Each level of the wheel has 2^SIMPLE_TIMER_WHEEL_BITS slots, timers
+// further out than the whole wheel are parked in the top level until
+// they come into range.
+//
+// A timer with slack can fire anywhere from its time to that many ticks
+// later. The wheel only wakes for the earliest end of a window, and then
+// fires every timer whose window has started, so timers with overlapping
+// windows share a wakeup.
+
+// Timers in the pool, ids are indexes into it
+#ifndef SIMPLE_TIMER_POOL_SIZE
+#define SIMPLE_TIMER_POOL_SIZE 16
+#endif
+
+// Slack for timers that weren't given any, as a percentage of their timeout
+#ifndef SIMPLE_TIMER_SLACK_PERCENT
+#define SIMPLE_TIMER_SLACK_PERCENT 0
+#endif
+
+#ifndef SIMPLE_TIMER_WHEEL_SHIFT
+#define SIMPLE_TIMER_WHEEL_SHIFT 5
+#endif
+
+#define SIMPLE_TIMER_WHEEL_BITS   5
+#define SIMPLE_TIMER_WHEEL_LEVELS 4
+
+#define SIMPLE_TIMER_WHEEL_NONE   0xFFFF
+#define SIMPLE_TIMER_WHEEL_IDLE   0xFFFFFFFF
+#define SIMPLE_TIMER_WHEEL_SLACK_DEFAULT 0xFFFFFFFF
+
+// Furthest away a timer can be, leaving room for the wheel to lag behind
+#define SIMPLE_TIMER_WHEEL_MAX_TICKS (1UL << 30)
+
+// Timer flags
+#define SIMPLE_TIMER_WHEEL_REPEATED 0x01
+#define SIMPLE_TIMER_WHEEL_RELEASE  0x02  // back to the pool once it fires
+
+typedef void (*simple_timer_wheel_handler_t)(void* p_context);
+
+// Empty the pool and the wheel, now is the counter's current value
+void simple_timer_wheel_init (uint32_t now);
+
+// Take a timer from the pool, returns SIMPLE_TIMER_WHEEL_NONE if the pool
+// is empty. Released one-shots are for timers nobody keeps the id of.
+uint16_t simple_timer_wheel_alloc (simple_timer_wheel_handler_t handler, uint8_t flags);
+void simple_timer_wheel_free (uint16_t id);
+
+// Ticks the timer may fire late by, from its next start on. Timers start
+// with SIMPLE_TIMER_WHEEL_SLACK_DEFAULT, SIMPLE_TIMER_SLACK_PERCENT of
+// their timeout.
+void simple_timer_wheel_set_slack (uint16_t id, uint32_t slack);
+
+// Fire ticks after now, and then every ticks if the timer repeats. A
+// repeating timer that expires more than a period late goes once and then
+// every ticks from then. Starting a running timer restarts it.
+void simple_timer_wheel_start (uint16_t id, uint32_t now, uint32_t ticks,
+                               void* p_context);
+void simple_timer_wheel_stop (uint16_t id);
+uint8_t simple_timer_wheel_running (uint16_t id);
+
+// Take one timer that is due by now off the wheel, rescheduling it if it
+// repeats. Returns 0 when none are left. The handler should be called
+// after any lock protecting the wheel is released, it may start and stop
+// timers itself.
+uint8_t simple_timer_wheel_expire (uint32_t now,
+                                   simple_timer_wheel_handler_t* handler,
+                                   void** p_context);
+
+// Ticks from now until the end of the first slack window, or
+// SIMPLE_TIMER_WHEEL_IDLE if no timer is running.
+uint32_t simple_timer_wheel_next (uint32_t now);
+
+#endif
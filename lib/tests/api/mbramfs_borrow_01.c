@@ -0,0 +1,64 @@
+
+#include <stdio.h>
+#include <string.h>
+#include "mbramfs.h"
+
+int main (int argc, char** argv) {
+	FILE* f;
+	uint8_t* dst;
+	const uint8_t* src;
+	size_t len;
+	size_t total;
+	int chunks;
+
+	// Fill a file in place, one reserve at a time
+	f = fopen("borrow", "w");
+	total = 0;
+	chunks = 0;
+	while (total < 150) {
+		len = mbramfs_write_reserve(f, &dst, 150 - total);
+		for (size_t i=0; i<len; i++) {
+			dst[i] = 'a' + ((total + i) % 26);
+		}
+		mbramfs_write_commit(f, len);
+		total += len;
+		chunks++;
+	}
+	fclose(f);
+	printf("Wrote %i bytes in %i chunks\n", (int) total, chunks);
+
+	// A reserve that is never filled must not grow the file
+	f = fopen("borrow", "a");
+	len = mbramfs_write_reserve(f, &dst, 10);
+	mbramfs_write_commit(f, 0);
+	fclose(f);
+
+	// Read it back without copying
+	f = fopen("borrow", "r");
+	total = 0;
+	chunks = 0;
+	while ((len = mbramfs_read_borrow(f, &src, 40)) > 0) {
+		printf("%2i: ", (int) len);
+		for (size_t i=0; i<len; i++) {
+			printf("%c", src[i]);
+		}
+		printf("\n");
+		mbramfs_read_release(f, len);
+		total += len;
+		chunks++;
+	}
+	printf("Read %i bytes in %i chunks\n", (int) total, chunks);
+
+	// Borrowing must agree with fread after a seek
+	char buf[5];
+	fseek(f, 62, SEEK_SET);
+	len = mbramfs_read_borrow(f, &src, 5);
+	fread(buf, 1, 5, f);
+	printf("Borrowed %i bytes, match: %i\n", (int) len, memcmp(src, buf, len) == 0);
+
+	// Cannot reserve on a read only stream
+	printf("Reserve on read stream: %i\n", (int) mbramfs_write_reserve(f, &dst, 10));
+	fclose(f);
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <string.h>
+#include "mbramfs.h"
+
+// A stream keeps the block it was last in. Another stream that truncates or
+// removes the file gives those blocks to other files, which the first
+// stream must not read. A stream left past the end of the file reads nothing.
+
+static void fill (const char* name, const char* flags, char c, int count) {
+	char buf[200];
+	FILE* f = fopen(name, flags);
+
+	memset(buf, c, sizeof(buf));
+	while (count > 0) {
+		int n = count < (int) sizeof(buf) ? count : (int) sizeof(buf);
+		fwrite(buf, 1, n, f);
+		count -= n;
+	}
+	fclose(f);
+}
+
+static void dump (FILE* f, int count) {
+	char buf[200];
+	int num = fread(buf, 1, count, f);
+
+	printf("Read %i bytes: %.*s\n", num, num, buf);
+}
+
+int main (int argc, char** argv) {
+	FILE* f;
+
+	// Truncated by another stream, then rewritten
+	fill("one", "w", 'O', 300);
+	f = fopen("one", "r");
+	dump(f, 100);
+	fill("one", "w", 'X', 0);
+	fill("two", "w", 'B', 200);
+	fill("one", "a", 'A', 200);
+	dump(f, 20);
+	fclose(f);
+
+	// Removed under the stream, its blocks going to a file that already exists
+	fill("four", "w", 'X', 0);
+	fill("three", "w", 'T', 300);
+	f = fopen("three", "r");
+	dump(f, 100);
+	remove("three");
+	fill("four", "w", 'C', 200);
+	dump(f, 20);
+	fclose(f);
+
+	// Appending after the blocks went to another file and came back
+	f = fopen("five", "a");
+	fwrite("fffff", 1, 5, f);
+	remove("five");
+	remove("two");
+	fill("six", "w", 'S', 100);
+	fill("five", "w", 'F', 70);
+	fwrite("ggggg", 1, 5, f);
+	fclose(f);
+	f = fopen("six", "r");
+	dump(f, 100);
+	fclose(f);
+	f = fopen("five", "r");
+	dump(f, 100);
+	fclose(f);
+	return 0;
+}
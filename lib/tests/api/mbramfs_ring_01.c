@@ -0,0 +1,86 @@
+
+#include <stdio.h>
+#include <string.h>
+#include "mbramfs.h"
+
+// Matches MBRAMFS_RING_SIZE_IN_BYTES
+#define RING_SIZE 512
+
+static void dump (FILE* f, int count) {
+	char buf[RING_SIZE];
+	int num = fread(buf, 1, count, f);
+
+	printf("Read %i bytes: ", num);
+	for (int i=0; i<num; i++) {
+		printf("%c", buf[i]);
+	}
+	printf("\n");
+}
+
+int main (int argc, char** argv) {
+	FILE* f;
+	char record[10];
+	const uint8_t* src;
+	size_t len;
+
+	// Log more records than fit, each one is "recNNNNN\n" plus a letter
+	f = fopen("ring", "wc");
+	for (int i=0; i<60; i++) {
+		snprintf(record, sizeof(record), "rec%05i", i);
+		record[8] = 'A' + (i % 26);
+		record[9] = '\n';
+		fwrite(record, 1, 10, f);
+	}
+	fclose(f);
+
+	// Reading starts at the oldest byte that is still there
+	f = fopen("ring", "r");
+	dump(f, 32);
+
+	// Seeking is relative to the oldest byte too
+	fseek(f, -12, SEEK_CUR);
+	dump(f, 10);
+	fseek(f, 500, SEEK_SET);
+	dump(f, 100);
+	printf("Seek past end: %i\n", fseek(f, RING_SIZE+1, SEEK_SET));
+	fclose(f);
+
+	// Appending keeps wrapping
+	f = fopen("ring", "a");
+	fwrite("0123456789", 1, 10, f);
+	fclose(f);
+
+	f = fopen("ring", "r");
+	fseek(f, RING_SIZE-20, SEEK_SET);
+	dump(f, 40);
+
+	// Borrowing stops at the wrap point
+	rewind(f);
+	len = mbramfs_read_borrow(f, &src, RING_SIZE);
+	printf("Borrowed %i bytes starting with %c\n", (int) len, src[0]);
+	fclose(f);
+
+	// A single write larger than the ring keeps only its newest bytes
+	char big[RING_SIZE+100];
+	for (int i=0; i<RING_SIZE+100; i++) {
+		big[i] = 'a' + (i % 26);
+	}
+	f = fopen("ring", "a");
+	printf("Wrote %i items\n", (int) fwrite(big, 1, sizeof(big), f));
+	fclose(f);
+
+	f = fopen("ring", "r");
+	dump(f, 26);
+	fclose(f);
+
+	// Opening without the flag makes it a normal file again
+	f = fopen("ring", "w");
+	fwrite("plain", 1, 5, f);
+	fclose(f);
+
+	f = fopen("ring", "r");
+	dump(f, 100);
+	fclose(f);
+
+	return 0;
+}
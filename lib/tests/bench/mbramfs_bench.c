@@ -0,0 +1,72 @@
+// Host benchmark of mbramfs name lookup
+//
+// Reports the average time of fopen/fclose on an existing file and of
+// remove/recreate as the number of files in the filesystem grows.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 20000
+
+static const int file_counts[] = {1, 4, 16, 64, 128};
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void make_name (char* buf, size_t len, int i) {
+	snprintf(buf, len, "/log/sensor_%03i.csv", i);
+}
+
+int main (int argc, char** argv) {
+	char fname[64];
+	FILE* f;
+	int created = 0;
+
+	printf("%8s %16s %16s\n", "files", "open+close (ns)", "remove+create (ns)");
+
+	for (unsigned c=0; c<sizeof(file_counts)/sizeof(file_counts[0]); c++) {
+		int count = file_counts[c];
+		uint64_t start, open_ns, remove_ns;
+
+		// Grow the filesystem to the desired number of files
+		for (; created<count; created++) {
+			make_name(fname, sizeof(fname), created);
+			f = fopen(fname, "w");
+			if (f == NULL) {
+				printf("could not create file %i\n", created);
+				return 1;
+			}
+			fwrite("x", 1, 1, f);
+			fclose(f);
+		}
+
+		start = now_ns();
+		for (int i=0; i<BENCH_ITERATIONS; i++) {
+			make_name(fname, sizeof(fname), i % count);
+			f = fopen(fname, "r");
+			fclose(f);
+		}
+		open_ns = now_ns() - start;
+
+		start = now_ns();
+		for (int i=0; i<BENCH_ITERATIONS; i++) {
+			make_name(fname, sizeof(fname), i % count);
+			remove(fname);
+			f = fopen(fname, "w");
+			fclose(f);
+		}
+		remove_ns = now_ns() - start;
+
+		printf("%8i %16.1f %16.1f\n", count,
+		       (double) open_ns / BENCH_ITERATIONS,
+		       (double) remove_ns / BENCH_ITERATIONS);
+	}
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+// multi_adv rotating an Eddystone URL, a name and manufacturer data built
+// by the advertisement libraries, and a configure function that sets the
+// SoftDevice itself, on the fake SoftDevice and the app_timer fake. Prints
+// the configure functions as they run and what the SoftDevice is given.
+// The bytes kept have to be the ones ble_advdata_set would have set.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "simple_adv.h"
+#include "eddystone.h"
+#include "multi_adv.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "multi",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static uint8_t mdata[2] = {0x01, 0x02};
+static uint8_t changing = 0;
+static uint32_t ms;
+
+void ble_address_set (void) {
+}
+
+static void adv_eddystone (void) {
+	printf("  configure eddystone\n");
+	eddystone_adv("goo.gl/hWTo8W", NULL);
+}
+
+static void adv_name (void) {
+	printf("  configure name\n");
+	simple_adv_only_name();
+}
+
+static void adv_data (void) {
+	ble_advdata_manuf_data_t mandata;
+
+	printf("  configure data\n");
+	mandata.company_identifier = 0x02E0;
+	mandata.data.p_data = mdata;
+	mandata.data.size   = 2;
+	simple_adv_manuf_data(&mandata);
+
+	// Built again every time while it is changing
+	if (changing) {
+		mdata[1]++;
+		multi_adv_invalidate(adv_data);
+	}
+}
+
+static void adv_direct (void) {
+	static const uint8_t adv[] = {0x02, 0x01, 0x06, 0x03, 0xff, 0xe0, 0x02};
+
+	printf("  configure direct\n");
+	sd_ble_gap_adv_data_set(adv, sizeof(adv), NULL, 0);
+	advertising_start();
+}
+
+static void adv_unused (void) {
+}
+
+static void run (uint32_t rotations) {
+	uint32_t i;
+
+	for (i = 0; i < rotations; i++) {
+		app_timer_fake_advance_ms(1000);
+		ms += 1000;
+		printf("at %lus\n", (unsigned long) ms / 1000);
+	}
+}
+
+// Set what the configure function gives the SoftDevice when multi_adv isn't
+// keeping it, and check it against what the rotation set
+static void check (const char* name, multi_adv_configure_f configure) {
+	uint8_t adv[BLE_GAP_ADV_MAX_SIZE], sr[BLE_GAP_ADV_MAX_SIZE];
+	uint8_t set_adv[BLE_GAP_ADV_MAX_SIZE], set_sr[BLE_GAP_ADV_MAX_SIZE];
+	uint8_t adv_len, sr_len, set_adv_len, set_sr_len;
+
+	softdevice_fake_adv_data(adv, &adv_len, sr, &sr_len);
+	softdevice_fake_quiet(1);
+	configure();
+	softdevice_fake_quiet(0);
+	softdevice_fake_adv_data(set_adv, &set_adv_len, set_sr, &set_sr_len);
+	printf("%s: %s ble_advdata_set\n", name,
+	       (adv_len == set_adv_len && sr_len == set_sr_len && memcmp(adv, set_adv, adv_len) == 0 &&
+	        memcmp(sr, set_sr, sr_len) == 0) ? "same as" : "differs from");
+}
+
+static void section (const char* title) {
+	printf("\n%s\n", title);
+}
+
+int main (void) {
+	simple_ble_init(&ble_config);
+	multi_adv_init(1000);
+	multi_adv_register_config(adv_eddystone);
+	multi_adv_register_config(adv_name);
+	multi_adv_register_config(adv_data);
+	multi_adv_register_config(adv_direct);
+	multi_adv_start();
+
+	section("the first time round each is configured");
+	run(4);
+
+	section("then only the bytes are set, but for the one that sets them itself");
+	run(4);
+
+	section("the kept bytes are what ble_advdata_set sets");
+	check("eddystone", adv_eddystone);
+	run(1);
+	check("name", adv_name);
+	run(1);
+	check("data", adv_data);
+
+	section("the data changes and is invalidated");
+	mdata[1] = 0x10;
+	multi_adv_invalidate(adv_data);
+	run(4);
+
+	section("it invalidates itself while changing");
+	changing = 1;
+	multi_adv_invalidate(adv_data);
+	run(8);
+	changing = 0;
+	run(8);
+
+	section("all of them are invalidated");
+	printf("unknown function: %lu\n", (unsigned long) multi_adv_invalidate(adv_unused));
+	multi_adv_invalidate(NULL);
+	run(4);
+
+	multi_adv_stop();
+	return 0;
+}
@@ -0,0 +1,120 @@
+// Host benchmark of multi_adv's rotation
+//
+// The three advertisements of apps/multi-adv-test: an Eddystone URL, a
+// 128-bit service UUID registered with the SoftDevice each time it is built,
+// and manufacturer data. Prints the time per rotation from the app_timer
+// fake through the SoftDevice fake, with the configure functions called
+// every time as multi_adv used to, with the bytes multi_adv keeps, and with
+// every advertisement invalidated each time round.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "simple_adv.h"
+#include "eddystone.h"
+#include "multi_adv.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+#define ROTATIONS 100000
+#define SWITCH_MS 1000
+
+// The app_timer fake numbers timers in the order they are created, after
+// the one simple_ble_init makes
+#define CONFIGURE_TIMER 1
+#define MULTI_ADV_TIMER 2
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "nRFtest",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(500, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(1000, UNIT_1_25_MS),
+};
+
+static uint8_t mdata[2] = {0x01, 0x02};
+static uint8_t invalidate = 0;
+
+APP_TIMER_DEF(configure_timer);
+
+void ble_address_set (void) {
+}
+
+static void adv_eddystone (void) {
+	eddystone_adv("goo.gl/hWTo8W", NULL);
+}
+
+static void adv_128bit_service (void) {
+	const ble_uuid128_t uuid128 = {{
+		0x99, 0xf9, 0xac, 0xe5, 0x57, 0xb9, 0x43, 0xec,
+		0x88, 0xf8, 0x88, 0xb9, 0x4d, 0xa1, 0x80, 0x50
+	}};
+	ble_uuid_t service_uuid;
+
+	service_uuid.uuid = (uuid128.uuid128[13] << 8) | uuid128.uuid128[12];
+	sd_ble_uuid_vs_add(&uuid128, &service_uuid.type);
+	simple_adv_service(&service_uuid);
+}
+
+static void adv_data (void) {
+	ble_advdata_manuf_data_t mandata;
+
+	mandata.company_identifier = 0x02E0;
+	mandata.data.p_data = mdata;
+	mandata.data.size   = 2;
+	simple_adv_manuf_data(&mandata);
+}
+
+static const multi_adv_configure_f configs[] = {adv_eddystone, adv_128bit_service, adv_data};
+#define CONFIGS (sizeof(configs)/sizeof(configs[0]))
+
+// multi_adv's old timer handler
+static void configure_rotation (void* p_context) {
+	static uint8_t index = 0;
+
+	index = (index + 1) % CONFIGS;
+	configs[index]();
+}
+
+static void rotate (const char* name, uint32_t timer) {
+	app_timer_fake_stats_t stats;
+	uint32_t i;
+
+	app_timer_fake_clear_stats();
+	for (i = 0; i < ROTATIONS; i++) {
+		if (invalidate) {
+			multi_adv_invalidate(NULL);
+		}
+		app_timer_fake_advance_ms(SWITCH_MS);
+	}
+	app_timer_fake_get_stats(timer, &stats);
+	printf("%-24s %12.1f\n", name, (double) stats.total_ns / stats.calls);
+}
+
+int main (void) {
+	uint32_t i;
+
+	softdevice_fake_quiet(1);
+	simple_ble_init(&ble_config);
+
+	printf("%-24s %12s\n", "rotation", "ns/rotation");
+
+	app_timer_create(&configure_timer, APP_TIMER_MODE_REPEATED, configure_rotation);
+	app_timer_start(configure_timer, APP_TIMER_TICKS(SWITCH_MS, 0), NULL);
+	rotate("configure every time", CONFIGURE_TIMER);
+	app_timer_stop(configure_timer);
+
+	multi_adv_init(SWITCH_MS);
+	for (i = 0; i < CONFIGS; i++) {
+		multi_adv_register_config(configs[i]);
+	}
+	multi_adv_start();
+	rotate("kept bytes", MULTI_ADV_TIMER);
+
+	invalidate = 1;
+	rotate("invalidated every time", MULTI_ADV_TIMER);
+	multi_adv_stop();
+	return 0;
+}
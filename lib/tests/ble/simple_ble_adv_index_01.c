@@ -0,0 +1,184 @@
+// simple_ble_adv_index against a plain reference parser, on hand made
+// reports with the edge cases and on random ones. Every field the index
+// gives has to be one the reference found, at the same place, and inside
+// the report. Prints the edge cases and totals for the random reports.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+
+#define FUZZ_REPORTS 200000
+#define REPORT_MAX 31
+
+typedef struct {
+	uint8_t count;
+	bool    malformed;
+	uint8_t type[REPORT_MAX];
+	uint8_t offset[REPORT_MAX];
+	uint8_t len[REPORT_MAX];
+} reference_t;
+
+static uint32_t seed = 0x2545f491;
+static uint32_t failures;
+
+void ble_address_set (void) {
+}
+
+static uint32_t xorshift (void) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+// Element by element, with the report copied out of the way so reading past
+// it can't go unnoticed
+static void reference (const uint8_t* p_data, uint8_t dlen, reference_t* ref) {
+	uint8_t copy[REPORT_MAX];
+	unsigned i = 0;
+
+	memcpy(copy, p_data, dlen);
+	memset(ref, 0, sizeof(*ref));
+	while (i < dlen) {
+		unsigned len = copy[i];
+		if (len == 0) {
+			return;
+		}
+		if (i + 1 + len > dlen) {
+			ref->malformed = true;
+			return;
+		}
+		ref->type[ref->count] = copy[i + 1];
+		ref->offset[ref->count] = i + 2;
+		ref->len[ref->count] = len - 1;
+		ref->count++;
+		i += 1 + len;
+	}
+}
+
+static void check (const char* name, const uint8_t* p_data, uint8_t dlen, uint8_t print) {
+	simple_ble_adv_index_t index;
+	reference_t ref;
+	uint8_t count, i, len;
+	const uint8_t* p_field;
+
+	reference(p_data, dlen, &ref);
+	count = simple_ble_adv_index(p_data, dlen, &index);
+
+	if (count != index.count || index.malformed != ref.malformed ||
+	    count != (ref.count < SIMPLE_BLE_ADV_INDEX_FIELDS ? ref.count : SIMPLE_BLE_ADV_INDEX_FIELDS)) {
+		printf("%s: %u fields%s, reference %u%s\n", name, count, index.malformed ? " malformed" : "",
+		       ref.count, ref.malformed ? " malformed" : "");
+		failures++;
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		if (index.fields[i].type != ref.type[i] || index.fields[i].offset != ref.offset[i] ||
+		    index.fields[i].len != ref.len[i] || index.fields[i].offset + index.fields[i].len > dlen) {
+			printf("%s: field %u is type %02x at %u+%u, reference %02x at %u+%u\n", name, i,
+			       index.fields[i].type, index.fields[i].offset, index.fields[i].len,
+			       ref.type[i], ref.offset[i], ref.len[i]);
+			failures++;
+			return;
+		}
+		// the first of its type is the one found
+		p_field = simple_ble_adv_find(&index, index.fields[i].type, &len);
+		if (p_field == NULL || p_field > p_data + index.fields[i].offset) {
+			printf("%s: type %02x not found first\n", name, index.fields[i].type);
+			failures++;
+			return;
+		}
+	}
+
+	if (print) {
+		printf("%s: %u fields%s", name, count, index.malformed ? ", malformed" : "");
+		for (i = 0; i < count; i++) {
+			printf(" %02x@%u+%u", index.fields[i].type, index.fields[i].offset, index.fields[i].len);
+		}
+		printf("\n");
+	}
+}
+
+// parse_adata keeps copying the first field of the type, and nothing for
+// one that isn't there
+static void check_parse_adata (void) {
+	static const uint8_t adv[] = {0x02, 0x01, 0x06, 0x05, 0xff, 0xe0, 0x02, 0x01, 0x02, 0x03, 0x09, 'a', 'b'};
+	ble_evt_t evt;
+	uint8_t data[REPORT_MAX];
+	int len;
+
+	memset(&evt, 0, sizeof(evt));
+	memcpy(evt.evt.gap_evt.params.adv_report.data, adv, sizeof(adv));
+	evt.evt.gap_evt.params.adv_report.dlen = sizeof(adv);
+
+	len = parse_adata(&evt, 0xff, data);
+	printf("parse_adata ff: %d bytes %02x %02x %02x %02x\n", len, data[0], data[1], data[2], data[3]);
+	len = parse_adata(&evt, 0x09, data);
+	printf("parse_adata 09: %d bytes %c%c\n", len, data[0], data[1]);
+	len = parse_adata(&evt, 0x16, data);
+	printf("parse_adata 16: %d bytes\n", len);
+}
+
+int main (void) {
+	static const uint8_t flags_name[] = {0x02, 0x01, 0x06, 0x05, 0x09, 't', 'e', 's', 't'};
+	static const uint8_t padded[] = {0x02, 0x01, 0x06, 0x00, 0x00, 0x00, 0x00};
+	static const uint8_t overrun[] = {0x02, 0x01, 0x06, 0x09, 0xff, 0x01, 0x02};
+	static const uint8_t no_type[] = {0x02, 0x01, 0x06, 0x03};
+	static const uint8_t empty_field[] = {0x01, 0x0a, 0x02, 0x01, 0x06};
+	static const uint8_t max_len[] = {0xff, 0x01, 0x06};
+	uint8_t many[REPORT_MAX];
+	uint8_t report[REPORT_MAX];
+	uint32_t n, malformed = 0, fields = 0;
+	uint8_t dlen, i;
+
+	check("flags and name", flags_name, sizeof(flags_name), 1);
+	check("no data", flags_name, 0, 1);
+	check("one byte", flags_name, 1, 1);
+	check("zero length padding", padded, sizeof(padded), 1);
+	check("element past the end", overrun, sizeof(overrun), 1);
+	check("length without a type", no_type, sizeof(no_type), 1);
+	check("field with no data", empty_field, sizeof(empty_field), 1);
+	check("length of 255", max_len, sizeof(max_len), 1);
+
+	// fifteen one byte fields, more than the index keeps
+	for (i = 0; i < 15; i++) {
+		many[i*2] = 0x01;
+		many[i*2+1] = 0x80 + i;
+	}
+	many[30] = 0x00;
+	check("fifteen fields", many, sizeof(many), 1);
+
+	check_parse_adata();
+
+	// Random reports, half of them put together from well formed elements
+	// with a random last one, half random bytes
+	for (n = 0; n < FUZZ_REPORTS; n++) {
+		simple_ble_adv_index_t index;
+
+		dlen = xorshift() % (REPORT_MAX + 1);
+		if (n & 1) {
+			for (i = 0; i < dlen; i++) {
+				report[i] = xorshift();
+			}
+		} else {
+			i = 0;
+			while (i < dlen) {
+				uint8_t len = 1 + xorshift() % 6;
+				report[i++] = (xorshift() % 16 == 0) ? xorshift() : len;
+				if (i < dlen) {
+					report[i++] = xorshift() % 4 ? 0xff : xorshift();
+				}
+				while (--len > 0 && i < dlen) {
+					report[i++] = xorshift();
+				}
+			}
+		}
+		check("random", report, dlen, 0);
+		fields += simple_ble_adv_index(report, dlen, &index);
+		malformed += index.malformed;
+	}
+	printf("%u random reports, %u fields, %u malformed, %u failures\n",
+	       FUZZ_REPORTS, fields, malformed, failures);
+	return failures != 0;
+}
@@ -0,0 +1,119 @@
+// Host benchmark of looking through advertising reports
+//
+// A scanner usually wants a few fields out of each report: here the flags,
+// the name and the manufacturer data. Times that per report with
+// parse_adata as it was, walking the report and copying the field once per
+// type, and with simple_ble_adv_index once and simple_ble_adv_find for
+// each type. Prints reports per second.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "simple_ble.h"
+
+#define BENCH_REPORTS 5000000
+#define REPORTS 4
+
+static ble_evt_t reports[REPORTS];
+static volatile uint32_t sink;
+
+void ble_address_set (void) {
+}
+
+// parse_adata before the index
+static int __attribute__((noinline)) parse_adata_copy (ble_evt_t * p_ble_evt, uint8_t type, uint8_t * data) {
+	unsigned int i = 0;
+	uint8_t * payload = p_ble_evt->evt.gap_evt.params.adv_report.data;
+	while (i < p_ble_evt->evt.gap_evt.params.adv_report.dlen) {
+		unsigned int dlen = payload[i];
+		if (payload[i+1] != type) {
+			i += dlen+1;
+			continue;
+		}
+		memcpy(data, payload+i+2, dlen-1);
+		return dlen-1;
+	}
+
+	return 0;
+}
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void add (ble_evt_t* evt, const uint8_t* data, uint8_t len) {
+	memcpy(evt->evt.gap_evt.params.adv_report.data, data, len);
+	evt->evt.gap_evt.params.adv_report.dlen = len;
+}
+
+static double run_copy (void) {
+	uint8_t data[31];
+	uint64_t start;
+	uint32_t i;
+
+	start = now_ns();
+	for (i = 0; i < BENCH_REPORTS; i++) {
+		ble_evt_t* evt = &reports[i % REPORTS];
+		sink += parse_adata_copy(evt, BLE_GAP_AD_TYPE_FLAGS, data);
+		sink += parse_adata_copy(evt, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, data);
+		sink += parse_adata_copy(evt, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, data);
+		sink += data[0];
+	}
+	return BENCH_REPORTS / ((now_ns() - start) / 1e9);
+}
+
+static double run_index (void) {
+	simple_ble_adv_index_t index;
+	const uint8_t* p_field;
+	uint8_t len;
+	uint64_t start;
+	uint32_t i;
+
+	start = now_ns();
+	for (i = 0; i < BENCH_REPORTS; i++) {
+		ble_evt_t* evt = &reports[i % REPORTS];
+		simple_ble_adv_index(evt->evt.gap_evt.params.adv_report.data,
+		                     evt->evt.gap_evt.params.adv_report.dlen, &index);
+		simple_ble_adv_find(&index, BLE_GAP_AD_TYPE_FLAGS, &len);
+		sink += len;
+		simple_ble_adv_find(&index, BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME, &len);
+		sink += len;
+		p_field = simple_ble_adv_find(&index, BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, &len);
+		sink += len;
+		if (p_field != NULL) {
+			sink += p_field[0];
+		}
+	}
+	return BENCH_REPORTS / ((now_ns() - start) / 1e9);
+}
+
+int main (void) {
+	// flags, name and manufacturer data, the way simple_ble advertises
+	static const uint8_t named[] = {0x02, 0x01, 0x06, 0x06, 0x09, 's', 'q', 'u', 'a', 'l',
+	                                0x0b, 0xff, 0xe0, 0x02, 0x11, 0x01, 0xc0, 0x98, 0xe5, 0x49, 0x00, 0x01};
+	// flags, a 128 bit UUID and manufacturer data, all 31 bytes
+	static const uint8_t uuid[] = {0x02, 0x01, 0x06, 0x11, 0x07, 0x87, 0xa4, 0xde, 0xa0, 0x96, 0xea,
+	                               0x4e, 0xe6, 0x87, 0x45, 0x83, 0x28, 0x89, 0x0f, 0xad, 0x7b,
+	                               0x09, 0xff, 0x59, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+	// a beacon with only manufacturer data
+	static const uint8_t beacon[] = {0x02, 0x01, 0x04, 0x1a, 0xff, 0x4c, 0x00, 0x02, 0x15,
+	                                 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+	                                 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x00, 0x01, 0x00, 0x02, 0xc5};
+	// flags and name only
+	static const uint8_t short_name[] = {0x02, 0x01, 0x06, 0x04, 0x09, 'a', 'b', 'c'};
+
+	add(&reports[0], named, sizeof(named));
+	add(&reports[1], uuid, sizeof(uuid));
+	add(&reports[2], beacon, sizeof(beacon));
+	add(&reports[3], short_name, sizeof(short_name));
+
+	printf("%-24s %14s\n", "", "reports/s");
+	printf("%-24s %14.0f\n", "parse_adata x3, copying", run_copy());
+	printf("%-24s %14.0f\n", "index, find x3", run_index());
+	return 0;
+}
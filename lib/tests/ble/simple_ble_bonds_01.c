@@ -0,0 +1,137 @@
+// Bonds on the peripheral link of simple_ble, on the fake SoftDevice and
+// the app_timer fake. Phones pair, come back and encrypt with the keys they
+// kept. The test stands in for the flash store, and simple_ble only keeps
+// two bonds in RAM, so older ones come back from the store. Prints what the
+// phones see, the store's calls, and the bond counters with the hit rate
+// and the time from connecting to encryption.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+#define PHONE 1
+#define STORE_BONDS 8
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "bonds",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+// what each phone, by the last byte of its address, kept
+static ble_gap_enc_key_t phone_keys[256];
+
+static simple_ble_bond_t store[STORE_BONDS];
+static uint8_t store_count;
+static uint8_t store_broken;
+
+void ble_address_set (void) {
+}
+
+uint32_t simple_ble_bond_store (const simple_ble_bond_t* p_bond) {
+	if (store_broken || store_count == STORE_BONDS) {
+		printf("  store: refused\n");
+		return NRF_ERROR_NO_MEM;
+	}
+	printf("  store: ediv %04x of %02x\n", p_bond->enc_key.master_id.ediv,
+	       p_bond->peer_id.id_addr_info.addr[0]);
+	store[store_count++] = *p_bond;
+	return NRF_SUCCESS;
+}
+
+uint32_t simple_ble_bond_load (const ble_gap_master_id_t* p_master_id, simple_ble_bond_t* p_bond) {
+	uint8_t i;
+
+	for (i = 0; i < store_count; i++) {
+		if (store[i].enc_key.master_id.ediv == p_master_id->ediv &&
+		        memcmp(store[i].enc_key.master_id.rand, p_master_id->rand, BLE_GAP_SEC_RAND_LEN) == 0) {
+			printf("  load: ediv %04x\n", p_master_id->ediv);
+			*p_bond = store[i];
+			return NRF_SUCCESS;
+		}
+	}
+	printf("  load: ediv %04x not found\n", p_master_id->ediv);
+	return NRF_ERROR_NOT_FOUND;
+}
+
+// The phone connects and encrypts with its keys, or pairs if it has none
+// or they don't work. Pairing takes about a second and a half, resuming a
+// connection event or two.
+static void visit (uint8_t phone) {
+	printf("%02x:\n", phone);
+	softdevice_fake_connect(PHONE, BLE_GAP_ROLE_PERIPH, phone);
+	app_timer_fake_advance_ms(30);
+	if (phone_keys[phone].master_id.ediv == 0 || !softdevice_fake_encrypt(PHONE, &phone_keys[phone])) {
+		app_timer_fake_advance_ms(1500);
+		softdevice_fake_pair(PHONE, &phone_keys[phone]);
+	}
+	app_timer_fake_advance_ms(1000);
+	softdevice_fake_disconnect(PHONE);
+}
+
+static void section (const char* name) {
+	printf("\n%s\n", name);
+}
+
+int main (void) {
+	simple_ble_bond_stats_t stats;
+	uint32_t lookups;
+
+	simple_ble_init(&ble_config);
+
+	section("a first visit pairs, the next ones resume");
+	visit(0xa1);
+	visit(0xa1);
+	visit(0xa1);
+
+	section("two more phones push a1 out of RAM, it comes back from the store");
+	visit(0xb2);
+	visit(0xc3);
+	visit(0xa1);
+	visit(0xa1);
+
+	section("a phone with keys from somewhere else pairs again");
+	phone_keys[0xd4].master_id.ediv = 0x0bad;
+	visit(0xd4);
+	visit(0xd4);
+
+	section("a phone that bonded while the store was broken, until it drops out of RAM");
+	store_broken = 1;
+	visit(0xe5);
+	store_broken = 0;
+	visit(0xe5);
+	visit(0xb2);
+	visit(0xc3);
+	visit(0xe5);
+
+	section("a phone that re-pairs replaces its bond");
+	memset(&phone_keys[0xb2], 0, sizeof(phone_keys[0xb2]));
+	visit(0xb2);
+	visit(0xb2);
+
+	section("a link that is never encrypted");
+	softdevice_fake_connect(PHONE, BLE_GAP_ROLE_PERIPH, 0xf6);
+	app_timer_fake_advance_ms(SIMPLE_BLE_BOND_TIMEOUT_MS + 1000);
+	softdevice_fake_disconnect(PHONE);
+
+	simple_ble_get_bond_stats(&stats);
+	lookups = stats.cache_hits + stats.flash_hits + stats.unknown;
+	printf("\nstats: cache hits %lu, flash hits %lu, unknown %lu, bonded %lu, store failed %lu, "
+	       "resumed %lu, paired %lu, unencrypted %lu\n",
+	       (unsigned long) stats.cache_hits, (unsigned long) stats.flash_hits,
+	       (unsigned long) stats.unknown, (unsigned long) stats.bonded,
+	       (unsigned long) stats.store_failed, (unsigned long) stats.resumed,
+	       (unsigned long) stats.paired, (unsigned long) stats.unencrypted);
+	printf("cache hit rate %lu%%, to encrypted: resumed %lu ms mean %lu ms max, paired %lu ms mean\n",
+	       (unsigned long) (lookups ? stats.cache_hits * 100 / lookups : 0),
+	       (unsigned long) (stats.resumed ? stats.resume_ms / stats.resumed : 0),
+	       (unsigned long) stats.resume_ms_max,
+	       (unsigned long) (stats.paired ? stats.pair_ms / stats.paired : 0));
+	return 0;
+}
@@ -0,0 +1,146 @@
+// simple_ble's connection parameter policy on the fake SoftDevice and the
+// app_timer fake. A phone is connected in the peripheral role, the test
+// plays the central: it takes or turns down each request, or ignores it.
+// Prints the requests with the second they went out at, and the policy's
+// counters.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+#define PHONE 1
+
+enum {ACCEPT, REJECT, IGNORE};
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "policy",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(40, UNIT_1_25_MS),
+};
+
+static simple_ble_service_t service = {
+	.uuid128 = {{0x87, 0xa4, 0xde, 0xa0, 0x96, 0xea, 0x4e, 0xe6,
+	             0x87, 0x45, 0x83, 0x28, 0x89, 0x0f, 0xad, 0x7b}}
+};
+static simple_ble_char_t sample_char = {.uuid16 = 0x8911};
+static uint8_t sample[4];
+
+static uint32_t seconds;
+static uint8_t central = ACCEPT;
+static simple_ble_conn_policy_stats_t last;
+
+void ble_address_set (void) {
+}
+
+// What the central picks from a request, or 0 to keep what it has
+static void answer (uint16_t interval, uint16_t latency) {
+	if (central == ACCEPT) {
+		softdevice_fake_conn_param_update(PHONE, interval, latency);
+	} else if (central == REJECT) {
+		softdevice_fake_conn_param_update(PHONE, last.conn_interval, last.slave_latency);
+	}
+}
+
+// One second at a time, with notifications sent each second and
+// acknowledged by the next
+static void run (uint32_t secs, uint32_t notifies) {
+	simple_ble_conn_policy_stats_t stats;
+	uint32_t i, n;
+
+	for (i = 0; i < secs; i++) {
+		for (n = 0; n < notifies; n++) {
+			sample[0] = seconds;
+			simple_ble_notify_char(&sample_char);
+		}
+		app_timer_fake_advance_ms(1000);
+		seconds++;
+		softdevice_fake_tx_complete(PHONE, softdevice_fake_tx_pending(PHONE));
+
+		simple_ble_get_conn_policy_stats(&stats);
+		if (stats.to_bulk != last.to_bulk) {
+			printf("  at %lus, bulk\n", (unsigned long) seconds);
+			last = stats;
+			answer(BULK_MIN_CONN_INTERVAL * 2, 0);
+		} else if (stats.to_idle != last.to_idle) {
+			printf("  at %lus, idle\n", (unsigned long) seconds);
+			last = stats;
+			answer(IDLE_MAX_CONN_INTERVAL, IDLE_SLAVE_LATENCY);
+		}
+		simple_ble_get_conn_policy_stats(&last);
+	}
+}
+
+static void print_stats (void) {
+	simple_ble_conn_policy_stats_t stats;
+
+	simple_ble_get_conn_policy_stats(&stats);
+	printf("stats: to bulk %lu, to idle %lu, deferred %lu, rejected %lu, "
+	       "ticks normal %lu bulk %lu idle %lu, interval %u latency %u\n",
+	       (unsigned long) stats.to_bulk, (unsigned long) stats.to_idle,
+	       (unsigned long) stats.deferred, (unsigned long) stats.rejected,
+	       (unsigned long) stats.normal_ticks, (unsigned long) stats.bulk_ticks,
+	       (unsigned long) stats.idle_ticks, stats.conn_interval, stats.slave_latency);
+}
+
+static void section (const char* name) {
+	printf("\n%s\n", name);
+}
+
+int main (void) {
+	int i;
+
+	simple_ble_init(&ble_config);
+	simple_ble_add_service(&service);
+	simple_ble_add_characteristic(1, 0, 1, 0, sizeof(sample), sample, &service, &sample_char);
+	softdevice_fake_connect(PHONE, BLE_GAP_ROLE_PERIPH, 0xa1);
+	softdevice_fake_cccd(PHONE, sample_char.char_handle.value_handle, 1);
+	simple_ble_get_conn_policy_stats(&last);
+
+	section("a notification a second keeps the configured parameters");
+	run(10, 1);
+
+	section("traffic stops, idle after five quiet seconds");
+	run(10, 0);
+
+	section("a burst backs up the queue, bulk straight away");
+	for (i = 0; i < 12; i++) {
+		simple_ble_notify_char(&sample_char);
+	}
+	run(3, 0);
+
+	section("quiet again, idle again");
+	run(10, 0);
+
+	section("the central turns the next burst's bulk request down");
+	central = REJECT;
+	for (i = 0; i < 12; i++) {
+		simple_ble_notify_char(&sample_char);
+	}
+	run(3, 0);
+
+	section("a bulk transfer during the back-off waits for it");
+	central = ACCEPT;
+	simple_ble_conn_policy_bulk();
+	run(35, 2);
+
+	section("the central never answers the idle request");
+	central = IGNORE;
+	run(20, 0);
+	print_stats();
+
+	section("a central changing the parameters itself doesn't reach ble_conn_params");
+	softdevice_fake_conn_param_update(PHONE, 80, 0);
+	print_stats();
+
+	section("disconnected, the policy stops");
+	softdevice_fake_disconnect(PHONE);
+	run(10, 0);
+	print_stats();
+	return 0;
+}
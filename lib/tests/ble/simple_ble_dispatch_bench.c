@@ -0,0 +1,112 @@
+// Host benchmark of how simple_ble hands GATT writes to the application
+//
+// With 1, 10 and 50 characteristics, times a write event from the fake
+// SoftDevice until it reaches the code for its characteristic: once through
+// ble_evt_write calling simple_ble_is_char_event on each characteristic in
+// turn, as the apps do, and once through the handlers registered with the
+// characteristics. Writes go round all the characteristics.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+
+#define BENCH_WRITES 2000000
+#define MAX_CHARS 50
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "bench",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static simple_ble_service_t service = {
+	.uuid128 = {{0x87, 0xa4, 0xde, 0xa0, 0x96, 0xea, 0x4e, 0xe6,
+	             0x87, 0x45, 0x83, 0x28, 0x89, 0x0f, 0xad, 0x7b}}
+};
+static simple_ble_char_t chars[MAX_CHARS];
+static uint8_t values[MAX_CHARS];
+static uint32_t char_count;
+static uint32_t hits[MAX_CHARS];
+
+static ble_evt_t writes[MAX_CHARS];
+
+void ble_address_set (void) {
+}
+
+static void on_write (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
+	hits[char_handle - chars]++;
+}
+
+// The way the apps find the characteristic today
+void ble_evt_write (ble_evt_t* p_ble_evt) {
+	uint32_t i;
+
+	for (i = 0; i < char_count; i++) {
+		if (simple_ble_is_char_event(p_ble_evt, &chars[i])) {
+			on_write(p_ble_evt, &chars[i]);
+			return;
+		}
+	}
+}
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double run (uint32_t count, uint8_t registered) {
+	uint64_t start;
+	uint32_t i;
+
+	char_count = count;
+	simple_ble_init(&ble_config);
+	simple_ble_add_service(&service);
+	for (i = 0; i < count; i++) {
+		memset(&chars[i], 0, sizeof(chars[i]));
+		chars[i].uuid16 = 0x9000 + i;
+		chars[i].handler = registered ? on_write : NULL;
+		simple_ble_add_characteristic(1, 1, 0, 0, 1, &values[i], &service, &chars[i]);
+
+		memset(&writes[i], 0, sizeof(writes[i]));
+		writes[i].header.evt_id = BLE_GATTS_EVT_WRITE;
+		writes[i].evt.gatts_evt.conn_handle = 1;
+		writes[i].evt.gatts_evt.params.write.handle = chars[i].char_handle.value_handle;
+		writes[i].evt.gatts_evt.params.write.len = 1;
+	}
+	memset(hits, 0, sizeof(hits));
+
+	start = now_ns();
+	for (i = 0; i < BENCH_WRITES; i++) {
+		softdevice_fake_evt(&writes[i % count]);
+	}
+	start = now_ns() - start;
+
+	for (i = 0; i < count; i++) {
+		if (hits[i] != BENCH_WRITES / count + (i < BENCH_WRITES % count)) {
+			printf("characteristic %u got %u writes\n", i, hits[i]);
+		}
+	}
+	return (double) start / BENCH_WRITES;
+}
+
+int main (void) {
+	static const uint32_t counts[] = {1, 10, 50};
+	uint32_t i;
+
+	printf("%-16s %18s %18s\n", "characteristics", "is_char_event ns", "handler table ns");
+	for (i = 0; i < sizeof(counts)/sizeof(counts[0]); i++) {
+		double chain = run(counts[i], 0);
+		double table = run(counts[i], 1);
+		printf("%-16u %18.1f %18.1f\n", counts[i], chain, table);
+	}
+	return 0;
+}
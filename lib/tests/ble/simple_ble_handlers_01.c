@@ -0,0 +1,105 @@
+// Writes and authorization requests reaching the handlers registered with
+// the characteristics on the fake SoftDevice, and falling through to the
+// ble_evt_write and ble_evt_rw_auth callbacks for the ones without.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+
+#define PHONE 1
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "handlers",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static void on_led (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle);
+static void on_config (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle);
+static void on_secret (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle);
+
+static simple_ble_service_t service = {
+	.uuid128 = {{0x87, 0xa4, 0xde, 0xa0, 0x96, 0xea, 0x4e, 0xe6,
+	             0x87, 0x45, 0x83, 0x28, 0x89, 0x0f, 0xad, 0x7b}}
+};
+static simple_ble_char_t led_char = {.uuid16 = 0x8910, .handler = on_led};
+static simple_ble_char_t name_char = {.uuid16 = 0x8911};
+static simple_ble_char_t config_char = {.uuid16 = 0x8912, .handler = on_config};
+static simple_ble_char_t secret_char = {.uuid16 = 0x8913, .handler = on_secret};
+static simple_ble_char_t sample_char = {.uuid16 = 0x8914, .handler = on_led};
+static uint8_t led;
+static uint8_t name[8];
+static uint8_t config[2];
+static uint8_t secret[4];
+static uint8_t sample[4];
+
+void ble_address_set (void) {
+}
+
+static void on_led (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
+	printf("on_led: %04x handle %u, value %02x\n", char_handle->uuid16,
+	       p_ble_evt->evt.gatts_evt.params.write.handle, led);
+}
+
+static void on_config (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
+	printf("on_config: write auth %s\n",
+	       simple_ble_is_write_auth_event(p_ble_evt, char_handle) ? "yes" : "no");
+	simple_ble_grant_auth(p_ble_evt);
+}
+
+static void on_secret (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
+	printf("on_secret: read auth %s\n",
+	       simple_ble_is_read_auth_event(p_ble_evt, char_handle) ? "yes" : "no");
+	simple_ble_grant_auth(p_ble_evt);
+}
+
+void ble_evt_write (ble_evt_t* p_ble_evt) {
+	printf("ble_evt_write: handle %u%s\n", p_ble_evt->evt.gatts_evt.params.write.handle,
+	       simple_ble_is_char_event(p_ble_evt, &name_char) ? " (name)" : "");
+}
+
+void ble_evt_rw_auth (ble_evt_t* p_ble_evt) {
+	printf("ble_evt_rw_auth\n");
+}
+
+int main (void) {
+	ble_evt_t read_auth;
+	uint8_t on = 1;
+	uint8_t value[2] = {0x12, 0x34};
+
+	simple_ble_init(&ble_config);
+	simple_ble_add_service(&service);
+	simple_ble_add_characteristic(1, 1, 0, 0, sizeof(led), &led, &service, &led_char);
+	simple_ble_add_characteristic(1, 1, 0, 1, sizeof(name), name, &service, &name_char);
+	simple_ble_add_auth_characteristic(1, 1, 0, 0, false, true, sizeof(config), config,
+	                                   &service, &config_char);
+	simple_ble_add_auth_characteristic(1, 0, 0, 0, true, false, sizeof(secret), secret,
+	                                   &service, &secret_char);
+	simple_ble_add_characteristic(1, 0, 1, 0, sizeof(sample), sample, &service, &sample_char);
+	softdevice_fake_connect(PHONE, BLE_GAP_ROLE_PERIPH, 0xa1);
+
+	printf("\nwrites\n");
+	softdevice_fake_write(PHONE, led_char.char_handle.value_handle, &on, 1);
+	softdevice_fake_write(PHONE, name_char.char_handle.value_handle, (const uint8_t*) "abc", 3);
+
+	printf("\nauthorization\n");
+	softdevice_fake_write(PHONE, config_char.char_handle.value_handle, value, sizeof(value));
+	printf("config %02x %02x\n", config[0], config[1]);
+	memset(&read_auth, 0, sizeof(read_auth));
+	read_auth.header.evt_id = BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST;
+	read_auth.evt.gatts_evt.conn_handle = PHONE;
+	read_auth.evt.gatts_evt.params.authorize_request.type = BLE_GATTS_AUTHORIZE_TYPE_READ;
+	read_auth.evt.gatts_evt.params.authorize_request.request.read.handle = secret_char.char_handle.value_handle;
+	softdevice_fake_evt(&read_auth);
+	read_auth.evt.gatts_evt.params.authorize_request.request.read.handle = name_char.char_handle.value_handle;
+	softdevice_fake_evt(&read_auth);
+
+	printf("\nCCCD writes aren't the characteristic's\n");
+	softdevice_fake_cccd(PHONE, sample_char.char_handle.value_handle, 1);
+	return 0;
+}
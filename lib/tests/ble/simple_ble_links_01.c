@@ -0,0 +1,201 @@
+// Runs simple_ble.c on the fake SoftDevice with a phone connected to us and
+// sensors we connected to as central, and prints what simple_ble asked the
+// SoftDevice for so the output can be diffed. Covers notifying one link and
+// all of them, each link's queue filling and draining on its own with the
+// values as they are when sent, and links going down in any order.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+
+#define PHONE   1
+#define SENSOR1 2
+#define SENSOR2 3
+
+static simple_ble_app_t* simple_ble_app;
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "links",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static simple_ble_service_t service = {
+	.uuid128 = {{0x87, 0xa4, 0xde, 0xa0, 0x96, 0xea, 0x4e, 0xe6,
+	             0x87, 0x45, 0x83, 0x28, 0x89, 0x0f, 0xad, 0x7b}}
+};
+static simple_ble_char_t sample_char = {.uuid16 = 0x8911};
+static simple_ble_char_t config_char = {.uuid16 = 0x8912};
+static simple_ble_char_t level_chars[SIMPLE_BLE_NOTIFY_QUEUE_LEN];
+static uint8_t sample[4];
+static uint8_t config[2];
+static uint8_t levels[SIMPLE_BLE_NOTIFY_QUEUE_LEN];
+
+// There's no flash to read an address from
+void ble_address_set (void) {
+}
+
+void ble_evt_connected (ble_evt_t* p_ble_evt) {
+	printf("connected %u, %u links, conn_handle %u\n", p_ble_evt->evt.gap_evt.conn_handle,
+	       simple_ble_app->link_count, simple_ble_app->conn_handle);
+}
+
+void ble_evt_disconnected (ble_evt_t* p_ble_evt) {
+	printf("disconnected %u, %u links, conn_handle %u\n", p_ble_evt->evt.gap_evt.conn_handle,
+	       simple_ble_app->link_count, simple_ble_app->conn_handle);
+}
+
+void ble_evt_rw_auth (ble_evt_t* p_ble_evt) {
+	if (simple_ble_is_write_auth_event(p_ble_evt, &config_char)) {
+		printf("config write from %u\n", p_ble_evt->evt.gatts_evt.conn_handle);
+		simple_ble_grant_auth(p_ble_evt);
+	}
+}
+
+static void set_sample (uint8_t value) {
+	memset(sample, value, sizeof(sample));
+}
+
+static void print_stats (void) {
+	simple_ble_notify_stats_t stats;
+
+	simple_ble_get_notify_stats(&stats);
+	printf("stats: queued %lu, high water %lu, sent %lu, dropped %lu, coalesced %lu, failed %lu\n",
+	       (unsigned long) stats.queued, (unsigned long) stats.high_water,
+	       (unsigned long) stats.sent, (unsigned long) stats.dropped,
+	       (unsigned long) stats.coalesced, (unsigned long) stats.failed);
+}
+
+static void section (const char* name) {
+	printf("\n%s\n", name);
+}
+
+int main (void) {
+	simple_ble_link_t* link;
+	uint8_t value[2] = {0x12, 0x34};
+	uint32_t err_code;
+	int i;
+
+	printf("%u links\n", SIMPLE_BLE_MAX_LINKS);
+	simple_ble_app = simple_ble_init(&ble_config);
+	simple_ble_add_service(&service);
+	simple_ble_add_characteristic(1, 0, 1, 0, sizeof(sample), sample, &service, &sample_char);
+	simple_ble_add_auth_characteristic(1, 1, 0, 0, false, true, sizeof(config), config,
+	                                   &service, &config_char);
+	for (i = 0; i < SIMPLE_BLE_NOTIFY_QUEUE_LEN; i++) {
+		level_chars[i].uuid16 = 0x8920 + i;
+		simple_ble_add_characteristic(1, 0, 1, 0, 1, &levels[i], &service, &level_chars[i]);
+	}
+	advertising_start();
+
+	section("phone connects, sensors on central links");
+	softdevice_fake_connect(PHONE, BLE_GAP_ROLE_PERIPH, 0xa1);
+	softdevice_fake_connect(SENSOR1, BLE_GAP_ROLE_CENTRAL, 0xb1);
+	softdevice_fake_connect(SENSOR2, BLE_GAP_ROLE_CENTRAL, 0xb2);
+	for (i = PHONE; i <= SENSOR2; i++) {
+		link = simple_ble_get_link(i);
+		printf("link %u: role %u, peer %02x, payload %u\n", link->conn_handle, link->role,
+		       link->peer_addr.addr[0], simple_ble_get_max_payload(i));
+	}
+	printf("unknown link: %s, payload %u\n", simple_ble_get_link(7) ? "found" : "NULL",
+	       simple_ble_get_max_payload(7));
+
+	section("notify with no CCCDs written");
+	set_sample(0x01);
+	err_code = simple_ble_notify_char(&sample_char);
+	printf("notify all: %lu\n", (unsigned long) err_code);
+
+	section("phone and sensor 2 enable notifications");
+	softdevice_fake_cccd(PHONE, sample_char.char_handle.value_handle, 1);
+	softdevice_fake_cccd(SENSOR2, sample_char.char_handle.value_handle, 1);
+	set_sample(0x02);
+	simple_ble_notify_char_all(&sample_char);
+	set_sample(0x03);
+	simple_ble_notify_char_link(SENSOR2, &sample_char);
+	err_code = simple_ble_notify_char_link(7, &sample_char);
+	printf("notify unknown link: %lu\n", (unsigned long) err_code);
+
+	section("phone's buffers fill, the repeats wait as one, sensor 2 keeps going");
+	for (i = 0; i < 12; i++) {
+		set_sample(0x10 + i);
+		err_code = simple_ble_notify_char_link(PHONE, &sample_char);
+		if (err_code != NRF_SUCCESS) {
+			printf("notify %02x: %lu\n", 0x10 + i, (unsigned long) err_code);
+		}
+	}
+	set_sample(0x20);
+	simple_ble_notify_char_link(SENSOR2, &sample_char);
+	print_stats();
+
+	section("phone acknowledges, the queued one goes out with the latest value");
+	softdevice_fake_tx_complete(PHONE, 2);
+	softdevice_fake_tx_complete(SENSOR2, 1);
+	softdevice_fake_tx_complete(PHONE, 4);
+	print_stats();
+
+	section("more characteristics than the queue holds, drained in order");
+	for (i = 0; i < SIMPLE_BLE_NOTIFY_QUEUE_LEN; i++) {
+		softdevice_fake_cccd(PHONE, level_chars[i].char_handle.value_handle, 1);
+	}
+	for (i = 0; i < 5; i++) {
+		set_sample(0x50 + i);
+		simple_ble_notify_char_link(PHONE, &sample_char);
+	}
+	for (i = 0; i < SIMPLE_BLE_NOTIFY_QUEUE_LEN; i++) {
+		levels[i] = 0x60 + i;
+		err_code = simple_ble_notify_char_link(PHONE, &level_chars[i]);
+		if (err_code != NRF_SUCCESS) {
+			printf("notify level %u: %lu\n", i, (unsigned long) err_code);
+		}
+	}
+	print_stats();
+	softdevice_fake_tx_complete(PHONE, 0xff);
+	softdevice_fake_tx_complete(PHONE, 0xff);
+	print_stats();
+
+	section("the app changes a value while its notification waits");
+	softdevice_fake_tx_complete(PHONE, 0xff);
+	for (i = 0; i < 4; i++) {
+		set_sample(0x70 + i);
+		simple_ble_notify_char_link(PHONE, &sample_char);
+	}
+	set_sample(0x22);
+	simple_ble_notify_char_link(PHONE, &sample_char);
+	sample[0] = 0x33;
+	softdevice_fake_tx_complete(PHONE, 1);
+	softdevice_fake_tx_complete(SENSOR2, 0xff);
+	printf("sample %02x %02x\n", sample[0], sample[1]);
+	simple_ble_notify_char_link(SENSOR2, &sample_char);
+
+	section("writes and authorization go back on their own link");
+	softdevice_fake_write(SENSOR1, config_char.char_handle.value_handle, value, sizeof(value));
+	printf("config %02x %02x\n", config[0], config[1]);
+
+	section("phone drops with notifications queued");
+	set_sample(0x30);
+	simple_ble_notify_char_all(&sample_char);
+	softdevice_fake_disconnect(PHONE);
+	print_stats();
+	set_sample(0x31);
+	simple_ble_notify_char_all(&sample_char);
+
+	section("phone reconnects as a new link");
+	softdevice_fake_connect(4, BLE_GAP_ROLE_PERIPH, 0xa1);
+	softdevice_fake_cccd(4, sample_char.char_handle.value_handle, 1);
+	set_sample(0x40);
+	simple_ble_notify_char(&sample_char);
+
+	section("everything disconnects");
+	softdevice_fake_disconnect(SENSOR2);
+	softdevice_fake_disconnect(4);
+	softdevice_fake_disconnect(SENSOR1);
+	err_code = simple_ble_notify_char(&sample_char);
+	printf("notify with no links: %lu\n", (unsigned long) err_code);
+	print_stats();
+	return 0;
+}
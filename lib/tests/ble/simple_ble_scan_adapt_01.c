@@ -0,0 +1,141 @@
+// The adaptive scan of simple_ble, on the fake SoftDevice and the app_timer
+// fake, with the default targets. Beacons turn up now and then, and the
+// scan parameters are printed each time they change, with the time. Once
+// the scan stops nothing changes, and no time is counted as scanning.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "adapt",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static const uint8_t beacon[] = {0x02, 0x01, 0x04, 0x05, 0xff, 0x59, 0x00, 0x01, 0x00};
+
+static uint32_t ms;
+static ble_gap_scan_params_t last;
+static uint8_t was_scanning;
+
+void ble_address_set (void) {
+}
+
+static void print_params (void) {
+	ble_gap_scan_params_t params;
+
+	if (!softdevice_fake_scan_params(&params)) {
+		if (was_scanning) {
+			printf("  at %lu.%lus, not scanning\n", (unsigned long) ms / 1000, (unsigned long) ms % 1000 / 100);
+		}
+		was_scanning = 0;
+		return;
+	}
+	if (!was_scanning || params.interval != last.interval || params.window != last.window) {
+		printf("  at %lu.%lus, interval %u ms window %u ms\n", (unsigned long) ms / 1000,
+		       (unsigned long) ms % 1000 / 100, params.interval * 625 / 1000, params.window * 625 / 1000);
+	}
+	was_scanning = 1;
+	last = params;
+}
+
+// A second at a time, with the beacons heard every 100 ms
+static void run (uint32_t secs, uint8_t first, uint8_t count) {
+	uint32_t s, t;
+	uint8_t i;
+
+	for (s = 0; s < secs; s++) {
+		for (t = 0; t < 10; t++) {
+			for (i = 0; i < count; i++) {
+				softdevice_fake_adv_report(first + i, 0, -70, beacon, sizeof(beacon));
+			}
+			app_timer_fake_advance_ms(100);
+			ms += 100;
+			print_params();
+		}
+	}
+}
+
+static void print_stats (void) {
+	simple_ble_scan_adapt_stats_t stats;
+
+	simple_ble_get_scan_adapt_stats(&stats);
+	printf("stats: bursts %lu, backoffs %lu, changes %lu, scanning %lu ms of %lu\n",
+	       (unsigned long) stats.bursts, (unsigned long) stats.backoffs,
+	       (unsigned long) stats.changes, (unsigned long) stats.scan_ms,
+	       (unsigned long) ms);
+}
+
+static void scan_timeout (void) {
+	ble_evt_t evt;
+
+	memset(&evt, 0, sizeof(evt));
+	evt.header.evt_id = BLE_GAP_EVT_TIMEOUT;
+	evt.evt.gap_evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+	evt.evt.gap_evt.params.timeout.src = BLE_GAP_TIMEOUT_SRC_SCAN;
+	sd_ble_gap_scan_stop();
+	softdevice_fake_evt(&evt);
+}
+
+static void section (const char* title) {
+	printf("\n%s\n", title);
+}
+
+int main (void) {
+	simple_ble_init(&ble_config);
+
+	section("a scan starts with a burst, nothing is around");
+	simple_ble_scan_start();
+	print_params();
+	run(60, 0, 0);
+	print_stats();
+
+	section("a beacon turns up, and stays");
+	run(30, 0x10, 1);
+	print_stats();
+
+	section("three more while backing off again");
+	run(14, 0x10, 1);
+	run(20, 0x10, 4);
+	print_stats();
+
+	section("bursts leave room for advertising");
+	advertising_start();
+	run(2, 0x20, 1);
+	advertising_stop();
+	run(5, 0x20, 1);
+
+	section("the scan is started again");
+	simple_ble_scan_start();
+	print_params();
+	run(5, 0x20, 1);
+	print_stats();
+
+	section("stopped by the app");
+	simple_ble_scan_stop();
+	run(30, 0x30, 1);
+	print_stats();
+
+	section("stopped by connecting as central");
+	simple_ble_scan_start();
+	run(2, 0x40, 1);
+	softdevice_fake_connect(1, BLE_GAP_ROLE_CENTRAL, 0x40);
+	run(30, 0x50, 1);
+	softdevice_fake_disconnect(1);
+	print_stats();
+
+	section("stopped by a scan timeout");
+	simple_ble_scan_start();
+	run(2, 0x60, 1);
+	scan_timeout();
+	run(30, 0x70, 1);
+	print_stats();
+	return 0;
+}
@@ -0,0 +1,157 @@
+// Host simulation of discovery latency against radio time for simple_ble's
+// scan
+//
+// An hour in a place that is quiet most of the time: every ten minutes a
+// crowd of 30 devices comes through within two minutes, and in between one
+// turns up every few minutes. Devices advertise every 100 ms to 1 s, plus
+// the 0-10 ms advertising delay, and stay two to ten minutes. An
+// advertising event is heard if it falls inside a window of the scan
+// simple_ble has running on the fake SoftDevice, a millisecond at a time.
+//
+// Prints the time from a device turning up to its first report reaching
+// the app, and the share of the hour the radio spent scanning. Built once
+// with SIMPLE_BLE_SCAN_ADAPT and once without, to compare against the
+// static scan parameters.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+#define SIM_MS (60 * 60 * 1000)
+#define MAX_DEVICES 512
+
+typedef struct {
+	uint32_t arrive;        // ms
+	uint32_t leave;
+	uint32_t interval;      // advertising interval, ms
+	uint32_t next_adv;
+	int32_t  found;         // ms it was first reported at, -1 before
+} device_t;
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "sim",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static device_t devices[MAX_DEVICES];
+static uint32_t device_count;
+static uint32_t now;
+static uint32_t seed = 0x1234567;
+static ble_evt_t report;
+
+void ble_address_set (void) {
+}
+
+void ble_evt_adv_report (ble_evt_t* p_ble_evt) {
+	const uint8_t* addr = p_ble_evt->evt.gap_evt.params.adv_report.peer_addr.addr;
+	device_t* device = &devices[addr[0] | (addr[1] << 8)];
+
+	if (device->found < 0) {
+		device->found = now;
+	}
+}
+
+static uint32_t xorshift (void) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static void add (uint32_t arrive) {
+	static const uint32_t intervals[] = {100, 250, 500, 1000};
+	device_t* device = &devices[device_count++];
+
+	device->arrive = arrive;
+	device->leave = arrive + 120000 + xorshift() % 480000;
+	device->interval = intervals[xorshift() % 4];
+	device->next_adv = arrive + xorshift() % device->interval;
+	device->found = -1;
+}
+
+static int compare (const void* a, const void* b) {
+	return *(const uint32_t*) a - *(const uint32_t*) b;
+}
+
+int main (void) {
+	static uint32_t latencies[MAX_DEVICES];
+	ble_gap_scan_params_t params;
+	uint32_t scan_start = 0, scanning_ms = 0, changes = 0;
+	uint16_t interval = 0, window = 0;
+	uint32_t i, t, found = 0;
+	uint64_t total = 0;
+
+	for (t = 0; t < SIM_MS; t += 600000) {
+		for (i = 0; i < 30; i++) {
+			add(t + 300000 + xorshift() % 120000);
+		}
+		for (i = 0; i < 3; i++) {
+			add(t + xorshift() % 600000);
+		}
+	}
+
+	memset(&report, 0, sizeof(report));
+	report.header.evt_id = BLE_GAP_EVT_ADV_REPORT;
+	report.evt.gap_evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+	report.evt.gap_evt.params.adv_report.peer_addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+	report.evt.gap_evt.params.adv_report.rssi = -70;
+	report.evt.gap_evt.params.adv_report.dlen = 3;
+	memcpy(report.evt.gap_evt.params.adv_report.data, "\x02\x01\x04", 3);
+
+	softdevice_fake_quiet(1);
+	simple_ble_init(&ble_config);
+	simple_ble_scan_start();
+
+	for (now = 0; now < SIM_MS; now++) {
+		uint8_t on = softdevice_fake_scan_params(&params);
+
+		if (on && (params.interval != interval || params.window != window)) {
+			// a scan with new parameters starts its first window now
+			interval = params.interval;
+			window = params.window;
+			scan_start = now;
+			changes++;
+		}
+		on = on && ((now - scan_start) * 1000 % (interval * 625)) < (uint32_t) window * 625;
+		scanning_ms += on;
+
+		for (i = 0; i < device_count; i++) {
+			device_t* device = &devices[i];
+			if (now < device->arrive || now >= device->leave || now < device->next_adv) {
+				continue;
+			}
+			device->next_adv = now + device->interval + xorshift() % 11;
+			if (on) {
+				report.evt.gap_evt.params.adv_report.peer_addr.addr[0] = i;
+				report.evt.gap_evt.params.adv_report.peer_addr.addr[1] = i >> 8;
+				softdevice_fake_evt(&report);
+			}
+		}
+		app_timer_fake_advance_ms(1);
+	}
+
+	for (i = 0; i < device_count; i++) {
+		if (devices[i].found >= 0) {
+			latencies[found++] = devices[i].found - devices[i].arrive;
+			total += devices[i].found - devices[i].arrive;
+		}
+	}
+	qsort(latencies, found, sizeof(latencies[0]), compare);
+
+	printf("%u devices, %u found\n", device_count, found);
+	if (found > 0) {
+		printf("latency ms: mean %lu, median %u, 90%% %u, max %u\n", (unsigned long) (total / found),
+		       latencies[found / 2], latencies[found * 9 / 10], latencies[found - 1]);
+	}
+	printf("radio scanning %.1f%% of the time, %u parameter changes\n",
+	       100.0 * scanning_ms / SIM_MS, changes);
+	return 0;
+}
@@ -0,0 +1,112 @@
+// The scan report cache of simple_ble, with eight entries in two sets, on
+// the fake SoftDevice and the app_timer fake. Beacons advertise, change
+// their payloads, answer scans and crowd each other out. Prints the reports
+// that reach the app with their RSSI so far, and the cache's counters.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "dedup",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static const uint8_t beacon[] = {0x02, 0x01, 0x04, 0x05, 0xff, 0x59, 0x00, 0x01, 0x00};
+static const uint8_t beacon_changed[] = {0x02, 0x01, 0x04, 0x05, 0xff, 0x59, 0x00, 0x02, 0x00};
+static const uint8_t name[] = {0x05, 0x09, 'n', 'a', 'm', 'e'};
+
+void ble_address_set (void) {
+}
+
+void ble_evt_adv_report (ble_evt_t* p_ble_evt) {
+	ble_gap_evt_adv_report_t* p_report = &p_ble_evt->evt.gap_evt.params.adv_report;
+	simple_ble_scan_rssi_t rssi;
+
+	printf("  app: %02x %s %u bytes, rssi %d", p_report->peer_addr.addr[0],
+	       p_report->scan_rsp ? "rsp" : "adv", p_report->dlen, p_report->rssi);
+	if (simple_ble_scan_dedup_rssi(p_ble_evt, &rssi)) {
+		printf(", %u reports, smoothed %d, max %d", rssi.reports, rssi.rssi, rssi.rssi_max);
+	}
+	printf("\n");
+}
+
+static void print_stats (void) {
+	simple_ble_scan_dedup_stats_t stats;
+
+	simple_ble_get_scan_dedup_stats(&stats);
+	printf("stats: reports %lu, hits %lu, misses %lu, aged %lu, evictions %lu\n",
+	       (unsigned long) stats.reports, (unsigned long) stats.hits,
+	       (unsigned long) stats.misses, (unsigned long) stats.aged,
+	       (unsigned long) stats.evictions);
+}
+
+static void section (const char* title) {
+	printf("\n%s\n", title);
+}
+
+int main (void) {
+	uint32_t wakeups;
+	int i;
+
+	simple_ble_init(&ble_config);
+	simple_ble_scan_start();
+
+	section("a beacon heard ten times a second reaches the app once");
+	for (i = 0; i < 10; i++) {
+		softdevice_fake_adv_report(0x10, 0, -60 - (i % 3) * 4, beacon, sizeof(beacon));
+		app_timer_fake_advance_ms(100);
+	}
+	print_stats();
+
+	section("its payload changes");
+	softdevice_fake_adv_report(0x10, 0, -62, beacon_changed, sizeof(beacon_changed));
+	softdevice_fake_adv_report(0x10, 0, -62, beacon_changed, sizeof(beacon_changed));
+
+	section("it answers a scan, then the same payload from another address");
+	softdevice_fake_adv_report(0x10, 1, -61, name, sizeof(name));
+	softdevice_fake_adv_report(0x10, 1, -61, name, sizeof(name));
+	softdevice_fake_adv_report(0x11, 1, -70, name, sizeof(name));
+	print_stats();
+
+	section("still heard, passed on again within ten seconds with its RSSI so far");
+	for (i = 0; i < 100; i++) {
+		softdevice_fake_adv_report(0x10, 0, -50 - (i % 10), beacon_changed, sizeof(beacon_changed));
+		app_timer_fake_advance_ms(100);
+	}
+	softdevice_fake_adv_report(0x10, 0, -55, beacon_changed, sizeof(beacon_changed));
+	print_stats();
+
+	section("twelve beacons at once crowd out the cache");
+	for (i = 0; i < 12; i++) {
+		softdevice_fake_adv_report(0x20 + i, 0, -80, beacon, sizeof(beacon));
+	}
+	for (i = 0; i < 12; i++) {
+		softdevice_fake_adv_report(0x20 + i, 0, -80, beacon, sizeof(beacon));
+	}
+	print_stats();
+
+	section("nothing heard for ten seconds, the timer stops after a step");
+	wakeups = app_timer_fake_wakeups();
+	app_timer_fake_advance_ms(10000);
+	printf("wakeups: %lu\n", (unsigned long) (app_timer_fake_wakeups() - wakeups));
+
+	section("heard again after the silence, passed on once");
+	softdevice_fake_adv_report(0x10, 0, -58, beacon_changed, sizeof(beacon_changed));
+	softdevice_fake_adv_report(0x10, 0, -58, beacon_changed, sizeof(beacon_changed));
+	print_stats();
+
+	section("cleared, the first beacon is new again");
+	simple_ble_scan_dedup_clear();
+	softdevice_fake_adv_report(0x10, 0, -60, beacon_changed, sizeof(beacon_changed));
+	softdevice_fake_adv_report(0x10, 0, -60, beacon_changed, sizeof(beacon_changed));
+	print_stats();
+	return 0;
+}
@@ -0,0 +1,142 @@
+// Host benchmark of simple_ble's scan report cache
+//
+// Rooms of 50, 200 and 500 beacons, each advertising ten times a second
+// for a minute with reports arriving in random order. A tenth of them
+// change their payload each second, a counter as sensors do, and every
+// other report of a quarter of them is a scan response. Prints the time
+// per report from the fake SoftDevice through the cache, how many reports
+// still reach the app and the cache's counters. Evictions include the old
+// payloads of beacons that changed. Built with a 512 entry
+// cache, so the largest room doesn't fit.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+#define MAX_BEACONS 500
+#define SECONDS 60
+#define REPORTS_PER_SECOND 10
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "bench",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static ble_evt_t adv[MAX_BEACONS];
+static ble_evt_t rsp[MAX_BEACONS];
+static uint16_t order[MAX_BEACONS * REPORTS_PER_SECOND];
+static uint32_t app_reports;
+static uint32_t seed = 0x9e3779b9;
+
+void ble_address_set (void) {
+}
+
+void ble_evt_adv_report (ble_evt_t* p_ble_evt) {
+	app_reports++;
+}
+
+static uint32_t xorshift (void) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void make (ble_evt_t* evt, uint32_t beacon, uint8_t scan_rsp) {
+	static const uint8_t data[] = {0x02, 0x01, 0x04, 0x1a, 0xff, 0x4c, 0x00, 0x02, 0x15,
+	                               0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+	                               0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x00, 0x01, 0x00, 0x00, 0xc5};
+	ble_gap_evt_adv_report_t* p_report = &evt->evt.gap_evt.params.adv_report;
+	uint8_t i;
+
+	memset(evt, 0, sizeof(*evt));
+	evt->header.evt_id = BLE_GAP_EVT_ADV_REPORT;
+	evt->evt.gap_evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+	p_report->peer_addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+	for (i = 0; i < BLE_GAP_ADDR_LEN; i++) {
+		p_report->peer_addr.addr[i] = xorshift();
+	}
+	p_report->rssi = -40 - (int8_t) (xorshift() % 50);
+	p_report->scan_rsp = scan_rsp;
+	memcpy(p_report->data, data, sizeof(data));
+	p_report->dlen = scan_rsp ? 8 : sizeof(data);
+	p_report->data[28] = beacon;
+}
+
+static void run (uint32_t beacons) {
+	simple_ble_scan_dedup_stats_t stats, before;
+	uint32_t reports = beacons * REPORTS_PER_SECOND;
+	uint64_t ns = 0, start;
+	uint32_t s, i, j, tmp;
+
+	simple_ble_init(&ble_config);
+	simple_ble_scan_start();
+	simple_ble_scan_dedup_clear();
+	for (i = 0; i < beacons; i++) {
+		make(&adv[i], i, 0);
+		rsp[i] = adv[i];
+		rsp[i].evt.gap_evt.params.adv_report.scan_rsp = 1;
+		rsp[i].evt.gap_evt.params.adv_report.dlen = 8;
+	}
+	for (i = 0; i < reports; i++) {
+		order[i] = i;
+	}
+	app_reports = 0;
+	simple_ble_get_scan_dedup_stats(&before);
+
+	for (s = 0; s < SECONDS; s++) {
+		for (i = 0; i < beacons / 10; i++) {
+			adv[xorshift() % beacons].evt.gap_evt.params.adv_report.data[27]++;
+		}
+		for (i = reports - 1; i > 0; i--) {
+			j = xorshift() % (i + 1);
+			tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+		}
+
+		start = now_ns();
+		for (i = 0; i < reports; i++) {
+			uint32_t beacon = order[i] % beacons;
+			if (beacon % 4 == 0 && (order[i] / beacons) % 2) {
+				softdevice_fake_evt(&rsp[beacon]);
+			} else {
+				softdevice_fake_evt(&adv[beacon]);
+			}
+		}
+		ns += now_ns() - start;
+		app_timer_fake_advance_ms(1000);
+	}
+
+	simple_ble_get_scan_dedup_stats(&stats);
+	printf("%-8u %10.1f %10u %10u %10u %10u %10u %10u\n", beacons,
+	       (double) ns / (reports * SECONDS), reports * SECONDS, app_reports,
+	       stats.hits - before.hits, stats.misses - before.misses,
+	       stats.aged - before.aged, stats.evictions - before.evictions);
+}
+
+int main (void) {
+	static const uint32_t rooms[] = {50, 200, 500};
+	uint32_t i;
+
+	printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n", "beacons", "ns/report",
+	       "reports", "to app", "hits", "misses", "aged", "evictions");
+	for (i = 0; i < sizeof(rooms)/sizeof(rooms[0]); i++) {
+		run(rooms[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,155 @@
+// Runs a script of SoftDevice events (see softdevice_fake_script) through
+// simple_ble, with a service like the apps have. Prints the attribute
+// handles first, for the script to use, then what simple_ble does.
+//
+//   simple_ble_script [-p] script
+//
+// With -p nothing is printed while the script runs, and the time simple_ble
+// took for each kind of event is printed at the end.
+//
+// On top of the fake's lines, the script can have
+//   advance <ms>                move app_timer on
+//   notify <conn> <handle>      simple_ble_notify_char_link
+//   stats                       simple_ble's notification counters
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+#include "app_timer_fake.h"
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "script",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static void on_led (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle);
+static void on_config (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle);
+
+static simple_ble_service_t service = {
+	.uuid128 = {{0x87, 0xa4, 0xde, 0xa0, 0x96, 0xea, 0x4e, 0xe6,
+	             0x87, 0x45, 0x83, 0x28, 0x89, 0x0f, 0xad, 0x7b}}
+};
+static simple_ble_char_t led_char = {.uuid16 = 0x8910, .handler = on_led};
+static simple_ble_char_t name_char = {.uuid16 = 0x8911};
+static simple_ble_char_t config_char = {.uuid16 = 0x8912, .handler = on_config};
+static simple_ble_char_t sample_char = {.uuid16 = 0x8913};
+static simple_ble_char_t* chars[] = {&led_char, &name_char, &config_char, &sample_char};
+static uint8_t led;
+static uint8_t name[8];
+static uint8_t config[2];
+static uint8_t sample[20];
+
+static uint8_t quiet = 0;
+
+void ble_address_set (void) {
+}
+
+static void on_led (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
+	if (!quiet) printf("led %02x\n", led);
+}
+
+static void on_config (ble_evt_t* p_ble_evt, simple_ble_char_t* char_handle) {
+	if (!quiet) printf("config: granted\n");
+	simple_ble_grant_auth(p_ble_evt);
+}
+
+void ble_evt_connected (ble_evt_t* p_ble_evt) {
+	if (!quiet) printf("ble_evt_connected %u\n", p_ble_evt->evt.gap_evt.conn_handle);
+}
+
+void ble_evt_disconnected (ble_evt_t* p_ble_evt) {
+	if (!quiet) printf("ble_evt_disconnected %u\n", p_ble_evt->evt.gap_evt.conn_handle);
+}
+
+void ble_evt_write (ble_evt_t* p_ble_evt) {
+	if (!quiet) printf("ble_evt_write: handle %u len %u\n", p_ble_evt->evt.gatts_evt.params.write.handle,
+	                   p_ble_evt->evt.gatts_evt.params.write.len);
+}
+
+static simple_ble_char_t* find_char (uint16_t handle) {
+	uint32_t i;
+
+	for (i = 0; i < sizeof(chars)/sizeof(chars[0]); i++) {
+		if (chars[i]->char_handle.value_handle == handle) {
+			return chars[i];
+		}
+	}
+	return NULL;
+}
+
+static uint8_t script_cmd (const char* line) {
+	simple_ble_notify_stats_t stats;
+	simple_ble_char_t* char_handle;
+	uint32_t err_code;
+	unsigned a, b;
+
+	if (sscanf(line, "advance %u", &a) == 1) {
+		app_timer_fake_advance_ms(a);
+	} else if (sscanf(line, "notify %u %u", &a, &b) == 2 && (char_handle = find_char(b)) != NULL) {
+		sample[0]++;
+		err_code = simple_ble_notify_char_link(a, char_handle);
+		if (err_code != NRF_SUCCESS && !quiet) {
+			printf("notify failed: 0x%04lx\n", (unsigned long) err_code);
+		}
+	} else if (strncmp(line, "stats", 5) == 0) {
+		simple_ble_get_notify_stats(&stats);
+		printf("stats: queued %lu, high water %lu, sent %lu, dropped %lu, coalesced %lu, failed %lu\n",
+		       (unsigned long) stats.queued, (unsigned long) stats.high_water,
+		       (unsigned long) stats.sent, (unsigned long) stats.dropped,
+		       (unsigned long) stats.coalesced, (unsigned long) stats.failed);
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+int main (int argc, char** argv) {
+	const char* path = argv[argc - 1];
+	FILE* in;
+	uint32_t failed;
+
+	if (argc == 3 && strcmp(argv[1], "-p") == 0) {
+		quiet = 1;
+	} else if (argc != 2) {
+		fprintf(stderr, "usage: %s [-p] script\n", argv[0]);
+		return 2;
+	}
+	in = fopen(path, "r");
+	if (in == NULL) {
+		perror(path);
+		return 2;
+	}
+
+	softdevice_fake_quiet(quiet);
+	simple_ble_init(&ble_config);
+	simple_ble_add_service(&service);
+	simple_ble_add_characteristic(1, 1, 0, 0, sizeof(led), &led, &service, &led_char);
+	simple_ble_add_characteristic(1, 1, 0, 1, sizeof(name), name, &service, &name_char);
+	simple_ble_add_auth_characteristic(1, 1, 0, 0, false, true, sizeof(config), config,
+	                                   &service, &config_char);
+	simple_ble_add_characteristic(1, 0, 1, 0, sizeof(sample), sample, &service, &sample_char);
+	if (!quiet) {
+		printf("handles: led %u, name %u, config %u, sample %u cccd %u\n",
+		       led_char.char_handle.value_handle, name_char.char_handle.value_handle,
+		       config_char.char_handle.value_handle, sample_char.char_handle.value_handle,
+		       sample_char.char_handle.cccd_handle);
+	}
+	softdevice_fake_clear_stats();
+
+	failed = softdevice_fake_script(in, script_cmd);
+	fclose(in);
+	if (failed) {
+		fprintf(stderr, "%s:%lu: not understood\n", path, (unsigned long) failed);
+		return 1;
+	}
+	if (quiet) {
+		softdevice_fake_report(stdout);
+	}
+	return 0;
+}
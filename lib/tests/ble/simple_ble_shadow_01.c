@@ -0,0 +1,153 @@
+// simple_ble's shadow of characteristic values on the fake SoftDevice. After
+// each step prints the sd_ble_gatts_value_get and _set calls the fake saw,
+// with the notifications it sent, and the shadow's counters at the end.
+// Built with room for 16 bytes of stack values, so the last characteristic
+// doesn't fit and goes to the SoftDevice every time.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_ble.h"
+#include "softdevice_fake.h"
+
+#define PHONE  1
+#define TABLET 2
+
+static const simple_ble_config_t ble_config = {
+	.platform_id       = 0x00,
+	.device_id         = DEVICE_ID_DEFAULT,
+	.adv_name          = "shadow",
+	.adv_interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+	.min_conn_interval = MSEC_TO_UNITS(10, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(20, UNIT_1_25_MS),
+};
+
+static simple_ble_service_t service = {
+	.uuid128 = {{0x87, 0xa4, 0xde, 0xa0, 0x96, 0xea, 0x4e, 0xe6,
+	             0x87, 0x45, 0x83, 0x28, 0x89, 0x0f, 0xad, 0x7b}}
+};
+static simple_ble_char_t level_char = {.uuid16 = 0x8910};
+static simple_ble_char_t name_char = {.uuid16 = 0x8911};
+static simple_ble_char_t log_char = {.uuid16 = 0x8912};
+static simple_ble_char_t big_char = {.uuid16 = 0x8913};
+static uint8_t log_buf[16];
+
+static uint32_t value_gets, value_sets;
+
+void ble_address_set (void) {
+}
+
+// SoftDevice value calls since the last step
+static void step (const char* what) {
+	printf("  %-40s gets %lu sets %lu\n", what,
+	       (unsigned long) (softdevice_fake_value_gets() - value_gets),
+	       (unsigned long) (softdevice_fake_value_sets() - value_sets));
+	value_gets = softdevice_fake_value_gets();
+	value_sets = softdevice_fake_value_sets();
+}
+
+static void set (simple_ble_char_t* char_handle, const char* value, const char* what) {
+	uint32_t err_code = simple_ble_stack_char_set(char_handle, strlen(value), (uint8_t*) value);
+
+	if (err_code != NRF_SUCCESS) {
+		printf("  set failed: %lu\n", (unsigned long) err_code);
+	}
+	step(what);
+}
+
+static void get (simple_ble_char_t* char_handle, const char* what) {
+	uint8_t buf[8];
+	uint16_t len = sizeof(buf);
+	uint16_t i;
+
+	memset(buf, 0, sizeof(buf));
+	simple_ble_stack_char_get(char_handle, &len, buf);
+	printf("  value");
+	for (i = 0; i < len; i++) {
+		printf(" %02x", buf[i]);
+	}
+	printf("\n");
+	step(what);
+}
+
+static void section (const char* name) {
+	printf("\n%s\n", name);
+}
+
+int main (void) {
+	simple_ble_shadow_stats_t stats;
+
+	simple_ble_init(&ble_config);
+	simple_ble_add_service(&service);
+	simple_ble_add_stack_characteristic(1, 1, 1, 0, 4, (uint8_t*) "\x01\x02\x03\x04",
+	                                    &service, &level_char);
+	simple_ble_add_stack_characteristic(1, 1, 0, 1, 8, NULL, &service, &name_char);
+	simple_ble_add_characteristic(1, 0, 0, 1, sizeof(log_buf), log_buf, &service, &log_char);
+	simple_ble_add_stack_characteristic(1, 1, 0, 0, 8, NULL, &service, &big_char);
+	softdevice_fake_connect(PHONE, BLE_GAP_ROLE_PERIPH, 0xa1);
+	softdevice_fake_cccd(PHONE, level_char.char_handle.value_handle, 1);
+	step("setup");
+
+	section("sets");
+	set(&level_char, "\x01\x02\x03\x04", "level to its initial value");
+	set(&level_char, "\x01\x02\x03\x05", "level changed");
+	set(&level_char, "\x01\x02\x03\x05", "level again");
+	set(&name_char, "ab", "name ab");
+	set(&name_char, "ab", "name ab again");
+	set(&name_char, "abc", "name abc");
+	set(&big_char, "12345678", "big, not kept");
+	set(&big_char, "12345678", "big again");
+
+	section("gets");
+	get(&level_char, "level");
+	get(&name_char, "name");
+	get(&big_char, "big, not kept");
+
+	section("lengths");
+	simple_ble_update_char_len(&log_char, 4);
+	step("log to 4");
+	simple_ble_update_char_len(&log_char, 4);
+	step("log to 4 again");
+	simple_ble_update_char_len(&log_char, 16);
+	step("log to 16");
+
+	section("notifications");
+	simple_ble_notify_char(&level_char);
+	step("level");
+	simple_ble_notify_char(&level_char);
+	step("level, unchanged");
+	set(&level_char, "\x01\x02\x03\x06", "level changed");
+	simple_ble_notify_char(&level_char);
+	step("level");
+	softdevice_fake_cccd(PHONE, level_char.char_handle.value_handle, 0);
+	softdevice_fake_cccd(PHONE, level_char.char_handle.value_handle, 1);
+	simple_ble_notify_char(&level_char);
+	step("level, after the CCCD was written");
+
+	section("a second link only gets what it hasn't seen");
+	softdevice_fake_connect(TABLET, BLE_GAP_ROLE_PERIPH, 0xb2);
+	softdevice_fake_cccd(TABLET, level_char.char_handle.value_handle, 1);
+	simple_ble_notify_char_all(&level_char);
+	step("level to both");
+	softdevice_fake_disconnect(TABLET);
+
+	section("the peer writes");
+	softdevice_fake_write(PHONE, level_char.char_handle.value_handle, (const uint8_t*) "\x09\x09\x09\x09", 4);
+	get(&level_char, "level, read back");
+	get(&level_char, "level");
+	set(&level_char, "\x09\x09\x09\x09", "level to what the peer wrote");
+	simple_ble_notify_char(&level_char);
+	step("level");
+	softdevice_fake_write(PHONE, name_char.char_handle.value_handle, (const uint8_t*) "xy", 2);
+	set(&name_char, "xy", "name to what the peer wrote");
+	set(&name_char, "xy", "name again");
+
+	simple_ble_get_shadow_stats(&stats);
+	printf("\nstats: svc calls %lu, avoided %lu, sets skipped %lu, gets local %lu, "
+	       "lengths skipped %lu, notifications skipped %lu, refreshes %lu, uncached %lu\n",
+	       (unsigned long) stats.svc_calls, (unsigned long) stats.avoided,
+	       (unsigned long) stats.sets_skipped, (unsigned long) stats.gets_local,
+	       (unsigned long) stats.lens_skipped, (unsigned long) stats.notifies_skipped,
+	       (unsigned long) stats.refreshes, (unsigned long) stats.uncached);
+	return 0;
+}
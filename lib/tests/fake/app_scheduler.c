@@ -0,0 +1,62 @@
+// Host stand-in for the SDK's app_scheduler.c, whose event header only fits
+// its buffer with 32 bit pointers. The buffer of APP_SCHED_INIT is not used.
+
+#include <stdint.h>
+#include <string.h>
+#include "nrf_error.h"
+#include "app_scheduler.h"
+
+#define FAKE_SCHED_EVENTS     16
+#define FAKE_SCHED_EVENT_SIZE 32
+
+typedef struct {
+	app_sched_event_handler_t handler;
+	uint16_t size;
+	uint8_t data[FAKE_SCHED_EVENT_SIZE];
+} fake_event_t;
+
+static fake_event_t events[FAKE_SCHED_EVENTS];
+static uint32_t head = 0;
+static uint32_t tail = 0;
+static uint16_t max_event_size = 0;
+static uint16_t queue_size = 0;
+
+uint32_t app_sched_init (uint16_t event_size, uint16_t size, void* p_evt_buffer) {
+	if (event_size > FAKE_SCHED_EVENT_SIZE || size > FAKE_SCHED_EVENTS) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	max_event_size = event_size;
+	queue_size = size;
+	head = tail = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_sched_event_put (void* p_event_data, uint16_t event_size,
+                              app_sched_event_handler_t handler) {
+	fake_event_t* event;
+
+	if (event_size > max_event_size) {
+		return NRF_ERROR_INVALID_LENGTH;
+	}
+	if (tail - head >= queue_size) {
+		return NRF_ERROR_NO_MEM;
+	}
+
+	event = &events[tail % FAKE_SCHED_EVENTS];
+	event->handler = handler;
+	event->size = event_size;
+	if (p_event_data != NULL && event_size > 0) {
+		memcpy(event->data, p_event_data, event_size);
+	}
+	tail++;
+	return NRF_SUCCESS;
+}
+
+// Events put by the handlers run in the same call, as on the chip
+void app_sched_execute (void) {
+	while (head != tail) {
+		fake_event_t* event = &events[head % FAKE_SCHED_EVENTS];
+		event->handler(event->size > 0 ? event->data : NULL, event->size);
+		head++;
+	}
+}
@@ -0,0 +1,312 @@
+// Host stand-in for the SDK's app_timer.c, on a virtual RTC1
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "nrf_error.h"
+#include "app_timer.h"
+#include "app_timer_fake.h"
+
+#define RTC_COUNTER_MASK 0x00FFFFFF
+
+typedef struct {
+	app_timer_id_t id;
+	app_timer_timeout_handler_t handler;
+	app_timer_mode_t mode;
+	void *p_context;
+	uint64_t expires;
+	uint32_t period;
+	uint32_t started;   // start order, to break ties
+	uint8_t running;
+	const char *name;
+	app_timer_fake_stats_t stats;
+} fake_timer_t;
+
+static fake_timer_t timers[APP_TIMER_FAKE_TIMERS];
+static uint32_t timer_count = 0;
+static uint8_t inited = 0;
+static uint32_t rtc_prescaler = 0;
+static app_timer_evt_schedule_func_t schedule_func = NULL;
+
+static uint64_t now = 0;
+static uint8_t rtc_running = 0;
+static uint64_t rtc_started;    // now when the counter was last cleared
+static uint32_t start_count = 0;
+static uint32_t wakeups = 0;
+
+// Timers are known by the slot in the pool, plus one so that the zeroed
+// app_timer_t of APP_TIMER_DEF means none
+static fake_timer_t *lookup (app_timer_id_t timer_id) {
+	if (timer_id == NULL || timer_id->data[0] == 0 || timer_id->data[0] > timer_count) {
+		return NULL;
+	}
+	return &timers[timer_id->data[0] - 1];
+}
+
+static uint64_t host_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Like RTC1 under app_timer, the counter stops and is cleared whenever no
+// timer is left running
+static void rtc_check (void) {
+	uint32_t i;
+
+	for (i = 0; i < timer_count; i++) {
+		if (timers[i].running) {
+			if (!rtc_running) {
+				rtc_running = 1;
+				rtc_started = now;
+			}
+			return;
+		}
+	}
+	rtc_running = 0;
+}
+
+static fake_timer_t *next_due (uint64_t limit) {
+	fake_timer_t *first = NULL;
+	uint32_t i;
+
+	for (i = 0; i < timer_count; i++) {
+		fake_timer_t *t = &timers[i];
+		if (!t->running || t->expires > limit) {
+			continue;
+		}
+		if (first == NULL || t->expires < first->expires ||
+		    (t->expires == first->expires && t->started < first->started)) {
+			first = t;
+		}
+	}
+	return first;
+}
+
+static void run (fake_timer_t *t) {
+	uint64_t start, took;
+
+	if (t->mode == APP_TIMER_MODE_REPEATED) {
+		t->expires += t->period;
+	} else {
+		t->running = 0;
+	}
+
+	start = host_ns();
+	if (schedule_func) {
+		schedule_func(t->handler, t->p_context);
+	} else {
+		t->handler(t->p_context);
+	}
+	took = host_ns() - start;
+
+	t->stats.calls++;
+	t->stats.total_ns += took;
+	if (took > t->stats.max_ns) {
+		t->stats.max_ns = took;
+	}
+}
+
+// Run everything due at the first expiry up to limit, as one RTC interrupt
+static uint8_t wakeup (uint64_t limit) {
+	fake_timer_t *t = next_due(limit);
+
+	if (t == NULL) {
+		return 0;
+	}
+	now = t->expires;
+	wakeups++;
+	do {
+		run(t);
+		t = next_due(now);
+	} while (t);
+	rtc_check();
+	return 1;
+}
+
+uint32_t app_timer_init (uint32_t prescaler,
+                         uint8_t op_queues_size,
+                         void *p_buffer,
+                         app_timer_evt_schedule_func_t evt_schedule_func) {
+	uint32_t i;
+
+	if (p_buffer == NULL) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+
+	// Running timers are forgotten, as on the chip
+	for (i = 0; i < timer_count; i++) {
+		timers[i].running = 0;
+	}
+	rtc_running = 0;
+	rtc_prescaler = prescaler;
+	schedule_func = evt_schedule_func;
+	inited = 1;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_create (app_timer_id_t const *p_timer_id,
+                           app_timer_mode_t mode,
+                           app_timer_timeout_handler_t timeout_handler) {
+	fake_timer_t *t;
+
+	if (!inited) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	if (p_timer_id == NULL || *p_timer_id == NULL || timeout_handler == NULL) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+
+	t = lookup(*p_timer_id);
+	if (t == NULL) {
+		if (timer_count == APP_TIMER_FAKE_TIMERS) {
+			return NRF_ERROR_NO_MEM;
+		}
+		t = &timers[timer_count++];
+		t->id = *p_timer_id;
+		t->id->data[0] = timer_count;
+	} else if (t->running) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+
+	t->mode = mode;
+	t->handler = timeout_handler;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start (app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context) {
+	fake_timer_t *t = lookup(timer_id);
+
+	if (!inited || t == NULL) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	if (t->running) {
+		//app_timer ignores starts of running timers
+		return NRF_SUCCESS;
+	}
+
+	t->expires = now + timeout_ticks;
+	t->period = timeout_ticks;
+	t->p_context = p_context;
+	t->started = start_count++;
+	t->running = 1;
+	rtc_check();
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop (app_timer_id_t timer_id) {
+	fake_timer_t *t = lookup(timer_id);
+
+	if (!inited || t == NULL) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	t->running = 0;
+	rtc_check();
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop_all (void) {
+	uint32_t i;
+
+	if (!inited) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	for (i = 0; i < timer_count; i++) {
+		timers[i].running = 0;
+	}
+	rtc_check();
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get (uint32_t *p_ticks) {
+	*p_ticks = rtc_running ? (uint32_t) (now - rtc_started) & RTC_COUNTER_MASK : 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute (uint32_t ticks_to,
+                                     uint32_t ticks_from,
+                                     uint32_t *p_ticks_diff) {
+	*p_ticks_diff = (ticks_to - ticks_from) & RTC_COUNTER_MASK;
+	return NRF_SUCCESS;
+}
+
+// APP_TIMER_INIT checks app_timer_init with APP_ERROR_CHECK
+void app_error_handler (uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+	fprintf(stderr, "app error %lu at %s:%lu\n", (unsigned long) error_code,
+	        p_file_name ? (const char *) p_file_name : "?", (unsigned long) line_num);
+	exit(1);
+}
+
+void app_timer_fake_advance (uint32_t ticks) {
+	uint64_t target = now + ticks;
+
+	while (wakeup(target));
+	now = target;
+}
+
+void app_timer_fake_advance_ms (uint32_t milliseconds) {
+	app_timer_fake_advance(APP_TIMER_TICKS(milliseconds, rtc_prescaler));
+}
+
+uint8_t app_timer_fake_run_next (void) {
+	return wakeup(UINT64_MAX);
+}
+
+uint64_t app_timer_fake_now (void) {
+	return now;
+}
+
+uint32_t app_timer_fake_wakeups (void) {
+	return wakeups;
+}
+
+void app_timer_fake_name (uint32_t index, const char *name) {
+	if (index < APP_TIMER_FAKE_TIMERS) {
+		timers[index].name = name;
+	}
+}
+
+void app_timer_fake_get_stats (uint32_t index, app_timer_fake_stats_t *stats) {
+	app_timer_fake_stats_t none = {0};
+
+	*stats = index < timer_count ? timers[index].stats : none;
+}
+
+void app_timer_fake_clear_stats (void) {
+	app_timer_fake_stats_t none = {0};
+	uint32_t i;
+
+	for (i = 0; i < timer_count; i++) {
+		timers[i].stats = none;
+	}
+	wakeups = 0;
+}
+
+void app_timer_fake_report (FILE *out) {
+	uint32_t i;
+
+	fprintf(out, "  %-16s %10s %10s %10s\n", "timer", "calls", "mean ns", "max ns");
+	for (i = 0; i < timer_count; i++) {
+		fake_timer_t *t = &timers[i];
+		char unnamed[24];
+
+		if (t->stats.calls == 0) {
+			continue;
+		}
+		if (t->name == NULL) {
+			snprintf(unnamed, sizeof(unnamed), "timer %lu", (unsigned long) i);
+		}
+		fprintf(out, "  %-16s %10lu %10llu %10llu\n", t->name ? t->name : unnamed,
+		        (unsigned long) t->stats.calls,
+		        (unsigned long long) (t->stats.total_ns / t->stats.calls),
+		        (unsigned long long) t->stats.max_ns);
+	}
+	fprintf(out, "  %lu wakeups in %.1f s\n", (unsigned long) wakeups,
+	        now * (rtc_prescaler + 1) / (double) APP_TIMER_CLOCK_FREQ);
+}
@@ -0,0 +1,53 @@
+#ifndef __APP_TIMER_FAKE_H
+#define __APP_TIMER_FAKE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "app_timer.h"
+
+// Host stand-in for the SDK's app_timer.c, behind the SDK's own app_timer.h.
+// The RTC is virtual: it counts 32768/(prescaler+1) ticks a second in 24
+// bits like RTC1, but only moves when the test moves it, so runs are
+// deterministic however long the handlers take. Handlers run in expiry
+// order, ties in the order the timers were started, and are timed with the
+// host's clock.
+//
+// As on the chip, starting a running timer does nothing (stop it first),
+// repeating timers don't drift and APP_TIMER_INIT forgets running timers.
+
+#ifndef APP_TIMER_FAKE_TIMERS
+#define APP_TIMER_FAKE_TIMERS 32
+#endif
+
+typedef struct {
+	uint32_t calls;
+	uint64_t total_ns;  // host time spent in the handler
+	uint64_t max_ns;
+} app_timer_fake_stats_t;
+
+// Move the RTC on, running every handler that comes due on the way at the
+// tick it is due
+void app_timer_fake_advance (uint32_t ticks);
+void app_timer_fake_advance_ms (uint32_t milliseconds);
+
+// Move straight to the next timer and run everything due then. Returns 0
+// if no timer is running.
+uint8_t app_timer_fake_run_next (void);
+
+// Ticks since the first init, unlike app_timer_cnt_get this doesn't wrap
+uint64_t app_timer_fake_now (void);
+
+// Times the RTC interrupt ran at least one handler
+uint32_t app_timer_fake_wakeups (void);
+
+// Timers are numbered in the order they were first created, since the
+// ids of most are static to their module. The name is for the report and
+// has to stay valid.
+void app_timer_fake_name (uint32_t index, const char *name);
+void app_timer_fake_get_stats (uint32_t index, app_timer_fake_stats_t *stats);
+void app_timer_fake_clear_stats (void);
+
+// One line per timer that has run: calls, mean and max handler time
+void app_timer_fake_report (FILE *out);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+// Host stand-in, the host tests run everything from one thread
+
+#define CRITICAL_REGION_ENTER()
+#define CRITICAL_REGION_EXIT()
+
+#endif
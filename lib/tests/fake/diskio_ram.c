@@ -0,0 +1,70 @@
+// RAM stand-in for mmc_nrf.c, so FatFs runs on the host
+
+#include <string.h>
+#include "diskio.h"
+#include "diskio_ram.h"
+
+static uint8_t disk[DISKIO_RAM_SECTORS][512];
+
+diskio_ram_stats_t diskio_ram_stats;
+uint32_t diskio_ram_dir_start = 0;
+uint32_t diskio_ram_data_start = 0;
+
+DSTATUS disk_initialize (BYTE pdrv) {
+	return pdrv ? STA_NOINIT : 0;
+}
+
+DSTATUS disk_status (BYTE pdrv) {
+	return pdrv ? STA_NOINIT : 0;
+}
+
+DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count) {
+	if(pdrv || sector + count > DISKIO_RAM_SECTORS) {
+		return RES_PARERR;
+	}
+	memcpy(buff, disk[sector], count*512);
+	diskio_ram_stats.sectors_read += count;
+	return RES_OK;
+}
+
+DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count) {
+	UINT i;
+
+	if(pdrv || sector + count > DISKIO_RAM_SECTORS) {
+		return RES_PARERR;
+	}
+	memcpy(disk[sector], buff, count*512);
+	diskio_ram_stats.writes++;
+	diskio_ram_stats.sectors_written += count;
+	for(i = 0; i < count; i++) {
+		if(sector + i < diskio_ram_dir_start) {
+			diskio_ram_stats.fat_written++;
+		} else if(sector + i < diskio_ram_data_start) {
+			diskio_ram_stats.dir_written++;
+		}
+	}
+	return RES_OK;
+}
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff) {
+	switch(cmd) {
+		case CTRL_SYNC:
+			return RES_OK;
+		case GET_SECTOR_COUNT:
+			*(DWORD*)buff = DISKIO_RAM_SECTORS;
+			return RES_OK;
+		case GET_SECTOR_SIZE:
+			*(WORD*)buff = 512;
+			return RES_OK;
+		case GET_BLOCK_SIZE:
+			*(DWORD*)buff = 1;
+			return RES_OK;
+	}
+	return RES_PARERR;
+}
+
+void disk_timerproc (void) {
+}
+
+void disk_restart (void) {
+}
@@ -0,0 +1,24 @@
+#ifndef __DISKIO_RAM_H
+#define __DISKIO_RAM_H
+
+#include <stdint.h>
+
+#ifndef DISKIO_RAM_SECTORS
+#define DISKIO_RAM_SECTORS 32768
+#endif
+
+// Counters kept by the RAM fake of the card. Set the starts from the mounted
+// FATFS to tell FAT and root directory (FAT12/16) writes from data writes.
+typedef struct {
+	uint32_t sectors_read;
+	uint32_t sectors_written;
+	uint32_t fat_written;
+	uint32_t dir_written;
+	uint32_t writes;
+} diskio_ram_stats_t;
+
+extern diskio_ram_stats_t diskio_ram_stats;
+extern uint32_t diskio_ram_dir_start;
+extern uint32_t diskio_ram_data_start;
+
+#endif
@@ -0,0 +1,33 @@
+// RAM fake of the FM25L04B FRAM, sized by SIMPLE_LOGGER_FRAM_SIZE so larger
+// parts can be pretended. Like the driver on nrf_drv_spi, whose lengths are
+// uint8_t, it fails transfers of more than 255 bytes.
+
+#include <stdint.h>
+#include <string.h>
+#include "nrf_drv_spi.h"
+#include "fm25l04b.h"
+#include "fm25l04b_ram.h"
+
+uint8_t fm25l04b_ram[SIMPLE_LOGGER_FRAM_SIZE];
+fm25l04b_ram_stats_t fm25l04b_ram_stats;
+
+int fm25l04b_read (fm25l04b_t* dev, uint16_t address, uint8_t *buf, uint16_t len) {
+	if ((uint32_t) address + len > sizeof(fm25l04b_ram) || len > FM25L04B_RAM_MAX_TRANSFER) {
+		fm25l04b_ram_stats.errors++;
+		return -1;
+	}
+	memcpy(buf, fm25l04b_ram+address, len);
+	fm25l04b_ram_stats.reads++;
+	return 0;
+}
+
+int fm25l04b_write (fm25l04b_t* dev, uint16_t address, uint8_t *buf, uint16_t len) {
+	if ((uint32_t) address + len > sizeof(fm25l04b_ram) || len > FM25L04B_RAM_MAX_TRANSFER) {
+		fm25l04b_ram_stats.errors++;
+		return -1;
+	}
+	memcpy(fm25l04b_ram+address, buf, len);
+	fm25l04b_ram_stats.writes++;
+	fm25l04b_ram_stats.bytes_written += len;
+	return 0;
+}
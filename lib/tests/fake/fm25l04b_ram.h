@@ -0,0 +1,24 @@
+#ifndef __FM25L04B_RAM_H
+#define __FM25L04B_RAM_H
+
+#include <stdint.h>
+
+#ifndef SIMPLE_LOGGER_FRAM_SIZE
+#define SIMPLE_LOGGER_FRAM_SIZE 512
+#endif
+
+#define FM25L04B_RAM_MAX_TRANSFER 255
+
+// Counters kept by the RAM fake of the FRAM, each write is one SPI
+// transaction on the real part
+typedef struct {
+	uint32_t writes;
+	uint32_t bytes_written;
+	uint32_t reads;
+	uint32_t errors;        // out of range, or too long for one transfer
+} fm25l04b_ram_stats_t;
+
+extern uint8_t fm25l04b_ram[SIMPLE_LOGGER_FRAM_SIZE];
+extern fm25l04b_ram_stats_t fm25l04b_ram_stats;
+
+#endif
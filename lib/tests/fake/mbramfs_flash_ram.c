@@ -0,0 +1,75 @@
+// RAM stand-in for the mbramfs flash backend, for host tests and benchmarks
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbramfs.h"
+#include "mbramfs_flash_ram.h"
+
+#define FLASH_RAM_MAX_RECORDS 512
+#define FLASH_RAM_MAX_LEN     256
+
+typedef struct {
+	uint16_t key; // 0 if unused
+	uint16_t len;
+	uint8_t data[FLASH_RAM_MAX_LEN];
+} record_t;
+
+static record_t records[FLASH_RAM_MAX_RECORDS];
+
+mbramfs_flash_ram_stats_t mbramfs_flash_ram_stats;
+
+static record_t* find (uint16_t key) {
+	for (int i=0; i<FLASH_RAM_MAX_RECORDS; i++) {
+		if (records[i].key == key) return &records[i];
+	}
+	return NULL;
+}
+
+void mbramfs_flash_ram_reset_stats (void) {
+	uint32_t count = mbramfs_flash_ram_stats.records;
+	memset(&mbramfs_flash_ram_stats, 0, sizeof(mbramfs_flash_ram_stats));
+	mbramfs_flash_ram_stats.records = count;
+}
+
+int mbramfs_flash_write (uint16_t key, const void* data, uint16_t len) {
+	record_t* rec = find(key);
+
+	if (len > FLASH_RAM_MAX_LEN) return -1;
+	if (rec == NULL) {
+		rec = find(0);
+		if (rec == NULL) return -1;
+		mbramfs_flash_ram_stats.records++;
+	}
+
+	rec->key = key;
+	rec->len = len;
+	memcpy(rec->data, data, len);
+
+	mbramfs_flash_ram_stats.writes++;
+	mbramfs_flash_ram_stats.bytes_written += (len + 3) & ~3;
+	return 0;
+}
+
+int mbramfs_flash_read (uint16_t key, void* data, uint16_t len) {
+	record_t* rec = find(key);
+
+	if (rec == NULL) return 0;
+	if (len > rec->len) len = rec->len;
+	memcpy(data, rec->data, len);
+
+	mbramfs_flash_ram_stats.reads++;
+	mbramfs_flash_ram_stats.bytes_read += len;
+	return len;
+}
+
+int mbramfs_flash_delete (uint16_t key) {
+	record_t* rec = find(key);
+
+	if (rec == NULL) return 0;
+	rec->key = 0;
+
+	mbramfs_flash_ram_stats.deletes++;
+	mbramfs_flash_ram_stats.records--;
+	return 0;
+}
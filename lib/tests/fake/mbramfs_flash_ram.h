@@ -0,0 +1,20 @@
+#ifndef __MBRAMFS_FLASH_RAM_H
+#define __MBRAMFS_FLASH_RAM_H
+
+#include <stdint.h>
+
+// Counters kept by the RAM fake of the mbramfs flash backend
+typedef struct {
+	uint32_t writes;
+	uint32_t bytes_written; // rounded up to flash words, like FDS
+	uint32_t reads;
+	uint32_t bytes_read;
+	uint32_t deletes;
+	uint32_t records;       // currently stored
+} mbramfs_flash_ram_stats_t;
+
+extern mbramfs_flash_ram_stats_t mbramfs_flash_ram_stats;
+
+void mbramfs_flash_ram_reset_stats (void);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef NRF_DRV_SPI_H__
+#define NRF_DRV_SPI_H__
+
+// Host stand-in, fm25l04b.h only needs the type
+
+typedef struct {
+	int unused;
+} nrf_drv_spi_t;
+
+#endif
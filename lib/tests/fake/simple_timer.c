@@ -0,0 +1,42 @@
+// Host stand-in for lib/simple_timer.c
+
+#include <stdint.h>
+#include <stddef.h>
+#include "simple_timer.h"
+
+#define FAKE_TIMERS 4
+
+typedef struct {
+	uint32_t period;
+	uint32_t elapsed;
+	app_timer_timeout_handler_t callback;
+} fake_timer_t;
+
+static fake_timer_t timers[FAKE_TIMERS];
+static int timer_count = 0;
+
+void simple_timer_init () {
+}
+
+uint32_t simple_timer_start (uint32_t milliseconds,
+                             app_timer_timeout_handler_t callback) {
+	if (timer_count == FAKE_TIMERS) {
+		return 1;
+	}
+	timers[timer_count].period = milliseconds;
+	timers[timer_count].elapsed = 0;
+	timers[timer_count].callback = callback;
+	timer_count++;
+	return 0;
+}
+
+void simple_timer_fake_advance (uint32_t milliseconds) {
+	for (uint32_t ms=0; ms<milliseconds; ms++) {
+		for (int i=0; i<timer_count; i++) {
+			if (++timers[i].elapsed >= timers[i].period) {
+				timers[i].elapsed = 0;
+				timers[i].callback(NULL);
+			}
+		}
+	}
+}
@@ -0,0 +1,17 @@
+#ifndef __SIMPLE_TIMER_H
+#define __SIMPLE_TIMER_H
+
+#include <stdint.h>
+
+// Host stand-in for lib/simple_timer.h. Timers only run when the test
+// advances time with simple_timer_fake_advance().
+
+typedef void (*app_timer_timeout_handler_t)(void* p_context);
+
+void simple_timer_init ();
+uint32_t simple_timer_start (uint32_t milliseconds,
+                             app_timer_timeout_handler_t callback);
+
+void simple_timer_fake_advance (uint32_t milliseconds);
+
+#endif
@@ -0,0 +1,1031 @@
+// Host stand-in for the SoftDevice calls and softdevice_handler that
+// simple_ble.c uses
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "nrf_error.h"
+#include "app_error.h"
+#include "ble.h"
+#include "ble_err.h"
+#include "ble_hci.h"
+#include "nrf_soc.h"
+#include "softdevice_handler.h"
+#include "ble_conn_params.h"
+#include "softdevice_fake.h"
+
+typedef struct {
+	uint8_t used;
+	uint8_t notify;         // value of a characteristic that can notify
+	uint8_t wr_auth;
+	uint8_t is_cccd;
+	uint16_t value_handle;  // for a CCCD, the value it belongs to
+	uint8_t *p_value;
+	uint16_t len;
+	uint16_t max_len;
+	uint8_t stack_value[BLE_GATTS_VAR_ATTR_LEN_MAX];
+} fake_attr_t;
+
+typedef struct {
+	uint16_t conn_handle;
+	uint8_t peer;
+	uint8_t tx_pending;
+	uint8_t cccd[SOFTDEVICE_FAKE_ATTRS];
+	uint8_t bond;                   // from the last sec_params_reply
+	ble_gap_sec_keyset_t keyset;
+	uint8_t enc_known;              // sec_info_reply had a key
+	ble_gap_enc_info_t enc_info;
+} fake_link_t;
+
+static fake_attr_t attrs[SOFTDEVICE_FAKE_ATTRS];
+static uint16_t next_handle = 1;
+static uint8_t vs_uuid_count = 0;
+static ble_uuid128_t vs_uuids[SOFTDEVICE_FAKE_VS_UUIDS];
+
+static fake_link_t links[SOFTDEVICE_FAKE_LINKS];
+static uint8_t advertising = 0;
+static uint8_t scanning = 0;
+static ble_gap_scan_params_t scan_params;
+static ble_gap_addr_t address;
+static uint8_t device_name[BLE_GAP_DEVNAME_MAX_LEN];
+static uint16_t device_name_len = 0;
+static uint16_t gap_appearance = 0;
+static uint8_t adv_data[BLE_GAP_ADV_MAX_SIZE];
+static uint8_t adv_data_len = 0;
+static uint8_t sr_data[BLE_GAP_ADV_MAX_SIZE];
+static uint8_t sr_data_len = 0;
+
+static ble_evt_handler_t ble_handler = NULL;
+static sys_evt_handler_t sys_handler = NULL;
+static uint32_t value_gets = 0;
+static uint32_t value_sets = 0;
+static uint8_t pairings = 0;
+static uint8_t quiet = 0;
+
+// Time in simple_ble's handler, by event id
+static softdevice_fake_stats_t evt_stats[256];
+
+#define say(...) do { if (!quiet) printf(__VA_ARGS__); } while (0)
+static ble_conn_params_evt_handler_t conn_params_handler = NULL;
+
+// Room for the variable length data at the end of write events
+static union {
+	ble_evt_t evt;
+	uint8_t raw[sizeof(ble_evt_t) + BLE_GATTS_VAR_ATTR_LEN_MAX];
+} evt_buf;
+
+// The write waiting for an authorize reply
+static struct {
+	uint16_t conn_handle;
+	uint16_t handle;
+	uint16_t len;
+	uint8_t data[BLE_GATTS_VAR_ATTR_LEN_MAX];
+} pending_write;
+
+static fake_link_t *find_link (uint16_t conn_handle) {
+	uint32_t i;
+
+	for (i = 0; i < SOFTDEVICE_FAKE_LINKS; i++) {
+		if (links[i].conn_handle == conn_handle) {
+			return &links[i];
+		}
+	}
+	return NULL;
+}
+
+static fake_attr_t *find_attr (uint16_t handle) {
+	if (handle == 0 || handle >= SOFTDEVICE_FAKE_ATTRS || !attrs[handle].used) {
+		return NULL;
+	}
+	return &attrs[handle];
+}
+
+static void print_data (const uint8_t *data, uint16_t len) {
+	uint16_t i;
+
+	for (i = 0; i < len; i++) {
+		say(" %02x", data[i]);
+	}
+	say("\n");
+}
+
+static void new_evt (uint16_t evt_id, uint16_t conn_handle) {
+	memset(&evt_buf, 0, sizeof(evt_buf));
+	evt_buf.evt.header.evt_id = evt_id;
+	evt_buf.evt.header.evt_len = sizeof(evt_buf.evt);
+	evt_buf.evt.evt.gap_evt.conn_handle = conn_handle;
+}
+
+
+/*
+ * softdevice_handler
+ */
+
+uint32_t softdevice_handler_init (nrf_clock_lf_cfg_t *p_clock_lf_cfg,
+                                  void *p_ble_evt_buffer,
+                                  uint16_t ble_evt_buffer_size,
+                                  softdevice_evt_schedule_func_t evt_schedule_func) {
+	memset(attrs, 0, sizeof(attrs));
+	memset(links, 0, sizeof(links));
+	for (uint32_t i = 0; i < SOFTDEVICE_FAKE_LINKS; i++) {
+		links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+	}
+	next_handle = 1;
+	vs_uuid_count = 0;
+	advertising = 0;
+	adv_data_len = 0;
+	sr_data_len = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t softdevice_enable_get_default_config (uint8_t central_links_count,
+                                               uint8_t periph_links_count,
+                                               ble_enable_params_t *p_ble_enable_params) {
+	memset(p_ble_enable_params, 0, sizeof(*p_ble_enable_params));
+	p_ble_enable_params->gap_enable_params.central_conn_count = central_links_count;
+	p_ble_enable_params->gap_enable_params.periph_conn_count = periph_links_count;
+	return NRF_SUCCESS;
+}
+
+uint32_t softdevice_enable (ble_enable_params_t *p_ble_enable_params) {
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_check_ram_start (uint32_t sd_req_ram_start) {
+	return NRF_SUCCESS;
+}
+
+uint32_t softdevice_ble_evt_handler_set (ble_evt_handler_t ble_evt_handler) {
+	ble_handler = ble_evt_handler;
+	return NRF_SUCCESS;
+}
+
+uint32_t softdevice_sys_evt_handler_set (sys_evt_handler_t sys_evt_handler) {
+	sys_handler = sys_evt_handler;
+	return NRF_SUCCESS;
+}
+
+
+/*
+ * ble_conn_params, which needs a peer to negotiate with. Only shows which
+ * links and updates it was told about, and takes the parameters of every
+ * connection as they come.
+ */
+
+uint32_t ble_conn_params_init (const ble_conn_params_init_t *p_init) {
+	conn_params_handler = p_init->evt_handler;
+	return NRF_SUCCESS;
+}
+
+void ble_conn_params_on_ble_evt (ble_evt_t *p_ble_evt) {
+	ble_conn_params_evt_t evt;
+
+	if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED) {
+		say("conn_params: connected %u\n", p_ble_evt->evt.gap_evt.conn_handle);
+		if (conn_params_handler) {
+			evt.evt_type = BLE_CONN_PARAMS_EVT_SUCCEEDED;
+			conn_params_handler(&evt);
+		}
+	} else if (p_ble_evt->header.evt_id == BLE_GAP_EVT_DISCONNECTED) {
+		say("conn_params: disconnected %u\n", p_ble_evt->evt.gap_evt.conn_handle);
+	} else if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONN_PARAM_UPDATE) {
+		say("conn_params: update %u\n", p_ble_evt->evt.gap_evt.conn_handle);
+	}
+}
+
+
+/*
+ * GAP
+ */
+
+uint32_t sd_ble_gap_address_set (uint8_t addr_cycle_mode, ble_gap_addr_t const *p_addr) {
+	address = *p_addr;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_address_get (ble_gap_addr_t *p_addr) {
+	*p_addr = address;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_tx_power_set (int8_t tx_power) {
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_device_name_set (ble_gap_conn_sec_mode_t const *p_write_perm,
+                                     uint8_t const *p_dev_name, uint16_t len) {
+	if (len > BLE_GAP_DEVNAME_MAX_LEN) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	memcpy(device_name, p_dev_name, len);
+	device_name_len = len;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_device_name_get (uint8_t *p_dev_name, uint16_t *p_len) {
+	if (p_dev_name != NULL) {
+		if (*p_len < device_name_len) {
+			return NRF_ERROR_DATA_SIZE;
+		}
+		memcpy(p_dev_name, device_name, device_name_len);
+	}
+	*p_len = device_name_len;
+	return NRF_SUCCESS;
+}
+
+// NULL leaves that packet as it was
+uint32_t sd_ble_gap_adv_data_set (uint8_t const *p_data, uint8_t dlen,
+                                  uint8_t const *p_sr_data, uint8_t srdlen) {
+	if (dlen > BLE_GAP_ADV_MAX_SIZE || srdlen > BLE_GAP_ADV_MAX_SIZE) {
+		return NRF_ERROR_INVALID_LENGTH;
+	}
+	if (p_data != NULL) {
+		memcpy(adv_data, p_data, dlen);
+		adv_data_len = dlen;
+		say("adv data");
+		print_data(adv_data, adv_data_len);
+	}
+	if (p_sr_data != NULL) {
+		memcpy(sr_data, p_sr_data, srdlen);
+		sr_data_len = srdlen;
+		say("scan response");
+		print_data(sr_data, sr_data_len);
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_appearance_set (uint16_t appearance) {
+	gap_appearance = appearance;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_appearance_get (uint16_t *p_appearance) {
+	*p_appearance = gap_appearance;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_ppcp_set (ble_gap_conn_params_t const *p_conn_params) {
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_start (ble_gap_adv_params_t const *p_adv_params) {
+	const char *type = "?";
+
+	if (advertising) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	switch (p_adv_params->type) {
+		case BLE_GAP_ADV_TYPE_ADV_IND:         type = "connectable"; break;
+		case BLE_GAP_ADV_TYPE_ADV_SCAN_IND:    type = "scannable"; break;
+		case BLE_GAP_ADV_TYPE_ADV_NONCONN_IND: type = "nonconnectable"; break;
+	}
+	say("adv start %s\n", type);
+	advertising = 1;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_stop (void) {
+	if (!advertising) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	advertising = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_start (ble_gap_scan_params_t const *p_scan_params) {
+	if (scanning) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	scanning = 1;
+	scan_params = *p_scan_params;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_stop (void) {
+	if (!scanning) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	scanning = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_disconnect (uint16_t conn_handle, uint8_t hci_status_code) {
+	if (find_link(conn_handle) == NULL) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	say("disconnect %u reason 0x%02x\n", conn_handle, hci_status_code);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_conn_param_update (uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params) {
+	if (find_link(conn_handle) == NULL) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	say("conn param request %u: interval %u-%u latency %u timeout %u\n", conn_handle,
+	       p_conn_params->min_conn_interval, p_conn_params->max_conn_interval,
+	       p_conn_params->slave_latency, p_conn_params->conn_sup_timeout);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_sec_params_reply (uint16_t conn_handle, uint8_t sec_status,
+                                      ble_gap_sec_params_t const *p_sec_params,
+                                      ble_gap_sec_keyset_t const *p_sec_keyset) {
+	fake_link_t *link = find_link(conn_handle);
+
+	if (link == NULL) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	// keys are only handed out if there is somewhere to put them
+	link->bond = p_sec_params && p_sec_params->bond && p_sec_params->kdist_own.enc &&
+	             p_sec_keyset && p_sec_keyset->keys_own.p_enc_key;
+	if (p_sec_keyset) {
+		link->keyset = *p_sec_keyset;
+	} else {
+		memset(&link->keyset, 0, sizeof(link->keyset));
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_sec_info_reply (uint16_t conn_handle, ble_gap_enc_info_t const *p_enc_info,
+                                    ble_gap_irk_t const *p_id_info,
+                                    ble_gap_sign_info_t const *p_sign_info) {
+	fake_link_t *link = find_link(conn_handle);
+
+	if (link == NULL) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	link->enc_known = (p_enc_info != NULL);
+	if (p_enc_info) {
+		link->enc_info = *p_enc_info;
+	}
+	return NRF_SUCCESS;
+}
+
+
+/*
+ * GATTS
+ */
+
+// Adding a base that is already there gives its type again
+uint32_t sd_ble_uuid_vs_add (ble_uuid128_t const *p_vs_uuid, uint8_t *p_uuid_type) {
+	uint8_t i;
+
+	for (i = 0; i < vs_uuid_count; i++) {
+		if (memcmp(vs_uuids[i].uuid128, p_vs_uuid->uuid128, 16) == 0) {
+			*p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN + i;
+			return NRF_SUCCESS;
+		}
+	}
+	if (vs_uuid_count == SOFTDEVICE_FAKE_VS_UUIDS) {
+		return NRF_ERROR_NO_MEM;
+	}
+	vs_uuids[vs_uuid_count] = *p_vs_uuid;
+	*p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN + vs_uuid_count++;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_uuid_encode (ble_uuid_t const *p_uuid, uint8_t *p_uuid_le_len, uint8_t *p_uuid_le) {
+	uint8_t vs = p_uuid->type - BLE_UUID_TYPE_VENDOR_BEGIN;
+
+	if (p_uuid->type == BLE_UUID_TYPE_BLE) {
+		*p_uuid_le_len = 2;
+	} else if (p_uuid->type >= BLE_UUID_TYPE_VENDOR_BEGIN && vs < vs_uuid_count) {
+		*p_uuid_le_len = 16;
+		if (p_uuid_le != NULL) {
+			memcpy(p_uuid_le, vs_uuids[vs].uuid128, 16);
+			p_uuid_le += 12;
+		}
+	} else {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	if (p_uuid_le != NULL) {
+		p_uuid_le[0] = p_uuid->uuid & 0xff;
+		p_uuid_le[1] = p_uuid->uuid >> 8;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_service_add (uint8_t type, ble_uuid_t const *p_uuid, uint16_t *p_handle) {
+	if (next_handle >= SOFTDEVICE_FAKE_ATTRS) {
+		return NRF_ERROR_NO_MEM;
+	}
+	*p_handle = next_handle++;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_characteristic_add (uint16_t service_handle,
+                                          ble_gatts_char_md_t const *p_char_md,
+                                          ble_gatts_attr_t const *p_attr_char_value,
+                                          ble_gatts_char_handles_t *p_handles) {
+	uint8_t notify = p_char_md->char_props.notify || p_char_md->char_props.indicate;
+	fake_attr_t *value;
+
+	// declaration, value and maybe a CCCD
+	if (next_handle + 2 + notify > SOFTDEVICE_FAKE_ATTRS) {
+		return NRF_ERROR_NO_MEM;
+	}
+	memset(p_handles, 0, sizeof(*p_handles));
+	next_handle++;
+
+	p_handles->value_handle = next_handle++;
+	value = &attrs[p_handles->value_handle];
+	value->used = 1;
+	value->notify = notify;
+	value->wr_auth = p_attr_char_value->p_attr_md->wr_auth;
+	value->len = p_attr_char_value->init_len;
+	value->max_len = p_attr_char_value->max_len;
+	if (p_attr_char_value->p_attr_md->vloc == BLE_GATTS_VLOC_USER) {
+		value->p_value = p_attr_char_value->p_value;
+	} else {
+		value->p_value = value->stack_value;
+		if (p_attr_char_value->p_value) {
+			memcpy(value->p_value, p_attr_char_value->p_value, value->len);
+		}
+	}
+
+	if (notify) {
+		p_handles->cccd_handle = next_handle++;
+		attrs[p_handles->cccd_handle].used = 1;
+		attrs[p_handles->cccd_handle].is_cccd = 1;
+		attrs[p_handles->cccd_handle].value_handle = p_handles->value_handle;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_get (uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value) {
+	fake_attr_t *attr = find_attr(handle);
+	uint16_t len;
+
+	value_gets++;
+	if (attr == NULL || attr->is_cccd) {
+		return BLE_ERROR_INVALID_ATTR_HANDLE;
+	}
+	if (p_value->offset > attr->len) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	len = attr->len - p_value->offset;
+	if (p_value->p_value) {
+		if (len > p_value->len) {
+			len = p_value->len;
+		}
+		memcpy(p_value->p_value, attr->p_value + p_value->offset, len);
+	}
+	p_value->len = len;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_set (uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value) {
+	fake_attr_t *attr = find_attr(handle);
+
+	value_sets++;
+	if (attr == NULL || attr->is_cccd) {
+		return BLE_ERROR_INVALID_ATTR_HANDLE;
+	}
+	if (p_value->offset + p_value->len > attr->max_len) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	// with BLE_GATTS_VLOC_USER a NULL value only sets the length
+	if (p_value->p_value && p_value->p_value != attr->p_value + p_value->offset) {
+		memcpy(attr->p_value + p_value->offset, p_value->p_value, p_value->len);
+	}
+	attr->len = p_value->offset + p_value->len;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_hvx (uint16_t conn_handle, ble_gatts_hvx_params_t const *p_hvx_params) {
+	fake_link_t *link = find_link(conn_handle);
+	fake_attr_t *attr = find_attr(p_hvx_params->handle);
+	const uint8_t *data;
+	uint16_t len;
+
+	if (link == NULL) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	if (attr == NULL || !attr->notify) {
+		return BLE_ERROR_INVALID_ATTR_HANDLE;
+	}
+	if (!link->cccd[p_hvx_params->handle]) {
+		return NRF_ERROR_INVALID_STATE;
+	}
+	if (link->tx_pending == SOFTDEVICE_FAKE_TX_BUFFERS) {
+		return BLE_ERROR_NO_TX_PACKETS;
+	}
+
+	// p_data sets the attribute's value first, for every link
+	len = p_hvx_params->p_len ? MIN(*p_hvx_params->p_len, attr->max_len) : attr->len;
+	if (p_hvx_params->p_data != NULL) {
+		memcpy(attr->p_value, p_hvx_params->p_data, len);
+		attr->len = len;
+	}
+	data = attr->p_value;
+	link->tx_pending++;
+	say("notify %u handle %u:", conn_handle, p_hvx_params->handle);
+	print_data(data, len);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_sys_attr_set (uint16_t conn_handle, uint8_t const *p_sys_attr_data,
+                                    uint16_t len, uint32_t flags) {
+	fake_link_t *link = find_link(conn_handle);
+
+	if (link == NULL) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	// no stored attributes, every CCCD starts off
+	memset(link->cccd, 0, sizeof(link->cccd));
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_rw_authorize_reply (uint16_t conn_handle,
+                                          ble_gatts_rw_authorize_reply_params_t const *p_reply) {
+	if (find_link(conn_handle) == NULL) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	say("authorize reply %u status 0x%04x\n", conn_handle, p_reply->params.write.gatt_status);
+
+	if (p_reply->type == BLE_GATTS_AUTHORIZE_TYPE_WRITE &&
+	    p_reply->params.write.gatt_status == BLE_GATT_STATUS_SUCCESS &&
+	    pending_write.conn_handle == conn_handle) {
+		fake_attr_t *attr = find_attr(pending_write.handle);
+		memcpy(attr->p_value, pending_write.data, pending_write.len);
+		attr->len = pending_write.len;
+		pending_write.conn_handle = BLE_CONN_HANDLE_INVALID;
+	}
+	return NRF_SUCCESS;
+}
+
+
+/*
+ * SoC
+ */
+
+uint32_t sd_app_evt_wait (void) {
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_power_system_off (void) {
+	say("system off\n");
+	return NRF_SUCCESS;
+}
+
+
+/*
+ * app_error, SDK 11's APP_ERROR_CHECK comes here unless DEBUG is defined
+ */
+
+void app_error_handler_bare (ret_code_t error_code) {
+	fprintf(stderr, "app error %lu\n", (unsigned long) error_code);
+	exit(1);
+}
+
+
+/*
+ * Events
+ */
+
+static uint64_t host_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void softdevice_fake_evt (ble_evt_t *p_ble_evt) {
+	softdevice_fake_stats_t *stats = &evt_stats[p_ble_evt->header.evt_id & 0xff];
+	uint64_t ns;
+
+	if (ble_handler) {
+		ns = host_ns();
+		ble_handler(p_ble_evt);
+		ns = host_ns() - ns;
+
+		// events the handler causes count in both
+		stats->calls++;
+		stats->total_ns += ns;
+		if (ns > stats->max_ns) {
+			stats->max_ns = ns;
+		}
+	}
+}
+
+void softdevice_fake_connect (uint16_t conn_handle, uint8_t role, uint8_t peer) {
+	fake_link_t *link = find_link(BLE_CONN_HANDLE_INVALID);
+
+	if (link == NULL) {
+		printf("softdevice_fake: too many links\n");
+		return;
+	}
+	link->conn_handle = conn_handle;
+	link->peer = peer;
+	link->tx_pending = 0;
+	memset(link->cccd, 0, sizeof(link->cccd));
+	if (role == BLE_GAP_ROLE_PERIPH) {
+		// a connection ends connectable advertising
+		advertising = 0;
+	} else {
+		// and one made as central ends the scan
+		scanning = 0;
+	}
+
+	new_evt(BLE_GAP_EVT_CONNECTED, conn_handle);
+	evt_buf.evt.evt.gap_evt.params.connected.role = role;
+	evt_buf.evt.evt.gap_evt.params.connected.conn_params.min_conn_interval = SOFTDEVICE_FAKE_CONN_INTERVAL;
+	evt_buf.evt.evt.gap_evt.params.connected.conn_params.max_conn_interval = SOFTDEVICE_FAKE_CONN_INTERVAL;
+	evt_buf.evt.evt.gap_evt.params.connected.conn_params.conn_sup_timeout = MSEC_TO_UNITS(4000, UNIT_10_MS);
+	evt_buf.evt.evt.gap_evt.params.connected.peer_addr.addr_type = BLE_GAP_ADDR_TYPE_PUBLIC;
+	evt_buf.evt.evt.gap_evt.params.connected.peer_addr.addr[0] = peer;
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_disconnect (uint16_t conn_handle) {
+	fake_link_t *link = find_link(conn_handle);
+
+	if (link == NULL) {
+		return;
+	}
+	link->conn_handle = BLE_CONN_HANDLE_INVALID;
+
+	new_evt(BLE_GAP_EVT_DISCONNECTED, conn_handle);
+	evt_buf.evt.evt.gap_evt.params.disconnected.reason = BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION;
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_adv_report (uint8_t peer, uint8_t scan_rsp, int8_t rssi, const uint8_t *data, uint8_t dlen) {
+	new_evt(BLE_GAP_EVT_ADV_REPORT, BLE_CONN_HANDLE_INVALID);
+	evt_buf.evt.evt.gap_evt.params.adv_report.peer_addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+	evt_buf.evt.evt.gap_evt.params.adv_report.peer_addr.addr[0] = peer;
+	evt_buf.evt.evt.gap_evt.params.adv_report.rssi = rssi;
+	evt_buf.evt.evt.gap_evt.params.adv_report.scan_rsp = scan_rsp;
+	evt_buf.evt.evt.gap_evt.params.adv_report.dlen = dlen;
+	memcpy(evt_buf.evt.evt.gap_evt.params.adv_report.data, data, dlen);
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_conn_param_update (uint16_t conn_handle, uint16_t interval, uint16_t latency) {
+	ble_gap_conn_params_t *params;
+
+	if (find_link(conn_handle) == NULL) {
+		return;
+	}
+	new_evt(BLE_GAP_EVT_CONN_PARAM_UPDATE, conn_handle);
+	params = &evt_buf.evt.evt.gap_evt.params.conn_param_update.conn_params;
+	params->min_conn_interval = interval;
+	params->max_conn_interval = interval;
+	params->slave_latency = latency;
+	params->conn_sup_timeout = MSEC_TO_UNITS(4000, UNIT_10_MS);
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_tx_complete (uint16_t conn_handle, uint8_t count) {
+	fake_link_t *link = find_link(conn_handle);
+
+	if (link == NULL) {
+		return;
+	}
+	if (count > link->tx_pending) {
+		count = link->tx_pending;
+	}
+	if (count == 0) {
+		return;
+	}
+	link->tx_pending -= count;
+
+	new_evt(BLE_EVT_TX_COMPLETE, conn_handle);
+	evt_buf.evt.evt.common_evt.params.tx_complete.count = count;
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_cccd (uint16_t conn_handle, uint16_t value_handle, uint8_t notify) {
+	fake_link_t *link = find_link(conn_handle);
+	fake_attr_t *attr = find_attr(value_handle);
+	ble_gatts_evt_write_t *write;
+
+	if (link == NULL || attr == NULL || !attr->notify) {
+		return;
+	}
+	link->cccd[value_handle] = notify;
+
+	new_evt(BLE_GATTS_EVT_WRITE, conn_handle);
+	write = &evt_buf.evt.evt.gatts_evt.params.write;
+	write->handle = value_handle + 1;
+	write->op = BLE_GATTS_OP_WRITE_REQ;
+	write->len = 2;
+	write->data[0] = notify ? BLE_GATT_HVX_NOTIFICATION : 0;
+	write->data[1] = 0;
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_write (uint16_t conn_handle, uint16_t handle, const uint8_t *data, uint16_t len) {
+	fake_attr_t *attr = find_attr(handle);
+	ble_gatts_evt_write_t *write;
+
+	if (find_link(conn_handle) == NULL || attr == NULL || attr->is_cccd || len > attr->max_len) {
+		return;
+	}
+
+	if (attr->wr_auth) {
+		pending_write.conn_handle = conn_handle;
+		pending_write.handle = handle;
+		pending_write.len = len;
+		memcpy(pending_write.data, data, len);
+
+		new_evt(BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST, conn_handle);
+		evt_buf.evt.evt.gatts_evt.params.authorize_request.type = BLE_GATTS_AUTHORIZE_TYPE_WRITE;
+		write = &evt_buf.evt.evt.gatts_evt.params.authorize_request.request.write;
+	} else {
+		memcpy(attr->p_value, data, len);
+		attr->len = len;
+
+		new_evt(BLE_GATTS_EVT_WRITE, conn_handle);
+		write = &evt_buf.evt.evt.gatts_evt.params.write;
+	}
+	write->handle = handle;
+	write->op = BLE_GATTS_OP_WRITE_REQ;
+	write->len = len;
+	memcpy(write->data, data, len);
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_adv_data (uint8_t *p_data, uint8_t *p_dlen, uint8_t *p_sr_data, uint8_t *p_srdlen) {
+	memcpy(p_data, adv_data, adv_data_len);
+	*p_dlen = adv_data_len;
+	memcpy(p_sr_data, sr_data, sr_data_len);
+	*p_srdlen = sr_data_len;
+}
+
+uint8_t softdevice_fake_scan_params (ble_gap_scan_params_t *p_params) {
+	*p_params = scan_params;
+	return scanning;
+}
+
+uint8_t softdevice_fake_tx_pending (uint16_t conn_handle) {
+	fake_link_t *link = find_link(conn_handle);
+
+	return link ? link->tx_pending : 0;
+}
+
+uint32_t softdevice_fake_value_gets (void) {
+	return value_gets;
+}
+
+uint32_t softdevice_fake_value_sets (void) {
+	return value_sets;
+}
+
+static void encrypted (uint16_t conn_handle) {
+	new_evt(BLE_GAP_EVT_CONN_SEC_UPDATE, conn_handle);
+	evt_buf.evt.evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.sm = 1;
+	evt_buf.evt.evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.lv = 2;
+	evt_buf.evt.evt.gap_evt.params.conn_sec_update.conn_sec.encr_key_size = 16;
+	softdevice_fake_evt(&evt_buf.evt);
+}
+
+void softdevice_fake_pair (uint16_t conn_handle, ble_gap_enc_key_t *p_peer_key) {
+	fake_link_t *link = find_link(conn_handle);
+	ble_gap_evt_auth_status_t *auth;
+	ble_gap_enc_key_t key;
+	uint8_t i;
+
+	if (link == NULL) {
+		return;
+	}
+	new_evt(BLE_GAP_EVT_SEC_PARAMS_REQUEST, conn_handle);
+	evt_buf.evt.evt.gap_evt.params.sec_params_request.peer_params.bond = 1;
+	evt_buf.evt.evt.gap_evt.params.sec_params_request.peer_params.kdist_own.id = 1;
+	evt_buf.evt.evt.gap_evt.params.sec_params_request.peer_params.kdist_peer.enc = 1;
+	link->bond = 0;
+	softdevice_fake_evt(&evt_buf.evt);
+
+	// a different key every pairing
+	pairings++;
+	memset(&key, 0, sizeof(key));
+	for (i = 0; i < BLE_GAP_SEC_KEY_LEN; i++) {
+		key.enc_info.ltk[i] = pairings * 0x10 + i;
+	}
+	key.enc_info.ltk_len = BLE_GAP_SEC_KEY_LEN;
+	key.master_id.ediv = 0x1000 + pairings;
+	memset(key.master_id.rand, pairings, BLE_GAP_SEC_RAND_LEN);
+
+	if (link->bond) {
+		*link->keyset.keys_own.p_enc_key = key;
+		if (link->keyset.keys_peer.p_id_key) {
+			memset(link->keyset.keys_peer.p_id_key->id_info.irk, link->peer, BLE_GAP_SEC_KEY_LEN);
+			link->keyset.keys_peer.p_id_key->id_addr_info.addr_type = BLE_GAP_ADDR_TYPE_PUBLIC;
+			link->keyset.keys_peer.p_id_key->id_addr_info.addr[0] = link->peer;
+		}
+	} else {
+		memset(&key, 0, sizeof(key));
+	}
+	if (p_peer_key) {
+		*p_peer_key = key;
+	}
+	say("pair %u: %s\n", conn_handle, link->bond ? "bonded" : "not bonded");
+
+	new_evt(BLE_GAP_EVT_AUTH_STATUS, conn_handle);
+	auth = &evt_buf.evt.evt.gap_evt.params.auth_status;
+	auth->auth_status = BLE_GAP_SEC_STATUS_SUCCESS;
+	auth->bonded = link->bond;
+	auth->kdist_own.enc = link->bond;
+	auth->kdist_peer.id = link->bond && link->keyset.keys_peer.p_id_key;
+	softdevice_fake_evt(&evt_buf.evt);
+
+	encrypted(conn_handle);
+}
+
+uint8_t softdevice_fake_encrypt (uint16_t conn_handle, const ble_gap_enc_key_t *p_peer_key) {
+	fake_link_t *link = find_link(conn_handle);
+
+	if (link == NULL) {
+		return 0;
+	}
+	new_evt(BLE_GAP_EVT_SEC_INFO_REQUEST, conn_handle);
+	evt_buf.evt.evt.gap_evt.params.sec_info_request.peer_addr.addr_type = BLE_GAP_ADDR_TYPE_PUBLIC;
+	evt_buf.evt.evt.gap_evt.params.sec_info_request.peer_addr.addr[0] = link->peer;
+	evt_buf.evt.evt.gap_evt.params.sec_info_request.master_id = p_peer_key->master_id;
+	evt_buf.evt.evt.gap_evt.params.sec_info_request.enc_info = 1;
+	link->enc_known = 0;
+	softdevice_fake_evt(&evt_buf.evt);
+
+	if (!link->enc_known ||
+	        memcmp(link->enc_info.ltk, p_peer_key->enc_info.ltk, BLE_GAP_SEC_KEY_LEN) != 0) {
+		say("encrypt %u: key missing\n", conn_handle);
+		return 0;
+	}
+	say("encrypt %u: resumed\n", conn_handle);
+	encrypted(conn_handle);
+	return 1;
+}
+
+
+/*
+ * Scripts and handler times
+ */
+
+#define SCRIPT_LINES    256
+#define SCRIPT_LINE_LEN 128
+
+static char script[SCRIPT_LINES][SCRIPT_LINE_LEN];
+
+// What each peer, by the last byte of its address, kept from pairing
+static ble_gap_enc_key_t script_keys[256];
+
+static const char *evt_name (uint8_t evt_id) {
+	switch (evt_id) {
+		case BLE_GAP_EVT_CONNECTED: return "connected";
+		case BLE_GAP_EVT_DISCONNECTED: return "disconnected";
+		case BLE_GAP_EVT_CONN_PARAM_UPDATE: return "conn_param_update";
+		case BLE_GAP_EVT_SEC_PARAMS_REQUEST: return "sec_params_request";
+		case BLE_GAP_EVT_SEC_INFO_REQUEST: return "sec_info_request";
+		case BLE_GAP_EVT_AUTH_STATUS: return "auth_status";
+		case BLE_GAP_EVT_CONN_SEC_UPDATE: return "conn_sec_update";
+		case BLE_GAP_EVT_TIMEOUT: return "gap_timeout";
+		case BLE_GAP_EVT_ADV_REPORT: return "adv_report";
+		case BLE_GATTS_EVT_WRITE: return "write";
+		case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST: return "rw_authorize_request";
+		case BLE_GATTS_EVT_SYS_ATTR_MISSING: return "sys_attr_missing";
+		case BLE_GATTS_EVT_TIMEOUT: return "gatts_timeout";
+		case BLE_EVT_TX_COMPLETE: return "tx_complete";
+		default: return NULL;
+	}
+}
+
+// The bytes in hex after the first skip words of line
+static uint16_t script_bytes (const char *line, uint8_t skip, uint8_t *data, uint16_t max) {
+	uint16_t len = 0;
+	unsigned byte;
+	int used;
+
+	while (skip > 0 && sscanf(line, "%*s%n", &used) == 0) {
+		line += used;
+		skip--;
+	}
+	while (len < max && sscanf(line, "%x%n", &byte, &used) == 1) {
+		data[len++] = byte;
+		line += used;
+	}
+	return len;
+}
+
+// Lines first to last, not including last. Returns the number of the line
+// that failed, 0 if they all ran.
+static uint32_t script_run (uint32_t first, uint32_t last, softdevice_fake_script_cmd_t p_cmd) {
+	uint8_t data[BLE_GATTS_VAR_ATTR_LEN_MAX];
+	fake_link_t *link;
+	char cmd[24];
+	char word[24];
+	unsigned a, b, c;
+	int d;
+	uint32_t i, end, depth, failed;
+
+	for (i = first; i < last; i++) {
+		const char *line = script[i];
+
+		if (sscanf(line, "%23s", cmd) != 1 || cmd[0] == '#') {
+			continue;
+		}
+
+		if (strcmp(cmd, "repeat") == 0) {
+			// up to the matching end
+			for (end = i + 1, depth = 1; end < last; end++) {
+				if (sscanf(script[end], "%23s", word) != 1) continue;
+				if (strcmp(word, "repeat") == 0) depth++;
+				if (strcmp(word, "end") == 0 && --depth == 0) break;
+			}
+			if (sscanf(line, "%*s %u", &a) != 1 || end == last) {
+				return i + 1;
+			}
+			while (a-- > 0) {
+				failed = script_run(i + 1, end, p_cmd);
+				if (failed) {
+					return failed;
+				}
+			}
+			i = end;
+		} else if (strcmp(cmd, "connect") == 0 && sscanf(line, "%*s %u %23s %x", &a, word, &b) == 3) {
+			softdevice_fake_connect(a, strcmp(word, "central") == 0 ?
+			                        BLE_GAP_ROLE_CENTRAL : BLE_GAP_ROLE_PERIPH, b);
+		} else if (strcmp(cmd, "disconnect") == 0 && sscanf(line, "%*s %u", &a) == 1) {
+			softdevice_fake_disconnect(a);
+		} else if (strcmp(cmd, "report") == 0 && sscanf(line, "%*s %x %23s %d", &a, word, &d) == 3) {
+			softdevice_fake_adv_report(a, strcmp(word, "rsp") == 0, d, data,
+			                           script_bytes(line, 4, data, BLE_GAP_ADV_MAX_SIZE));
+		} else if (strcmp(cmd, "conn_param") == 0 && sscanf(line, "%*s %u %u %u", &a, &b, &c) == 3) {
+			softdevice_fake_conn_param_update(a, b, c);
+		} else if (strcmp(cmd, "cccd") == 0 && sscanf(line, "%*s %u %u %u", &a, &b, &c) == 3) {
+			softdevice_fake_cccd(a, b, c);
+		} else if (strcmp(cmd, "write") == 0 && sscanf(line, "%*s %u %u", &a, &b) == 2) {
+			softdevice_fake_write(a, b, data, script_bytes(line, 3, data, sizeof(data)));
+		} else if (strcmp(cmd, "tx_complete") == 0 && sscanf(line, "%*s %u %23s", &a, word) == 2) {
+			softdevice_fake_tx_complete(a, strcmp(word, "all") == 0 ?
+			                            softdevice_fake_tx_pending(a) : (uint8_t) atoi(word));
+		} else if (strcmp(cmd, "pair") == 0 && sscanf(line, "%*s %u", &a) == 1) {
+			link = find_link(a);
+			if (link) {
+				softdevice_fake_pair(a, &script_keys[link->peer]);
+			}
+		} else if (strcmp(cmd, "encrypt") == 0 && sscanf(line, "%*s %u", &a) == 1) {
+			link = find_link(a);
+			if (link) {
+				softdevice_fake_encrypt(a, &script_keys[link->peer]);
+			}
+		} else if (strcmp(cmd, "timeout") == 0 && sscanf(line, "%*s %23s", word) == 1 &&
+		           strcmp(word, "adv") == 0) {
+			new_evt(BLE_GAP_EVT_TIMEOUT, BLE_CONN_HANDLE_INVALID);
+			evt_buf.evt.evt.gap_evt.params.timeout.src = BLE_GAP_TIMEOUT_SRC_ADVERTISING;
+			softdevice_fake_evt(&evt_buf.evt);
+		} else if (strcmp(cmd, "timeout") == 0 && sscanf(line, "%*s %23s %u", word, &a) == 2 &&
+		           strcmp(word, "gatt") == 0) {
+			new_evt(BLE_GATTS_EVT_TIMEOUT, a);
+			evt_buf.evt.evt.gatts_evt.params.timeout.src = BLE_GATT_TIMEOUT_SRC_PROTOCOL;
+			softdevice_fake_evt(&evt_buf.evt);
+		} else if (p_cmd == NULL || !p_cmd(line)) {
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+uint32_t softdevice_fake_script (FILE *in, softdevice_fake_script_cmd_t p_cmd) {
+	uint32_t count = 0;
+
+	while (count < SCRIPT_LINES && fgets(script[count], SCRIPT_LINE_LEN, in)) {
+		count++;
+	}
+	return script_run(0, count, p_cmd);
+}
+
+void softdevice_fake_quiet (uint8_t on) {
+	quiet = on;
+}
+
+void softdevice_fake_get_stats (uint8_t evt_id, softdevice_fake_stats_t *stats) {
+	*stats = evt_stats[evt_id];
+}
+
+void softdevice_fake_clear_stats (void) {
+	memset(evt_stats, 0, sizeof(evt_stats));
+}
+
+void softdevice_fake_report (FILE *out) {
+	uint32_t i;
+
+	fprintf(out, "  %-20s %10s %10s %10s\n", "event", "calls", "mean ns", "max ns");
+	for (i = 0; i < 256; i++) {
+		softdevice_fake_stats_t *stats = &evt_stats[i];
+		char unnamed[24];
+
+		if (stats->calls == 0) {
+			continue;
+		}
+		if (evt_name(i) == NULL) {
+			snprintf(unnamed, sizeof(unnamed), "event 0x%02lx", (unsigned long) i);
+		}
+		fprintf(out, "  %-20s %10lu %10llu %10llu\n", evt_name(i) ? evt_name(i) : unnamed,
+		        (unsigned long) stats->calls,
+		        (unsigned long long) (stats->total_ns / stats->calls),
+		        (unsigned long long) stats->max_ns);
+	}
+}
@@ -0,0 +1,131 @@
+#ifndef __SOFTDEVICE_FAKE_H
+#define __SOFTDEVICE_FAKE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ble.h"
+
+// Host stand-in for the parts of the SoftDevice and softdevice_handler that
+// simple_ble.c calls, behind the SDK's own headers. GATTS keeps a flat
+// attribute table (service, declaration, value and CCCD handles numbered in
+// the order they are added, values in the user's buffers as with
+// BLE_GATTS_VLOC_USER), GAP only remembers what it was asked. Calls that a
+// test wants to see (advertising, disconnects, notifications, authorize
+// replies) are printed to stdout so the output can be diffed.
+//
+// Events go to the handler simple_ble registered, straight from the
+// softdevice_fake_* calls, as if SWI2 had fired. They can also come from a
+// script, and the time simple_ble takes for each kind of event is kept.
+
+// Notifications the SoftDevice holds per link before hvx reports
+// BLE_ERROR_NO_TX_PACKETS, as on S130 with the default bandwidth
+#ifndef SOFTDEVICE_FAKE_TX_BUFFERS
+#define SOFTDEVICE_FAKE_TX_BUFFERS 4
+#endif
+
+#ifndef SOFTDEVICE_FAKE_ATTRS
+#define SOFTDEVICE_FAKE_ATTRS 64
+#endif
+
+#ifndef SOFTDEVICE_FAKE_LINKS
+#define SOFTDEVICE_FAKE_LINKS 8
+#endif
+
+// Vendor specific UUID bases, as many as S130 takes by default
+#ifndef SOFTDEVICE_FAKE_VS_UUIDS
+#define SOFTDEVICE_FAKE_VS_UUIDS 10
+#endif
+
+// Interval every connection starts with, in 1.25 ms units
+#ifndef SOFTDEVICE_FAKE_CONN_INTERVAL
+#define SOFTDEVICE_FAKE_CONN_INTERVAL 24
+#endif
+
+typedef struct {
+	uint32_t calls;
+	uint64_t total_ns;  // host time spent in simple_ble's handler
+	uint64_t max_ns;
+} softdevice_fake_stats_t;
+
+// Gets the script lines the fake doesn't know. Returns 0 if it doesn't
+// know them either.
+typedef uint8_t (*softdevice_fake_script_cmd_t) (const char* line);
+
+// Hand any event to simple_ble
+void softdevice_fake_evt (ble_evt_t* p_ble_evt);
+
+// A peer connected in role (BLE_GAP_ROLE_PERIPH or _CENTRAL), with the
+// last byte of its address set to peer
+void softdevice_fake_connect (uint16_t conn_handle, uint8_t role, uint8_t peer);
+void softdevice_fake_disconnect (uint16_t conn_handle);
+
+// The scanner heard an advertisement, or a scan response, from the peer
+// with this last byte of its random static address
+void softdevice_fake_adv_report (uint8_t peer, uint8_t scan_rsp, int8_t rssi, const uint8_t* data, uint8_t dlen);
+
+// The central changed the connection's parameters, the interval and slave
+// latency it picked
+void softdevice_fake_conn_param_update (uint16_t conn_handle, uint16_t interval, uint16_t latency);
+
+// The peer acknowledged count notifications on the link, which frees their
+// buffers and sends BLE_EVT_TX_COMPLETE
+void softdevice_fake_tx_complete (uint16_t conn_handle, uint8_t count);
+
+// The peer wrote its CCCD for the characteristic with this value handle
+void softdevice_fake_cccd (uint16_t conn_handle, uint16_t value_handle, uint8_t notify);
+
+// The peer wrote to a value. Characteristics with write authorization get
+// BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST and are only stored once authorized,
+// the others are stored and get BLE_GATTS_EVT_WRITE.
+void softdevice_fake_write (uint16_t conn_handle, uint16_t handle, const uint8_t* data, uint16_t len);
+
+// The central paired and bonded with the peripheral, and encrypted the
+// link. The keys the central keeps, to come back with, go to p_peer_key.
+// They are zero if the peripheral didn't hand out any.
+void softdevice_fake_pair (uint16_t conn_handle, ble_gap_enc_key_t* p_peer_key);
+
+// The central encrypts the link with the keys it kept. Returns 1 if the
+// peripheral had the same key, 0 if it didn't and the central would have to
+// pair again.
+uint8_t softdevice_fake_encrypt (uint16_t conn_handle, const ble_gap_enc_key_t* p_peer_key);
+
+// The advertising and scan response data the SoftDevice was last given,
+// each up to BLE_GAP_ADV_MAX_SIZE bytes
+void softdevice_fake_adv_data (uint8_t* p_data, uint8_t* p_dlen, uint8_t* p_sr_data, uint8_t* p_srdlen);
+
+// The parameters of the scan running. Returns 0 if there is none.
+uint8_t softdevice_fake_scan_params (ble_gap_scan_params_t* p_params);
+
+// Notifications sent on a link that the peer hasn't acknowledged yet
+uint8_t softdevice_fake_tx_pending (uint16_t conn_handle);
+
+// sd_ble_gatts_value_get and _set calls so far
+uint32_t softdevice_fake_value_gets (void);
+uint32_t softdevice_fake_value_sets (void);
+
+// Run the events of a script, one per line, with # starting a comment:
+//   connect <conn> periph|central <peer>
+//   disconnect <conn>
+//   conn_param <conn> <interval> <latency>
+//   report <peer> adv|rsp <rssi> <bytes in hex>...
+//   cccd <conn> <value handle> 0|1
+//   write <conn> <handle> <bytes in hex>...
+//   tx_complete <conn> <count>|all
+//   pair <conn>                 the peer keeps the keys it gets
+//   encrypt <conn>              with the keys the peer kept
+//   timeout adv
+//   timeout gatt <conn>
+//   repeat <n> ... end
+// Up to 256 lines. Returns the number of the first line that failed, 0 if
+// they all ran.
+uint32_t softdevice_fake_script (FILE* in, softdevice_fake_script_cmd_t p_cmd);
+
+// Stop printing what simple_ble asks the SoftDevice for, to time it
+void softdevice_fake_quiet (uint8_t on);
+
+// Handler times by event id, and one line per event id that came
+void softdevice_fake_get_stats (uint8_t evt_id, softdevice_fake_stats_t* stats);
+void softdevice_fake_clear_stats (void);
+void softdevice_fake_report (FILE* out);
+
+#endif
@@ -0,0 +1,141 @@
+// simple_logger's batch ring on the mbramfs sink, with simple_timer faked
+//
+// Prints every write and sync the sink sees, and the batch stats after each
+// step: records commit once a 64 byte mbramfs block is waiting, once the
+// oldest has waited SIMPLE_LOGGER_BATCH_MAX_AGE_MS, and on
+// simple_logger_flush(). Pending records are the ones a reset would lose.
+// A sink that is busy keeps the rest waiting, without being reopened.
+// Built with SIMPLE_LOGGER_BATCH_SIZE=256 and SIMPLE_LOGGER_BATCH_MAX_AGE_MS=100.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "simple_logger.h"
+#include "simple_timer.h"
+
+static simple_logger_sink_t counted;
+static const simple_logger_sink_t* inner;
+
+// bytes the sink takes before it is busy, as RTT is with no debugger reading
+static uint32_t busy_after = UINT32_MAX;
+
+static uint8_t counted_open (void* context, const char* name, uint8_t append, uint8_t* existed) {
+	printf("  open\n");
+	return inner->open(context, name, append, existed);
+}
+
+static uint8_t counted_write (void* context, const void* data, uint32_t len, uint32_t* written) {
+	uint8_t res;
+
+	printf("  write %lu at %lu\n", (unsigned long) len, (unsigned long) inner->tell(context));
+	if (len <= busy_after) {
+		busy_after -= busy_after == UINT32_MAX ? 0 : len;
+		return inner->write(context, data, len, written);
+	}
+	res = inner->write(context, data, busy_after, written);
+	busy_after = 0;
+	printf("  busy after %lu\n", (unsigned long) *written);
+	return res != SIMPLE_LOGGER_SUCCESS ? res : SIMPLE_LOGGER_BUSY;
+}
+
+static uint8_t counted_sync (void* context) {
+	printf("  sync at %lu\n", (unsigned long) inner->tell(context));
+	return inner->sync(context);
+}
+
+static void stats (void) {
+	simple_logger_batch_stats_t s;
+
+	simple_logger_get_batch_stats(&s);
+	printf("  pending %lu records %lu bytes, last flush %lu, flushes %lu, dropped %lu\n",
+			(unsigned long) s.records_pending, (unsigned long) s.bytes_pending,
+			(unsigned long) s.records_last_flush, (unsigned long) s.flushes,
+			(unsigned long) s.records_dropped);
+}
+
+// 20 bytes each
+static void log_record (uint32_t i) {
+	printf("log %lu\n", (unsigned long) i);
+	simple_logger_log("record %04lu,abcdefg\n", (unsigned long) i);
+}
+
+static void wait_ms (uint32_t ms) {
+	printf("wait %lums\n", (unsigned long) ms);
+	simple_timer_fake_advance(ms);
+	simple_logger_update();
+}
+
+static void section (const char* title) {
+	printf("\n%s\n", title);
+}
+
+int main (void) {
+	uint32_t i = 0;
+
+	inner = simple_logger_sink_mbramfs();
+	counted = *inner;
+	counted.open = counted_open;
+	counted.write = counted_write;
+	counted.sync = counted_sync;
+
+	printf("init %i\n", simple_logger_init_sink(&counted, "batch.log", "w"));
+	stats();
+
+	section("records wait until a block is full, the one it cuts stays pending");
+	for (; i < 3; i++) {
+		log_record(i);
+	}
+	stats();
+	log_record(i++);
+	stats();
+
+	section("then only whole blocks are written");
+	for (; i < 10; i++) {
+		log_record(i);
+	}
+	stats();
+
+	section("the oldest record ages out");
+	wait_ms(SIMPLE_LOGGER_BATCH_MAX_AGE_MS - 1);
+	stats();
+	wait_ms(1);
+	stats();
+
+	section("a lone record ages out on its own");
+	log_record(i++);
+	wait_ms(SIMPLE_LOGGER_BATCH_MAX_AGE_MS / 2);
+	log_record(i++);
+	wait_ms(SIMPLE_LOGGER_BATCH_MAX_AGE_MS / 2);
+	stats();
+
+	section("flush commits whatever is waiting");
+	log_record(i++);
+	log_record(i++);
+	stats();
+	printf("flush %i\n", simple_logger_flush());
+	stats();
+	printf("flush %i\n", simple_logger_flush());
+	stats();
+
+	section("round the ring a few times");
+	for (; i < 40; i++) {
+		log_record(i);
+	}
+	stats();
+	printf("flush %i\n", simple_logger_flush());
+	stats();
+
+	section("a busy sink keeps the rest waiting");
+	busy_after = 30;
+	for (; i < 44; i++) {
+		log_record(i);
+	}
+	stats();
+	printf("flush %i\n", simple_logger_flush());
+	stats();
+	busy_after = UINT32_MAX;
+	printf("flush %i\n", simple_logger_flush());
+	stats();
+
+	printf("\n%lu bytes logged\n", (unsigned long) inner->tell(NULL));
+	return 0;
+}
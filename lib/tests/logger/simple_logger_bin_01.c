@@ -0,0 +1,100 @@
+// Round trip of simple_logger's binary records
+//
+// Writes each record twice: as a binary log to argv[1] and formatted with
+// vsnprintf to argv[2]. decode_log.py on the first must give the second.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include "simple_logger_bin.h"
+
+static FILE* bin;
+static FILE* text;
+static uint8_t out[256];
+static uint32_t types[8];
+static uint8_t nargs[8];
+static const char* formats[8];
+
+static void define (uint8_t id, const char* format) {
+	int8_t n = simple_logger_bin_parse(format, &types[id]);
+	if (n < 0) {
+		printf("could not parse %s\n", format);
+		return;
+	}
+	nargs[id] = n;
+	formats[id] = format;
+	fwrite(out, 1, simple_logger_bin_format(out, sizeof(out), id, format), bin);
+}
+
+static void log_both (uint8_t id, uint32_t delta_ms, ...) {
+	va_list args;
+	char line[256];
+
+	va_start(args, delta_ms);
+	fwrite(out, 1, simple_logger_bin_record(out, sizeof(out), id, nargs[id],
+			types[id], 1, delta_ms, args), bin);
+	va_end(args);
+
+	va_start(args, delta_ms);
+	vsnprintf(line, sizeof(line), formats[id], args);
+	va_end(args);
+	fputs(line, text);
+}
+
+static void text_both (const char* s) {
+	fwrite(out, 1, simple_logger_bin_text_prefix(out, strlen(s)), bin);
+	fputs(s, bin);
+	fputs(s, text);
+}
+
+int main (int argc, char** argv) {
+	uint32_t t;
+	char longer[200];
+
+	bin = fopen(argv[1], "wb");
+	text = fopen(argv[2], "w");
+
+	fwrite(out, 1, simple_logger_bin_file_header(out, SIMPLE_LOGGER_BIN_FLAG_TIME), bin);
+	fwrite(out, 1, simple_logger_bin_time(out, sizeof(out), 123456), bin);
+	text_both("time,x,y,z\n");
+
+	define(0, "%lu,%d,%d,%d\n");
+	define(1, "%s=%5.2f %x%% %c\n");
+	define(2, "no arguments\n");
+	define(3, "%08X|%-6i|%+d|%hd|%o\n");
+	define(4, "%.3f %f %g\n");
+	define(5, "%ld|%lx|%zu\n");
+	define(6, "%hx|%hhu|%hd|%hhd|%hhX|%hu\n");
+
+	log_both(0, 0, 0ul, 0, -1, 1);
+	log_both(0, 10, 4294967295ul, 2147483647, -2147483647-1, 300);
+	log_both(1, 1, "temp", 21.5, 0xbeef, 'k');
+	log_both(2, 100000);
+	log_both(3, 5, 0xdeadu, -42, 7, -3, 8);
+	// none of these fit in a float
+	log_both(4, 3, 1234567.891, 16777217.0, 0.1);
+	log_both(5, 4, -5l, 0xfffffffful, (size_t) 70000);
+	// printf narrows these
+	log_both(6, 6, 0x12345, 300, 40000, 200, 0x1ff, -1);
+
+	memset(longer, 'a', sizeof(longer)-1);
+	longer[sizeof(longer)-1] = '\0';
+	log_both(1, 2, longer, -0.125, 0, 'z');
+
+	for (t=0; t<50; t++) {
+		log_both(0, 1, 123456ul + t, t*3, -t, t*t);
+	}
+
+	fclose(bin);
+	fclose(text);
+
+	// formats that cannot be deferred
+	if (simple_logger_bin_parse("%lld", &t) != -1 ||
+	    simple_logger_bin_parse("%*d", &t) != -1 ||
+	    simple_logger_bin_parse("%d%d%d%d%d%d%d%d%d", &t) != -1) {
+		printf("accepted a format that cannot be deferred\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,92 @@
+// Host benchmark of simple_logger's binary records
+//
+// Compares formatting a typical numeric record with vsnprintf, as
+// simple_logger_log does, against storing it with simple_logger_log_bin's
+// encoder. Reports bytes and time per record, and cycles on x86.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include "simple_logger_bin.h"
+
+#define BENCH_RECORDS 1000000
+
+static const char* format = "%lu,%d,%d,%d,%u\n";
+static uint32_t types;
+static int8_t nargs;
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t now_cycles (void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static uint32_t text_record (char* out, ...) {
+	va_list args;
+	int len;
+	va_start(args, out);
+	len = vsnprintf(out, 256, format, args);
+	va_end(args);
+	return len;
+}
+
+static uint32_t bin_record (uint8_t* out, uint32_t delta_ms, ...) {
+	va_list args;
+	uint32_t len;
+	va_start(args, delta_ms);
+	len = simple_logger_bin_record(out, 256, 0, nargs, types, 1, delta_ms, args);
+	va_end(args);
+	return len;
+}
+
+int main (int argc, char** argv) {
+	static char text[256];
+	static uint8_t bin[256];
+	uint64_t text_bytes = 0, bin_bytes = 0;
+	uint64_t start, cycles, text_ns, text_cycles, bin_ns, bin_cycles;
+	uint32_t i;
+
+	nargs = simple_logger_bin_parse(format, &types);
+
+	// an accelerometer sampled every 10 ms, plus a counter
+	start = now_ns();
+	cycles = now_cycles();
+	for (i=0; i<BENCH_RECORDS; i++) {
+		text_bytes += text_record(text, 100000ul + i*10, (int)(i%2048)-1024,
+				(int)((i*7)%2048)-1024, 980, i);
+	}
+	text_cycles = now_cycles() - cycles;
+	text_ns = now_ns() - start;
+
+	start = now_ns();
+	cycles = now_cycles();
+	for (i=0; i<BENCH_RECORDS; i++) {
+		bin_bytes += bin_record(bin, 10, 100000ul + i*10, (int)(i%2048)-1024,
+				(int)((i*7)%2048)-1024, 980, i);
+	}
+	bin_cycles = now_cycles() - cycles;
+	bin_ns = now_ns() - start;
+
+	printf("%8s %16s %16s %16s\n", "", "bytes/record", "ns/record", "cycles/record");
+	printf("%8s %16.2f %16.1f %16.1f\n", "text",
+			(double) text_bytes / BENCH_RECORDS,
+			(double) text_ns / BENCH_RECORDS,
+			(double) text_cycles / BENCH_RECORDS);
+	printf("%8s %16.2f %16.1f %16.1f\n", "binary",
+			(double) bin_bytes / BENCH_RECORDS,
+			(double) bin_ns / BENCH_RECORDS,
+			(double) bin_cycles / BENCH_RECORDS);
+
+	return 0;
+}
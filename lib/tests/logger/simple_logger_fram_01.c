@@ -0,0 +1,67 @@
+// simple_logger on the FRAM sink, on the RAM fake of a 512 byte FM25L04B
+//
+// Batches records longer than one SPI transfer takes, nearly fills the chip,
+// and checks that the fake holds what was logged. The fake fails any
+// transfer of more than 255 bytes, as nrf_drv_spi's uint8_t lengths would
+// cut it short. Built with SIMPLE_LOGGER_BATCH_SIZE=512 and
+// SIMPLE_LOGGER_BUFFER_SIZE=512.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "simple_logger.h"
+#include "simple_logger_sink_fram.h"
+#include "fm25l04b_ram.h"
+
+static fm25l04b_t fram;
+static char logged[1024];
+static uint32_t logged_len = 0;
+
+static void fake_stats (void) {
+	printf("  fram: writes %lu, bytes %lu, errors %lu, length %u\n",
+			(unsigned long) fm25l04b_ram_stats.writes,
+			(unsigned long) fm25l04b_ram_stats.bytes_written,
+			(unsigned long) fm25l04b_ram_stats.errors,
+			fm25l04b_ram[0] | (fm25l04b_ram[1] << 8));
+}
+
+static void log_line (char c, uint32_t len) {
+	char line[400];
+	uint8_t err;
+
+	memset(line, c, len - 1);
+	line[len - 1] = '\0';
+	err = simple_logger_log("%s\n", line);
+	printf("log %lu bytes of %c: %i\n", (unsigned long) len, c, err);
+	if (err == SIMPLE_LOGGER_SUCCESS && logged_len + len <= sizeof(logged)) {
+		memset(logged + logged_len, c, len - 1);
+		logged[logged_len + len - 1] = '\n';
+		logged_len += len;
+	}
+}
+
+static void section (const char* title) {
+	printf("\n%s\n", title);
+}
+
+int main (void) {
+	uint32_t stored;
+
+	printf("init %i\n", simple_logger_init_sink(simple_logger_sink_fram(&fram), NULL, "w"));
+
+	section("a record longer than a transfer");
+	log_line('a', 300);
+	fake_stats();
+
+	section("short ones after it, nearly filling the chip");
+	log_line('b', 100);
+	log_line('c', 100);
+	printf("flush %i\n", simple_logger_flush());
+	fake_stats();
+
+	section("the chip holds what was logged");
+	stored = fm25l04b_ram[0] | (fm25l04b_ram[1] << 8);
+	printf("%s\n", stored == logged_len && memcmp(fm25l04b_ram + 2, logged, stored) == 0 ?
+			"same" : "differs");
+	return 0;
+}
@@ -0,0 +1,102 @@
+// simple_logger_log_async's queue, drained through the app_scheduler fake
+//
+// Logs as an interrupt handler would, past the end of the queue, and prints
+// what reaches the mbramfs sink each time the main loop runs the scheduler,
+// with the queue stats after each step. Records have to come out in the
+// order they were logged, and the ones that did not fit are only counted.
+// Built with SIMPLE_LOGGER_QUEUE_LEN=4 and SIMPLE_LOGGER_QUEUE_RECORD_SIZE=32.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "simple_logger.h"
+#include "app_scheduler.h"
+
+#define SCHED_QUEUE_SIZE 4
+
+static simple_logger_sink_t counted;
+static const simple_logger_sink_t* inner;
+
+static uint8_t counted_write (void* context, const void* data, uint32_t len, uint32_t* written) {
+	const char* record = data;
+
+	// records cut short have no newline
+	printf("  write %.*s\n", (int) (len - (record[len-1] == '\n')), record);
+	return inner->write(context, data, len, written);
+}
+
+static void stats (void) {
+	simple_logger_queue_stats_t s;
+
+	simple_logger_get_queue_stats(&s);
+	printf("  queued %lu, high water %lu, written %lu, dropped %lu, truncated %lu, errors %lu\n",
+			(unsigned long) s.records_queued, (unsigned long) s.high_water,
+			(unsigned long) s.records_written, (unsigned long) s.records_dropped,
+			(unsigned long) s.records_truncated, (unsigned long) s.write_errors);
+}
+
+static void log_async (uint32_t i) {
+	printf("log %lu: %i\n", (unsigned long) i,
+			simple_logger_log_async("irq %lu\n", (unsigned long) i));
+}
+
+static void main_loop (void) {
+	printf("main loop\n");
+	app_sched_execute();
+	stats();
+}
+
+static void section (const char* title) {
+	printf("\n%s\n", title);
+}
+
+int main (void) {
+	uint32_t i = 0;
+
+	app_sched_init(0, SCHED_QUEUE_SIZE, NULL);
+
+	inner = simple_logger_sink_mbramfs();
+	counted = *inner;
+	counted.write = counted_write;
+
+	printf("init %i\n", simple_logger_init_sink(&counted, "queue.log", "w"));
+
+	section("nothing is written until the main loop runs");
+	for (; i < 3; i++) {
+		log_async(i);
+	}
+	stats();
+	main_loop();
+
+	section("a burst longer than the queue drops the newest");
+	for (; i < 9; i++) {
+		log_async(i);
+	}
+	stats();
+	main_loop();
+
+	section("the queue is free again once drained");
+	for (; i < 13; i++) {
+		log_async(i);
+	}
+	main_loop();
+
+	section("records logged from the main loop don't wait for the queued ones");
+	log_async(i++);
+	log_async(i++);
+	simple_logger_log("main %lu\n", (unsigned long) i++);
+	main_loop();
+
+	section("a long record is cut to fit its slot");
+	printf("log: %i\n", simple_logger_log_async("%s\n",
+			"irq long record that does not fit"));
+	main_loop();
+
+	section("flush drains without the scheduler");
+	log_async(i++);
+	log_async(i++);
+	printf("flush %i\n", simple_logger_flush());
+	stats();
+	main_loop();
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+// Host benchmark of simple_logger's RAM backed sinks
+//
+// Runs the same workload through simple_logger_log for each sink, each in
+// its own process since simple_logger can only be initialized once, and
+// reports throughput, per record latency percentiles, and how many writes
+// reached the sink. Built once syncing every record and once batching.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "simple_logger.h"
+#include "simple_logger_sink_fram.h"
+#include "SEGGER_RTT.h"
+
+#define BENCH_RECORDS 2000
+
+static uint64_t latency[BENCH_RECORDS];
+static simple_logger_sink_t counted;
+static const simple_logger_sink_t* inner;
+static uint32_t sink_writes;
+static uint32_t sink_syncs;
+static fm25l04b_t fram;
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Count what the logger asks of the sink
+static uint8_t counted_write (void* context, const void* data, uint32_t len, uint32_t* written) {
+	sink_writes++;
+	return inner->write(context, data, len, written);
+}
+
+static uint8_t counted_sync (void* context) {
+	sink_syncs++;
+	return inner->sync(context);
+}
+
+static int compare (const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*) a;
+	uint64_t y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+static void run (const char* name, const simple_logger_sink_t* sink) {
+	uint64_t start, total = 0;
+	uint32_t bytes = 0;
+	uint8_t err;
+
+	inner = sink;
+	counted = *sink;
+	counted.write = counted_write;
+	counted.sync = counted_sync;
+
+	err = simple_logger_init_sink(&counted, "bench.log", "w");
+	if (err != SIMPLE_LOGGER_SUCCESS) {
+		printf("%-8s init failed %i\n", name, err);
+		return;
+	}
+
+	for (uint32_t i=0; i<BENCH_RECORDS; i++) {
+		uint32_t before = counted.tell(counted.context);
+
+		start = now_ns();
+		simple_logger_log("%lu,%d,%d,%d,%u\n", 100000ul + i*10,
+				(int)(i%2048)-1024, (int)((i*7)%2048)-1024, 980, i);
+		latency[i] = now_ns() - start;
+		total += latency[i];
+
+		bytes += counted.tell(counted.context) - before;
+
+		// a fast host reader empties the RTT buffer between records
+		_SEGGER_RTT.aUp[0].RdOff = _SEGGER_RTT.aUp[0].WrOff;
+	}
+	start = now_ns();
+	simple_logger_flush();
+	total += now_ns() - start;
+
+	qsort(latency, BENCH_RECORDS, sizeof(latency[0]), compare);
+	printf("%-8s %10.2f %8lu %8lu %8lu %8lu %10.3f %10.3f\n", name,
+			(double) bytes * 1000 / total,
+			(unsigned long) latency[BENCH_RECORDS/2],
+			(unsigned long) latency[BENCH_RECORDS*99/100],
+			(unsigned long) latency[BENCH_RECORDS*999/1000],
+			(unsigned long) latency[BENCH_RECORDS-1],
+			(double) sink_writes / BENCH_RECORDS,
+			(double) sink_syncs / BENCH_RECORDS);
+}
+
+int main (int argc, char** argv) {
+	const char* names[] = {"mbramfs", "fram", "rtt"};
+
+	printf("%-8s %10s %8s %8s %8s %8s %10s %10s\n", "sink", "MB/s",
+			"p50 ns", "p99 ns", "p99.9 ns", "max ns", "writes/rec", "syncs/rec");
+
+	for (int s=0; s<3; s++) {
+		pid_t pid;
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0) {
+			if (s == 0) run(names[s], simple_logger_sink_mbramfs());
+			if (s == 1) run(names[s], simple_logger_sink_fram(&fram));
+			if (s == 2) {
+				SEGGER_RTT_Init();
+				run(names[s], simple_logger_sink_rtt(0));
+			}
+			fflush(stdout);
+			_exit(0);
+		}
+		waitpid(pid, NULL, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+
+#include <stdio.h>
+#include <string.h>
+
+int main (int argc, char** argv) {
+	char fname_a[64];
+	char fname_b[64];
+	char fname_c[64];
+
+	FILE* fa;
+	FILE* fb;
+	FILE* fc;
+	char mydata_start[100];
+	char mydata_end[400];
+	int num;
+
+	snprintf(fname_a, sizeof(fname_a), "%s.a", argv[1]);
+	snprintf(fname_b, sizeof(fname_b), "%s.b", argv[1]);
+	snprintf(fname_c, sizeof(fname_c), "%s.c", argv[1]);
+
+	for (int i=0; i<100; i++) {
+		mydata_start[i] = 'A' + (i % 26);
+	}
+
+	// Interleave appends so that the files end up sharing the storage
+	fa = fopen(fname_a, "w");
+	fb = fopen(fname_b, "w");
+	for (int i=0; i<4; i++) {
+		fwrite(mydata_start, 1, 70, fa);
+		fwrite(mydata_start+i, 1, 50, fb);
+	}
+	fclose(fa);
+	fclose(fb);
+
+	// Free the first file and reuse its space for a new one
+	remove(fname_a);
+
+	fc = fopen(fname_c, "w");
+	for (int i=0; i<3; i++) {
+		fwrite(mydata_start+(i*3), 1, 90, fc);
+	}
+	fclose(fc);
+
+	fb = fopen(fname_b, "r");
+	num = fread(mydata_end, 1, 400, fb);
+	fclose(fb);
+
+	printf("Read %i bytes: \n", num);
+	for (int i=0; i<num; i++) {
+		printf("%c", mydata_end[i]);
+	}
+	printf("\n");
+
+	fc = fopen(fname_c, "r");
+	num = fread(mydata_end, 1, 400, fc);
+	fclose(fc);
+
+	printf("Read %i bytes: \n", num);
+	for (int i=0; i<num; i++) {
+		printf("%c", mydata_end[i]);
+	}
+	printf("\n");
+
+	fa = fopen(fname_a, "r");
+	if (fa == NULL) {
+		printf("could not open file\n");
+	}
+
+	// Do this to make the build system happy...
+	fa = fopen(argv[1], "w");
+	fwrite(mydata_start, 1, 10, fa);
+	fclose(fa);
+	remove(fname_b);
+	remove(fname_c);
+
+	return 0;
+}
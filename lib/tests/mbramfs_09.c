@@ -0,0 +1,49 @@
+
+#include <stdio.h>
+
+int main (int argc, char** argv) {
+	char* fname = argv[1];
+
+	FILE* f;
+	char mydata_start[10] = "abcDEFghi";
+	char mydata_end[1000];
+	int num;
+
+	// Write a file that spans many storage blocks
+	f = fopen(fname, "w");
+	for (int i=0; i<90; i++) {
+		fwrite(mydata_start, 1, 9, f);
+	}
+	fclose(f);
+
+	// Overwrite it with a shorter file, then grow it again
+	f = fopen(fname, "w");
+	fwrite(mydata_start, 1, 5, f);
+	fclose(f);
+
+	f = fopen(fname, "a");
+	for (int i=0; i<30; i++) {
+		fwrite(mydata_start+3, 1, 6, f);
+	}
+	fclose(f);
+
+	f = fopen(fname, "r");
+	fseek(f, 120, SEEK_SET);
+	num = fread(mydata_end, 1, 20, f);
+
+	printf("Read %i bytes: \n", num);
+	for (int i=0; i<num; i++) {
+		printf("%c\n", mydata_end[i]);
+	}
+
+	fseek(f, -70, SEEK_CUR);
+	num = fread(mydata_end, 1, 1000, f);
+
+	printf("Read %i bytes: \n", num);
+	for (int i=0; i<num; i++) {
+		printf("%c", mydata_end[i]);
+	}
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+
+#include <stdio.h>
+
+int main (int argc, char** argv) {
+	char fname[8][64];
+
+	FILE* f;
+	char mydata_start[10] = "abcDEFghi";
+	char mydata_end[10];
+	int num;
+
+	// Fill every file slot, each with different contents
+	for (int i=0; i<8; i++) {
+		snprintf(fname[i], sizeof(fname[i]), "%s.%i", argv[1], i);
+		f = fopen(fname[i], "w");
+		fwrite(mydata_start+i, 1, 9-i, f);
+		fclose(f);
+	}
+
+	// Remove some out of order, then reuse those names
+	remove(fname[5]);
+	remove(fname[0]);
+	remove(fname[3]);
+
+	f = fopen(fname[3], "w");
+	fwrite("xyz", 1, 3, f);
+	fclose(f);
+
+	for (int i=0; i<8; i++) {
+		f = fopen(fname[i], "r");
+		if (f == NULL) {
+			printf("could not open file %i\n", i);
+			continue;
+		}
+		num = fread(mydata_end, 1, 10, f);
+		fclose(f);
+
+		printf("Read %i bytes from file %i: ", num, i);
+		for (int j=0; j<num; j++) {
+			printf("%c", mydata_end[j]);
+		}
+		printf("\n");
+	}
+
+	for (int i=0; i<8; i++) {
+		remove(fname[i]);
+	}
+
+	// Do this to make the build system happy...
+	f = fopen(argv[1], "w");
+	fwrite(mydata_start, 1, 10, f);
+	fclose(f);
+
+	return 0;
+}
@@ -0,0 +1,40 @@
+#include <stdio.h>
+
+int main (int argc, char** argv) {
+	char* fname = argv[1];
+
+	FILE* f;
+	char mydata[10] = "abcDEFghi";
+	char readback[20];
+	int num;
+
+	// Append to a file and find where we are
+	f = fopen(fname, "w");
+	fwrite(mydata, 1, 9, f);
+	printf("After write: %li\n", ftell(f));
+	fclose(f);
+
+	f = fopen(fname, "a");
+	printf("After open for append: %li\n", ftell(f));
+	fwrite(mydata, 1, 4, f);
+	printf("After append: %li\n", ftell(f));
+	fclose(f);
+
+	// Seek relative to the end
+	f = fopen(fname, "r");
+	fseek(f, 0, SEEK_END);
+	printf("End: %li\n", ftell(f));
+
+	fseek(f, -5, SEEK_END);
+	printf("End-5: %li\n", ftell(f));
+	num = fread(readback, 1, 20, f);
+	printf("Read %i bytes: ", num);
+	for (int i=0; i<num; i++) {
+		printf("%c", readback[i]);
+	}
+	printf("\n");
+
+	fclose(f);
+
+	return 0;
+}
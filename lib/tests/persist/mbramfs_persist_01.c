@@ -0,0 +1,106 @@
+
+#include <stdio.h>
+#include "mbramfs.h"
+#include "mbramfs_flash_ram.h"
+
+static void dump (const char* fname) {
+	char buf[400];
+	FILE* f = fopen(fname, "r");
+	if (f == NULL) {
+		printf("%s: could not open file\n", fname);
+		return;
+	}
+
+	int num = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+
+	printf("%s: %i bytes: ", fname, num);
+	for (int i=0; i<num; i++) {
+		printf("%c", buf[i]);
+	}
+	printf("\n");
+}
+
+static void stats (const char* what) {
+	printf("%s: %u writes, %u bytes written, %u reads, %u deletes, %u records\n", what,
+	       mbramfs_flash_ram_stats.writes, mbramfs_flash_ram_stats.bytes_written,
+	       mbramfs_flash_ram_stats.reads, mbramfs_flash_ram_stats.deletes,
+	       mbramfs_flash_ram_stats.records);
+	mbramfs_flash_ram_reset_stats();
+}
+
+int main (int argc, char** argv) {
+	FILE* f;
+	char line[32];
+
+	// A log that spans a few blocks, plus a config file
+	f = fopen("log", "w");
+	for (int i=0; i<10; i++) {
+		int n = snprintf(line, sizeof(line), "sample %02i;", i);
+		fwrite(line, 1, n, f);
+	}
+	fclose(f);
+
+	f = fopen("config", "w");
+	fwrite("interval=100", 1, 12, f);
+	fclose(f);
+
+	mbramfs_sync();
+	stats("first sync");
+
+	// Nothing changed
+	mbramfs_sync();
+	stats("idle sync");
+
+	// Appending only rewrites the last block plus the log's metadata
+	f = fopen("log", "a");
+	fwrite("sample 10;", 1, 10, f);
+	fclose(f);
+	mbramfs_sync();
+	stats("append sync");
+
+	// Removing and shrinking files deletes their records
+	remove("config");
+	f = fopen("log", "w");
+	fwrite("restarted;", 1, 10, f);
+	fclose(f);
+	mbramfs_sync();
+	stats("remove sync");
+
+	// Unsynced changes are lost on "reset"
+	f = fopen("lost", "w");
+	fwrite("unsaved", 1, 7, f);
+	fclose(f);
+
+	mbramfs_restore();
+	stats("restore");
+
+	dump("log");
+	dump("config");
+	dump("lost");
+
+	// A ring keeps its position across a restore
+	f = fopen("ring", "wc");
+	for (int i=0; i<60; i++) {
+		int n = snprintf(line, sizeof(line), "r%08i;", i);
+		fwrite(line, 1, n, f);
+	}
+	fclose(f);
+	mbramfs_sync();
+	stats("ring sync");
+
+	mbramfs_restore();
+	stats("restore");
+
+	f = fopen("ring", "r");
+	int num = fread(line, 1, 20, f);
+	fclose(f);
+	printf("ring starts with: %.*s\n", num, line);
+	dump("log");
+
+	// Restored blocks are clean, so syncing again writes nothing
+	mbramfs_sync();
+	stats("sync after restore");
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+// Host benchmark of mbramfs flash persistence
+//
+// Appends fixed size samples to a log and syncs every few samples. Reports
+// flash bytes written per byte logged for the incremental sync, compared to
+// snapshotting the whole file on every sync, and how long a restore takes.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mbramfs.h"
+#include "mbramfs_flash_ram.h"
+
+#define SAMPLE_LEN       16
+#define SAMPLES          200
+#define RESTORE_ROUNDS   2000
+
+static const int sync_every[] = {1, 4, 16};
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main (int argc, char** argv) {
+	uint8_t sample[SAMPLE_LEN] = {0};
+	uint64_t start;
+	FILE* f;
+
+	printf("%10s %14s %14s\n", "sync every", "incremental", "full snapshot");
+
+	for (unsigned c=0; c<sizeof(sync_every)/sizeof(sync_every[0]); c++) {
+		uint64_t snapshot_bytes = 0;
+
+		remove("log");
+		mbramfs_sync();
+		mbramfs_flash_ram_reset_stats();
+
+		for (int i=0; i<SAMPLES; i++) {
+			f = fopen("log", "a");
+			fwrite(sample, 1, SAMPLE_LEN, f);
+			fclose(f);
+
+			if ((i+1) % sync_every[c] == 0) {
+				mbramfs_sync();
+				snapshot_bytes += (i+1) * SAMPLE_LEN;
+			}
+		}
+
+		printf("%10i %13.2fx %13.2fx\n", sync_every[c],
+		       (double) mbramfs_flash_ram_stats.bytes_written / (SAMPLES * SAMPLE_LEN),
+		       (double) snapshot_bytes / (SAMPLES * SAMPLE_LEN));
+	}
+
+	start = now_ns();
+	for (int i=0; i<RESTORE_ROUNDS; i++) {
+		mbramfs_restore();
+	}
+	printf("restore of %i bytes: %.1f us\n", SAMPLES * SAMPLE_LEN,
+	       (double) (now_ns() - start) / RESTORE_ROUNDS / 1000);
+
+	return 0;
+}
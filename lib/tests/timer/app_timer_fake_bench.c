@@ -0,0 +1,98 @@
+// Host benchmark of the timer driven modules on the app_timer fake
+//
+// Runs an hour of virtual time with simple_logger (and its 1ms heartbeat)
+// logging to mbramfs, multi_adv rotating three advertisements and a row of
+// simple_timers, then reports how long each app_timer handler took on the
+// host and how often the RTC woke the chip.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "simple_timer.h"
+#include "simple_logger.h"
+#include "multi_adv.h"
+#include "app_timer_fake.h"
+
+#define RUN_MS (3600UL * 1000)
+#define ADV_INTERVAL_MS 200
+#define LOG_INTERVAL_MS 10000
+
+static uint8_t adv_data[31];
+static uint32_t samples;
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Each advertisement is rebuilt when it comes round, as a configure
+// function would before handing it to the SoftDevice
+static void build_adv (uint8_t kind) {
+	int name_len;
+
+	adv_data[0] = 2;
+	adv_data[1] = 0x01;
+	adv_data[2] = 0x06;
+	name_len = snprintf((char*) &adv_data[5], sizeof(adv_data) - 5,
+	                    "node%u-%lu", kind, (unsigned long) samples);
+	adv_data[3] = 1 + name_len;
+	adv_data[4] = 0x09;
+}
+
+static void adv_a (void) { build_adv(0); }
+static void adv_b (void) { build_adv(1); }
+static void adv_c (void) { build_adv(2); }
+
+static void sample (void* p_context) {
+	samples++;
+}
+
+static void log_sample (void* p_context) {
+	simple_logger_log("%lu,%lu\n", (unsigned long) app_timer_fake_now(), (unsigned long) samples);
+}
+
+int main (void) {
+	static const uint32_t periods[] = {50, 100, 250, 333, 500, 1000, 2000, 5000};
+	simple_timer_stats_t stats;
+	uint64_t start;
+	double took;
+	uint32_t i;
+
+	simple_timer_init();
+	app_timer_fake_name(0, "simple_timer");
+	app_timer_fake_name(1, "keepalive");
+
+	if (simple_logger_init_sink(simple_logger_sink_mbramfs(), "log.csv", "w")) {
+		printf("simple_logger_init_sink failed\n");
+		return 1;
+	}
+	simple_timer_start(LOG_INTERVAL_MS, log_sample);
+	for (i = 0; i < sizeof(periods)/sizeof(periods[0]); i++) {
+		simple_timer_start(periods[i], sample);
+	}
+
+	multi_adv_init(ADV_INTERVAL_MS);
+	app_timer_fake_name(2, "multi_adv");
+	multi_adv_register_config(adv_a);
+	multi_adv_register_config(adv_b);
+	multi_adv_register_config(adv_c);
+	multi_adv_start();
+
+	start = now_ns();
+	for (i = 0; i < RUN_MS / 1000; i++) {
+		app_timer_fake_advance_ms(1000);
+		simple_logger_update();
+	}
+	took = (now_ns() - start) / 1e9;
+
+	simple_timer_get_stats(&stats);
+	printf("one virtual hour in %.2f s on the host\n", took);
+	printf("simple_timer: %lu wakeups, %lu handlers\n",
+	       (unsigned long) stats.wakeups, (unsigned long) stats.fired);
+	app_timer_fake_report(stdout);
+	return 0;
+}
@@ -0,0 +1,105 @@
+// Runs simple_timer.c and multi_adv.c on the virtual RTC of the app_timer
+// fake and prints when each handler runs, in RTC ticks (32768 a second), so
+// the output can be diffed. Covers restarting the only timer, leaving the
+// RTC idle and running past the wrap of its 24 bit counter.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "simple_timer.h"
+#include "simple_timer_wheel.h"
+#include "multi_adv.h"
+#include "app_timer_fake.h"
+
+typedef struct {
+	const char* name;
+	uint64_t due;
+	uint32_t period;
+} test_timer_t;
+
+static uint64_t start_at;
+
+static void fired (void* p_context) {
+	test_timer_t* t = p_context;
+	int64_t late = app_timer_fake_now() - t->due;
+
+	printf("%10llu %-8s late %lld%s\n", (unsigned long long) (app_timer_fake_now() - start_at),
+	       t->name, (long long) late,
+	       late < 0 ? " EARLY" : late >= (1 << SIMPLE_TIMER_WHEEL_SHIFT) ? " LATE" : "");
+	t->due += t->period;
+}
+
+static void start (simple_timer_id_t id, test_timer_t* t, uint32_t ms) {
+	t->due = app_timer_fake_now() + APP_TIMER_TICKS(ms, 0);
+	t->period = APP_TIMER_TICKS(ms, 0);
+	simple_timer_start_timer(id, ms, t);
+}
+
+static void section (const char* name) {
+	start_at = app_timer_fake_now();
+	printf("%s\n", name);
+}
+
+static void adv_a (void) { printf("%10llu adv a\n", (unsigned long long) (app_timer_fake_now() - start_at)); }
+static void adv_b (void) { printf("%10llu adv b\n", (unsigned long long) (app_timer_fake_now() - start_at)); }
+static void adv_c (void) { printf("%10llu adv c\n", (unsigned long long) (app_timer_fake_now() - start_at)); }
+
+int main (void) {
+	simple_timer_id_t tick, once, far;
+	test_timer_t tick_t = {"tick"};
+	test_timer_t once_t = {"once"};
+	test_timer_t far_t = {"far"};
+	simple_timer_stats_t stats;
+	int i;
+
+	simple_timer_init();
+	simple_timer_create(&tick, APP_TIMER_MODE_REPEATED, fired);
+	simple_timer_create(&once, APP_TIMER_MODE_SINGLE_SHOT, fired);
+	simple_timer_create(&far, APP_TIMER_MODE_REPEATED, fired);
+
+	section("1000ms and a 250ms one-shot");
+	start(tick, &tick_t, 1000);
+	app_timer_fake_advance_ms(10);
+	start(once, &once_t, 250);
+	app_timer_fake_advance_ms(2100);
+
+	section("restart the one-shot every 100ms, then let it fire");
+	simple_timer_stop(tick);
+	for (i = 0; i < 20; i++) {
+		start(once, &once_t, 250);
+		app_timer_fake_advance_ms(100);
+	}
+	app_timer_fake_advance_ms(1000);
+
+	section("idle for 1000s, longer than the RTC takes to wrap");
+	app_timer_fake_advance_ms(1000000);
+	start(tick, &tick_t, 1000);
+	app_timer_fake_advance_ms(3500);
+	simple_timer_stop(tick);
+
+	section("100s timer across the wrap");
+	start(far, &far_t, 100000);
+	app_timer_fake_advance_ms(1200000);
+	simple_timer_stop(far);
+
+	section("re-init keeps the timers");
+	start(tick, &tick_t, 1000);
+	app_timer_fake_advance_ms(1500);
+	simple_timer_init();
+	app_timer_fake_advance_ms(2000);
+	simple_timer_stop(tick);
+
+	section("multi_adv rotating every 1000ms");
+	multi_adv_init(1000);
+	multi_adv_register_config(adv_a);
+	multi_adv_register_config(adv_b);
+	multi_adv_register_config(adv_c);
+	multi_adv_start();
+	app_timer_fake_advance_ms(4500);
+	multi_adv_stop();
+	app_timer_fake_advance_ms(2000);
+
+	simple_timer_get_stats(&stats);
+	printf("simple_timer: %lu wakeups, %lu fired\n",
+	       (unsigned long) stats.wakeups, (unsigned long) stats.fired);
+	return 0;
+}
@@ -0,0 +1,152 @@
+// Host simulation of timer coalescing on the timer wheel
+//
+// Runs a mix of repeating timers against a virtual RTC for an hour and
+// reports how many times the chip would wake up, with no slack and with
+// each timer allowed to fire a percentage of its period late. The mix is
+// given as periods in ms, optionally with an explicit slack in ms:
+//
+//     ./simple_timer_slack_sim 1000 500 250:20 60000
+//
+// Without arguments it runs the apps/timer-test mix and a busier one.
+// Exits non-zero if a timer fires early or past the end of its window.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "simple_timer_wheel.h"
+
+#define RTC_HZ 32768
+#define RUN_TICKS (3600UL * RTC_HZ)
+#define MAX_TIMERS 32
+
+// Timers are started this far apart, like a row of simple_timer_start calls
+#define START_GAP_TICKS 49
+
+typedef struct {
+	uint16_t id;
+	uint32_t period;
+	uint32_t slack;
+	uint32_t due;
+	uint32_t fires;
+} sim_timer_t;
+
+static sim_timer_t timers[MAX_TIMERS];
+static uint32_t count;
+static uint32_t rtc;
+static uint32_t bad;
+static uint64_t total_late;
+static uint32_t fires;
+
+static void fired (void* p_context) {
+	sim_timer_t* t = p_context;
+	int32_t late = rtc - t->due;
+
+	if (late < 0 || (uint32_t) late >= t->slack + (1 << SIMPLE_TIMER_WHEEL_SHIFT)) {
+		bad++;
+	}
+	total_late += late;
+	fires++;
+	t->fires++;
+	t->due += t->period;
+}
+
+// Wakeups in an hour, with slack as a percentage of each period unless the
+// timer has its own
+static uint32_t run (uint32_t percent, const uint32_t* own_slack) {
+	simple_timer_wheel_handler_t handler;
+	void* context;
+	uint32_t wakeups = 0;
+	uint32_t i;
+
+	rtc = 0;
+	fires = 0;
+	total_late = 0;
+	simple_timer_wheel_init(rtc);
+
+	for (i = 0; i < count; i++) {
+		sim_timer_t* t = &timers[i];
+		t->slack = own_slack[i] ? own_slack[i] : t->period / 100 * percent;
+		t->id = simple_timer_wheel_alloc(fired, SIMPLE_TIMER_WHEEL_REPEATED);
+		simple_timer_wheel_set_slack(t->id, t->slack);
+		t->due = rtc + t->period;
+		t->fires = 0;
+		simple_timer_wheel_start(t->id, rtc, t->period, t);
+		rtc += START_GAP_TICKS;
+	}
+
+	while (rtc < RUN_TICKS) {
+		rtc += simple_timer_wheel_next(rtc);
+		wakeups++;
+		while (simple_timer_wheel_expire(rtc, &handler, &context)) {
+			handler(context);
+		}
+	}
+
+	return wakeups;
+}
+
+static void mix (const char* name, uint32_t n, const uint32_t* period_ms, const uint32_t* slack_ms) {
+	static const uint32_t percents[] = {0, 1, 5, 10, 25};
+	uint32_t own_slack[MAX_TIMERS] = {0};
+	uint8_t has_own = 0;
+	uint32_t base, wakeups, i;
+
+	count = n;
+	printf("%s:", name);
+	for (i = 0; i < n; i++) {
+		timers[i].period = (uint64_t) period_ms[i] * RTC_HZ / 1000;
+		own_slack[i] = (uint64_t) slack_ms[i] * RTC_HZ / 1000;
+		has_own |= slack_ms[i] != 0;
+		if (slack_ms[i]) {
+			printf(" %u:%u", period_ms[i], slack_ms[i]);
+		} else {
+			printf(" %u", period_ms[i]);
+		}
+	}
+	printf(" ms\n");
+
+	base = run(0, (uint32_t[MAX_TIMERS]) {0});
+	printf("  no slack       %8u wakeups/hour, %8u fires\n", base, fires);
+
+	if (has_own) {
+		wakeups = run(0, own_slack);
+		printf("  given slack    %8u wakeups/hour (%4.1f%% fewer), avg %.2f ms late\n",
+		       wakeups, 100.0 - 100.0 * wakeups / base, total_late * 1000.0 / RTC_HZ / fires);
+		return;
+	}
+
+	for (i = 1; i < sizeof(percents)/sizeof(percents[0]); i++) {
+		wakeups = run(percents[i], own_slack);
+		printf("  %2u%% slack      %8u wakeups/hour (%4.1f%% fewer), avg %.2f ms late\n",
+		       percents[i], wakeups, 100.0 - 100.0 * wakeups / base,
+		       total_late * 1000.0 / RTC_HZ / fires);
+	}
+}
+
+int main (int argc, char** argv) {
+	uint32_t period_ms[MAX_TIMERS];
+	uint32_t slack_ms[MAX_TIMERS] = {0};
+	int i;
+
+	if (argc > 1) {
+		for (i = 1; i < argc && i <= MAX_TIMERS; i++) {
+			char* end;
+			period_ms[i-1] = strtoul(argv[i], &end, 10);
+			if (*end == ':') {
+				slack_ms[i-1] = strtoul(end+1, NULL, 10);
+			}
+		}
+		mix("given mix", i-1, period_ms, slack_ms);
+	} else {
+		static const uint32_t timer_test[] = {1000, 500, 250};
+		static const uint32_t busy[] = {1000, 500, 250, 100, 333, 2000, 60000, 15};
+		static const uint32_t none[MAX_TIMERS] = {0};
+		mix("apps/timer-test", 3, timer_test, none);
+		mix("busier app", 8, busy, none);
+	}
+
+	if (bad) {
+		printf("%u timers fired outside their window\n", bad);
+	}
+	return bad != 0;
+}
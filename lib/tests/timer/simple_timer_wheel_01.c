@@ -0,0 +1,147 @@
+// Fires timers on the wheel against a virtual RTC and prints when each one
+// runs, in RTC ticks (32768 a second), so the output can be diffed.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "simple_timer_wheel.h"
+
+typedef struct {
+	const char* name;
+	uint16_t id;
+	uint32_t due;
+	uint32_t period;
+} test_timer_t;
+
+static uint32_t rtc;
+static uint32_t start_rtc;
+
+static void expire_all (void) {
+	simple_timer_wheel_handler_t handler;
+	void* context;
+
+	while (simple_timer_wheel_expire(rtc, &handler, &context)) {
+		handler(context);
+	}
+}
+
+// Jump the RTC from one wheel wakeup to the next, like the app_timer would
+static void run_until (uint32_t until) {
+	for (;;) {
+		uint32_t wait = simple_timer_wheel_next(rtc);
+		if (wait == SIMPLE_TIMER_WHEEL_IDLE || wait > until - rtc) {
+			rtc = until;
+			expire_all();
+			return;
+		}
+		rtc += wait;
+		expire_all();
+	}
+}
+
+static void fired (void* p_context) {
+	test_timer_t* t = p_context;
+	int32_t late = rtc - t->due;
+
+	printf("%8u %-8s late %d%s\n", rtc - start_rtc, t->name, late,
+	       late < 0 ? " EARLY" : late >= (1 << SIMPLE_TIMER_WHEEL_SHIFT) ? " LATE" : "");
+	t->due += t->period;
+}
+
+static void start (test_timer_t* t, uint32_t ticks) {
+	t->due = rtc + ticks;
+	t->period = ticks;
+	simple_timer_wheel_start(t->id, rtc, ticks, t);
+}
+
+static test_timer_t other = {"other"};
+
+// Stops the other timer and restarts itself for half as long
+static void meddle (void* p_context) {
+	test_timer_t* t = p_context;
+	fired(t);
+	simple_timer_wheel_stop(other.id);
+	if (t->period > 1000) {
+		start(t, t->period/2);
+	}
+}
+
+static void stalled (void* p_context) {
+	printf("%8u stalled\n", rtc - start_rtc);
+}
+
+static void run (uint32_t from) {
+	test_timer_t slow = {"1000ms"};
+	test_timer_t mid = {"500ms"};
+	test_timer_t fast = {"250ms"};
+	test_timer_t once = {"once"};
+	test_timer_t odd = {"odd"};
+	test_timer_t far = {"far"};
+	test_timer_t self = {"meddle"};
+	uint16_t stall;
+	uint32_t count = 0;
+
+	rtc = start_rtc = from;
+	simple_timer_wheel_init(rtc);
+	printf("start at %u\n", from);
+
+	slow.id = simple_timer_wheel_alloc(fired, SIMPLE_TIMER_WHEEL_REPEATED);
+	mid.id = simple_timer_wheel_alloc(fired, SIMPLE_TIMER_WHEEL_REPEATED);
+	fast.id = simple_timer_wheel_alloc(fired, SIMPLE_TIMER_WHEEL_REPEATED);
+	once.id = simple_timer_wheel_alloc(fired, 0);
+	odd.id = simple_timer_wheel_alloc(fired, SIMPLE_TIMER_WHEEL_REPEATED);
+	start(&slow, 32768);
+	start(&mid, 16384);
+	start(&fast, 8192);
+	start(&once, 100);
+	start(&odd, 12345);
+	run_until(rtc + 40000);
+
+	printf("stop 250ms and odd, restart 500ms\n");
+	simple_timer_wheel_stop(fast.id);
+	simple_timer_wheel_stop(odd.id);
+	printf("odd running %u\n", simple_timer_wheel_running(odd.id));
+	start(&mid, 16384);
+	run_until(rtc + 40000);
+	simple_timer_wheel_stop(slow.id);
+	simple_timer_wheel_stop(mid.id);
+
+	printf("past the end of the wheel\n");
+	far.id = simple_timer_wheel_alloc(fired, 0);
+	start(&far, 200000000);
+	run_until(rtc + 200000100);
+
+	printf("handler that starts and stops timers\n");
+	self.id = simple_timer_wheel_alloc(meddle, 0);
+	other.id = simple_timer_wheel_alloc(fired, SIMPLE_TIMER_WHEEL_REPEATED);
+	start(&other, 3000);
+	start(&self, 8000);
+	run_until(rtc + 20000);
+
+	printf("a repeating timer after a stall goes once, then a period from then\n");
+	stall = simple_timer_wheel_alloc(stalled, SIMPLE_TIMER_WHEEL_REPEATED);
+	simple_timer_wheel_start(stall, rtc, 1000, NULL);
+	run_until(rtc + 2500);
+	rtc += 5500;
+	expire_all();
+	run_until(rtc + 2500);
+	simple_timer_wheel_stop(stall);
+	simple_timer_wheel_free(stall);
+
+	printf("released one-shots go back to the pool\n");
+	while (simple_timer_wheel_alloc(fired, 0) != SIMPLE_TIMER_WHEEL_NONE) {
+		count++;
+	}
+	printf("%u left in the pool\n", count);
+	simple_timer_wheel_free(once.id);
+	once.id = simple_timer_wheel_alloc(fired, SIMPLE_TIMER_WHEEL_RELEASE);
+	start(&once, 500);
+	run_until(rtc + 1000);
+	printf("pool has %s\n", simple_timer_wheel_alloc(fired, 0) == SIMPLE_TIMER_WHEEL_NONE ? "none" : "one");
+}
+
+int main (void) {
+	run(0);
+	//the 32 bit RTC count wraps in the middle of this one
+	run(0xFFFF0000);
+	return 0;
+}
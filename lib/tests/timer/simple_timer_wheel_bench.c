@@ -0,0 +1,157 @@
+// Host benchmark of the timer wheel against a virtual RTC
+//
+// Runs thousands of timers (repeating ones, and one-shots that start
+// themselves again with a new random timeout) for ten minutes of RTC time,
+// jumping from one wheel wakeup to the next like the app_timer would.
+// Reports how late timers fire, how many wakeups there were, and the host
+// cost of starting a timer and of each wakeup. Starting a timer is also
+// timed against a sorted list like app_timer's, for comparison.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "simple_timer_wheel.h"
+
+#define RTC_HZ 32768
+#define RUN_TICKS (600UL * RTC_HZ)
+
+typedef struct bench_timer {
+	uint16_t id;
+	uint8_t repeated;
+	uint32_t due;
+	uint32_t period;
+	struct bench_timer* next; // for the sorted list
+} bench_timer_t;
+
+static bench_timer_t timers[SIMPLE_TIMER_POOL_SIZE];
+static uint32_t rtc;
+static uint32_t fires;
+static uint32_t early;
+static uint32_t max_late;
+static uint64_t total_late;
+static uint32_t restarts;
+static uint64_t restart_ns;
+
+static uint64_t now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 10 ms to 10 minutes, spread evenly over the orders of magnitude
+static uint32_t random_ticks (void) {
+	double ms = 10.0;
+	int r = rand() % 1000;
+	while (r >= 250) {
+		ms *= 10;
+		r -= 250;
+	}
+	ms *= 1.0 + r / 27.8;
+	return (uint32_t) (ms * RTC_HZ / 1000);
+}
+
+static void fired (void* p_context) {
+	bench_timer_t* t = p_context;
+	int32_t late = rtc - t->due;
+
+	fires++;
+	if (late < 0) {
+		early++;
+	} else {
+		total_late += late;
+		if ((uint32_t) late > max_late) max_late = late;
+	}
+
+	if (t->repeated) {
+		t->due += t->period;
+	} else {
+		uint64_t start = now_ns();
+		t->period = random_ticks();
+		t->due = rtc + t->period;
+		simple_timer_wheel_start(t->id, rtc, t->period, t);
+		restart_ns += now_ns() - start;
+		restarts++;
+	}
+}
+
+// Inserting into a list sorted by due time, which is what app_timer does
+static uint64_t sorted_list_ns (uint32_t count) {
+	bench_timer_t* head = NULL;
+	uint64_t start = now_ns();
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		bench_timer_t** p = &head;
+		while (*p && (int32_t) ((*p)->due - timers[i].due) <= 0) {
+			p = &(*p)->next;
+		}
+		timers[i].next = *p;
+		*p = &timers[i];
+	}
+	return now_ns() - start;
+}
+
+static int run (uint32_t count) {
+	uint32_t wakeups = 0;
+	uint64_t wakeup_ns = 0;
+	uint64_t start_ns;
+	uint32_t i;
+	simple_timer_wheel_handler_t handler;
+	void* context;
+
+	srand(count);
+	rtc = 0;
+	fires = early = max_late = restarts = 0;
+	total_late = restart_ns = 0;
+	simple_timer_wheel_init(rtc);
+
+	start_ns = now_ns();
+	for (i = 0; i < count; i++) {
+		bench_timer_t* t = &timers[i];
+		t->repeated = i & 1;
+		t->id = simple_timer_wheel_alloc(fired, t->repeated ? SIMPLE_TIMER_WHEEL_REPEATED : 0);
+		t->period = random_ticks();
+		t->due = rtc + t->period;
+		simple_timer_wheel_start(t->id, rtc, t->period, t);
+	}
+	start_ns = now_ns() - start_ns;
+
+	while (rtc < RUN_TICKS) {
+		uint32_t wait = simple_timer_wheel_next(rtc);
+		if (wait == SIMPLE_TIMER_WHEEL_IDLE) {
+			break;
+		}
+		rtc += wait;
+		wakeups++;
+
+		uint64_t t0 = now_ns();
+		while (simple_timer_wheel_expire(rtc, &handler, &context)) {
+			handler(context);
+		}
+		wakeup_ns += now_ns() - t0;
+	}
+
+	printf("%6u timers: %8u fires, %7u wakeups, late avg %.1f max %u us, %u early\n",
+	       count, fires, wakeups, fires ? total_late * 1e6 / RTC_HZ / fires : 0.0,
+	       (uint32_t) (max_late * 1000000ull / RTC_HZ), early);
+	printf("              start %.0f ns (sorted list %.0f ns), restart in handler %.0f ns, %.0f ns a wakeup\n",
+	       (double) start_ns / count, (double) sorted_list_ns(count) / count,
+	       restarts ? (double) restart_ns / restarts : 0.0,
+	       wakeups ? (double) wakeup_ns / wakeups : 0.0);
+
+	//firing early or a whole wheel step late is a bug
+	return early != 0 || max_late >= (1 << SIMPLE_TIMER_WHEEL_SHIFT);
+}
+
+int main (void) {
+	int failed = 0;
+	uint32_t count;
+
+	for (count = 1000; count <= SIMPLE_TIMER_POOL_SIZE; count *= 4) {
+		failed |= run(count);
+	}
+	return failed;
+}